@@ -24,223 +24,469 @@
 
 #include "amide_config.h"
 #include <glib.h>
+#include <string.h>
 #include "amitk_data_set.h"
-#include "amitk_data_set_DOUBLE_0D_SCALING.h"
+#include "amitk_parallel.h"
 #include "alignment_mutual_information.h"
-
-/* this algorithm will calculate the amount of mutual information between two data sets in their current orientations    */
-/* it is a re-write of the original algorithm for purposes of improved speed. the hope is that it won't affect accuracy. */
-/* rather than computing mutual information for the whole volume of data, the algorithm computes it for three orthogonal */
-/* slices: axial, sagittal, and coronal */
-#define NUM_BINS 50
-gdouble calculate_mutual_information(AmitkDataSet * fixed_ds, AmitkDataSet * moving_ds, AmitkSpace * new_space, gint granularity,
-				     gboolean * pfixed_slices_current, AmitkDataSet ** fixed_slice,
-				     AmitkPoint view_center, amide_real_t thickness,
-				     amide_time_t view_start_time, amide_time_t view_duration) {
-
-  /* variables related to datasets, their volumes, coordinate spaces, etc */
-  amide_data_t value_fixed, value_moving;
-  AmitkCanvasPoint pixel_size;
-  
-  /* variables related to binning and mutual information determination*/
-  gdouble bin_width_moving;             // mutual information will be calculated bin-wise
-  gdouble bin_width_fixed;              // these values determine the size of the bins
-  gint current_bin_number_moving;                       // the number of bins for the first dataset
-  gint current_bin_number_fixed;                        // the number of bins for the second dataset
-  gint mutual_information_array[NUM_BINS][NUM_BINS] =  {{ 0 }} ;
-  gint margin_moving[NUM_BINS] = { 0 };
-  gint margin_fixed[NUM_BINS] = { 0 };
-  gint margin_total = 0;
-  gint mi_nan_count;
-  gdouble voxel_probability;            // the probability contribution of a single voxel
-  gdouble incremental_mi;
-  gdouble mutual_information = 0.0;     // this is the return value; the amount of MI computed in the two data sets; default to zero
-
-  AmitkSpace * temp_space;
-  GList * fixed_dss;
-  AmitkVolume * view_volume;
-  AmitkDataSet * moving_slice;
-  AmitkPoint temp_offset;
-
-  /* loop counters */
-  AmitkView i_view;
-  AmitkVoxel i_voxel;
-  gint i, j;                             // temporary counters to iterate through the bins for the two datasets
-
-  amide_data_t moving_global_min;
-  amide_data_t fixed_global_min;
-  
-     
-  /* use the range of values present in the data and the number of bins desired in order to determine how wide the bins should be */
-  moving_global_min = amitk_data_set_get_global_min(moving_ds);
-  fixed_global_min = amitk_data_set_get_global_min(fixed_ds);
-  bin_width_moving = (amitk_data_set_get_global_max(moving_ds) - moving_global_min) / NUM_BINS;
-  bin_width_fixed  = (amitk_data_set_get_global_max(fixed_ds)  - fixed_global_min)  / NUM_BINS;
-    
-  /* iterate through the dataset, and build up a frequency matrix for binned values */
-  /* granularity determines whether we look at all the voxels, or just a subset. */
-  /* we look at every nth voxel, where n is granularity */
-  pixel_size.x = pixel_size.y = granularity * point_min_dim(AMITK_DATA_SET_VOXEL_SIZE(fixed_ds));
-
-  /* iterate over the orthogonal directions */
-  for (i_view = 0; i_view < AMITK_VIEW_NUM; i_view++) {
-
-    /* create a volume for the slice we're going to work on */
-    view_volume = amitk_volume_new();
-    temp_space = amitk_space_get_view_space(i_view, AMITK_LAYOUT_LINEAR);
-
-    /* figure out the dimensions of the slice volume */
-    fixed_dss = g_list_append(NULL, amitk_object_ref(fixed_ds));
-    /* note, we don't bother with FOV, as that's actually computed based on all visible data sets, and we only
-       have two of the data sets here. We'll just use 100% FOV */
-    amitk_volumes_calc_display_volume(fixed_dss, temp_space, view_center, thickness, 100.0, view_volume);
-    amitk_objects_unref(fixed_dss);
-    g_object_unref(temp_space);
-
-    /* (re)calculate the fixed slice if we need to */
-    if ((fixed_slice[i_view] == NULL) || (*pfixed_slices_current == FALSE)) {
-#ifdef AMIDE_DEBUG
-      g_print("recompute fixed slice for view %d with pixel size %f\n", i_view, pixel_size.x);
+#ifdef AMIDE_LIBGSL_SUPPORT
+#include <gsl/gsl_multimin.h>
 #endif
 
-      if (fixed_slice[i_view] != NULL)
-	amitk_object_unref(AMITK_OBJECT(fixed_slice[i_view]));
+/* notes on the mutual information engine
+   - the fixed data set is sampled on a regular grid of voxel centers over the
+     whole volume, the grid spacing is picked to give about num_samples samples.
+     The fixed values are binned once, up front
+   - the samples are stored as rows along the fixed data set's x axis, so for a
+     given moving space, each row only needs its start transformed, and the rest
+     of the row is reached by adding a constant step (the transform is affine)
+   - the moving data set is loaded once into a float array, and trilinearly
+     interpolated directly.  Anything outside the moving data set is treated as
+     zero, as are NaN's, same as the old slice based algorithm
+   - the rows are split into a number of blocks, each block gets its own joint
+     histogram, and these are farmed out with amitk_parallel_for and merged at the end
+   - values over multiple frames (within the view time) are averaged, weighted
+     by the overlap, as are the data set's view gates
+*/
+
+/* blocks per thread, each block has its own joint histogram */
+#define BLOCKS_PER_THREAD 4
+
+struct _AlignmentMi {
+  AlignmentMiMeasure measure;
+  gint num_bins;
+
+  /* the fixed samples */
+  gint num_rows;
+  gint row_length;
+  AmitkPoint * row_start; /* base coordinates */
+  AmitkPoint row_step; /* base coordinates */
+  guint16 * fixed_bins; /* num_rows*row_length */
+
+  /* the moving data set */
+  gfloat * moving;
+  AmitkVoxel moving_dim;
+  AmitkPoint moving_voxel_size;
+  amide_data_t moving_min;
+  amide_data_t moving_bin_width;
+
+  /* joint histograms */
+  gint num_blocks;
+  gint * block_hist; /* num_blocks*num_bins*num_bins, [fixed][moving] */
+  gint * hist;
+  gint * margin_fixed; /* num_bins */
+  gint * margin_moving; /* num_bins */
+};
+
+typedef struct {
+  AlignmentMi * mi;
+  const AmitkSpace * moving_space;
+  AmitkPoint step; /* row step in moving voxel coordinates */
+} mi_calc_t;
+
+typedef struct {
+  const AmitkDataSet * ds;
+  gint num_frames;
+  guint * frames;
+  gdouble * weights; /* per frame, already divided by the number of gates */
+} mi_frames_t;
+
+typedef struct {
+  mi_frames_t * frames;
+  gfloat * volume;
+} mi_load_t;
+
+
+/* figure out which frames cover the given time, and how much weight each gets */
+static gboolean mi_frames_init(mi_frames_t * mf, const AmitkDataSet * ds, 
+			       const amide_time_t start, const amide_time_t duration) {
+
+  guint start_frame, end_frame, i_frame;
+  amide_time_t overlap, total;
+  gint i;
+
+  mf->ds = ds;
+  start_frame = amitk_data_set_get_frame(ds, start);
+  end_frame = amitk_data_set_get_frame(ds, start+duration);
+  if (end_frame < start_frame) end_frame = start_frame;
+
+  mf->num_frames = end_frame-start_frame+1;
+  mf->frames = g_try_new(guint, mf->num_frames);
+  mf->weights = g_try_new(gdouble, mf->num_frames);
+  if ((mf->frames == NULL) || (mf->weights == NULL)) {
+    g_free(mf->frames);
+    g_free(mf->weights);
+    return FALSE;
+  }
+
+  total = 0.0;
+  for (i_frame = start_frame, i=0; i_frame <= end_frame; i_frame++, i++) {
+    overlap = MIN(amitk_data_set_get_end_time(ds, i_frame), start+duration) -
+      MAX(amitk_data_set_get_start_time(ds, i_frame), start);
+    mf->frames[i] = i_frame;
+    mf->weights[i] = MAX(overlap, 0.0);
+    total += mf->weights[i];
+  }
+  for (i=0; i < mf->num_frames; i++)
+    mf->weights[i] = ((total > 0.0) ? mf->weights[i]/total : 1.0/mf->num_frames)/
+      AMITK_DATA_SET_NUM_VIEW_GATES(ds);
+
+  return TRUE;
+}
+
+static void mi_frames_free(mi_frames_t * mf) {
+  g_free(mf->frames);
+  g_free(mf->weights);
+}
+
+/* value of the voxel averaged over the frames and view gates, non-finite values are zero */
+static amide_data_t mi_frames_value(const mi_frames_t * mf, AmitkVoxel i) {
 
-      /* compute the fixed slices of data */
-      fixed_slice[i_view] = amitk_data_set_get_slice(fixed_ds, view_start_time, view_duration, -1, pixel_size, 
-						     view_volume);
+  amide_data_t value, sum;
+  gint i_frame, i_gate;
+
+  sum = 0.0;
+  for (i_frame=0; i_frame < mf->num_frames; i_frame++) {
+    i.t = mf->frames[i_frame];
+    for (i_gate=0; i_gate < AMITK_DATA_SET_NUM_VIEW_GATES(mf->ds); i_gate++) {
+      i.g = (AMITK_DATA_SET_VIEW_START_GATE(mf->ds)+i_gate) % AMITK_DATA_SET_NUM_GATES(mf->ds);
+      value = amitk_data_set_get_value(mf->ds, i);
+      if (finite(value))
+	sum += mf->weights[i_frame]*value;
     }
+  }
+
+  return sum;
+}
+
+static gint mi_bin(const amide_data_t value, const amide_data_t min, 
+		   const amide_data_t bin_width, const gint num_bins) {
+
+  gint bin;
+
+  if (bin_width <= 0.0) return 0;
+  bin = floor((value-min)/bin_width);
+  return CLAMP(bin, 0, num_bins-1);
+}
+
+/* load planes [start, end) of the moving data set */
+static void mi_load_planes(gint start, gint end, gpointer data) {
+
+  mi_load_t * load = data;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  gfloat * out;
+
+  dim = AMITK_DATA_SET_DIM(load->frames->ds);
+  i.t = i.g = 0;
+  for (i.z=start; i.z < end; i.z++) {
+    out = load->volume + i.z*dim.y*dim.x;
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	*(out++) = mi_frames_value(load->frames, i);
+  }
+
+  return;
+}
+
+/* trilinear interpolation of the moving data set, p is in (continuous) voxel
+   coordinates, with voxel centers on the integers */
+static inline amide_data_t mi_moving_value(const AlignmentMi * mi, const AmitkPoint p) {
+
+  gint x0, y0, z0;
+  amide_data_t fx, fy, fz;
+  amide_data_t c[2][2][2];
+  const gfloat * v;
+  gint dx, dy, dz;
+  gint stride_y, stride_z;
+
+  x0 = floor(p.x);
+  y0 = floor(p.y);
+  z0 = floor(p.z);
+  if ((x0 < -1) || (y0 < -1) || (z0 < -1) ||
+      (x0 >= mi->moving_dim.x) || (y0 >= mi->moving_dim.y) || (z0 >= mi->moving_dim.z))
+    return 0.0;
+
+  fx = p.x-x0;
+  fy = p.y-y0;
+  fz = p.z-z0;
+  stride_y = mi->moving_dim.x;
+  stride_z = mi->moving_dim.x*mi->moving_dim.y;
+
+  if ((x0 >= 0) && (y0 >= 0) && (z0 >= 0) &&
+      (x0+1 < mi->moving_dim.x) && (y0+1 < mi->moving_dim.y) && (z0+1 < mi->moving_dim.z)) {
+    v = mi->moving + z0*stride_z + y0*stride_y + x0;
+    c[0][0][0] = v[0];
+    c[0][0][1] = v[1];
+    c[0][1][0] = v[stride_y];
+    c[0][1][1] = v[stride_y+1];
+    c[1][0][0] = v[stride_z];
+    c[1][0][1] = v[stride_z+1];
+    c[1][1][0] = v[stride_z+stride_y];
+    c[1][1][1] = v[stride_z+stride_y+1];
+  } else { /* on the edge, corners outside count as zero */
+    for (dz=0; dz < 2; dz++)
+      for (dy=0; dy < 2; dy++)
+	for (dx=0; dx < 2; dx++)
+	  if ((x0+dx < 0) || (y0+dy < 0) || (z0+dz < 0) ||
+	      (x0+dx >= mi->moving_dim.x) || (y0+dy >= mi->moving_dim.y) || (z0+dz >= mi->moving_dim.z))
+	    c[dz][dy][dx] = 0.0;
+	  else
+	    c[dz][dy][dx] = mi->moving[(z0+dz)*stride_z + (y0+dy)*stride_y + x0+dx];
+  }
 
-    /* update the view volume by a transform to take into account the rotations/translations we're doing */
-    /* first take care of the axis rotation */
-    temp_offset = AMITK_SPACE_OFFSET(view_volume);
-    temp_space = amitk_space_calculate_transform(new_space, AMITK_SPACE(moving_ds));
-    amitk_space_transform(AMITK_SPACE(view_volume), temp_space);
-    g_object_unref(temp_space);
-
-    /* second, take care of adjusting the view volume's offset. */
-    temp_offset = amitk_space_b2s(AMITK_SPACE(new_space), temp_offset);
-    temp_offset = amitk_space_s2b(AMITK_SPACE(moving_ds), temp_offset);
-    amitk_space_set_offset(AMITK_SPACE(view_volume), temp_offset);
-
-    /* now calculate the slice from the moving data set, and calculate the corresponding MI */
-    moving_slice = amitk_data_set_get_slice(moving_ds, view_start_time, view_duration, -1, pixel_size, 
-					    view_volume);
-
-    /* calculate the mutual information */
-    i_voxel = zero_voxel;
-    for (i_voxel.y = 0; i_voxel.y < AMITK_DATA_SET_DIM_Y(fixed_slice[i_view]); i_voxel.y++) {
-      for (i_voxel.x = 0; i_voxel.x < AMITK_DATA_SET_DIM_X(fixed_slice[i_view]); i_voxel.x++) {
-
-	/* DOUBLE_0D is the type of the slice data sets */
-	value_fixed = AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(AMITK_DATA_SET(fixed_slice[i_view]), i_voxel);
-	value_moving = AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(AMITK_DATA_SET(moving_slice), i_voxel);
-
-	/* treat any NaN or "out of volume" values as zeros */
-	if (isnan(value_fixed)) value_fixed = 0;
-	if (isnan(value_moving)) value_moving = 0;
-      
-	current_bin_number_fixed = floor((value_fixed-fixed_global_min)/bin_width_fixed);
-	current_bin_number_moving = floor((value_moving-moving_global_min)/bin_width_moving);
-
-	g_assert(current_bin_number_fixed < NUM_BINS);
-	g_assert(current_bin_number_moving < NUM_BINS);
-      
-	/* Update the count in this particular bin combination by incrementing the counter*/
-	mutual_information_array[current_bin_number_fixed][current_bin_number_moving]++;
-      
-	/* Update the *marginal* count. We could derive this, but we'll need it later, and computing
-	   it one time only should improve computation speed */
-	margin_fixed[current_bin_number_fixed]++;
-	margin_moving[current_bin_number_moving]++;
-	margin_total++;
+  return 
+    (1.0-fz)*((1.0-fy)*((1.0-fx)*c[0][0][0] + fx*c[0][0][1]) + fy*((1.0-fx)*c[0][1][0] + fx*c[0][1][1])) +
+    fz*((1.0-fy)*((1.0-fx)*c[1][0][0] + fx*c[1][0][1]) + fy*((1.0-fx)*c[1][1][0] + fx*c[1][1][1]));
+}
+
+/* base coordinates to moving voxel coordinates */
+static inline AmitkPoint mi_moving_voxel_point(const AlignmentMi * mi, const AmitkSpace * moving_space,
+					       const AmitkPoint base_point) {
+
+  AmitkPoint p;
+
+  p = amitk_space_b2s(moving_space, base_point);
+  p.x = p.x/mi->moving_voxel_size.x - 0.5;
+  p.y = p.y/mi->moving_voxel_size.y - 0.5;
+  p.z = p.z/mi->moving_voxel_size.z - 0.5;
+
+  return p;
+}
+
+/* fill in the joint histograms for blocks [start, end) */
+static void mi_calc_blocks(gint start, gint end, gpointer data) {
+
+  mi_calc_t * calc = data;
+  AlignmentMi * mi = calc->mi;
+  gint * hist;
+  const guint16 * fixed_bins;
+  AmitkPoint p;
+  gint i_block, i_row, i_sample;
+  gint start_row, end_row;
+  gint moving_bin;
+  gsize num_joint;
+
+  num_joint = ((gsize) mi->num_bins)*mi->num_bins;
+  for (i_block = start; i_block < end; i_block++) {
+    hist = mi->block_hist + i_block*num_joint;
+    memset(hist, 0, sizeof(gint)*num_joint);
+
+    start_row = (((gint64) mi->num_rows)*i_block)/mi->num_blocks;
+    end_row = (((gint64) mi->num_rows)*(i_block+1))/mi->num_blocks;
+    for (i_row = start_row; i_row < end_row; i_row++) {
+      p = mi_moving_voxel_point(mi, calc->moving_space, mi->row_start[i_row]);
+      fixed_bins = mi->fixed_bins + i_row*mi->row_length;
+      for (i_sample = 0; i_sample < mi->row_length; i_sample++) {
+	moving_bin = mi_bin(mi_moving_value(mi, p), mi->moving_min, mi->moving_bin_width, mi->num_bins);
+	hist[fixed_bins[i_sample]*mi->num_bins + moving_bin]++;
+	p.x += calc->step.x;
+	p.y += calc->step.y;
+	p.z += calc->step.z;
       }
     }
-
-    /* garbage collection */
-    amitk_object_unref(AMITK_OBJECT(view_volume));
-    amitk_object_unref(AMITK_OBJECT(moving_slice));
   }
 
-  /* mark that we may not need to recompute the fixed slices next time around */
-  *pfixed_slices_current = TRUE;
+  return;
+}
 
 
-  
-  /* calculate the "probability weight" of a single voxel */
-  voxel_probability = (1.0 / margin_total);
-
-  /* this is an idea for later: add the MI array to the study as a data set
-  if (mi_matrix != NULL) {
-    // and add the mutual information matrix to the study
-    amitk_object_add_child(AMITK_OBJECT(fixed_ds), AMITK_OBJECT(mi_matrix)); // this adds a reference to the data set
-    amitk_object_unref(mi_matrix); // so remove a reference 
-  } else  {
-    g_warning("Failed to generate filtered data set");
+/* set up for calculating the mutual information between fixed_ds and moving_ds
+   over the given time.  The fixed data set is sampled at about num_samples
+   points.  Returns NULL on failure */
+AlignmentMi * alignment_mi_new(AmitkDataSet * fixed_ds,
+			       AmitkDataSet * moving_ds,
+			       const amide_time_t view_start_time,
+			       const amide_time_t view_duration,
+			       const gint num_bins,
+			       const gint num_samples,
+			       const AlignmentMiMeasure measure) {
+
+  AlignmentMi * mi;
+  mi_frames_t fixed_frames, moving_frames;
+  mi_load_t load;
+  AmitkVoxel fixed_dim, i;
+  AmitkPoint voxel_size, p;
+  amide_data_t fixed_min, fixed_bin_width;
+  gint stride;
+  gint i_row, i_sample;
+  gsize num_joint;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(fixed_ds), NULL);
+  g_return_val_if_fail(AMITK_IS_DATA_SET(moving_ds), NULL);
+  g_return_val_if_fail((num_bins > 1) && (num_bins <= ALIGNMENT_MI_MAX_BINS), NULL);
+  g_return_val_if_fail(num_samples > 0, NULL);
+
+  if ((mi = g_try_new0(AlignmentMi, 1)) == NULL) {
+    g_warning(_("couldn't allocate memory space for the mutual information calculation"));
+    return NULL;
   }
-   */
-
-  mutual_information = 0;
-   
-  /* // print the column headings in order to debug the matrix
-  g_print("\t%i", margin_moving[0]);
-  for (j = 1; j < NUM_BINS ; j++) {
-    g_print("\t%i", margin_moving[j]);
-  } */
-  
-  mi_nan_count=0;
-  for (i = 0; i < NUM_BINS ; i++) {
-    // g_print("\n%i", margin_fixed[i]);  // print the row headings in order to debug the matrix
-    for (j = 0; j < NUM_BINS ; j++) {
-      /* when the probability of (x AND y) == 0, then the log (x AND y) is NaN. Therefore, test for this condition, and add a zero in order
-         to avoid blowing up the equation
-      */
-      if (mutual_information_array[i][j] != 0) {
-        incremental_mi = (mutual_information_array[i][j]*voxel_probability)*(log2((mutual_information_array[i][j] * voxel_probability)  /( (margin_fixed[i] * voxel_probability)*(margin_moving[j] * voxel_probability))));
-      }
-      else {
-        // how do we deal with zero probability? There is probably a theoretical "best" answer, but this should be practical.
-        // we are trying to avoid complete lack of overlap from looking like a "good fit"
-        // things I've tried that *don't* work are i_mi=log2(EPSILON) and =log2(voxel_probability)
-        incremental_mi = 0;
-        mi_nan_count++;
-      }
-      /* you can choose either of the following g_print commands for debugging the matrix */
-      //g_print("\t\%i", mutual_information_array[i][j] );  // for point-wise counts
-      // g_print("\t\%4.3f", incremental_mi );               // for point-wise probability
-      
-      if (isinf(incremental_mi)) {
-        //count it (because lots and lots of zeroes mean bad registration) and go to the next loop
-        mi_nan_count++;
-        // this is most often a problem when the incemental MI is infinity, due to divide by zero
-      } else {
-        // add it to the mutual information metric
-        mutual_information += (incremental_mi);
-      }
+  mi->measure = measure;
+  mi->num_bins = num_bins;
 
-/*    // debugging code
-      g_print("Current indices are: %i, %i\n", i, j);
-      g_print("Current prob(x,y) is: %e\n", mutual_information_array[i][j] * voxel_probability);
-      g_print("Current prob(x) is: %e\n", margin_moving[i] * voxel_probability);
-      g_print("Current prob(y) is: %e\n", margin_fixed[j] * voxel_probability);
-      if (margin_moving[i] == 0 || margin_fixed[j] == 0 ) {
-        g_print("there is a zero at i=%i, j=%i!\n", i, j);
-      }
-      g_print("Incremental mutual information is: %e\n", incremental_mi);
-      
-      if (margin_moving[i] == 0 || margin_fixed[j] == 0 ) {
-        g_print("there is a zero at i=%i, j=%i!\n", i, j);
-      }
-      g_print("Incremental mutual information is: %e\n", incremental_mi); */
+  if (!mi_frames_init(&fixed_frames, fixed_ds, view_start_time, view_duration)) {
+    g_warning(_("couldn't allocate memory space for the mutual information calculation"));
+    g_free(mi);
+    return NULL;
+  }
+  if (!mi_frames_init(&moving_frames, moving_ds, view_start_time, view_duration)) {
+    g_warning(_("couldn't allocate memory space for the mutual information calculation"));
+    mi_frames_free(&fixed_frames);
+    g_free(mi);
+    return NULL;
+  }
+
+  /* pick a sampling grid for the fixed data set */
+  fixed_dim = AMITK_DATA_SET_DIM(fixed_ds);
+  stride = ceil(pow(((gdouble) fixed_dim.x)*fixed_dim.y*fixed_dim.z/num_samples, 1.0/3.0));
+  if (stride < 1) stride = 1;
+  mi->row_length = (fixed_dim.x+stride-1)/stride;
+  mi->num_rows = ((fixed_dim.y+stride-1)/stride)*((fixed_dim.z+stride-1)/stride);
+
+  mi->moving_dim = AMITK_DATA_SET_DIM(moving_ds);
+  mi->moving_voxel_size = AMITK_DATA_SET_VOXEL_SIZE(moving_ds);
+  mi->num_blocks = MIN(mi->num_rows, BLOCKS_PER_THREAD*amitk_parallel_get_num_threads());
+  num_joint = ((gsize) num_bins)*num_bins;
+
+  mi->row_start = g_try_new(AmitkPoint, mi->num_rows);
+  mi->fixed_bins = g_try_new(guint16, ((gsize) mi->num_rows)*mi->row_length);
+  mi->moving = g_try_new(gfloat, ((gsize) mi->moving_dim.x)*mi->moving_dim.y*mi->moving_dim.z);
+  if (mi->num_blocks <= G_MAXSIZE/sizeof(gint)/num_joint) /* else leave it NULL */
+    mi->block_hist = g_try_new(gint, mi->num_blocks*num_joint);
+  mi->hist = g_try_new(gint, num_joint);
+  mi->margin_fixed = g_try_new(gint, num_bins);
+  mi->margin_moving = g_try_new(gint, num_bins);
+  if ((mi->row_start == NULL) || (mi->fixed_bins == NULL) || (mi->moving == NULL) ||
+      (mi->block_hist == NULL) || (mi->hist == NULL) ||
+      (mi->margin_fixed == NULL) || (mi->margin_moving == NULL)) {
+    g_warning(_("couldn't allocate memory space for the mutual information calculation"));
+    mi_frames_free(&fixed_frames);
+    mi_frames_free(&moving_frames);
+    alignment_mi_free(mi);
+    return NULL;
+  }
+
+  /* sample and bin the fixed data set */
+  fixed_min = amitk_data_set_get_global_min(fixed_ds);
+  fixed_bin_width = (amitk_data_set_get_global_max(fixed_ds)-fixed_min)/num_bins;
+  voxel_size = AMITK_DATA_SET_VOXEL_SIZE(fixed_ds);
+
+  i = zero_voxel;
+  i_row = 0;
+  for (i.z = 0; i.z < fixed_dim.z; i.z += stride)
+    for (i.y = 0; i.y < fixed_dim.y; i.y += stride, i_row++) {
+      p.x = 0.5*voxel_size.x;
+      p.y = (i.y+0.5)*voxel_size.y;
+      p.z = (i.z+0.5)*voxel_size.z;
+      mi->row_start[i_row] = amitk_space_s2b(AMITK_SPACE(fixed_ds), p);
+      for (i.x = 0, i_sample = 0; i.x < fixed_dim.x; i.x += stride, i_sample++)
+	mi->fixed_bins[i_row*mi->row_length+i_sample] = 
+	  mi_bin(mi_frames_value(&fixed_frames, i), fixed_min, fixed_bin_width, num_bins);
+    }
+
+  p = zero_point;
+  p.x = stride*voxel_size.x;
+  mi->row_step = point_sub(amitk_space_s2b(AMITK_SPACE(fixed_ds), p), 
+			   amitk_space_s2b(AMITK_SPACE(fixed_ds), zero_point));
+
+  /* and load in the moving data set */
+  mi->moving_min = amitk_data_set_get_global_min(moving_ds);
+  mi->moving_bin_width = (amitk_data_set_get_global_max(moving_ds)-mi->moving_min)/num_bins;
+  load.frames = &moving_frames;
+  load.volume = mi->moving;
+  amitk_parallel_for(mi->moving_dim.z, 1, mi_load_planes, &load, NULL, NULL);
+
+  mi_frames_free(&fixed_frames);
+  mi_frames_free(&moving_frames);
+
+  return mi;
+}
+
+void alignment_mi_free(AlignmentMi * mi) {
 
+  if (mi == NULL) return;
+
+  g_free(mi->row_start);
+  g_free(mi->fixed_bins);
+  g_free(mi->moving);
+  g_free(mi->block_hist);
+  g_free(mi->hist);
+  g_free(mi->margin_fixed);
+  g_free(mi->margin_moving);
+  g_free(mi);
+
+  return;
+}
+
+/* the mutual information with the moving data set placed in moving_space */
+gdouble alignment_mi_calculate(AlignmentMi * mi, const AmitkSpace * moving_space) {
+
+  mi_calc_t calc;
+  gint * margin_fixed;
+  gint * margin_moving;
+  gint i_block, i, j;
+  gsize num_joint, k;
+  gint total;
+  gdouble p, p_fixed, p_moving;
+  gdouble entropy_fixed, entropy_moving, entropy_joint;
+  gdouble mutual_information;
+
+  g_return_val_if_fail(mi != NULL, 0.0);
+  g_return_val_if_fail(AMITK_IS_SPACE(moving_space), 0.0);
+
+  calc.mi = mi;
+  calc.moving_space = moving_space;
+  calc.step = point_sub(mi_moving_voxel_point(mi, moving_space, point_add(mi->row_start[0], mi->row_step)),
+			mi_moving_voxel_point(mi, moving_space, mi->row_start[0]));
+
+  amitk_parallel_for(mi->num_blocks, 1, mi_calc_blocks, &calc, NULL, NULL);
+
+  /* merge the per block histograms */
+  num_joint = ((gsize) mi->num_bins)*mi->num_bins;
+  memcpy(mi->hist, mi->block_hist, sizeof(gint)*num_joint);
+  for (i_block = 1; i_block < mi->num_blocks; i_block++)
+    for (k = 0; k < num_joint; k++)
+      mi->hist[k] += mi->block_hist[i_block*num_joint+k];
+
+  margin_fixed = mi->margin_fixed;
+  margin_moving = mi->margin_moving;
+  memset(margin_fixed, 0, sizeof(gint)*mi->num_bins);
+  memset(margin_moving, 0, sizeof(gint)*mi->num_bins);
+  total = 0;
+  for (i = 0; i < mi->num_bins; i++)
+    for (j = 0; j < mi->num_bins; j++) {
+      margin_fixed[i] += mi->hist[i*mi->num_bins+j];
+      margin_moving[j] += mi->hist[i*mi->num_bins+j];
+      total += mi->hist[i*mi->num_bins+j];
     }
+  if (total == 0) return 0.0;
+
+  /* entropies, bins with a zero probability contribute nothing */
+  entropy_fixed = entropy_moving = entropy_joint = 0.0;
+  mutual_information = 0.0;
+  for (i = 0; i < mi->num_bins; i++) {
+    p_fixed = ((gdouble) margin_fixed[i])/total;
+    p_moving = ((gdouble) margin_moving[i])/total;
+    if (margin_fixed[i] > 0) entropy_fixed -= p_fixed*log2(p_fixed);
+    if (margin_moving[i] > 0) entropy_moving -= p_moving*log2(p_moving);
   }
-  // g_print("\nThe mutual information sum is %f\n", mutual_information);
-  // g_print("the count of NAN in the MI algorithm was\t%d\n", mi_nan_count);
+  for (i = 0; i < mi->num_bins; i++)
+    for (j = 0; j < mi->num_bins; j++)
+      if (mi->hist[i*mi->num_bins+j] > 0) {
+	p = ((gdouble) mi->hist[i*mi->num_bins+j])/total;
+	entropy_joint -= p*log2(p);
+      }
 
+  switch (mi->measure) {
+  case ALIGNMENT_MI_NORMALIZED:
+    mutual_information = (entropy_joint > 0.0) ? (entropy_fixed+entropy_moving)/entropy_joint : 1.0;
+    break;
+  case ALIGNMENT_MI_MUTUAL_INFORMATION:
+  default:
+    mutual_information = entropy_fixed+entropy_moving-entropy_joint;
+    break;
+  }
 
   return mutual_information;
-  
 }
 
 /* rot_x, y, and z are angles about the respective axes, in radians */
@@ -257,8 +503,6 @@ void rotate(AmitkPoint rotation, AmitkSpace * moving_space) {
 /* This is the algorithm responsible for computing the transform which provides the maximum amount of mutual information for coregistration */
 AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds, 
 					  AmitkDataSet * fixed_ds, 
-					  AmitkPoint view_center,
-					  amide_real_t thickness,
 					  amide_time_t view_start_time,
 					  amide_time_t view_duration,
 					  gdouble * pointer_mutual_information_error,
@@ -272,22 +516,18 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
   // twenty degrees:
   #define ROTATION_MAX_ANGLE (20*(M_PI/180))
   #define ROTATION_TARGET_PRECISION (0.1*(M_PI/180))
-  #define INITIAL_STEP_SIZE 8
-  #define MIN_STEP_SIZE 8
 
   AmitkSpace * transform_space;
   AmitkSpace * new_space;
   AmitkSpace * last_best_space;
-  gdouble translation_precision, rotation_precision, step_size;
+  gdouble translation_precision, rotation_precision;
   //  GRand * random_generator;
   gdouble current_mi = 0, best_mi = 0;
   AmitkPoint best_shift, best_rotation;
   AmitkPoint current_shift, current_rotation;
   gchar * temp_string;
   gboolean continue_work = TRUE;
-  AmitkDataSet * fixed_slice[AMITK_VIEW_NUM] = {NULL, NULL, NULL};
-  gboolean fixed_slices_current;
-  AmitkView i_view;
+  AlignmentMi * mi;
 
   //  random_generator = g_rand_new();
   
@@ -296,18 +536,23 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
   /* first pass of pyramidal descent (course alignment followed by fine alignment           */
   /* =======================================================================================*/
 
+  mi = alignment_mi_new(fixed_ds, moving_ds, view_start_time, view_duration,
+			ALIGNMENT_MI_DEFAULT_BINS, ALIGNMENT_MI_DEFAULT_SAMPLES, 
+			ALIGNMENT_MI_MUTUAL_INFORMATION);
+  if (mi == NULL) {
+    *pointer_mutual_information_error = 0.0;
+    return NULL;
+  }
+
   new_space = amitk_space_copy(AMITK_SPACE(moving_ds));
   last_best_space = amitk_space_copy(new_space);
 
   
   translation_precision = TRANSLATION_MAX_DISTANCE;
   rotation_precision = ROTATION_MAX_ANGLE;
-  step_size = INITIAL_STEP_SIZE;
-  fixed_slices_current = FALSE;
 
   /* set baseline characteristics, including baseline space and initial error */
-  best_mi = calculate_mutual_information(fixed_ds, moving_ds, new_space, step_size, &fixed_slices_current, fixed_slice,
-					 view_center, thickness, view_start_time, view_duration);
+  best_mi = alignment_mi_calculate(mi, new_space);
 #ifdef AMIDE_DEBUG
   g_print("initial mi %f\n", best_mi);
 #endif
@@ -320,8 +565,7 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
 
   
   while (continue_work && ((translation_precision > TRANSLATION_TARGET_PRECISION) || 
-			   (rotation_precision > ROTATION_TARGET_PRECISION) || 
-			   ( step_size > MIN_STEP_SIZE ))) {
+			   (rotation_precision > ROTATION_TARGET_PRECISION))) {
 #ifdef AMIDE_DEBUG
     g_print("starting descent\ttranslation precision=\t%4.4f\n\t\t\trotation precision=\t%4.4f\tdegrees\n", 
 	    translation_precision, rotation_precision*180/M_PI );
@@ -341,8 +585,7 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
           
           /* first test whether offset increases the mutual information */
 	  amitk_space_shift_offset(AMITK_SPACE(new_space), current_shift);
-	  current_mi = calculate_mutual_information( fixed_ds, moving_ds, new_space, step_size, &fixed_slices_current, fixed_slice,
-						     view_center, thickness, view_start_time, view_duration);
+	  current_mi = alignment_mi_calculate(mi, new_space);
           
           /*if this location gives a better mutual information, then keep it */
           if (current_mi > best_mi ) {
@@ -377,8 +620,7 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
           
           /* first test whether offset increases the mutual information */
           rotate(current_rotation, AMITK_SPACE(new_space));
-          current_mi = calculate_mutual_information( fixed_ds, moving_ds, new_space, step_size, &fixed_slices_current, fixed_slice,
-						     view_center, thickness, view_start_time, view_duration);
+          current_mi = alignment_mi_calculate(mi, new_space);
 
 	  /*if this location gives a better mutual information, then keep it */
           if (current_mi > best_mi ) {
@@ -404,13 +646,6 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
     /* update loop variables for next iteration */
     translation_precision = translation_precision * 0.70;
     rotation_precision = rotation_precision * 0.70;
-
-    if (step_size != MIN_STEP_SIZE) {
-      step_size = step_size / 2.0;
-      if (step_size < MIN_STEP_SIZE ) 
-	step_size = MIN_STEP_SIZE;
-      fixed_slices_current = FALSE;
-    }
   }
   
   if (update_func != NULL) /* remove progress bar */
@@ -424,13 +659,237 @@ AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds,
     g_object_unref(last_best_space);
   if (new_space != NULL)
     g_object_unref(new_space);
-  for (i_view = 0; i_view < AMITK_VIEW_NUM; i_view++) {
-    if (fixed_slice[i_view] != NULL)
-      amitk_object_unref(AMITK_OBJECT(fixed_slice[i_view]));
-  }
+  alignment_mi_free(mi);
     
   *pointer_mutual_information_error = best_mi;
   
   return transform_space;
   
 }
+
+
+
+#ifdef AMIDE_LIBGSL_SUPPORT
+
+/* notes on the multi-resolution driver
+   - registration runs coarse to fine over the data sets' resolution pyramids,
+     starting at the coarsest level that still has MULTIRES_MIN_DIM voxels
+     across in x and y
+   - at each level the 6 rigid body parameters (shift, then rotation about
+     the moving data set's center) are optimized with GSL's Nelder-Mead simplex.
+     The parameters are scaled so a unit step is a voxel of the level, and a
+     rotation that shrinks by half each level, so a single size tolerance works
+     for both translations and rotations
+   - each level stops when the simplex has shrunk below the tolerance, or after
+     MULTIRES_MAX_ITERATIONS iterations.  The result seeds the next finer level
+   - the candidate transforms the simplex asks for are evaluated one at a time,
+     as each evaluation is already spread over all the threads by the engine
+*/
+
+#define MULTIRES_MIN_DIM 16
+#define MULTIRES_MAX_ITERATIONS 200 /* per level */
+#define MULTIRES_ROTATION_STEP (4.0*M_PI/180.0) /* at the coarsest level */
+#define MULTIRES_TOLERANCE 0.05 /* in units of the initial steps */
+
+typedef enum {
+  PARAM_SHIFT_X,
+  PARAM_SHIFT_Y,
+  PARAM_SHIFT_Z,
+  PARAM_ROTATE_X,
+  PARAM_ROTATE_Y,
+  PARAM_ROTATE_Z,
+  NUM_PARAMS
+} multires_param_t;
+
+typedef struct {
+  AlignmentMi * mi;
+  AmitkSpace * initial_space;
+  AmitkSpace * trial_space;
+  AmitkPoint center;
+  gdouble scale[NUM_PARAMS]; /* optimizer units to mm/radians */
+} multires_t;
+
+/* put the physical parameters (mm/radians) into space */
+static void multires_set_space(const multires_t * mr, const gdouble * params, AmitkSpace * space) {
+
+  AmitkPoint shift;
+
+  amitk_space_copy_in_place(space, mr->initial_space);
+  if (params[PARAM_ROTATE_X] != 0.0) 
+    amitk_space_rotate_on_vector(space, base_axes[AMITK_AXIS_X], params[PARAM_ROTATE_X], mr->center);
+  if (params[PARAM_ROTATE_Y] != 0.0) 
+    amitk_space_rotate_on_vector(space, base_axes[AMITK_AXIS_Y], params[PARAM_ROTATE_Y], mr->center);
+  if (params[PARAM_ROTATE_Z] != 0.0) 
+    amitk_space_rotate_on_vector(space, base_axes[AMITK_AXIS_Z], params[PARAM_ROTATE_Z], mr->center);
+
+  shift.x = params[PARAM_SHIFT_X];
+  shift.y = params[PARAM_SHIFT_Y];
+  shift.z = params[PARAM_SHIFT_Z];
+  amitk_space_shift_offset(space, shift);
+
+  return;
+}
+
+/* the function the simplex minimizes */
+static double multires_cost(const gsl_vector * x, void * data) {
+
+  multires_t * mr = data;
+  gdouble params[NUM_PARAMS];
+  gint i;
+
+  for (i=0; i < NUM_PARAMS; i++)
+    params[i] = gsl_vector_get(x, i)*mr->scale[i];
+  multires_set_space(mr, params, mr->trial_space);
+
+  return -alignment_mi_calculate(mr->mi, mr->trial_space);
+}
+
+/* rigid body registration of moving_ds onto fixed_ds, run coarse to fine on the
+   data set pyramids.  The space returned is the transform to apply to moving_ds,
+   same as alignment_mutual_information.  piterations gets the total number of
+   simplex iterations */
+AmitkSpace * alignment_mutual_information_multires(AmitkDataSet * moving_ds, 
+						   AmitkDataSet * fixed_ds, 
+						   amide_time_t view_start_time,
+						   amide_time_t view_duration,
+						   const AlignmentMiMeasure measure,
+						   gdouble * pointer_mutual_information_error,
+						   gint * piterations,
+						   AmitkUpdateFunc update_func,
+						   gpointer update_data) {
+
+  multires_t mr;
+  gdouble params[NUM_PARAMS] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  const gsl_multimin_fminimizer_type * minimizer_type = gsl_multimin_fminimizer_nmsimplex2;
+  gsl_multimin_fminimizer * minimizer;
+  gsl_multimin_function cost_func;
+  gsl_vector * x;
+  gsl_vector * step;
+  AmitkDataSet * fixed_level;
+  AmitkDataSet * moving_level;
+  AmitkSpace * final_space;
+  AmitkSpace * transform_space;
+  AmitkVoxel dim;
+  amide_real_t voxel_size;
+  gint start_level, level;
+  gint iteration;
+  gint status;
+  gint i;
+  gchar * temp_string;
+  gboolean continue_work=TRUE;
+  gdouble best_mi = 0.0;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(moving_ds), NULL);
+  g_return_val_if_fail(AMITK_IS_DATA_SET(fixed_ds), NULL);
+
+  *pointer_mutual_information_error = 0.0;
+  *piterations = 0;
+
+  /* find the coarsest level worth looking at */
+  dim = AMITK_DATA_SET_DIM(fixed_ds);
+  for (start_level = AMITK_DATA_SET_PYRAMID_LEVELS-1; start_level > 0; start_level--)
+    if ((MIN(dim.x, dim.y) >> start_level) >= MULTIRES_MIN_DIM)
+      break;
+
+  mr.initial_space = amitk_space_copy(AMITK_SPACE(moving_ds));
+  mr.trial_space = amitk_space_copy(AMITK_SPACE(moving_ds));
+  mr.center = amitk_volume_get_center(AMITK_VOLUME(moving_ds));
+
+  x = gsl_vector_alloc(NUM_PARAMS);
+  step = gsl_vector_alloc(NUM_PARAMS);
+  minimizer = gsl_multimin_fminimizer_alloc(minimizer_type, NUM_PARAMS);
+  if ((x == NULL) || (step == NULL) || (minimizer == NULL)) {
+    g_warning(_("couldn't allocate memory space for the minimizer"));
+    if (minimizer != NULL) gsl_multimin_fminimizer_free(minimizer);
+    if (x != NULL) gsl_vector_free(x);
+    if (step != NULL) gsl_vector_free(step);
+    g_object_unref(mr.initial_space);
+    g_object_unref(mr.trial_space);
+    return NULL;
+  }
+  cost_func.n = NUM_PARAMS;
+  cost_func.f = multires_cost;
+  cost_func.params = &mr;
+
+  for (level = start_level; (level >= 0) && continue_work; level--) {
+
+    if (update_func != NULL) {
+      temp_string = g_strdup_printf(_("Maximizing the mutual information, resolution level %d"), level);
+      continue_work = (*update_func)(update_data, temp_string, (gdouble) -1.0);
+      g_free(temp_string);
+    }
+
+    fixed_level = amitk_data_set_get_pyramid_level(fixed_ds, level);
+    moving_level = amitk_data_set_get_pyramid_level(moving_ds, level);
+    if ((fixed_level == NULL) || (moving_level == NULL)) {
+      if (fixed_level != NULL) amitk_object_unref(fixed_level);
+      if (moving_level != NULL) amitk_object_unref(moving_level);
+      continue;
+    }
+
+    mr.mi = alignment_mi_new(fixed_level, moving_level, view_start_time, view_duration,
+			     ALIGNMENT_MI_DEFAULT_BINS, ALIGNMENT_MI_DEFAULT_SAMPLES, measure);
+    voxel_size = point_max_dim(AMITK_DATA_SET_VOXEL_SIZE(fixed_level));
+    amitk_object_unref(fixed_level);
+    amitk_object_unref(moving_level);
+    if (mr.mi == NULL) {
+      continue_work = FALSE;
+      break;
+    }
+
+    /* unit steps are a voxel of this level, and a rotation that halves each level */
+    for (i=PARAM_SHIFT_X; i <= PARAM_SHIFT_Z; i++) 
+      mr.scale[i] = voxel_size;
+    for (i=PARAM_ROTATE_X; i <= PARAM_ROTATE_Z; i++) 
+      mr.scale[i] = MULTIRES_ROTATION_STEP/(1 << (start_level-level));
+
+    for (i=0; i < NUM_PARAMS; i++) 
+      gsl_vector_set(x, i, params[i]/mr.scale[i]);
+    gsl_vector_set_all(step, 1.0);
+    gsl_multimin_fminimizer_set(minimizer, &cost_func, x, step);
+
+    iteration = 0;
+    do {
+      iteration++;
+      status = gsl_multimin_fminimizer_iterate(minimizer);
+      if (status) break; /* can't improve */
+      status = gsl_multimin_test_size(gsl_multimin_fminimizer_size(minimizer), MULTIRES_TOLERANCE);
+
+      if (update_func != NULL) 
+	continue_work = (*update_func)(update_data, NULL, (gdouble) -1.0);
+    } while (continue_work && (status == GSL_CONTINUE) && (iteration < MULTIRES_MAX_ITERATIONS));
+
+#ifdef AMIDE_DEBUG
+    g_print("level %d: %d iterations, mi %f\n", level, iteration, -gsl_multimin_fminimizer_minimum(minimizer));
+#endif
+
+    *piterations += iteration;
+    best_mi = -gsl_multimin_fminimizer_minimum(minimizer);
+    for (i=0; i < NUM_PARAMS; i++)
+      params[i] = gsl_vector_get(gsl_multimin_fminimizer_x(minimizer), i)*mr.scale[i];
+
+    alignment_mi_free(mr.mi);
+    mr.mi = NULL;
+  }
+
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
+  /* calculate the transform we'll need to apply */
+  final_space = amitk_space_copy(mr.initial_space);
+  multires_set_space(&mr, params, final_space);
+  transform_space = amitk_space_calculate_transform(AMITK_SPACE(moving_ds), final_space);
+  *pointer_mutual_information_error = best_mi;
+
+  /* garbage collection */
+  gsl_multimin_fminimizer_free(minimizer);
+  gsl_vector_free(x);
+  gsl_vector_free(step);
+  g_object_unref(final_space);
+  g_object_unref(mr.initial_space);
+  g_object_unref(mr.trial_space);
+
+  return transform_space;
+}
+
+#endif /* AMIDE_LIBGSL_SUPPORT */
@@ -29,19 +29,57 @@
 #include "amitk_data_set.h"
 
 
+/* defines */
+#define ALIGNMENT_MI_DEFAULT_BINS 50
+#define ALIGNMENT_MI_MAX_BINS 1024 /* each thread's block histograms are bins^2 */
+#define ALIGNMENT_MI_DEFAULT_SAMPLES 100000
+
+typedef enum {
+  ALIGNMENT_MI_MUTUAL_INFORMATION,
+  ALIGNMENT_MI_NORMALIZED, /* (H(fixed)+H(moving))/H(fixed,moving) */
+  ALIGNMENT_MI_NUM_MEASURES
+} AlignmentMiMeasure;
+
+/* the mutual information engine, opaque */
+typedef struct _AlignmentMi AlignmentMi;
+
+
 /* external functions */
+AlignmentMi * alignment_mi_new(AmitkDataSet * fixed_ds,
+			       AmitkDataSet * moving_ds,
+			       const amide_time_t view_start_time,
+			       const amide_time_t view_duration,
+			       const gint num_bins,
+			       const gint num_samples,
+			       const AlignmentMiMeasure measure);
+void          alignment_mi_free(AlignmentMi * mi);
+gdouble       alignment_mi_calculate(AlignmentMi * mi, 
+				     const AmitkSpace * moving_space);
+
 /* the space returned is the transform needed to change moving_ds's space to the
    aligned space, incoding an axes rotation, as well as the necessary shift
    with respect to the dataset's center */
 AmitkSpace * alignment_mutual_information(AmitkDataSet * moving_ds, 
 					  AmitkDataSet * fixed_ds, 
-					  AmitkPoint view_center,
-					  amide_real_t thickness,
 					  amide_time_t view_start_time,
 					  amide_time_t view_duration,
 					  gdouble * pointer_mutual_information_error,
 					  AmitkUpdateFunc update_func,
 					  gpointer update_data);
 
+#ifdef AMIDE_LIBGSL_SUPPORT
+/* same as above, but optimizes over the whole data sets, coarse to fine on
+   their resolution pyramids.  piterations gets the number of iterations taken */
+AmitkSpace * alignment_mutual_information_multires(AmitkDataSet * moving_ds, 
+						   AmitkDataSet * fixed_ds, 
+						   amide_time_t view_start_time,
+						   amide_time_t view_duration,
+						   const AlignmentMiMeasure measure,
+						   gdouble * pointer_mutual_information_error,
+						   gint * piterations,
+						   AmitkUpdateFunc update_func,
+						   gpointer update_data);
+#endif
+
 
 #endif /* __ALIGNMENT_MUTUAL_INFORMATION_H__ */
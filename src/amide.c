@@ -24,7 +24,7 @@
 */
 
 #include "amide_config.h" 
-//#include <locale.h>
+#include <locale.h>
 #include <signal.h>
 #include <sys/stat.h>
 //#include <dirent.h>
@@ -36,6 +36,9 @@
 //#include "amitk_type_builtins.h"
 #include "amitk_common.h"
 #include "amitk_study.h"
+#include "amitk_trace.h"
+#include "batch.h"
+#include "benchmark.h"
 #include "pixmaps.h"
 #include "ui_study.h"
 #include "ui_common.h"
@@ -51,6 +54,31 @@ gchar * object_menu_names[] = {
 };
 
 
+/* the thread that gtk runs in */
+static GThread * main_thread = NULL;
+
+typedef struct {
+  GLogLevelFlags log_level;
+  gchar * message;
+  gpointer user_data;
+} deferred_log_t;
+
+void amide_log_handler(const gchar *log_domain,
+		       GLogLevelFlags log_level,
+		       const gchar *message,
+		       gpointer user_data);
+
+static gboolean deferred_log_cb(gpointer data) {
+
+  deferred_log_t * deferred = data;
+
+  amide_log_handler(NULL, deferred->log_level, deferred->message, deferred->user_data);
+  g_free(deferred->message);
+  g_free(deferred);
+
+  return FALSE;
+}
+
 void amide_log_handler_nopopup(const gchar *log_domain,
 			       GLogLevelFlags log_level,
 			       const gchar *message,
@@ -74,6 +102,7 @@ void amide_log_handler(const gchar *log_domain,
   GtkWidget * message_area;
   GtkWidget * scrolled;
   GtkWidget * label;
+  deferred_log_t * deferred;
 
   if (AMITK_PREFERENCES_WARNINGS_TO_CONSOLE(preferences)) {
     if (log_level & G_LOG_LEVEL_MESSAGE) 
@@ -84,6 +113,16 @@ void amide_log_handler(const gchar *log_domain,
       g_print("AMIDE INFO: %s\n", message);
     else if (log_level & G_LOG_LEVEL_DEBUG) /* G_LOG_LEVEL_WARNING */
       g_print("AMIDE DEBUG: %s\n", message);
+  } else if ((main_thread != NULL) && (g_thread_self() != main_thread)) {
+
+    /* gtk can only be used from the main thread, so messages from worker
+       threads get popped up once the main loop gets back around to them */
+    deferred = g_new(deferred_log_t, 1);
+    deferred->log_level = log_level;
+    deferred->message = g_strdup(message);
+    deferred->user_data = user_data;
+    g_idle_add(deferred_log_cb, deferred);
+
   } else {
 
     dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -168,6 +207,27 @@ static GOptionEntry command_line_entries[] = {
 };
 
 
+/* runs one of the modes that don't need gtk (batch, benchmark), with
+   the locale and translations setup the same way as for the gui */
+static int headless_main(int argc, char * argv[], int (* mode_main)(int, char * [])) {
+
+  int status;
+
+#if !defined (G_PLATFORM_WIN32)
+  /* gtk_init does this for the gui, except on win32 (see main) */
+  setlocale(LC_ALL, "");
+#endif
+  amide_gconf_init();
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+
+  status = (*mode_main)(argc, argv);
+
+  amitk_trace_shutdown();
+  amide_gconf_shutdown();
+
+  return status;
+}
+
 /********************************************* */
 int main (int argc, char *argv []) {
 
@@ -193,6 +253,15 @@ int main (int argc, char *argv []) {
   //  textdomain(GETTEXT_PACKAGE);
 
 
+  /* AMIDE_TRACE=file.json records a performance trace */
+  amitk_trace_init();
+
+  /* headless batch processing and benchmarks, gtk never gets initialized */
+  if (batch_requested(argc, argv))
+    return headless_main(argc, argv, batch_main);
+  if (benchmark_requested(argc, argv))
+    return headless_main(argc, argv, benchmark_main);
+
 #if defined (G_PLATFORM_WIN32)
   /* if setlocale is called on win32, we can't seem to reset the locale back to "C"
      to allow correct reading in of text data */
@@ -227,6 +296,7 @@ int main (int argc, char *argv []) {
   //g_log_set_handler (NULL, G_LOG_LEVEL_WARNING, amide_log_handler, preferences);
 
   /* specify my message handler */
+  main_thread = g_thread_self();
   g_log_set_handler (NULL, G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_WARNING | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG, amide_log_handler, preferences);
 
   /* specify the default directory */
@@ -329,6 +399,7 @@ int main (int argc, char *argv []) {
   gtk_main(); 
   
   /* clean-up */
+  amitk_trace_shutdown();
   amide_gconf_shutdown();
 
   return 0;
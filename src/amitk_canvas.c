@@ -29,6 +29,8 @@
 #include "amide.h"
 #include "amitk_canvas.h"
 #include "amitk_canvas_object.h"
+#include "amitk_slice_cache.h"
+#include "amitk_trace.h"
 #include "image.h"
 #include "ui_common.h"
 #include "amitk_marshal.h"
@@ -54,6 +56,19 @@
 #define UPDATE_SUBJECT_ORIENTATION 0x200
 #define UPDATE_ALL 0x2FF
 
+#define CANVAS_PREVIEW_MIN_PIXELS (256*256) /* canvases this big get a coarse preview first */
+#define CANVAS_PREVIEW_SCALE 2 /* preview pixel size factor, doubled for really big canvases */
+#define CANVAS_PREFETCH_MAX_STEPS 8 /* most slices/frames/gates to generate ahead */
+#define CANVAS_PREFETCH_LOOKAHEAD (G_TIME_SPAN_SECOND/2) /* generate what'll be needed this far ahead */
+#define CANVAS_PREFETCH_TIMEOUT (2*G_TIME_SPAN_SECOND) /* steps further apart aren't considered navigation */
+
+typedef enum {
+  PREFETCH_NONE,
+  PREFETCH_Z,
+  PREFETCH_TIME,
+  PREFETCH_GATE
+} canvas_prefetch_t;
+
 #define cp_2_p(canvas, canvas_cpoint) (canvas_point_2_point(AMITK_VOLUME_CORNER((canvas)->volume),\
 							    (canvas)->pixbuf_width, \
 							    (canvas)->pixbuf_height,\
@@ -174,7 +189,6 @@ static void canvas_time_changed_cb(AmitkStudy * study, gpointer canvas);
 static void canvas_volume_changed_cb(AmitkVolume * vol, gpointer canvas);
 static void canvas_roi_changed_cb(AmitkRoi * roi, gpointer canvas);
 static void canvas_fiducial_mark_changed_cb(AmitkFiducialMark * fm, gpointer canvas);
-static void canvas_data_set_invalidate_slice_cache(AmitkDataSet * ds, gpointer data);
 static void data_set_changed_cb(AmitkDataSet * ds, gpointer canvas);
 static void data_set_subject_orientation_changed_cb(AmitkDataSet * ds, gpointer canvas);
 static void data_set_thresholding_changed_cb(AmitkDataSet * ds, gpointer data);
@@ -195,7 +209,7 @@ static void canvas_update_arrows(AmitkCanvas * canvas);
 static void canvas_update_line_profile(AmitkCanvas * canvas);
 static void canvas_update_time_on_image(AmitkCanvas * canvas);
 static void canvas_update_subject_orientation(AmitkCanvas * canvas);
-static void canvas_update_pixbuf(AmitkCanvas * canvas);
+static void canvas_update_pixbuf(AmitkCanvas * canvas, gboolean synchronous);
 static void canvas_update_object(AmitkCanvas * canvas, AmitkObject * object);
 static void canvas_update_objects(AmitkCanvas * canvas, gboolean all);
 static void canvas_update_setup(AmitkCanvas * canvas);
@@ -326,8 +340,6 @@ static void canvas_init (AmitkCanvas *canvas)
   canvas->active_object = NULL;
 
   canvas->canvas = NULL;
-  canvas->slice_cache = NULL;
-  canvas->max_slice_cache_size = 15;
   canvas->slices=NULL;
   canvas->image=NULL;
   canvas->pixbuf=NULL;
@@ -346,6 +358,18 @@ static void canvas_init (AmitkCanvas *canvas)
   canvas->idle_handler_id = 0;
   canvas->next_update_objects = NULL;
 
+  canvas->pixbuf_generation = 0;
+  canvas->pixbuf_final_generation = 0;
+
+  canvas->prefetch_type = PREFETCH_NONE;
+  canvas->prefetch_step = 0.0;
+  canvas->prefetch_time = 0;
+  canvas->prefetch_offset = zero_point;
+  canvas->prefetch_start = 0.0;
+  canvas->prefetch_duration = 0.0;
+  canvas->prefetch_gate_ds = NULL;
+  canvas->prefetch_gate = 0;
+
 }
 
 static void canvas_destroy (GtkObject * object) {
@@ -362,6 +386,9 @@ static void canvas_destroy (GtkObject * object) {
     canvas->idle_handler_id = 0;
   }
 
+  /* throw out anything still being worked on in the background */
+  g_atomic_int_inc(&(canvas->pixbuf_generation));
+
   if (canvas->next_update_objects != NULL) {
     canvas->next_update_objects = amitk_objects_unref(canvas->next_update_objects);
   }
@@ -369,10 +396,6 @@ static void canvas_destroy (GtkObject * object) {
   if (canvas->volume != NULL) 
     canvas->volume = amitk_object_unref(canvas->volume);
 
-  if (canvas->slice_cache != NULL) {
-    canvas->slice_cache = amitk_objects_unref(canvas->slice_cache);
-  }
-
   if (canvas->slices != NULL) {
     canvas->slices = amitk_objects_unref(canvas->slices);
   }
@@ -658,17 +681,6 @@ static void canvas_fiducial_mark_changed_cb(AmitkFiducialMark * fm, gpointer dat
   return;
 }
 
-static void canvas_data_set_invalidate_slice_cache(AmitkDataSet * ds, gpointer data) {
-
-  AmitkCanvas * canvas = data;  
-
-  g_return_if_fail(AMITK_IS_CANVAS(canvas));
-  g_return_if_fail(AMITK_IS_DATA_SET(ds));
-
-  canvas->slice_cache = amitk_data_sets_remove_with_slice_parent(canvas->slice_cache, ds);
-
-}
-
 static void data_set_changed_cb(AmitkDataSet * ds, gpointer data) {
 
   AmitkCanvas * canvas = data;  
@@ -1685,8 +1697,11 @@ static gboolean canvas_event_cb(GtkWidget* widget,  GdkEvent * event, gpointer d
 	  return FALSE;
 	}
 	pixbuf = image_from_slice(active_slice, AMITK_CANVAS_VIEW_MODE(canvas));
-      } else
+      } else {
+	/* the first background render may not be back yet */
+	if (canvas->pixbuf == NULL) return FALSE;
 	pixbuf = g_object_ref(canvas->pixbuf);
+      }
 
       grab_on = TRUE;
       extended_event_type = canvas_event_type;
@@ -3223,33 +3238,421 @@ static void canvas_update_subject_orientation(AmitkCanvas * canvas) {
 
 
 
-static void canvas_update_pixbuf(AmitkCanvas * canvas) {
+/* record the size of the canvas image, resizing the canvas to fit if needed */
+static void canvas_set_size(AmitkCanvas * canvas, gint width, gint height) {
+
+  if ((width != canvas->pixbuf_width) || (height != canvas->pixbuf_height) || 
+      (canvas->image == NULL)) {
+    canvas->pixbuf_width = width;
+    canvas->pixbuf_height = height;
+    gtk_widget_set_size_request(canvas->canvas, 
+				canvas->pixbuf_width + 2 * canvas->border_width, 
+				canvas->pixbuf_height + 2 * canvas->border_width);
+    gnome_canvas_set_scroll_region(GNOME_CANVAS(canvas->canvas), 0.0, 0.0, 
+				   canvas->pixbuf_width + 2 * canvas->border_width,
+				   canvas->pixbuf_height + 2 * canvas->border_width);
+  }
+
+  return;
+}
+
+/* put the pixbuf on the canvas, takes over the reference to pixbuf */
+static void canvas_set_pixbuf(AmitkCanvas * canvas, GdkPixbuf * pixbuf) {
+
+  if (canvas->pixbuf != NULL)
+    g_object_unref(canvas->pixbuf);
+  canvas->pixbuf = pixbuf;
+
+  canvas_set_size(canvas, gdk_pixbuf_get_width(canvas->pixbuf), gdk_pixbuf_get_height(canvas->pixbuf));
+
+  /* put the canvas rgb image on the canvas_image */
+  if (canvas->image == NULL) {/* time to make a new image */
+    canvas->image = gnome_canvas_item_new(gnome_canvas_root(GNOME_CANVAS(canvas->canvas)),
+					  gnome_canvas_pixbuf_get_type(),
+					  "pixbuf", canvas->pixbuf,
+					  "x", (double) canvas->border_width,
+					  "y", (double) canvas->border_width,
+					  NULL);
+    g_signal_connect(G_OBJECT(canvas->image), "event", G_CALLBACK(canvas_event_cb), canvas);
+    /* rois and such may have been drawn while we were waiting on the image */
+    gnome_canvas_item_lower_to_bottom(canvas->image);
+  } else {
+    gnome_canvas_item_set(canvas->image, "pixbuf", canvas->pixbuf, NULL);
+  }
+
+  return;
+}
+
+
+/* notes on generating the canvas images in the background
+   - each time the data sets need reslicing, the canvas's pixbuf_generation is
+     bumped and a job is queued.  Jobs from older generations are skipped by the
+     workers, and their results thrown out, so only the latest view gets worked on
+     while the user is scrolling
+   - larger canvases get a coarse preview job as well, which is made at
+     CANVAS_PREVIEW_SCALE times the pixel size and blown back up.  Previews are 
+     run before any full resolution jobs
+   - there's one worker per view, so the orthogonal canvases are done concurrently,
+     the slice generation within each job is itself split across threads
+   - everything gtk related (and anything that might finalize a gtk object) 
+     happens back on the main thread in canvas_job_done
+   - thresholding can calculate a data set's statistics from a worker, that's
+     guarded by the data set's stats_mutex
+   - when the user has taken two steps in a row in the same direction (through
+     z, frames, or gates), prefetch jobs generate the next few slices in that
+     direction into the slice cache.  How far ahead depends on how quickly the
+     steps are coming in.  Prefetch jobs are run after everything else
+*/
+
+typedef struct {
+  AmitkCanvas * canvas;
+  gint generation;
+  guint sequence;
+  gint scale; /* 1 for the full resolution image */
+  GList * data_sets;
+  AmitkDataSet * active_ds;
+  amide_time_t start;
+  amide_time_t duration;
+  amide_real_t pixel_dim;
+  AmitkVolume * volume;
+  AmitkFuseType fuse_type;
+  AmitkViewMode view_mode;
+  gint width;
+  gint height;
+
+  /* for prefetch jobs, which only fill the slice cache */
+  gboolean prefetch;
+  AmitkDataSet * gate_ds; /* never dereferenced */
+  gint gate;
+
+  /* results */
+  GdkPixbuf * pixbuf;
+  GList * slices;
+} canvas_job_t;
+
+static GThreadPool * canvas_job_pool = NULL;
+static guint canvas_job_sequence = 0;
+
+/* run on the main thread once a job is done or skipped */
+static gboolean canvas_job_done(gpointer data) {
 
+  canvas_job_t * job = data;
+  AmitkCanvas * canvas = job->canvas;
   gint old_width, old_height;
+
+  if ((canvas->study != NULL) && 
+      (job->generation == canvas->pixbuf_generation) &&
+      (job->pixbuf != NULL) &&
+      ((job->scale == 1) || (canvas->pixbuf_final_generation != job->generation))) {
+
+    old_width = canvas->pixbuf_width;
+    old_height = canvas->pixbuf_height;
+    canvas_set_pixbuf(canvas, job->pixbuf);
+    job->pixbuf = NULL;
+
+    if (job->scale == 1) {
+      canvas->pixbuf_final_generation = job->generation;
+      amitk_objects_unref(canvas->slices);
+      canvas->slices = job->slices;
+      job->slices = NULL;
+
+      /* these get drawn off of the slices */
+      canvas_add_update(canvas, UPDATE_ARROWS | UPDATE_LINE_PROFILE | UPDATE_TARGET);
+    }
+
+    if ((old_width != canvas->pixbuf_width) || (old_height != canvas->pixbuf_height))
+      canvas_add_update(canvas, UPDATE_ALL & ~UPDATE_DATA_SETS);
+  }
+
+  if (job->pixbuf != NULL) g_object_unref(job->pixbuf);
+  amitk_objects_unref(job->slices);
+  amitk_objects_unref(job->data_sets);
+  if (job->active_ds != NULL) amitk_object_unref(job->active_ds);
+  amitk_object_unref(job->volume);
+  g_object_unref(canvas);
+  g_free(job);
+
+  return FALSE;
+}
+
+static void canvas_job_run(gpointer data, gpointer user_data) {
+
+  canvas_job_t * job = data;
+  GdkPixbuf * pixbuf;
+  GList * data_sets;
+  AmitkCanvasPoint pixel_size;
+  gint64 trace_start;
+
+  trace_start = AMITK_TRACE_BEGIN();
+
+  /* skip anything that's already been superseded */
+  if (job->generation != g_atomic_int_get(&(job->canvas->pixbuf_generation))) {
+    /* nothing to do */
+  } else if (job->prefetch) {
+    pixel_size.x = pixel_size.y = job->pixel_dim;
+    for (data_sets = job->data_sets; data_sets != NULL; data_sets = data_sets->next)
+      amitk_slice_cache_prefetch(AMITK_DATA_SET(data_sets->data), job->start, job->duration,
+				 (data_sets->data == job->gate_ds) ? job->gate : -1,
+				 pixel_size, job->volume);
+  } else {
+    job->pixbuf = image_from_data_sets(&(job->slices),
+				       job->data_sets,
+				       job->active_ds,
+				       job->start,
+				       job->duration,
+				       -1,
+				       job->scale*job->pixel_dim,
+				       job->volume,
+				       job->fuse_type,
+				       job->view_mode);
+
+    /* blow previews back up to the canvas size */
+    if ((job->scale != 1) && (job->pixbuf != NULL)) {
+      pixbuf = gdk_pixbuf_scale_simple(job->pixbuf, job->width, job->height, GDK_INTERP_NEAREST);
+      g_object_unref(job->pixbuf);
+      job->pixbuf = pixbuf;
+    }
+  }
+
+  AMITK_TRACE_END(job->prefetch ? "canvas_job_prefetch" :
+		  (job->scale != 1) ? "canvas_job_preview" : "canvas_job", trace_start);
+  g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, canvas_job_done, job, NULL);
+
+  return;
+}
+
+/* previews first, prefetches last, otherwise first come first serve */
+static gint canvas_job_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+
+  const canvas_job_t * job_a = a;
+  const canvas_job_t * job_b = b;
+
+  if (job_a->prefetch != job_b->prefetch)
+    return job_a->prefetch ? 1 : -1;
+  else if (job_a->scale != job_b->scale)
+    return (job_a->scale > job_b->scale) ? -1 : 1;
+  else if (job_a->sequence != job_b->sequence)
+    return (job_a->sequence < job_b->sequence) ? -1 : 1;
+  else
+    return 0;
+}
+
+/* returns a job to make the canvas image, takes over the reference to data_sets */
+static canvas_job_t * canvas_job_new(AmitkCanvas * canvas, GList * data_sets, AmitkDataSet * active_ds,
+				     amide_real_t pixel_dim, gint scale) {
+
+  canvas_job_t * job;
+
+  job = g_new0(canvas_job_t, 1);
+  job->canvas = g_object_ref(canvas);
+  job->generation = canvas->pixbuf_generation;
+  job->sequence = canvas_job_sequence++;
+  job->scale = scale;
+  job->data_sets = data_sets;
+  job->active_ds = (active_ds != NULL) ? amitk_object_ref(active_ds) : NULL;
+  job->start = AMITK_STUDY_VIEW_START_TIME(canvas->study);
+  job->duration = AMITK_STUDY_VIEW_DURATION(canvas->study);
+  job->pixel_dim = pixel_dim;
+  job->volume = AMITK_VOLUME(amitk_object_copy(AMITK_OBJECT(canvas->volume)));
+  job->fuse_type = AMITK_STUDY_FUSE_TYPE(canvas->study);
+  job->view_mode = AMITK_CANVAS_VIEW_MODE(canvas);
+  job->width = canvas->pixbuf_width;
+  job->height = canvas->pixbuf_height;
+  job->prefetch = FALSE;
+  job->gate_ds = NULL;
+  job->gate = -1;
+
+  return job;
+}
+
+static void canvas_job_push(canvas_job_t * job) {
+
+  GError * error=NULL;
+
+  if (canvas_job_pool == NULL) {
+    canvas_job_pool = g_thread_pool_new(canvas_job_run, NULL, AMITK_VIEW_NUM, FALSE, &error);
+    if (canvas_job_pool == NULL) {
+      g_warning(_("Couldn't start canvas threads: %s"), error->message);
+      g_error_free(error);
+      job->generation = -1; /* cleanup only */
+      canvas_job_done(job);
+      return;
+    }
+    g_thread_pool_set_sort_function(canvas_job_pool, canvas_job_compare, NULL);
+  }
+
+  g_thread_pool_push(canvas_job_pool, job, NULL);
+
+  return;
+}
+
+/* the data set whose gates we watch for gate prefetching */
+static AmitkDataSet * canvas_prefetch_gate_ds(GList * data_sets, AmitkDataSet * active_ds) {
+
+  if ((active_ds != NULL) && (AMITK_DATA_SET_NUM_GATES(active_ds) > 1))
+    return active_ds;
+
+  while (data_sets != NULL) {
+    if (AMITK_DATA_SET_NUM_GATES(data_sets->data) > 1)
+      return AMITK_DATA_SET(data_sets->data);
+    data_sets = data_sets->next;
+  }
+
+  return NULL;
+}
+
+/* compare where we are to the last reslice, and if we've moved the same way
+   twice in a row, queue up prefetch jobs for the next few steps */
+static void canvas_prefetch(AmitkCanvas * canvas, GList * data_sets, AmitkDataSet * active_ds,
+			    amide_real_t pixel_dim) {
+
+  canvas_prefetch_t type = PREFETCH_NONE;
+  gint num_changes = 0;
+  AmitkPoint offset, z_axis, shift;
+  amide_time_t start, duration;
+  AmitkDataSet * gate_ds;
+  gint gate=0, num_gates=1;
+  gint frame=0;
+  gdouble step=0.0;
+  gint64 now, interval;
+  gint num_steps, i_step;
+  canvas_job_t * job;
+
+  now = g_get_monotonic_time();
+  offset = AMITK_SPACE_OFFSET(canvas->volume);
+  z_axis = amitk_space_get_axis(AMITK_SPACE(canvas->volume), AMITK_AXIS_Z);
+  start = AMITK_STUDY_VIEW_START_TIME(canvas->study);
+  duration = AMITK_STUDY_VIEW_DURATION(canvas->study);
+  gate_ds = canvas_prefetch_gate_ds(data_sets, active_ds);
+  if (gate_ds != NULL) {
+    gate = AMITK_DATA_SET_VIEW_START_GATE(gate_ds);
+    num_gates = AMITK_DATA_SET_NUM_GATES(gate_ds);
+  }
+
+  /* figure out what's changed since last time */
+  if (!POINT_EQUAL(offset, canvas->prefetch_offset)) {
+    num_changes++;
+    shift = point_sub(offset, canvas->prefetch_offset);
+    step = point_dot_product(shift, z_axis);
+    if (POINT_EQUAL(shift, point_cmult(step, z_axis))) /* only moves along z count */
+      type = PREFETCH_Z;
+  }
+  if (!REAL_EQUAL(start, canvas->prefetch_start) || !REAL_EQUAL(duration, canvas->prefetch_duration)) {
+    num_changes++;
+    type = PREFETCH_TIME;
+    step = start-canvas->prefetch_start;
+  }
+  if ((gate_ds != canvas->prefetch_gate_ds) || (gate != canvas->prefetch_gate)) {
+    num_changes++;
+    if (gate_ds == canvas->prefetch_gate_ds) {
+      type = PREFETCH_GATE;
+      step = gate-canvas->prefetch_gate;
+      /* stepping off the end wraps around (autoplay) */
+      if (step > num_gates/2) step -= num_gates;
+      else if (step < -num_gates/2) step += num_gates;
+    }
+  }
+  if ((num_changes != 1) || (step == 0.0))
+    type = PREFETCH_NONE;
+
+  interval = now - canvas->prefetch_time;
+
+  /* two steps the same way in a row, time to look ahead */
+  if ((type != PREFETCH_NONE) && (type == canvas->prefetch_type) &&
+      ((step > 0.0) == (canvas->prefetch_step > 0.0)) &&
+      (interval < CANVAS_PREFETCH_TIMEOUT)) {
+
+    num_steps = CLAMP(CANVAS_PREFETCH_LOOKAHEAD/MAX(interval, 1), 1, CANVAS_PREFETCH_MAX_STEPS);
+    if ((type == PREFETCH_GATE) && (gate_ds != NULL))
+      num_steps = MIN(num_steps, num_gates-1);
+
+    for (i_step = 1; i_step <= num_steps; i_step++) {
+      job = canvas_job_new(canvas, amitk_objects_ref(data_sets), active_ds, pixel_dim, 1);
+      job->prefetch = TRUE;
+
+      switch(type) {
+      case PREFETCH_Z:
+	amitk_space_set_offset(AMITK_SPACE(job->volume), 
+			       point_add(offset, point_cmult(i_step*step, z_axis)));
+	break;
+      case PREFETCH_TIME:
+	/* if we're stepping through the frames of the active data set, follow its framing */
+	if (active_ds != NULL) 
+	  frame = amitk_data_set_get_frame(active_ds, start);
+	if ((active_ds != NULL) && (AMITK_DATA_SET_NUM_FRAMES(active_ds) > 1) &&
+	    REAL_EQUAL(start, amitk_data_set_get_start_time(active_ds, frame))) {
+	  frame += (step > 0.0) ? i_step : -i_step;
+	  if ((frame >= 0) && (frame < AMITK_DATA_SET_NUM_FRAMES(active_ds))) {
+	    job->start = amitk_data_set_get_start_time(active_ds, frame);
+	    job->duration = amitk_data_set_get_end_time(active_ds, frame)-job->start;
+	  } else {
+	    job->generation = -1; /* past the end, nothing to do */
+	  }
+	} else {
+	  job->start = start + i_step*step;
+	}
+	break;
+      case PREFETCH_GATE:
+	/* only worth doing when we're looking at one gate at a time */
+	if (AMITK_DATA_SET_VIEW_END_GATE(gate_ds) != gate) 
+	  job->generation = -1;
+	job->gate_ds = gate_ds;
+	job->gate = gate + i_step*((gint) step);
+	job->gate = ((job->gate % num_gates) + num_gates) % num_gates;
+	break;
+      default:
+	break;
+      }
+
+      if (job->generation == -1)
+	canvas_job_done(job);
+      else
+	canvas_job_push(job);
+    }
+  }
+
+  canvas->prefetch_type = type;
+  canvas->prefetch_step = step;
+  canvas->prefetch_time = now;
+  canvas->prefetch_offset = offset;
+  canvas->prefetch_start = start;
+  canvas->prefetch_duration = duration;
+  canvas->prefetch_gate_ds = gate_ds;
+  canvas->prefetch_gate = gate;
+
+  return;
+}
+
+
+static void canvas_update_pixbuf(AmitkCanvas * canvas, gboolean synchronous) {
+
   rgba_t blank_rgba;
   GtkStyle * widget_style;
   amide_real_t pixel_dim;
   AmitkPoint corner;
   gint width,height;
   GList * data_sets;
+  GList * temp_data_sets;
   AmitkDataSet * active_ds;
+  gint scale;
 
 
   /* sanity checks */
   g_return_if_fail(canvas->study != NULL);
 
-  old_width = canvas->pixbuf_width;
-  old_height = canvas->pixbuf_height;
-
-  /* free the previous pixbuf if possible */
-  if (canvas->pixbuf != NULL) {
-    g_object_unref(canvas->pixbuf);
-    canvas->pixbuf = NULL;
-  }
+  /* anything still in the works is now out of date */
+  g_atomic_int_inc(&(canvas->pixbuf_generation));
 
   /* compensate for zoom */
   pixel_dim = (1/AMITK_STUDY_ZOOM(canvas->study))*AMITK_STUDY_VOXEL_DIM(canvas->study); 
 
+  /* slices come out at this size */
+  corner = AMITK_VOLUME_CORNER(canvas->volume);
+  width = ceil(corner.x/pixel_dim);
+  if (width < 1) width = 1;
+  height =  ceil(corner.y/pixel_dim);
+  if (height < 1) height = 1;
+
   data_sets = amitk_object_get_selected_children_of_type(AMITK_OBJECT(canvas->study),
   							 AMITK_OBJECT_TYPE_DATA_SET,
   							 canvas->view_mode,
@@ -3270,66 +3673,60 @@ static void canvas_update_pixbuf(AmitkCanvas * canvas) {
     blank_rgba.b = widget_style->bg[GTK_STATE_NORMAL].blue >> 8;
     blank_rgba.a = 0xFF;
 
-    corner = AMITK_VOLUME_CORNER(canvas->volume);
-
-    width = ceil(corner.x/pixel_dim);
-    if (width < 1) width = 1;
-    height =  ceil(corner.y/pixel_dim);
-    if (height < 1) height = 1;
-				 
-    canvas->pixbuf = image_blank(width, height,blank_rgba);
+    canvas_set_pixbuf(canvas, image_blank(width, height,blank_rgba));
+    canvas->pixbuf_final_generation = canvas->pixbuf_generation;
     amitk_objects_unref(canvas->slices);
     canvas->slices = NULL;
+    return;
+  } 
 
-  } else {
-    if (AMITK_IS_DATA_SET(canvas->active_object))
-      active_ds = AMITK_DATA_SET(canvas->active_object);
-    else
-      active_ds = NULL;
-    canvas->pixbuf = image_from_data_sets(&(canvas->slices),
-					  &(canvas->slice_cache),
-					  canvas->max_slice_cache_size,
-					  data_sets,
-					  active_ds,
-					  AMITK_STUDY_VIEW_START_TIME(canvas->study),
-					  AMITK_STUDY_VIEW_DURATION(canvas->study),
-					  -1,
-					  pixel_dim,
-					  canvas->volume,
-					  AMITK_STUDY_FUSE_TYPE(canvas->study),
-					  AMITK_CANVAS_VIEW_MODE(canvas));
+  if (AMITK_IS_DATA_SET(canvas->active_object))
+    active_ds = AMITK_DATA_SET(canvas->active_object);
+  else
+    active_ds = NULL;
+
+  /* movies and exports grab the canvas image as soon as the update's done, so do these right now */
+  if (synchronous || (canvas->type == AMITK_CANVAS_TYPE_FLY_THROUGH)) {
+    GList * slices = canvas->slices;
+    GdkPixbuf * pixbuf;
+
+    pixbuf = image_from_data_sets(&slices,
+				  data_sets,
+				  active_ds,
+				  AMITK_STUDY_VIEW_START_TIME(canvas->study),
+				  AMITK_STUDY_VIEW_DURATION(canvas->study),
+				  -1,
+				  pixel_dim,
+				  canvas->volume,
+				  AMITK_STUDY_FUSE_TYPE(canvas->study),
+				  AMITK_CANVAS_VIEW_MODE(canvas));
+    canvas->slices = slices;
     amitk_objects_unref(data_sets);
+    if (pixbuf != NULL) {
+      canvas_set_pixbuf(canvas, pixbuf);
+      canvas->pixbuf_final_generation = canvas->pixbuf_generation;
+    }
+    return;
   }
 
-  if (canvas->pixbuf != NULL) {
-    /* record the width and height for future use*/
-    canvas->pixbuf_width = gdk_pixbuf_get_width(canvas->pixbuf);
-    canvas->pixbuf_height = gdk_pixbuf_get_height(canvas->pixbuf);
-
-    /* reset the min size of the widget and set the scroll region */
-    if ((old_width != canvas->pixbuf_width) || 
-	(old_height != canvas->pixbuf_height) || (canvas->image == NULL)) {
-      gtk_widget_set_size_request(canvas->canvas, 
-				  canvas->pixbuf_width + 2 * canvas->border_width, 
-				  canvas->pixbuf_height + 2 * canvas->border_width);
-      gnome_canvas_set_scroll_region(GNOME_CANVAS(canvas->canvas), 0.0, 0.0, 
-				     canvas->pixbuf_width + 2 * canvas->border_width,
-				     canvas->pixbuf_height + 2 * canvas->border_width);
-    }
-    /* put the canvas rgb image on the canvas_image */
-    if (canvas->image == NULL) {/* time to make a new image */
-      canvas->image = gnome_canvas_item_new(gnome_canvas_root(GNOME_CANVAS(canvas->canvas)),
-					    gnome_canvas_pixbuf_get_type(),
-					    "pixbuf", canvas->pixbuf,
-					    "x", (double) canvas->border_width,
-					    "y", (double) canvas->border_width,
-					    NULL);
-      g_signal_connect(G_OBJECT(canvas->image), "event", G_CALLBACK(canvas_event_cb), canvas);
-    } else {
-      gnome_canvas_item_set(canvas->image, "pixbuf", canvas->pixbuf, NULL);
-    }
-    
+  /* the min/max values get calculated the first time they're needed, do 
+     that here instead of in the worker threads */
+  for (temp_data_sets = data_sets; temp_data_sets != NULL; temp_data_sets = temp_data_sets->next)
+    amitk_data_set_get_global_max(AMITK_DATA_SET(temp_data_sets->data));
+
+  /* set the canvas size now, so everything drawn over the image lines up
+     while we're waiting on it */
+  canvas_set_size(canvas, width, height);
+
+  if (width*height >= CANVAS_PREVIEW_MIN_PIXELS) {
+    scale = (width*height >= CANVAS_PREVIEW_SCALE*CANVAS_PREVIEW_SCALE*CANVAS_PREVIEW_MIN_PIXELS) ?
+      2*CANVAS_PREVIEW_SCALE : CANVAS_PREVIEW_SCALE;
+    canvas_job_push(canvas_job_new(canvas, amitk_objects_ref(data_sets), active_ds, pixel_dim, scale));
   }
+  canvas_job_push(canvas_job_new(canvas, amitk_objects_ref(data_sets), active_ds, pixel_dim, 1));
+
+  canvas_prefetch(canvas, data_sets, active_ds, pixel_dim);
+  amitk_objects_unref(data_sets);
 
   return;
 }
@@ -3522,17 +3919,25 @@ static void canvas_add_update(AmitkCanvas * canvas, guint update_type) {
 static gboolean canvas_update_while_idle(gpointer data) {
 
   AmitkCanvas * canvas = data;
+  gint64 trace_start;
+  gint64 trace_update;
+
+  trace_update = AMITK_TRACE_BEGIN();
 
   /* update the corners */
   if (canvas_recalc_corners(canvas)) /* if corners changed */
     canvas->next_update = canvas->next_update | UPDATE_ALL;
 
   if (canvas->next_update & UPDATE_DATA_SETS) {
-    canvas_update_pixbuf(canvas);
+    trace_start = AMITK_TRACE_BEGIN();
+    canvas_update_pixbuf(canvas, FALSE);
+    AMITK_TRACE_END("canvas_update_pixbuf", trace_start);
   } 
   
   if (canvas->next_update & UPDATE_ARROWS) {
+    trace_start = AMITK_TRACE_BEGIN();
     canvas_update_arrows(canvas);
+    AMITK_TRACE_END("canvas_update_arrows", trace_start);
   }
   
   if (canvas->next_update & UPDATE_SCROLLBAR) {
@@ -3540,11 +3945,15 @@ static gboolean canvas_update_while_idle(gpointer data) {
   } 
 
   if (canvas->next_update & (UPDATE_OBJECTS | UPDATE_OBJECT)) {
+    trace_start = AMITK_TRACE_BEGIN();
     canvas_update_objects(canvas, (canvas->next_update & UPDATE_OBJECTS));
+    AMITK_TRACE_END("canvas_update_objects", trace_start);
   } 
 
   if (canvas->next_update & UPDATE_LINE_PROFILE) {
+    trace_start = AMITK_TRACE_BEGIN();
     canvas_update_line_profile(canvas);
+    AMITK_TRACE_END("canvas_update_line_profile", trace_start);
   }
 
   if (canvas->next_update & UPDATE_TIME) {
@@ -3567,6 +3976,7 @@ static gboolean canvas_update_while_idle(gpointer data) {
     ui_common_remove_wait_cursor(GTK_WIDGET(canvas));
   canvas->next_update = UPDATE_NONE;
 
+  AMITK_TRACE_END("canvas_update", trace_update);
   return FALSE;
 }
 
@@ -3623,7 +4033,6 @@ static void canvas_add_object(AmitkCanvas * canvas, AmitkObject * object) {
   }
   if (AMITK_IS_DATA_SET(object)) {
     g_signal_connect(G_OBJECT(object), "data_set_changed", G_CALLBACK(data_set_changed_cb), canvas);
-    g_signal_connect(G_OBJECT(object), "invalidate_slice_cache", G_CALLBACK(canvas_data_set_invalidate_slice_cache), canvas);
     g_signal_connect(G_OBJECT(object), "interpolation_changed", G_CALLBACK(data_set_changed_cb), canvas);
     g_signal_connect(G_OBJECT(object), "rendering_changed", G_CALLBACK(data_set_changed_cb), canvas);
     g_signal_connect(G_OBJECT(object), "thresholding_changed", G_CALLBACK(data_set_thresholding_changed_cb), canvas);
@@ -3704,11 +4113,9 @@ static void canvas_remove_object(AmitkCanvas * canvas, AmitkObject * object) {
   }
   if (AMITK_IS_DATA_SET(object)) {
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_changed_cb, canvas);
-    g_signal_handlers_disconnect_by_func(G_OBJECT(object), canvas_data_set_invalidate_slice_cache, canvas);
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_thresholding_changed_cb, canvas);
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_color_table_changed_cb, canvas);
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_subject_orientation_changed_cb, canvas);
-    canvas->slice_cache = amitk_data_sets_remove_with_slice_parent(canvas->slice_cache, AMITK_DATA_SET(object));
   }
   
   /* find corresponding CanvasItem and destroy */
@@ -3849,6 +4256,19 @@ GdkPixbuf * amitk_canvas_get_pixbuf(AmitkCanvas * canvas) {
 
   GdkPixbuf * pixbuf;
 
+  /* run any pending update now */
+  if (canvas->idle_handler_id != 0) {
+    g_source_remove(canvas->idle_handler_id);
+    canvas_update_while_idle(canvas);
+  }
+
+  /* the background render might only have the coarse preview up, 
+     so redo the image at full resolution before grabbing it */
+  if ((canvas->study != NULL) && 
+      (canvas->pixbuf_final_generation != g_atomic_int_get(&(canvas->pixbuf_generation))))
+    canvas_update_pixbuf(canvas, TRUE);
+  gnome_canvas_update_now(GNOME_CANVAS(canvas->canvas));
+
   pixbuf = amitk_get_pixbuf_from_canvas(GNOME_CANVAS(canvas->canvas), 
 					canvas->border_width,canvas->border_width,
 					canvas->pixbuf_width, canvas->pixbuf_height);
@@ -80,12 +80,22 @@ struct _AmitkCanvas
   AmitkObject * active_object;
 
   GList * slices;
-  GList * slice_cache;
-  gint max_slice_cache_size;
   gint pixbuf_width, pixbuf_height;
   gdouble border_width;
   GnomeCanvasItem * image;
   GdkPixbuf * pixbuf;
+  gint pixbuf_generation; /* bumped for each reslice, images from older ones get dropped */
+  gint pixbuf_final_generation; /* generation of the last full resolution image */
+
+  /* prefetch stuff, where we were at the last reslice */
+  gint prefetch_type;
+  gdouble prefetch_step;
+  gint64 prefetch_time;
+  AmitkPoint prefetch_offset;
+  amide_time_t prefetch_start;
+  amide_time_t prefetch_duration;
+  AmitkDataSet * prefetch_gate_ds; /* never dereferenced */
+  gint prefetch_gate;
 
   gboolean time_on_image;
   GnomeCanvasItem * time_label;
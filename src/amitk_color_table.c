@@ -850,3 +850,143 @@ const gchar * amitk_color_table_get_name(const AmitkColorTable which) {
 
   return enum_value->value_nick;
 }
+
+
+/* number of recently used luts we hang onto, a fused view needs one per data set */
+#define LUT_CACHE_SIZE 8
+
+/* number of values quantized at a time in amitk_color_table_lut_map */
+#define LUT_MAP_BLOCK 256
+
+static AmitkColorTableLut * lut_cache[LUT_CACHE_SIZE]; /* most recently used first */
+G_LOCK_DEFINE_STATIC(lut_cache);
+
+static AmitkColorTableLut * lut_new(AmitkColorTable which, amide_data_t min, amide_data_t max) {
+
+  AmitkColorTableLut * lut;
+  amide_data_t step;
+  gint k;
+
+  if ((lut = g_try_new(AmitkColorTableLut, 1)) == NULL) {
+    g_warning(_("couldn't allocate memory space for color table lookup"));
+    return NULL;
+  }
+
+  lut->which = which;
+  lut->min = min;
+  lut->max = max;
+  lut->ref_count = 1;
+  lut->exact = !(isfinite(min) && isfinite(max) && isfinite(max-min) && (max > min));
+
+  if (lut->exact) {
+    lut->scale = 0.0;
+    return lut;
+  }
+
+  step = (max-min)/(AMITK_COLOR_TABLE_LUT_SIZE-1);
+  lut->scale = 1.0/step;
+
+  /* the color tables are constant outside of min/max */
+  lut->entries[0] = amitk_color_table_lookup(min-(max-min), which, min, max);
+  for (k=0; k < AMITK_COLOR_TABLE_LUT_SIZE-1; k++)
+    lut->entries[k+1] = amitk_color_table_lookup(min+k*step, which, min, max);
+  lut->entries[AMITK_COLOR_TABLE_LUT_SIZE] = amitk_color_table_lookup(max, which, min, max);
+  lut->entries[AMITK_COLOR_TABLE_LUT_SIZE+1] = amitk_color_table_lookup(max+(max-min), which, min, max);
+  lut->entries[AMITK_COLOR_TABLE_LUT_SIZE+2] = amitk_color_table_lookup(NAN, which, min, max);
+
+  return lut;
+}
+
+/* returns a compiled version of the color table for the given min/max, only 
+   recompiling if it isn't one of the recently used ones.  Unref when done. */
+AmitkColorTableLut * amitk_color_table_lut_get(AmitkColorTable which, 
+					       amide_data_t min, amide_data_t max) {
+
+  AmitkColorTableLut * lut=NULL;
+  AmitkColorTableLut * dropped=NULL;
+  gint i, j;
+
+  G_LOCK(lut_cache);
+  for (i=0; (i < LUT_CACHE_SIZE) && (lut == NULL); i++) 
+    if ((lut_cache[i] != NULL) && (lut_cache[i]->which == which) &&
+	(lut_cache[i]->min == min) && (lut_cache[i]->max == max)) {
+      lut = lut_cache[i];
+      for (j=i; j > 0; j--) 
+	lut_cache[j] = lut_cache[j-1];
+      lut_cache[0] = lut;
+      g_atomic_int_inc(&lut->ref_count);
+    }
+  G_UNLOCK(lut_cache);
+  if (lut != NULL) return lut;
+
+  /* compile it outside the lock */
+  if ((lut = lut_new(which, min, max)) == NULL) 
+    return NULL;
+
+  G_LOCK(lut_cache);
+  dropped = lut_cache[LUT_CACHE_SIZE-1];
+  for (j=LUT_CACHE_SIZE-1; j > 0; j--) 
+    lut_cache[j] = lut_cache[j-1];
+  lut_cache[0] = lut;
+  g_atomic_int_inc(&lut->ref_count);
+  G_UNLOCK(lut_cache);
+
+  if (dropped != NULL)
+    amitk_color_table_lut_unref(dropped);
+
+  return lut;
+}
+
+void amitk_color_table_lut_unref(AmitkColorTableLut * lut) {
+
+  if (lut == NULL) return;
+
+  if (g_atomic_int_dec_and_test(&lut->ref_count))
+    g_free(lut);
+
+  return;
+}
+
+/* colors num values of data (each multiplied by scale_factor) into rgba.  The
+   quantization is done in blocks without branches so the compiler can vectorize
+   it, the table lookups are then done separately. */
+void amitk_color_table_lut_map(const AmitkColorTableLut * lut, 
+			       const amide_data_t * data,
+			       const amide_data_t scale_factor,
+			       rgba_t * rgba,
+			       const gint num) {
+
+  guint16 index[LUT_MAP_BLOCK];
+  amide_data_t x;
+  amide_data_t min, scale;
+  const amide_data_t above = AMITK_COLOR_TABLE_LUT_SIZE+1;
+  const amide_data_t not_a_number = AMITK_COLOR_TABLE_LUT_SIZE+2;
+  gint start, i, n;
+
+  if (lut->exact) {
+    for (i=0; i<num; i++)
+      rgba[i] = amitk_color_table_lookup(scale_factor*data[i], lut->which, lut->min, lut->max);
+    return;
+  }
+
+  min = lut->min;
+  scale = lut->scale;
+
+  for (start=0; start < num; start += LUT_MAP_BLOCK) {
+    n = MIN(LUT_MAP_BLOCK, num-start);
+
+    /* + 1 for the below min entry, + 0.5 to round */
+    for (i=0; i<n; i++) {
+      x = (scale_factor*data[start+i] - min)*scale + 1.5;
+      x = (x < 0.0) ? 0.0 : x;
+      x = (x > above) ? above : x;
+      x = (x == x) ? x : not_a_number;
+      index[i] = (guint16) x;
+    }
+
+    for (i=0; i<n; i++)
+      rgba[start+i] = lut->entries[index[i]];
+  }
+
+  return;
+}
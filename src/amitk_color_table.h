@@ -96,6 +96,22 @@ typedef struct hsv_t {
 } hsv_t;
 
 
+/* a color table compiled for a given min/max.  entries[0] is used for values 
+   below min, entries[1] through entries[AMITK_COLOR_TABLE_LUT_SIZE] evenly 
+   cover min to max, followed by the entries for values above max and for NaN's */
+#define AMITK_COLOR_TABLE_LUT_SIZE 4096
+
+typedef struct AmitkColorTableLut {
+  AmitkColorTable which;
+  amide_data_t min;
+  amide_data_t max;
+  amide_data_t scale; /* entries per unit of data */
+  gboolean exact; /* degenerate min/max, amitk_color_table_lookup gets used instead */
+  gint ref_count;
+  rgba_t entries[AMITK_COLOR_TABLE_LUT_SIZE+3];
+} AmitkColorTableLut;
+
+
 /* defines */
 #define amitk_color_table_rgba_to_uint32(rgba) (((rgba).r<<24) | ((rgba).g<<16) | ((rgba).b<<8) | ((rgba).a<<0))
 
@@ -105,6 +121,14 @@ rgba_t amitk_color_table_outline_color(AmitkColorTable which, gboolean highlight
 rgba_t amitk_color_table_lookup(amide_data_t datum, AmitkColorTable which,
 				amide_data_t min, amide_data_t max);
 const gchar * amitk_color_table_get_name(const AmitkColorTable which);
+AmitkColorTableLut * amitk_color_table_lut_get(AmitkColorTable which, 
+					       amide_data_t min, amide_data_t max);
+void amitk_color_table_lut_unref(AmitkColorTableLut * lut);
+void amitk_color_table_lut_map(const AmitkColorTableLut * lut, 
+			       const amide_data_t * data,
+			       const amide_data_t scale_factor,
+			       rgba_t * rgba,
+			       const gint num);
 /* external variables */
 extern gchar * color_table_menu_names[];
 
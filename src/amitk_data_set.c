@@ -29,6 +29,9 @@
 #include "amitk_marshal.h"
 #include "amitk_type_builtins.h"
 #include "amitk_line_profile.h"
+#include "amitk_slice_cache.h"
+#include "amitk_parallel.h"
+#include "amitk_trace.h"
 
 /* variable type function declarations */
 #include "amitk_data_set_UBYTE_0D_SCALING.h"
@@ -235,7 +238,6 @@ static void          data_set_scale                  (AmitkSpace        *space,
 						      AmitkPoint        *ref_point,
 						      AmitkPoint        *scaling);
 static void          data_set_space_changed          (AmitkSpace        *space);
-static void          data_set_selection_changed      (AmitkObject       *object);
 static AmitkObject * data_set_copy                   (const AmitkObject *object);
 static void          data_set_copy_in_place          (AmitkObject * dest_object, const AmitkObject * src_object);
 static void          data_set_write_xml              (const AmitkObject *object, 
@@ -246,6 +248,13 @@ static gchar *       data_set_read_xml               (AmitkObject       *object,
 						      FILE              *study_file,
 						      gchar             *error_buf);
 static void          data_set_invalidate_slice_cache (AmitkDataSet * ds);
+static void          data_stats_scale                (AmitkDataStats * stats,
+						      const amide_data_t scaling);
+static AmitkRawData * data_set_stats_to_raw_data     (AmitkDataSet * ds);
+static gboolean      data_set_stats_from_raw_data    (AmitkDataSet * ds,
+						      AmitkRawData * raw_data);
+static void          data_set_drop_pyramid           (AmitkDataSet * ds);
+static void          data_set_sync_pyramid_space     (AmitkDataSet * ds);
 static void          data_set_set_voxel_size         (AmitkDataSet * ds, 
 						      const AmitkPoint voxel_size);
 static void           data_set_drop_intercept        (AmitkDataSet * ds);
@@ -255,8 +264,6 @@ static guint         data_set_signals[LAST_SIGNAL];
 
 
 static amide_data_t calculate_scale_factor(AmitkDataSet * ds);
-GList * slice_cache_trim(GList * slice_cache, gint max_size);
-#define MIN_LOCAL_CACHE_SIZE 3
 
 GType amitk_data_set_get_type(void) {
 
@@ -296,7 +303,6 @@ static void data_set_class_init (AmitkDataSetClass * class) {
   space_class->space_scale = data_set_scale;
   space_class->space_changed = data_set_space_changed;
 
-  object_class->object_selection_changed = data_set_selection_changed;
   object_class->object_copy = data_set_copy;
   object_class->object_copy_in_place = data_set_copy_in_place;
   object_class->object_write_xml = data_set_write_xml;
@@ -453,6 +459,8 @@ static void data_set_init (AmitkDataSet * data_set) {
   data_set->min_max_calculated = FALSE;
   data_set->frame_max = NULL;
   data_set->frame_min = NULL;
+  data_set->plane_stats = NULL;
+  data_set->frame_stats = NULL;
   data_set->global_max = 0.0;
   data_set->global_min = 0.0;
   amitk_data_set_set_thresholding(data_set, AMITK_THRESHOLDING_GLOBAL);
@@ -460,6 +468,11 @@ static void data_set_init (AmitkDataSet * data_set) {
   for (i=0; i<2; i++)
     data_set->threshold_ref_frame[i]=0;
   data_set->distribution = NULL;
+  for (i=0; i<AMITK_DATA_SET_PYRAMID_LEVELS-1; i++)
+    data_set->pyramid[i] = NULL;
+  g_mutex_init(&(data_set->pyramid_mutex));
+  g_rec_mutex_init(&(data_set->stats_mutex));
+  data_set->pyramid_epoch = 0;
   data_set->modality = AMITK_MODALITY_PET;
   data_set->voxel_size = one_point;
   data_set->scaling_type = AMITK_SCALING_TYPE_0D;
@@ -495,8 +508,8 @@ static void data_set_init (AmitkDataSet * data_set) {
   data_set->rendering = AMITK_RENDERING_MPR;
   data_set->subject_orientation = AMITK_SUBJECT_ORIENTATION_UNKNOWN;
   data_set->subject_sex = AMITK_SUBJECT_SEX_UNKNOWN;
-  data_set->slice_cache = NULL;
   data_set->slice_parent = NULL;
+  data_set->slice_cache_epoch = 0;
 
   for (i_window=0; i_window < AMITK_WINDOW_NUM; i_window++)
     for (i_limit=0; i_limit < AMITK_LIMIT_NUM; i_limit++)
@@ -527,6 +540,8 @@ static void data_set_finalize (GObject *object)
 {
   AmitkDataSet * data_set = AMITK_DATA_SET(object);
 
+  data_set_drop_pyramid(data_set);
+
   if (data_set->raw_data != NULL) {
 #ifdef AMIDE_DEBUG
     if (data_set->raw_data->dim.z != 1) /* avoid slices */
@@ -576,6 +591,16 @@ static void data_set_finalize (GObject *object)
     data_set->frame_min = NULL;
   }
 
+  if (data_set->plane_stats != NULL) {
+    g_free(data_set->plane_stats);
+    data_set->plane_stats = NULL;
+  }
+
+  if (data_set->frame_stats != NULL) {
+    g_free(data_set->frame_stats);
+    data_set->frame_stats = NULL;
+  }
+
   if (data_set->scan_date != NULL) {
     g_free(data_set->scan_date);
     data_set->scan_date = NULL;
@@ -601,10 +626,7 @@ static void data_set_finalize (GObject *object)
     data_set->dicom_image_type = NULL;
   }
 
-  if (data_set->slice_cache != NULL) {
-    amitk_objects_unref(data_set->slice_cache);
-    data_set->slice_cache = NULL;
-  }
+  amitk_slice_cache_remove_parent(data_set);
 
   if (data_set->slice_parent != NULL) {
     g_object_remove_weak_pointer(G_OBJECT(data_set->slice_parent),
@@ -612,6 +634,9 @@ static void data_set_finalize (GObject *object)
     data_set->slice_parent = NULL;
   }
 
+  g_mutex_clear(&(data_set->pyramid_mutex));
+  g_rec_mutex_clear(&(data_set->stats_mutex));
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -646,28 +671,12 @@ static void data_set_space_changed(AmitkSpace * space) {
   data_set = AMITK_DATA_SET(space);
 
   g_signal_emit(G_OBJECT (data_set), data_set_signals[INVALIDATE_SLICE_CACHE], 0);
+  data_set_sync_pyramid_space(data_set);
 
   if (AMITK_SPACE_CLASS(parent_class)->space_changed)
     AMITK_SPACE_CLASS(parent_class)->space_changed (space);
 }
 
-static void data_set_selection_changed(AmitkObject * object) {
-
-  AmitkDataSet * data_set;
-
-  g_return_if_fail(AMITK_IS_DATA_SET(object));
-  data_set = AMITK_DATA_SET(object);
-
-
-  if (!amitk_object_get_selected(object, AMITK_SELECTION_ANY)) {
-    data_set->slice_cache = 
-      slice_cache_trim(data_set->slice_cache, MIN_LOCAL_CACHE_SIZE);
-  }
-
-  return;
-}
-
-
 static AmitkObject * data_set_copy (const AmitkObject * object) {
 
   AmitkDataSet * copy;
@@ -698,6 +707,9 @@ static void data_set_copy_in_place (AmitkObject * dest_object, const AmitkObject
   src_ds = AMITK_DATA_SET(src_object);
   dest_ds = AMITK_DATA_SET(dest_object);
 
+  /* the pyramid's rebuilt as needed from the new data */
+  data_set_drop_pyramid(dest_ds);
+
 
   /* copy the data elements */
   amitk_data_set_set_scan_date(dest_ds, AMITK_DATA_SET_SCAN_DATE(src_object));
@@ -781,8 +793,11 @@ static void data_set_copy_in_place (AmitkObject * dest_object, const AmitkObject
   for (i=0;i<AMITK_DATA_SET_NUM_FRAMES(dest_ds);i++)
     dest_ds->frame_duration[i] = amitk_data_set_get_frame_duration(src_ds, i);
 
-  /* if they've already been calculated, make a copy in memory of the data set's max/min values */
-  dest_ds->min_max_calculated = AMITK_DATA_SET(src_object)->min_max_calculated;
+  /* if they've already been calculated, make a copy in memory of the data set's max/min values,
+     the source's statistics may be getting calculated by another thread */
+  g_rec_mutex_lock(&(src_ds->stats_mutex));
+  g_rec_mutex_lock(&(dest_ds->stats_mutex));
+  dest_ds->min_max_calculated = src_ds->min_max_calculated;
 
   if (dest_ds->frame_max != NULL) {
     g_free(dest_ds->frame_max);
@@ -792,21 +807,40 @@ static void data_set_copy_in_place (AmitkObject * dest_object, const AmitkObject
     g_free(dest_ds->frame_min);
     dest_ds->frame_min = NULL;
   }
+  if (dest_ds->plane_stats != NULL) {
+    g_free(dest_ds->plane_stats);
+    dest_ds->plane_stats = NULL;
+  }
+  if (dest_ds->frame_stats != NULL) {
+    g_free(dest_ds->frame_stats);
+    dest_ds->frame_stats = NULL;
+  }
 
   if (src_ds->min_max_calculated) {
-    dest_ds->global_max = AMITK_DATA_SET(src_object)->global_max;
-    dest_ds->global_min = AMITK_DATA_SET(src_object)->global_min;
+    dest_ds->global_max = src_ds->global_max;
+    dest_ds->global_min = src_ds->global_min;
+    dest_ds->global_stats = src_ds->global_stats;
 
     dest_ds->frame_max = amitk_data_set_get_frame_min_max_mem(dest_ds);
-    g_return_if_fail(dest_ds->frame_max != NULL);
-    for (i=0;i<AMITK_DATA_SET_NUM_FRAMES(dest_ds);i++) 
-      dest_ds->frame_max[i] = src_ds->frame_max[i];
-
     dest_ds->frame_min = amitk_data_set_get_frame_min_max_mem(dest_ds);
-    g_return_if_fail(dest_ds->frame_min != NULL);
-    for (i=0;i<AMITK_DATA_SET_NUM_FRAMES(dest_ds);i++)
-      dest_ds->frame_min[i] = src_ds->frame_min[i];
+    dest_ds->frame_stats = amitk_data_set_get_frame_stats_mem(dest_ds);
+    dest_ds->plane_stats = amitk_data_set_get_plane_stats_mem(dest_ds);
+    if ((dest_ds->frame_max == NULL) || (dest_ds->frame_min == NULL) ||
+	(dest_ds->frame_stats == NULL) || (dest_ds->plane_stats == NULL)) {
+      g_warning(_("couldn't allocate memory space for the data set statistics"));
+      dest_ds->min_max_calculated = FALSE; /* they'll get recalculated */
+    } else {
+      for (i=0;i<AMITK_DATA_SET_NUM_FRAMES(dest_ds);i++) {
+	dest_ds->frame_max[i] = src_ds->frame_max[i];
+	dest_ds->frame_min[i] = src_ds->frame_min[i];
+	dest_ds->frame_stats[i] = src_ds->frame_stats[i];
+      }
+      for (i=0;i<AMITK_DATA_SET_TOTAL_PLANES(dest_ds);i++)
+	dest_ds->plane_stats[i] = src_ds->plane_stats[i];
+    }
   }
+  g_rec_mutex_unlock(&(dest_ds->stats_mutex));
+  g_rec_mutex_unlock(&(src_ds->stats_mutex));
 
   AMITK_OBJECT_CLASS (parent_class)->object_copy_in_place (dest_object, src_object);
 }
@@ -827,6 +861,7 @@ static void data_set_write_xml(const AmitkObject * object, xmlNodePtr nodes, FIL
   AmitkWindow i_window;
   AmitkLimit i_limit;
   AmitkViewMode i_view_mode;
+  AmitkRawData * stats;
 
   AMITK_OBJECT_CLASS(parent_class)->object_write_xml(object, nodes, study_file);
 
@@ -873,6 +908,24 @@ static void data_set_write_xml(const AmitkObject * object, xmlNodePtr nodes, FIL
     }
   }
 
+  /* save the statistics so we don't need a pass through the data on loading */
+  amitk_data_set_calc_min_max_if_needed(ds, NULL, NULL);
+  if (ds->min_max_calculated && (ds->plane_stats != NULL)) {
+    stats = data_set_stats_to_raw_data(ds);
+    if (stats != NULL) {
+      name = g_strdup_printf("data-set_%s_statistics",AMITK_OBJECT_NAME(ds));
+      amitk_raw_data_write_xml(stats, name, study_file, &xml_filename, &location, &size);
+      g_free(name);
+      g_object_unref(stats);
+      if (study_file == NULL) {
+	xml_save_string(nodes, "statistics_file", xml_filename);
+	g_free(xml_filename);
+      } else {
+	xml_save_location_and_size(nodes, "statistics_location_and_size", location, size);
+      }
+    }
+  }
+
   if (ds->distribution != NULL) {
     name = g_strdup_printf("data-set_%s_distribution",AMITK_OBJECT_NAME(ds));
     amitk_raw_data_write_xml(ds->distribution, name, study_file, &xml_filename, &location, &size);
@@ -966,6 +1019,7 @@ static gchar * data_set_read_xml(AmitkObject * object, xmlNodePtr nodes,
   gchar * filename=NULL;
   guint64 location, size;
   gboolean intercept;
+  AmitkRawData * stats;
 
   error_buf = AMITK_OBJECT_CLASS(parent_class)->object_read_xml(object, nodes, study_file, error_buf);
 
@@ -1279,16 +1333,36 @@ static gchar * data_set_read_xml(AmitkObject * object, xmlNodePtr nodes,
   data_set_drop_intercept(ds);
   data_set_reduce_scaling_dimension(ds);
 
+  /* saved statistics (as of 1.0.6), trust them, saves a pass through the data */
+  if (xml_node_exists(nodes, "statistics_file") || 
+      xml_node_exists(nodes, "statistics_location_and_size")) {
+    if (study_file == NULL) 
+      filename = xml_get_string(nodes, "statistics_file");
+    else
+      xml_get_location_and_size(nodes, "statistics_location_and_size", &location, &size, &error_buf);
+    stats = amitk_raw_data_read_xml(filename, study_file, location, size, &error_buf, NULL, NULL);
+    if (filename != NULL) {
+      g_free(filename);
+      filename = NULL;
+    }
+    if (stats != NULL) {
+      if (!data_set_stats_from_raw_data(ds, stats))
+	amitk_append_str_with_newline(&error_buf, _("saved statistics don't match the data set, will recalculate"));
+      g_object_unref(stats);
+    }
+  }
+
   return error_buf;
 }
 
 static void data_set_invalidate_slice_cache(AmitkDataSet * data_set) {
 
+  /* slices being generated right now are stale too, the epoch keeps them
+     out of the cache */
+  g_atomic_int_inc(&(data_set->slice_cache_epoch));
+
   /* invalidate cache */
-  if (data_set->slice_cache != NULL) {
-    amitk_objects_unref(data_set->slice_cache);
-    data_set->slice_cache = NULL;
-  }
+  amitk_slice_cache_remove_parent(data_set);
 
 
   return;
@@ -1301,6 +1375,7 @@ static void data_set_set_voxel_size(AmitkDataSet * ds, const AmitkPoint voxel_si
 
   if (!POINT_EQUAL(AMITK_DATA_SET_VOXEL_SIZE(ds), voxel_size)) {
     ds->voxel_size = voxel_size;
+    data_set_drop_pyramid(ds);
     g_signal_emit(G_OBJECT (ds), data_set_signals[VOXEL_SIZE_CHANGED], 0);
     g_signal_emit(G_OBJECT (ds), data_set_signals[INVALIDATE_SLICE_CACHE], 0);
     g_signal_emit(G_OBJECT (ds), data_set_signals[DATA_SET_CHANGED], 0);
@@ -1569,7 +1644,14 @@ GList * amitk_data_set_import_file(AmitkImportMethod method,
     if (stat(raw_filename, &file_info) == 0)
       incorrect_raw_permissions = (access(raw_filename, R_OK) != 0);
 	
-  if (incorrect_permissions || incorrect_hdr_permissions || incorrect_raw_permissions) {
+  if ((incorrect_permissions || incorrect_hdr_permissions || incorrect_raw_permissions) &&
+      (gdk_display_get_default() == NULL)) {
+    /* nobody to ask, leave the permissions alone */
+    g_warning(_("File has incorrect permissions for reading: %s"), filename);
+    g_free(header_filename);
+    g_free(raw_filename);
+    return NULL;
+  } else if (incorrect_permissions || incorrect_hdr_permissions || incorrect_raw_permissions) {
 
     /* check if it's okay to change permission of file */
     question = gtk_message_dialog_new(NULL,
@@ -1694,7 +1776,13 @@ GList * amitk_data_set_import_file(AmitkImportMethod method,
 #endif
   case AMITK_IMPORT_METHOD_RAW:
   default:
-    import_ds= raw_data_import(filename, preferences);
+    /* the raw import dialog needs a display, without one (batch mode) the 
+       format has to be given explicitly through amitk_data_set_import_raw_file */
+    if (gdk_display_get_default() == NULL)
+      g_warning(_("%s would have to be imported as raw data, which needs the data format, dimensions, and voxel size specified"), 
+		filename);
+    else
+      import_ds= raw_data_import(filename, preferences);
     break;
   }
 
@@ -2118,7 +2206,7 @@ gboolean amitk_data_sets_export_to_file(GList * data_sets,
 	/* advance the requested slice volume */
 	amitk_space_set_offset(AMITK_SPACE(volume), amitk_space_s2b(AMITK_SPACE(export_ds), new_offset));
 
-	slices = amitk_data_sets_get_slices(data_sets, NULL, 0,
+	slices = amitk_data_sets_get_slices(data_sets, FALSE,
 					    amitk_data_set_get_start_time(export_ds, i_voxel.t)+EPSILON,
 					    amitk_data_set_get_frame_duration(export_ds, i_voxel.t)-EPSILON,
 					    i_voxel.g,
@@ -2333,6 +2421,52 @@ amide_data_t amitk_data_set_get_frame_min(AmitkDataSet * ds, const guint frame)
   return ds->frame_min[frame];
 }
 
+AmitkDataStats amitk_data_set_get_global_stats(AmitkDataSet * ds) {
+  amitk_data_set_calc_min_max_if_needed(ds, NULL, NULL);
+  return ds->global_stats;
+}
+
+AmitkDataStats amitk_data_set_get_frame_stats(AmitkDataSet * ds, const guint frame) {
+
+  AmitkDataStats empty_stats = {0.0, 0.0, 0.0, 0.0, 0};
+  AmitkDataStats stats;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), empty_stats);
+  g_return_val_if_fail(frame < AMITK_DATA_SET_NUM_FRAMES(ds), empty_stats);
+
+  g_rec_mutex_lock(&(ds->stats_mutex));
+  amitk_data_set_calc_min_max_if_needed(ds, NULL, NULL);
+  if (ds->frame_stats != NULL) /* otherwise, couldn't calculate */
+    stats = ds->frame_stats[frame];
+  else
+    stats = empty_stats;
+  g_rec_mutex_unlock(&(ds->stats_mutex));
+
+  return stats;
+}
+
+AmitkDataStats amitk_data_set_get_plane_stats(AmitkDataSet * ds, const guint frame, 
+					      const guint gate, const guint z) {
+
+  AmitkDataStats empty_stats = {0.0, 0.0, 0.0, 0.0, 0};
+  AmitkDataStats stats;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), empty_stats);
+  g_return_val_if_fail(frame < AMITK_DATA_SET_NUM_FRAMES(ds), empty_stats);
+  g_return_val_if_fail(gate < AMITK_DATA_SET_NUM_GATES(ds), empty_stats);
+  g_return_val_if_fail(z < AMITK_DATA_SET_DIM_Z(ds), empty_stats);
+
+  g_rec_mutex_lock(&(ds->stats_mutex));
+  amitk_data_set_calc_min_max_if_needed(ds, NULL, NULL);
+  if (ds->plane_stats != NULL) /* otherwise, couldn't calculate */
+    stats = ds->plane_stats[(frame*AMITK_DATA_SET_NUM_GATES(ds)+gate)*AMITK_DATA_SET_DIM_Z(ds)+z];
+  else
+    stats = empty_stats;
+  g_rec_mutex_unlock(&(ds->stats_mutex));
+
+  return stats;
+}
+
 AmitkColorTable amitk_data_set_get_color_table_to_use(AmitkDataSet * ds, const AmitkViewMode view_mode) {
 
   g_return_val_if_fail(AMITK_IS_DATA_SET(ds), AMITK_COLOR_TABLE_BW_LINEAR);
@@ -2719,6 +2853,8 @@ void amitk_data_set_set_scale_factor(AmitkDataSet * ds, amide_data_t new_scale_f
 
   if (need_update) {
 
+    data_set_drop_pyramid(ds);
+
     if (ds->current_scaling_factor == NULL) /* first time */
       scaling = 1.0;
     else
@@ -2764,6 +2900,13 @@ void amitk_data_set_set_scale_factor(AmitkDataSet * ds, amide_data_t new_scale_f
 	ds->frame_max[j] *= scaling;
 	ds->frame_min[j] *= scaling;
       }
+    data_stats_scale(&(ds->global_stats), scaling);
+    if ((AMITK_DATA_SET_RAW_DATA(ds) != NULL) && (ds->frame_stats != NULL) && (ds->plane_stats != NULL)) {
+      for (j=0; j < AMITK_DATA_SET_NUM_FRAMES(ds); j++)
+	data_stats_scale(&(ds->frame_stats[j]), scaling);
+      for (j=0; j < AMITK_DATA_SET_TOTAL_PLANES(ds); j++)
+	data_stats_scale(&(ds->plane_stats[j]), scaling);
+    }
 
     /* and emit the signal */
     g_signal_emit (G_OBJECT (ds), data_set_signals[SCALE_FACTOR_CHANGED], 0);
@@ -3081,111 +3224,168 @@ void amitk_data_set_calc_far_corner(AmitkDataSet * ds) {
 }
 
 
-static void (*calc_slice_min_max_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, const amide_intpoint_t, const amide_intpoint_t, const amide_intpoint_t, amitk_format_DOUBLE_t *, amitk_format_DOUBLE_t *) = {
-  {amitk_data_set_UBYTE_0D_SCALING_calc_slice_min_max, amitk_data_set_UBYTE_1D_SCALING_calc_slice_min_max,  amitk_data_set_UBYTE_2D_SCALING_calc_slice_min_max, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_calc_slice_min_max  },
-  {amitk_data_set_SBYTE_0D_SCALING_calc_slice_min_max, amitk_data_set_SBYTE_1D_SCALING_calc_slice_min_max,  amitk_data_set_SBYTE_2D_SCALING_calc_slice_min_max, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_calc_slice_min_max  },
-  {amitk_data_set_USHORT_0D_SCALING_calc_slice_min_max,amitk_data_set_USHORT_1D_SCALING_calc_slice_min_max, amitk_data_set_USHORT_2D_SCALING_calc_slice_min_max,amitk_data_set_USHORT_0D_SCALING_INTERCEPT_calc_slice_min_max,amitk_data_set_USHORT_1D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_USHORT_2D_SCALING_INTERCEPT_calc_slice_min_max },
-  {amitk_data_set_SSHORT_0D_SCALING_calc_slice_min_max,amitk_data_set_SSHORT_1D_SCALING_calc_slice_min_max, amitk_data_set_SSHORT_2D_SCALING_calc_slice_min_max,amitk_data_set_SSHORT_0D_SCALING_INTERCEPT_calc_slice_min_max,amitk_data_set_SSHORT_1D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_SSHORT_2D_SCALING_INTERCEPT_calc_slice_min_max },
-  {amitk_data_set_UINT_0D_SCALING_calc_slice_min_max,  amitk_data_set_UINT_1D_SCALING_calc_slice_min_max,   amitk_data_set_UINT_2D_SCALING_calc_slice_min_max,  amitk_data_set_UINT_0D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_UINT_1D_SCALING_INTERCEPT_calc_slice_min_max,   amitk_data_set_UINT_2D_SCALING_INTERCEPT_calc_slice_min_max   },
-  {amitk_data_set_SINT_0D_SCALING_calc_slice_min_max,  amitk_data_set_SINT_1D_SCALING_calc_slice_min_max,   amitk_data_set_SINT_2D_SCALING_calc_slice_min_max,  amitk_data_set_SINT_0D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_SINT_1D_SCALING_INTERCEPT_calc_slice_min_max,   amitk_data_set_SINT_2D_SCALING_INTERCEPT_calc_slice_min_max   },
-  {amitk_data_set_FLOAT_0D_SCALING_calc_slice_min_max, amitk_data_set_FLOAT_1D_SCALING_calc_slice_min_max,  amitk_data_set_FLOAT_2D_SCALING_calc_slice_min_max, amitk_data_set_FLOAT_0D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_FLOAT_1D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_FLOAT_2D_SCALING_INTERCEPT_calc_slice_min_max  },
-  {amitk_data_set_DOUBLE_0D_SCALING_calc_slice_min_max,amitk_data_set_DOUBLE_1D_SCALING_calc_slice_min_max, amitk_data_set_DOUBLE_2D_SCALING_calc_slice_min_max,amitk_data_set_DOUBLE_0D_SCALING_INTERCEPT_calc_slice_min_max,amitk_data_set_DOUBLE_1D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_DOUBLE_2D_SCALING_INTERCEPT_calc_slice_min_max }
+static void (*calc_plane_stats_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, const amide_intpoint_t, const amide_intpoint_t, const amide_intpoint_t, AmitkDataStats *) = {
+  {amitk_data_set_UBYTE_0D_SCALING_calc_plane_stats, amitk_data_set_UBYTE_1D_SCALING_calc_plane_stats,  amitk_data_set_UBYTE_2D_SCALING_calc_plane_stats, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_calc_plane_stats, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_calc_plane_stats,  amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_calc_plane_stats  },
+  {amitk_data_set_SBYTE_0D_SCALING_calc_plane_stats, amitk_data_set_SBYTE_1D_SCALING_calc_plane_stats,  amitk_data_set_SBYTE_2D_SCALING_calc_plane_stats, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_calc_plane_stats, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_calc_plane_stats,  amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_calc_plane_stats  },
+  {amitk_data_set_USHORT_0D_SCALING_calc_plane_stats,amitk_data_set_USHORT_1D_SCALING_calc_plane_stats, amitk_data_set_USHORT_2D_SCALING_calc_plane_stats,amitk_data_set_USHORT_0D_SCALING_INTERCEPT_calc_plane_stats,amitk_data_set_USHORT_1D_SCALING_INTERCEPT_calc_plane_stats, amitk_data_set_USHORT_2D_SCALING_INTERCEPT_calc_plane_stats },
+  {amitk_data_set_SSHORT_0D_SCALING_calc_plane_stats,amitk_data_set_SSHORT_1D_SCALING_calc_plane_stats, amitk_data_set_SSHORT_2D_SCALING_calc_plane_stats,amitk_data_set_SSHORT_0D_SCALING_INTERCEPT_calc_plane_stats,amitk_data_set_SSHORT_1D_SCALING_INTERCEPT_calc_plane_stats, amitk_data_set_SSHORT_2D_SCALING_INTERCEPT_calc_plane_stats },
+  {amitk_data_set_UINT_0D_SCALING_calc_plane_stats,  amitk_data_set_UINT_1D_SCALING_calc_plane_stats,   amitk_data_set_UINT_2D_SCALING_calc_plane_stats,  amitk_data_set_UINT_0D_SCALING_INTERCEPT_calc_plane_stats,  amitk_data_set_UINT_1D_SCALING_INTERCEPT_calc_plane_stats,   amitk_data_set_UINT_2D_SCALING_INTERCEPT_calc_plane_stats   },
+  {amitk_data_set_SINT_0D_SCALING_calc_plane_stats,  amitk_data_set_SINT_1D_SCALING_calc_plane_stats,   amitk_data_set_SINT_2D_SCALING_calc_plane_stats,  amitk_data_set_SINT_0D_SCALING_INTERCEPT_calc_plane_stats,  amitk_data_set_SINT_1D_SCALING_INTERCEPT_calc_plane_stats,   amitk_data_set_SINT_2D_SCALING_INTERCEPT_calc_plane_stats   },
+  {amitk_data_set_FLOAT_0D_SCALING_calc_plane_stats, amitk_data_set_FLOAT_1D_SCALING_calc_plane_stats,  amitk_data_set_FLOAT_2D_SCALING_calc_plane_stats, amitk_data_set_FLOAT_0D_SCALING_INTERCEPT_calc_plane_stats, amitk_data_set_FLOAT_1D_SCALING_INTERCEPT_calc_plane_stats,  amitk_data_set_FLOAT_2D_SCALING_INTERCEPT_calc_plane_stats  },
+  {amitk_data_set_DOUBLE_0D_SCALING_calc_plane_stats,amitk_data_set_DOUBLE_1D_SCALING_calc_plane_stats, amitk_data_set_DOUBLE_2D_SCALING_calc_plane_stats,amitk_data_set_DOUBLE_0D_SCALING_INTERCEPT_calc_plane_stats,amitk_data_set_DOUBLE_1D_SCALING_INTERCEPT_calc_plane_stats, amitk_data_set_DOUBLE_2D_SCALING_INTERCEPT_calc_plane_stats }
 };
 
 
+/* fold the statistics of src into dest */
+static void data_stats_merge(AmitkDataStats * dest, const AmitkDataStats * src) {
+
+  if (src->num_finite == 0) return;
+
+  if (dest->num_finite == 0) {
+    dest->min = src->min;
+    dest->max = src->max;
+  } else {
+    if (src->min < dest->min) dest->min = src->min;
+    if (src->max > dest->max) dest->max = src->max;
+  }
+  dest->sum += src->sum;
+  dest->sum_squares += src->sum_squares;
+  dest->num_finite += src->num_finite;
+
+  return;
+}
+
+static void data_stats_scale(AmitkDataStats * stats, const amide_data_t scaling) {
+
+  stats->min *= scaling;
+  stats->max *= scaling;
+  stats->sum *= scaling;
+  stats->sum_squares *= scaling*scaling;
+
+  return;
+}
+
+/* worker for calc_min_max, gathers the statistics for planes [start, end) */
+static void calc_planes_stats(gint start, gint end, gpointer data) {
+
+  AmitkDataSet * ds = data;
+  AmitkVoxel dim;
+  gint i_plane;
+
+  dim = AMITK_DATA_SET_DIM(ds);
+  for (i_plane=start; i_plane<end; i_plane++)
+    (*calc_plane_stats_func[ds->raw_data->format][ds->scaling_type])(ds, 
+								     i_plane / (dim.z*dim.g),
+								     (i_plane / dim.z) % dim.g,
+								     i_plane % dim.z,
+								     &(ds->plane_stats[i_plane]));
+
+  return;
+}
+
 void amitk_data_set_slice_calc_min_max (AmitkDataSet * ds,
 					const amide_intpoint_t frame,
 					const amide_intpoint_t gate,
 					const amide_intpoint_t z,
 					amitk_format_DOUBLE_t * pmin,
 					amitk_format_DOUBLE_t * pmax) {
-  (*calc_slice_min_max_func[ds->raw_data->format][ds->scaling_type])(ds, frame, gate, z, pmin, pmax);
+  AmitkDataStats stats;
+  gboolean calculated;
+
+  g_rec_mutex_lock(&(ds->stats_mutex));
+  calculated = ds->min_max_calculated && (ds->plane_stats != NULL);
+  if (calculated)
+    stats = ds->plane_stats[(frame*AMITK_DATA_SET_NUM_GATES(ds)+gate)*AMITK_DATA_SET_DIM_Z(ds)+z];
+  g_rec_mutex_unlock(&(ds->stats_mutex));
+
+  if (!calculated)
+    (*calc_plane_stats_func[ds->raw_data->format][ds->scaling_type])(ds, frame, gate, z, &stats);
+
+  if (pmin != NULL) *pmin = stats.min;
+  if (pmax != NULL) *pmax = stats.max;
 }
 
-/* function to calculate the max and min over the data frames */
-void amitk_data_set_calc_min_max(AmitkDataSet * ds,
-				 AmitkUpdateFunc update_func,
-				 gpointer update_data) {
+static void (*threshold_plane_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, const amide_intpoint_t, const amide_intpoint_t, const amide_intpoint_t, const amide_data_t, const amide_data_t, guint8 *, const gint) = {
+  {amitk_data_set_UBYTE_0D_SCALING_threshold_plane, amitk_data_set_UBYTE_1D_SCALING_threshold_plane, amitk_data_set_UBYTE_2D_SCALING_threshold_plane, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_SBYTE_0D_SCALING_threshold_plane, amitk_data_set_SBYTE_1D_SCALING_threshold_plane, amitk_data_set_SBYTE_2D_SCALING_threshold_plane, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_USHORT_0D_SCALING_threshold_plane, amitk_data_set_USHORT_1D_SCALING_threshold_plane, amitk_data_set_USHORT_2D_SCALING_threshold_plane, amitk_data_set_USHORT_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_USHORT_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_USHORT_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_SSHORT_0D_SCALING_threshold_plane, amitk_data_set_SSHORT_1D_SCALING_threshold_plane, amitk_data_set_SSHORT_2D_SCALING_threshold_plane, amitk_data_set_SSHORT_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_SSHORT_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_SSHORT_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_UINT_0D_SCALING_threshold_plane, amitk_data_set_UINT_1D_SCALING_threshold_plane, amitk_data_set_UINT_2D_SCALING_threshold_plane, amitk_data_set_UINT_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_UINT_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_UINT_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_SINT_0D_SCALING_threshold_plane, amitk_data_set_SINT_1D_SCALING_threshold_plane, amitk_data_set_SINT_2D_SCALING_threshold_plane, amitk_data_set_SINT_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_SINT_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_SINT_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_FLOAT_0D_SCALING_threshold_plane, amitk_data_set_FLOAT_1D_SCALING_threshold_plane, amitk_data_set_FLOAT_2D_SCALING_threshold_plane, amitk_data_set_FLOAT_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_FLOAT_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_FLOAT_2D_SCALING_INTERCEPT_threshold_plane},
+  {amitk_data_set_DOUBLE_0D_SCALING_threshold_plane, amitk_data_set_DOUBLE_1D_SCALING_threshold_plane, amitk_data_set_DOUBLE_2D_SCALING_threshold_plane, amitk_data_set_DOUBLE_0D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_DOUBLE_1D_SCALING_INTERCEPT_threshold_plane, amitk_data_set_DOUBLE_2D_SCALING_INTERCEPT_threshold_plane}
+};
 
-  AmitkVoxel i;
-  amide_data_t max, min, temp;
-  amide_data_t slice_max, slice_min;
-  div_t x;
-  gint divider;
-  gint total_planes;
-  gint i_plane;
-  gchar * temp_string;
-  AmitkVoxel dim;
+/* marks the voxels in a plane of the data set whose values fall within [min,max],
+   see amitk_data_set_*_threshold_plane */
+void amitk_data_set_threshold_plane(AmitkDataSet * ds,
+				    const amide_intpoint_t frame,
+				    const amide_intpoint_t gate,
+				    const amide_intpoint_t z,
+				    const amide_data_t min,
+				    const amide_data_t max,
+				    guint8 * mask,
+				    const gint row_stride) {
 
   g_return_if_fail(AMITK_IS_DATA_SET(ds));
-  g_return_if_fail(ds->raw_data != NULL);
+  g_return_if_fail(mask != NULL);
 
-  dim = AMITK_DATA_SET_DIM(ds);
+  (*threshold_plane_func[ds->raw_data->format][ds->scaling_type])(ds, frame, gate, z, 
+								   min, max, mask, row_stride);
+
+  return;
+}
+
+/* (re)allocate the statistics arrays, the plane arrays get reallocated as the 
+   number of planes may have changed */
+static gboolean data_set_alloc_stats(AmitkDataSet * ds) {
 
-  /* allocate the arrays if we haven't already */
   if (ds->frame_max == NULL) {
     ds->frame_max = amitk_data_set_get_frame_min_max_mem(ds);
     ds->frame_min = amitk_data_set_get_frame_min_max_mem(ds);
   }
-  g_return_if_fail(ds->frame_max != NULL);
-  g_return_if_fail(ds->frame_min != NULL);
+  if (ds->frame_stats != NULL) g_free(ds->frame_stats);
+  ds->frame_stats = amitk_data_set_get_frame_stats_mem(ds);
+  if (ds->plane_stats != NULL) g_free(ds->plane_stats);
+  ds->plane_stats = amitk_data_set_get_plane_stats_mem(ds);
 
-  /* note, we can't cancel this */
-  if (update_func != NULL) {
-    temp_string = g_strdup_printf(_("Calculating Max/Min Values for:\n   %s"), 
-				  AMITK_OBJECT_NAME(ds) == NULL ? "dataset" :
-				  AMITK_OBJECT_NAME(ds));
-    (*update_func)(update_data, temp_string, (gdouble) 0.0);
-    g_free(temp_string);
+  if ((ds->frame_max == NULL) || (ds->frame_min == NULL) ||
+      (ds->frame_stats == NULL) || (ds->plane_stats == NULL)) {
+    g_warning(_("couldn't allocate memory space for the data set statistics"));
+    return FALSE;
   }
 
-  total_planes = AMITK_DATA_SET_TOTAL_PLANES(ds);
-  divider = ((total_planes/AMITK_UPDATE_DIVIDER) < 1) ? 1 : (total_planes/AMITK_UPDATE_DIVIDER);
+  return TRUE;
+}
 
-  i_plane=0;
-  for (i.t = 0; i.t < dim.t; i.t++) {
-    i.x = i.y = i.z = i.g = 0;
-    temp = amitk_data_set_get_value(ds,i);
-    if (finite(temp)) max = min = temp;   
-    else max = min = 0.0; /* just throw in zero */
+/* fold the plane statistics into the frames and the frames into the global statistics */
+static void data_set_fold_stats(AmitkDataSet * ds) {
 
-    for (i.g = 0; i.g < dim.g; i.g++) {
-      for (i.z = 0; i.z < dim.z; i.z++, i_plane++) {
-	if (update_func != NULL) {
-	  x = div(i_plane, divider);
-	  if (x.rem == 0) 
-	    (*update_func)(update_data, NULL, ((gdouble) i_plane)/((gdouble)total_planes));
-	}
-	amitk_data_set_slice_calc_min_max(ds, i.t, i.g, i.z, &slice_min, &slice_max);
-	if (finite(slice_min))
-	  if (slice_min < min)
-	    min = slice_min;
-	if (finite(slice_max))
-	  if (slice_max > max)
-	    max = slice_max;
-      }
-    }    
-    ds->frame_max[i.t] = max;
-    ds->frame_min[i.t] = min;
+  AmitkDataStats * plane_stats;
+  AmitkVoxel dim;
+  gint i_frame, i_plane;
+
+  dim = AMITK_DATA_SET_DIM(ds);
+
+  memset(&(ds->global_stats), 0, sizeof(AmitkDataStats));
+  plane_stats = ds->plane_stats;
+  for (i_frame = 0; i_frame < dim.t; i_frame++) {
+    memset(&(ds->frame_stats[i_frame]), 0, sizeof(AmitkDataStats));
+    for (i_plane = 0; i_plane < dim.g*dim.z; i_plane++, plane_stats++)
+      data_stats_merge(&(ds->frame_stats[i_frame]), plane_stats);
+    data_stats_merge(&(ds->global_stats), &(ds->frame_stats[i_frame]));
+
+    ds->frame_max[i_frame] = ds->frame_stats[i_frame].max;
+    ds->frame_min[i_frame] = ds->frame_stats[i_frame].min;
     
 #ifdef AMIDE_DEBUG
     if (dim.z > 1) /* don't print for slices */
-      g_print("\tframe %d max %5.3g frame min %5.3g\n",i.t, ds->frame_max[i.t],ds->frame_min[i.t]);
+      g_print("\tframe %d max %5.3g frame min %5.3g\n",i_frame, ds->frame_max[i_frame],ds->frame_min[i_frame]);
 #endif
   }
 
-  if (update_func != NULL)
-    (*update_func)(update_data, NULL, (gdouble) 2.0); /* remove progress bar */
-
-  /* calc the global max/min */
-  ds->global_max = ds->frame_max[0];
-  ds->global_min = ds->frame_min[0];
-  for (i.t=1; i.t<AMITK_DATA_SET_NUM_FRAMES(ds); i.t++) {
-    if (ds->global_max < ds->frame_max[i.t]) 
-      ds->global_max = ds->frame_max[i.t];
-    if (ds->global_min > ds->frame_min[i.t])
-      ds->global_min = ds->frame_min[i.t];
-  }
+  ds->global_max = ds->global_stats.max;
+  ds->global_min = ds->global_stats.min;
 
   /* note that we've calculated the max and mins */
   ds->min_max_calculated = TRUE;
@@ -3194,15 +3394,163 @@ void amitk_data_set_calc_min_max(AmitkDataSet * ds,
   if (AMITK_DATA_SET_DIM_Z(ds) > 1) /* don't print for slices */
     g_print("\tglobal max %5.3g global min %5.3g\n",ds->global_max,ds->global_min);
 #endif
+
+  return;
+}
+
+/* the per plane statistics are saved as a DOUBLE raw data set, with the fields
+   of each plane's AmitkDataStats along x */
+#define DATA_STATS_NUM_FIELDS 5
+
+static AmitkRawData * data_set_stats_to_raw_data(AmitkDataSet * ds) {
+
+  AmitkRawData * raw_data;
+  AmitkVoxel dim;
+  amide_data_t * fields;
+  AmitkDataStats * stats;
+  gint i_plane;
+
+  dim = AMITK_DATA_SET_DIM(ds);
+  dim.x = DATA_STATS_NUM_FIELDS;
+  dim.y = 1;
+  raw_data = amitk_raw_data_new_with_data(AMITK_FORMAT_DOUBLE, dim);
+  if (raw_data == NULL) return NULL;
+
+  fields = raw_data->data;
+  for (i_plane=0; i_plane < AMITK_DATA_SET_TOTAL_PLANES(ds); i_plane++, fields += DATA_STATS_NUM_FIELDS) {
+    stats = &(ds->plane_stats[i_plane]);
+    fields[0] = stats->min;
+    fields[1] = stats->max;
+    fields[2] = stats->sum;
+    fields[3] = stats->sum_squares;
+    fields[4] = stats->num_finite;
+  }
+
+  return raw_data;
+}
+
+/* returns FALSE if the saved statistics don't fit the data set */
+static gboolean data_set_stats_from_raw_data(AmitkDataSet * ds, AmitkRawData * raw_data) {
+
+  amide_data_t * fields;
+  AmitkDataStats * stats;
+  gint i_plane;
+
+  if ((AMITK_RAW_DATA_FORMAT(raw_data) != AMITK_FORMAT_DOUBLE) ||
+      (AMITK_RAW_DATA_DIM_X(raw_data) != DATA_STATS_NUM_FIELDS) ||
+      (AMITK_RAW_DATA_DIM_Y(raw_data) != 1) ||
+      (AMITK_RAW_DATA_DIM_Z(raw_data) != AMITK_DATA_SET_DIM_Z(ds)) ||
+      (AMITK_RAW_DATA_DIM_G(raw_data) != AMITK_DATA_SET_DIM_G(ds)) ||
+      (AMITK_RAW_DATA_DIM_T(raw_data) != AMITK_DATA_SET_DIM_T(ds)))
+    return FALSE;
+
+  g_rec_mutex_lock(&(ds->stats_mutex));
+  if (!data_set_alloc_stats(ds)) {
+    g_rec_mutex_unlock(&(ds->stats_mutex));
+    return FALSE;
+  }
+
+  fields = raw_data->data;
+  for (i_plane=0; i_plane < AMITK_DATA_SET_TOTAL_PLANES(ds); i_plane++, fields += DATA_STATS_NUM_FIELDS) {
+    stats = &(ds->plane_stats[i_plane]);
+    stats->min = fields[0];
+    stats->max = fields[1];
+    stats->sum = fields[2];
+    stats->sum_squares = fields[3];
+    stats->num_finite = fields[4];
+  }
+
+  data_set_fold_stats(ds);
+  g_rec_mutex_unlock(&(ds->stats_mutex));
+
+  return TRUE;
+}
+
+typedef struct {
+  AmitkUpdateFunc update_func;
+  gpointer update_data;
+} calc_min_max_progress_t;
+
+/* passes the progress along, but ignores any attempt to cancel */
+static gboolean calc_min_max_progress_update(gpointer data, char * message, gdouble fraction) {
+  calc_min_max_progress_t * progress = data;
+  (*progress->update_func)(progress->update_data, message, fraction);
+  return TRUE;
+}
+
+/* function to calculate the max and min, along with the other per plane, per frame, 
+   and global statistics.  This is a single pass over the data, split up by planes 
+   between the worker threads.  Canvas workers can end up here (through thresholding)
+   at the same time as the main thread, so the stats_mutex is held throughout, as 
+   the statistics arrays get reallocated */
+void amitk_data_set_calc_min_max(AmitkDataSet * ds,
+				 AmitkUpdateFunc update_func,
+				 gpointer update_data) {
+
+  gchar * temp_string;
+  calc_min_max_progress_t progress;
+
+  g_return_if_fail(AMITK_IS_DATA_SET(ds));
+  g_return_if_fail(ds->raw_data != NULL);
+
+  g_rec_mutex_lock(&(ds->stats_mutex));
+  if (!data_set_alloc_stats(ds)) {
+    g_rec_mutex_unlock(&(ds->stats_mutex));
+    return;
+  }
+
+  /* note, we can't cancel this */
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Calculating Max/Min Values for:\n   %s"), 
+				  AMITK_OBJECT_NAME(ds) == NULL ? "dataset" :
+				  AMITK_OBJECT_NAME(ds));
+    (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  if (update_func != NULL) {
+    progress.update_func = update_func;
+    progress.update_data = update_data;
+    amitk_parallel_for(AMITK_DATA_SET_TOTAL_PLANES(ds), 1, calc_planes_stats, ds,
+		       calc_min_max_progress_update, &progress);
+  } else {
+    amitk_parallel_for(AMITK_DATA_SET_TOTAL_PLANES(ds), 1, calc_planes_stats, ds, NULL, NULL);
+  }
+
+  if (update_func != NULL)
+    (*update_func)(update_data, NULL, (gdouble) 2.0); /* remove progress bar */
+
+  data_set_fold_stats(ds);
+  g_rec_mutex_unlock(&(ds->stats_mutex));
    
   return;
 }
 
+/* mark the statistics and distribution as out of date, call after changing the 
+   data set's voxel values.  They'll get recalculated as needed. */
+void amitk_data_set_invalidate_stats(AmitkDataSet * ds) {
+
+  g_return_if_fail(AMITK_IS_DATA_SET(ds));
+
+  g_rec_mutex_lock(&(ds->stats_mutex));
+  ds->min_max_calculated = FALSE;
+  g_rec_mutex_unlock(&(ds->stats_mutex));
+  if (ds->distribution != NULL) {
+    g_object_unref(ds->distribution);
+    ds->distribution = NULL;
+  }
+  data_set_drop_pyramid(ds);
+
+  return;
+}
+
 void amitk_data_set_calc_min_max_if_needed(AmitkDataSet * ds,
 					   AmitkUpdateFunc update_func,
 					   gpointer update_data) {
+  g_rec_mutex_lock(&(ds->stats_mutex));
   if (!ds->min_max_calculated)
     amitk_data_set_calc_min_max(ds, update_func, update_data);
+  g_rec_mutex_unlock(&(ds->stats_mutex));
   return;
 }
 
@@ -4029,6 +4377,7 @@ void amitk_data_set_set_value(AmitkDataSet * ds,
   }
 
   if (signal_change) {
+    data_set_drop_pyramid(ds);
     g_signal_emit (G_OBJECT (ds), data_set_signals[INVALIDATE_SLICE_CACHE], 0);
     g_signal_emit (G_OBJECT (ds), data_set_signals[DATA_SET_CHANGED], 0);
   }
@@ -4121,6 +4470,7 @@ void amitk_data_set_set_internal_value(AmitkDataSet * ds,
   }
 
   if (signal_change) {
+    data_set_drop_pyramid(ds);
     g_signal_emit (G_OBJECT (ds), data_set_signals[INVALIDATE_SLICE_CACHE], 0);
     g_signal_emit (G_OBJECT (ds), data_set_signals[DATA_SET_CHANGED], 0);
   }
@@ -4140,59 +4490,374 @@ static AmitkDataSet * (*get_slice_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM]
 };
 
 /* returns a "2D" slice from a data set */
-AmitkDataSet *amitk_data_set_get_slice(AmitkDataSet * ds,
-				       const amide_time_t start,
-				       const amide_time_t duration,
-				       const amide_intpoint_t gate,
-				       const AmitkCanvasPoint pixel_size,
-				       const AmitkVolume * slice_volume) {
+/* notes on the pyramid
+   - each level is a FLOAT data set holding the box filtered (2x2x2 average of
+     the finite voxels) values of the level below it, with all the scaling applied
+   - a level's space is copied from the parent when the level is built, and
+     again whenever the parent's space changes, so moving/rotating a data set
+     doesn't require a rebuild.  The timing and display parameters are synced
+     each time a level is handed out.  Changes to the voxel values, scale
+     factor, or voxel size drop the pyramid.
+   - levels are built outside of the data set's pyramid_mutex, and only get
+     published if the pyramid wasn't dropped (or moved) in the meantime, so
+     dropping the pyramid never has to wait on a build
+   - axes with a dimension of 1 aren't downsampled
+*/
 
-  AmitkDataSet * slice;
+typedef struct {
+  AmitkDataSet * src;
+  AmitkDataSet * level;
+} pyramid_build_t;
 
-  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
-  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+/* build planes [start, end) of a level from the level below it */
+static void pyramid_build_planes(gint start, gint end, gpointer data) {
 
-  /* hand everything off to the data type specific function */
-  slice = (*get_slice_func[ds->raw_data->format][ds->scaling_type])(ds, start, duration, gate, pixel_size, slice_volume);
-  return slice;
+  pyramid_build_t * build = data;
+  AmitkVoxel dim, src_dim;
+  AmitkVoxel i, j;
+  AmitkVoxel step;
+  amide_data_t value, sum;
+  gint count;
+  gint i_plane;
+
+  dim = AMITK_DATA_SET_DIM(build->level);
+  src_dim = AMITK_DATA_SET_DIM(build->src);
+  step.x = (src_dim.x > 1) ? 2 : 1;
+  step.y = (src_dim.y > 1) ? 2 : 1;
+  step.z = (src_dim.z > 1) ? 2 : 1;
+
+  for (i_plane=start; i_plane < end; i_plane++) {
+    i.z = i_plane % dim.z;
+    i.g = (i_plane / dim.z) % dim.g;
+    i.t = i_plane / (dim.z*dim.g);
+    j.g = i.g;
+    j.t = i.t;
+
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++) {
+	sum = 0.0;
+	count = 0;
+	for (j.z = i.z*step.z; j.z < MIN((i.z+1)*step.z, src_dim.z); j.z++)
+	  for (j.y = i.y*step.y; j.y < MIN((i.y+1)*step.y, src_dim.y); j.y++)
+	    for (j.x = i.x*step.x; j.x < MIN((i.x+1)*step.x, src_dim.x); j.x++) {
+	      value = amitk_data_set_get_value(build->src, j);
+	      if (finite(value)) {
+		sum += value;
+		count++;
+	      }
+	    }
+	AMITK_RAW_DATA_FLOAT_SET_CONTENT(build->level->raw_data, i) = (count > 0) ? sum/count : NAN;
+      }
+  }
+
+  return;
 }
 
-/* start_point and end_point should be in the base coordinate frame */
-void  amitk_data_set_get_line_profile(AmitkDataSet * ds,
-				      const amide_time_t start,
-				      const amide_time_t duration,
-				      const AmitkPoint base_start_point,
-				      const AmitkPoint base_end_point,
-				      GPtrArray ** preturn_data) {
+/* make the next level up from src, returns NULL on failure */
+static AmitkDataSet * pyramid_build_level(AmitkDataSet * ds, AmitkDataSet * src) {
 
-  AmitkPoint start_point, end_point;
-  AmitkPoint candidate_point, current_point;
-  AmitkPoint step;
-  AmitkPoint direction;
-  AmitkVoxel current_voxel, last_voxel, candidate_voxel;
-  amide_real_t min_size;
-  amide_real_t length;
-  amide_intpoint_t i_gate;
-  gint start_frame, end_frame;
-  amide_time_t used_start, used_end, used_duration;
-  amide_time_t ds_start, ds_end;
-  amide_data_t value, gate_value, time_weight;
-  AmitkLineProfileDataElement * element;
-  AmitkPoint voxel_point;
-  gdouble m;
+  AmitkDataSet * level;
+  AmitkVoxel dim, src_dim;
+  AmitkPoint voxel_size;
+  pyramid_build_t build;
+
+  src_dim = AMITK_DATA_SET_DIM(src);
+  dim = src_dim;
+  voxel_size = AMITK_DATA_SET_VOXEL_SIZE(src);
+  if (src_dim.x > 1) { dim.x = (src_dim.x+1)/2; voxel_size.x *= 2.0; }
+  if (src_dim.y > 1) { dim.y = (src_dim.y+1)/2; voxel_size.y *= 2.0; }
+  if (src_dim.z > 1) { dim.z = (src_dim.z+1)/2; voxel_size.z *= 2.0; }
+
+  level = amitk_data_set_new_with_data(NULL, AMITK_DATA_SET_MODALITY(ds),
+				       AMITK_FORMAT_FLOAT, dim, AMITK_SCALING_TYPE_0D);
+  if (level == NULL) {
+    g_warning(_("couldn't allocate memory space for the data set pyramid, wanted %dx%dx%dx%dx%d elements"), 
+	      dim.x, dim.y, dim.z, dim.g, dim.t);
+    return NULL;
+  }
+  level->voxel_size = voxel_size;
+  amitk_data_set_calc_far_corner(level);
+  amitk_space_copy_in_place(AMITK_SPACE(level), AMITK_SPACE(ds));
 
-  g_return_if_fail(AMITK_IS_DATA_SET(ds));
+  build.src = src;
+  build.level = level;
+  amitk_parallel_for(AMITK_DATA_SET_TOTAL_PLANES(level), 1, pyramid_build_planes, &build, NULL, NULL);
 
-  *preturn_data = g_ptr_array_new();
-  g_return_if_fail(*preturn_data != NULL);
+  return level;
+}
 
-  /* figure out what frames of this data set to use */
-  used_start = start;
-  start_frame = amitk_data_set_get_frame(ds, used_start);
-  ds_start = amitk_data_set_get_start_time(ds, start_frame);
+/* copy over the timing and display parameters the slicing code looks at from
+   the parent, only writing what's changed as the level may be in use */
+static void pyramid_sync_level(AmitkDataSet * ds, AmitkDataSet * level) {
 
-  used_end = start+duration;
-  end_frame = amitk_data_set_get_frame(ds, used_end);
+  guint i;
+
+  if (level->scan_start != ds->scan_start) level->scan_start = ds->scan_start;
+  for (i=0; i < AMITK_DATA_SET_NUM_FRAMES(ds); i++)
+    if (level->frame_duration[i] != ds->frame_duration[i])
+      level->frame_duration[i] = ds->frame_duration[i];
+  for (i=0; i < AMITK_DATA_SET_NUM_GATES(ds); i++)
+    if (level->gate_time[i] != ds->gate_time[i])
+      level->gate_time[i] = ds->gate_time[i];
+  if (level->interpolation != ds->interpolation) level->interpolation = ds->interpolation;
+  if (level->rendering != ds->rendering) level->rendering = ds->rendering;
+  if (level->thresholding != ds->thresholding) level->thresholding = ds->thresholding;
+  if (level->view_start_gate != ds->view_start_gate) level->view_start_gate = ds->view_start_gate;
+  if (level->view_end_gate != ds->view_end_gate) level->view_end_gate = ds->view_end_gate;
+  if (level->num_view_gates != ds->num_view_gates) level->num_view_gates = ds->num_view_gates;
+
+  return;
+}
+
+static void data_set_drop_pyramid(AmitkDataSet * ds) {
+
+  AmitkDataSet * pyramid[AMITK_DATA_SET_PYRAMID_LEVELS-1];
+  gint i;
+
+  g_mutex_lock(&(ds->pyramid_mutex));
+  for (i=0; i < AMITK_DATA_SET_PYRAMID_LEVELS-1; i++) {
+    pyramid[i] = ds->pyramid[i];
+    ds->pyramid[i] = NULL;
+  }
+  ds->pyramid_epoch++;
+  g_mutex_unlock(&(ds->pyramid_mutex));
+
+  for (i=0; i < AMITK_DATA_SET_PYRAMID_LEVELS-1; i++)
+    if (pyramid[i] != NULL)
+      amitk_object_unref(pyramid[i]);
+
+  return;
+}
+
+/* move the built levels along with the data set */
+static void data_set_sync_pyramid_space(AmitkDataSet * ds) {
+
+  AmitkDataSet * pyramid[AMITK_DATA_SET_PYRAMID_LEVELS-1];
+  gint i;
+
+  /* levels still being built were copied from the old space, keep them out */
+  g_mutex_lock(&(ds->pyramid_mutex));
+  for (i=0; i < AMITK_DATA_SET_PYRAMID_LEVELS-1; i++)
+    pyramid[i] = (ds->pyramid[i] != NULL) ? amitk_object_ref(ds->pyramid[i]) : NULL;
+  ds->pyramid_epoch++;
+  g_mutex_unlock(&(ds->pyramid_mutex));
+
+  for (i=0; i < AMITK_DATA_SET_PYRAMID_LEVELS-1; i++)
+    if (pyramid[i] != NULL) {
+      amitk_space_copy_in_place(AMITK_SPACE(pyramid[i]), AMITK_SPACE(ds));
+      amitk_object_unref(pyramid[i]);
+    }
+
+  return;
+}
+
+/* returns the given level of the data set's resolution pyramid, building it if
+   needed.  Level 0 is the data set itself.  The returned data set should be unref'ed.
+   Values in the levels have the data set's scaling already applied. */
+AmitkDataSet * amitk_data_set_get_pyramid_level(AmitkDataSet * ds, const gint level) {
+
+  AmitkDataSet * levels[AMITK_DATA_SET_PYRAMID_LEVELS-1];
+  AmitkDataSet * level_ds;
+  AmitkDataSet * src;
+  gint epoch;
+  gint i;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+  g_return_val_if_fail((level >= 0) && (level < AMITK_DATA_SET_PYRAMID_LEVELS), NULL);
+
+  if (level == 0) return amitk_object_ref(ds);
+
+  g_mutex_lock(&(ds->pyramid_mutex));
+  for (i=0; i < level; i++)
+    levels[i] = (ds->pyramid[i] != NULL) ? amitk_object_ref(ds->pyramid[i]) : NULL;
+  epoch = ds->pyramid_epoch;
+  g_mutex_unlock(&(ds->pyramid_mutex));
+
+  /* build anything that's missing without holding the lock */
+  src = ds;
+  for (i=0; (i < level) && (src != NULL); i++) {
+    if (levels[i] == NULL)
+      levels[i] = pyramid_build_level(ds, src);
+    src = levels[i];
+  }
+
+  /* and publish what we built, unless it's already out of date */
+  g_mutex_lock(&(ds->pyramid_mutex));
+  if (ds->pyramid_epoch == epoch)
+    for (i=0; i < level; i++)
+      if ((levels[i] != NULL) && (ds->pyramid[i] == NULL))
+	ds->pyramid[i] = amitk_object_ref(levels[i]);
+  g_mutex_unlock(&(ds->pyramid_mutex));
+
+  for (i=0; i < level-1; i++)
+    if (levels[i] != NULL)
+      amitk_object_unref(levels[i]);
+
+  level_ds = levels[level-1];
+  if (level_ds != NULL)
+    pyramid_sync_level(ds, level_ds);
+
+  return level_ds;
+}
+
+/* the coarsest pyramid level whose voxels are still no bigger than the requested 
+   pixels, or than the slice's thickness.  Nearest neighbor interpolation and 
+   MIP/MINIP renderings always use the full resolution data, the first as it's 
+   supposed to show the voxels as they are, the second as averaging would wash 
+   out the extremes */
+gint amitk_data_set_get_pyramid_level_for_slice(const AmitkDataSet * ds,
+						const AmitkCanvasPoint pixel_size,
+						const AmitkVolume * slice_volume) {
+
+  amide_real_t voxel_size;
+  amide_real_t pixel;
+  gint level;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), 0);
+  g_return_val_if_fail(AMITK_IS_VOLUME(slice_volume), 0);
+
+  if (AMITK_DATA_SET_RENDERING(ds) != AMITK_RENDERING_MPR) return 0;
+  if (AMITK_DATA_SET_INTERPOLATION(ds) == AMITK_INTERPOLATION_NEAREST_NEIGHBOR) return 0;
+
+  /* the levels are downsampled along every axis, and the slice can be at any
+     angle to the data set, so the largest voxel dimension has to fit within
+     both the pixel size and the slice thickness */
+  voxel_size = point_max_dim(AMITK_DATA_SET_VOXEL_SIZE(ds));
+  pixel = MIN(pixel_size.x, pixel_size.y);
+  pixel = MIN(pixel, AMITK_VOLUME_Z_CORNER(slice_volume));
+
+  level = 0;
+  while ((level+1 < AMITK_DATA_SET_PYRAMID_LEVELS) && 
+	 ((1 << (level+1))*voxel_size <= pixel*(1.0+EPSILON)))
+    level++;
+
+  return level;
+}
+
+/* full resolution slice of the data set.  This is what exporting, math, and 
+   the like should use */
+AmitkDataSet *amitk_data_set_get_slice(AmitkDataSet * ds,
+				       const amide_time_t start,
+				       const amide_time_t duration,
+				       const amide_intpoint_t gate,
+				       const AmitkCanvasPoint pixel_size,
+				       const AmitkVolume * slice_volume) {
+
+  AmitkDataSet * slice;
+  gint64 trace_start;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+
+  trace_start = AMITK_TRACE_BEGIN();
+  slice = amitk_data_set_get_slice_at_level(ds, start, duration, gate, pixel_size, slice_volume, 0);
+  AMITK_TRACE_END("get_slice", trace_start);
+
+  return slice;
+}
+
+/* slice for putting up on the screen, taken from the coarsest pyramid level
+   that's still fine enough for the requested pixel size and thickness */
+AmitkDataSet *amitk_data_set_get_display_slice(AmitkDataSet * ds,
+					       const amide_time_t start,
+					       const amide_time_t duration,
+					       const amide_intpoint_t gate,
+					       const AmitkCanvasPoint pixel_size,
+					       const AmitkVolume * slice_volume) {
+
+  AmitkDataSet * slice;
+  gint64 trace_start;
+  gint level;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+
+  trace_start = AMITK_TRACE_BEGIN();
+  level = amitk_data_set_get_pyramid_level_for_slice(ds, pixel_size, slice_volume);
+  slice = amitk_data_set_get_slice_at_level(ds, start, duration, gate, pixel_size, slice_volume, level);
+
+  /* slices get shared between threads through the slice cache, so fill in
+     their statistics now rather than lazily (per slice thresholding) */
+  if (slice != NULL)
+    amitk_data_set_calc_min_max(slice, NULL, NULL);
+  AMITK_TRACE_END("get_display_slice", trace_start);
+
+  return slice;
+}
+
+/* same as amitk_data_set_get_slice, but explicitly specifying the pyramid level to use */
+AmitkDataSet *amitk_data_set_get_slice_at_level(AmitkDataSet * ds,
+						const amide_time_t start,
+						const amide_time_t duration,
+						const amide_intpoint_t gate,
+						const AmitkCanvasPoint pixel_size,
+						const AmitkVolume * slice_volume,
+						const gint level) {
+
+  AmitkDataSet * slice;
+  AmitkDataSet * level_ds;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+
+  /* hand everything off to the data type specific function */
+  if (level == 0) 
+    return (*get_slice_func[ds->raw_data->format][ds->scaling_type])(ds, start, duration, gate, pixel_size, slice_volume);
+
+  level_ds = amitk_data_set_get_pyramid_level(ds, level);
+  if (level_ds == NULL) /* fall back to the full resolution data */
+    return (*get_slice_func[ds->raw_data->format][ds->scaling_type])(ds, start, duration, gate, pixel_size, slice_volume);
+
+  slice = (*get_slice_func[level_ds->raw_data->format][level_ds->scaling_type])(level_ds, start, duration, gate, pixel_size, slice_volume);
+  amitk_object_unref(level_ds);
+
+  /* the slice belongs to the data set, not the pyramid level */
+  if ((slice != NULL) && (slice->slice_parent != NULL)) {
+    g_object_remove_weak_pointer(G_OBJECT(slice->slice_parent), (gpointer *) &(slice->slice_parent));
+    slice->slice_parent = ds;
+    g_object_add_weak_pointer(G_OBJECT(ds), (gpointer *) &(slice->slice_parent));
+  }
+
+  return slice;
+}
+
+/* start_point and end_point should be in the base coordinate frame */
+void  amitk_data_set_get_line_profile(AmitkDataSet * ds,
+				      const amide_time_t start,
+				      const amide_time_t duration,
+				      const AmitkPoint base_start_point,
+				      const AmitkPoint base_end_point,
+				      GPtrArray ** preturn_data) {
+
+  AmitkPoint start_point, end_point;
+  AmitkPoint candidate_point, current_point;
+  AmitkPoint step;
+  AmitkPoint direction;
+  AmitkVoxel current_voxel, last_voxel, candidate_voxel;
+  amide_real_t min_size;
+  amide_real_t length;
+  amide_intpoint_t i_gate;
+  gint start_frame, end_frame;
+  amide_time_t used_start, used_end, used_duration;
+  amide_time_t ds_start, ds_end;
+  amide_data_t value, gate_value, time_weight;
+  AmitkLineProfileDataElement * element;
+  AmitkPoint voxel_point;
+  gdouble m;
+
+  g_return_if_fail(AMITK_IS_DATA_SET(ds));
+
+  *preturn_data = g_ptr_array_new();
+  g_return_if_fail(*preturn_data != NULL);
+
+  /* figure out what frames of this data set to use */
+  used_start = start;
+  start_frame = amitk_data_set_get_frame(ds, used_start);
+  ds_start = amitk_data_set_get_start_time(ds, start_frame);
+
+  used_end = start+duration;
+  end_frame = amitk_data_set_get_frame(ds, used_end);
   ds_end = amitk_data_set_get_end_time(ds, end_frame);
 
   if (ds_end < used_end) used_end = ds_end;
@@ -4571,6 +5236,16 @@ AmitkDataSet *amitk_data_set_get_cropped(const AmitkDataSet * ds,
     cropped->frame_min = NULL;
   }
 
+  if (cropped->plane_stats != NULL) {
+    g_free(cropped->plane_stats);
+    cropped->plane_stats = NULL;
+  }
+
+  if (cropped->frame_stats != NULL) {
+    g_free(cropped->frame_stats);
+    cropped->frame_stats = NULL;
+  }
+
   /* set a new name for this guy */
   temp_string = g_strdup_printf(_("%s, cropped"), AMITK_OBJECT_NAME(ds));
   amitk_object_set_name(AMITK_OBJECT(cropped), temp_string);
@@ -4871,201 +5546,792 @@ error:
 }
 
 
-#ifdef AMIDE_LIBGSL_SUPPORT
+/* notes on the gaussian filter
+   - the gaussian is separable, so it's applied as three 1D passes (x, y, then z),
+     each pass being farmed out over the planes (or rows for z) with amitk_parallel_for
+   - lines are gathered into a double buffer with the filtering direction as the
+     slow index, so the inner loops run over many lines at once and vectorize
+   - with a kernel size given, the kernel is the truncated (and renormalized)
+     gaussian, zero padded at the edges the same as the old FFT based filter
+   - with a kernel size of 0, the recursive gaussian (Young/van Vliet) is used,
+     which costs the same no matter the fwhm.  The causal pass is run out past the
+     edge of the data by a few sigma of zeros, so the edges match the zero padded FIR.
+     Directions with a small sigma (in voxels) use a short FIR kernel.
+*/
+
+typedef struct {
+  gint kernel_size; /* 0 for recursive */
+  amide_real_t * kernel;
+  amide_real_t coefs[4];
+  gint pad; /* zeros past the end for the recursive filter */
+} filter_line_t;
+
+typedef struct {
+  const AmitkDataSet * data_set;
+  AmitkDataSet * filtered_ds;
+  filter_line_t line;
+  gint error; /* atomic */
+} filter_gaussian_t;
+
+typedef struct {
+  AmitkUpdateFunc update_func;
+  gpointer update_data;
+  gdouble offset;
+  gdouble fraction;
+} filter_progress_t;
+
+/* maps the progress of a single pass onto the progress of the whole filter */
+static gboolean filter_progress_update(gpointer data, char * message, gdouble fraction) {
+  filter_progress_t * progress = data;
+  return (*progress->update_func)(progress->update_data, message, 
+				  progress->offset + progress->fraction*fraction);
+}
+
+/* figure out the filtering for one direction, returns FALSE on failure */
+static gboolean filter_line_init(filter_line_t * line, const gint kernel_size,
+				 const amide_real_t voxel_size, const amide_real_t fwhm) {
+
+  amide_real_t sigma; /* in voxels */
+
+  sigma = (fwhm/SIGMA_TO_FWHM)/voxel_size;
+  line->kernel = NULL;
+  line->pad = 0;
+
+  if (kernel_size > 0) 
+    line->kernel_size = kernel_size;
+  else if (sigma < AMITK_FILTER_RECURSIVE_MIN_SIGMA)
+    line->kernel_size = 2*ceil(3.0*sigma)+1;
+  else
+    line->kernel_size = 0;
+
+  if (line->kernel_size > 0) {
+    line->kernel = amitk_filter_calculate_gaussian_kernel_1D(line->kernel_size, voxel_size, fwhm);
+    if (line->kernel == NULL) return FALSE;
+  } else {
+    amitk_filter_calculate_recursive_gaussian_coefs(sigma, line->coefs);
+    line->pad = ceil(4.0*sigma);
+  }
+
+  return TRUE;
+}
+
+/* filter the buffer along its slow direction, in place.  The buffer holds
+   width lines of the given length, interleaved.  temp needs to be
+   (length+kernel_size)*width or (length+pad)*width elements */
+static void filter_lines(const filter_line_t * line, amide_real_t * buffer, amide_real_t * temp,
+			 const gint length, const gint width) {
+
+  amide_real_t * in;
+  amide_real_t * out;
+  amide_real_t * prev1, * prev2, * prev3;
+  amide_real_t k;
+  gint half;
+  gint i, j, x;
+  gint total;
+
+  if (line->kernel_size == 1) return; /* nothing to do */
+
+  if (line->kernel_size > 0) { /* FIR */
+    half = line->kernel_size >> 1;
+    total = length+line->kernel_size-1;
+
+    /* zero padded copy */
+    for (i=0; i < half*width; i++) temp[i] = 0.0;
+    for (i=0; i < length*width; i++) temp[half*width+i] = buffer[i];
+    for (i=(half+length)*width; i < total*width; i++) temp[i] = 0.0;
+
+    for (i=0; i < length; i++) {
+      out = buffer+i*width;
+      for (x=0; x < width; x++) out[x] = 0.0;
+      for (j=0; j < line->kernel_size; j++) {
+	k = line->kernel[j];
+	in = temp+(i+j)*width;
+	for (x=0; x < width; x++)
+	  out[x] += k*in[x];
+      }
+    }
+
+  } else { /* recursive */
+    total = length+line->pad;
+
+    /* causal pass, zeros before the start and past the end */
+    for (i=0; i < total; i++) {
+      out = temp+i*width;
+      if (i < length) {
+	in = buffer+i*width;
+	for (x=0; x < width; x++) out[x] = line->coefs[0]*in[x];
+      } else {
+	for (x=0; x < width; x++) out[x] = 0.0;
+      }
+      for (j=1; (j <= 3) && (j <= i); j++) {
+	k = line->coefs[j];
+	in = temp+(i-j)*width;
+	for (x=0; x < width; x++)
+	  out[x] += k*in[x];
+      }
+    }
+
+    /* anti-causal pass, in place */
+    for (i=total-1; i >= 0; i--) {
+      out = temp+i*width;
+      prev1 = (i+1 < total) ? temp+(i+1)*width : NULL;
+      prev2 = (i+2 < total) ? temp+(i+2)*width : NULL;
+      prev3 = (i+3 < total) ? temp+(i+3)*width : NULL;
+      for (x=0; x < width; x++) out[x] *= line->coefs[0];
+      if (prev1 != NULL) for (x=0; x < width; x++) out[x] += line->coefs[1]*prev1[x];
+      if (prev2 != NULL) for (x=0; x < width; x++) out[x] += line->coefs[2]*prev2[x];
+      if (prev3 != NULL) for (x=0; x < width; x++) out[x] += line->coefs[3]*prev3[x];
+    }
+
+    for (i=0; i < length*width; i++) buffer[i] = temp[i];
+  }
+
+  return;
+}
+
+/* size of the temp buffer filter_lines needs */
+static gint filter_lines_temp_size(const filter_line_t * line, const gint length, const gint width) {
+  return (length + MAX(line->kernel_size, line->pad))*width;
+}
+
+/* copy over the data into filtered_ds for planes [start, end) */
+static void filter_gaussian_copy(gint start, gint end, gpointer data) {
+
+  filter_gaussian_t * filter = data;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  gint i_plane;
+
+  dim = AMITK_DATA_SET_DIM(filter->filtered_ds);
+  for (i_plane=start; i_plane < end; i_plane++) {
+    i.z = i_plane % dim.z;
+    i.g = (i_plane / dim.z) % dim.g;
+    i.t = i_plane / (dim.z*dim.g);
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	AMITK_RAW_DATA_FLOAT_SET_CONTENT(filter->filtered_ds->raw_data, i) = 
+	  amitk_data_set_get_internal_value(filter->data_set, i);
+  }
+
+  return;
+}
+
+/* filter along x for planes [start, end), each plane is transposed into the buffer */
+static void filter_gaussian_x(gint start, gint end, gpointer data) {
+
+  filter_gaussian_t * filter = data;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  amide_real_t * buffer;
+  amide_real_t * temp;
+  gint i_plane;
+
+  dim = AMITK_DATA_SET_DIM(filter->filtered_ds);
+  buffer = g_try_new(amide_real_t, dim.x*dim.y);
+  temp = g_try_new(amide_real_t, filter_lines_temp_size(&filter->line, dim.x, dim.y));
+  if ((buffer == NULL) || (temp == NULL)) {
+    g_atomic_int_set(&filter->error, TRUE);
+    goto exit_strategy;
+  }
+
+  for (i_plane=start; i_plane < end; i_plane++) {
+    i.z = i_plane % dim.z;
+    i.g = (i_plane / dim.z) % dim.g;
+    i.t = i_plane / (dim.z*dim.g);
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	buffer[i.x*dim.y+i.y] = AMITK_RAW_DATA_FLOAT_CONTENT(filter->filtered_ds->raw_data, i);
+    filter_lines(&filter->line, buffer, temp, dim.x, dim.y);
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	AMITK_RAW_DATA_FLOAT_SET_CONTENT(filter->filtered_ds->raw_data, i) = buffer[i.x*dim.y+i.y];
+  }
+
+ exit_strategy:
+  g_free(buffer);
+  g_free(temp);
+
+  return;
+}
+
+/* filter along y for planes [start, end) */
+static void filter_gaussian_y(gint start, gint end, gpointer data) {
+
+  filter_gaussian_t * filter = data;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  amide_real_t * buffer;
+  amide_real_t * temp;
+  gint i_plane;
+
+  dim = AMITK_DATA_SET_DIM(filter->filtered_ds);
+  buffer = g_try_new(amide_real_t, dim.x*dim.y);
+  temp = g_try_new(amide_real_t, filter_lines_temp_size(&filter->line, dim.y, dim.x));
+  if ((buffer == NULL) || (temp == NULL)) {
+    g_atomic_int_set(&filter->error, TRUE);
+    goto exit_strategy;
+  }
+
+  for (i_plane=start; i_plane < end; i_plane++) {
+    i.z = i_plane % dim.z;
+    i.g = (i_plane / dim.z) % dim.g;
+    i.t = i_plane / (dim.z*dim.g);
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	buffer[i.y*dim.x+i.x] = AMITK_RAW_DATA_FLOAT_CONTENT(filter->filtered_ds->raw_data, i);
+    filter_lines(&filter->line, buffer, temp, dim.y, dim.x);
+    for (i.y=0; i.y < dim.y; i.y++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	AMITK_RAW_DATA_FLOAT_SET_CONTENT(filter->filtered_ds->raw_data, i) = buffer[i.y*dim.x+i.x];
+  }
+
+ exit_strategy:
+  g_free(buffer);
+  g_free(temp);
+
+  return;
+}
+
+/* filter along z for the (frame, gate, row) sets [start, end) */
+static void filter_gaussian_z(gint start, gint end, gpointer data) {
+
+  filter_gaussian_t * filter = data;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  amide_real_t * buffer;
+  amide_real_t * temp;
+  gint i_row;
+
+  dim = AMITK_DATA_SET_DIM(filter->filtered_ds);
+  buffer = g_try_new(amide_real_t, dim.x*dim.z);
+  temp = g_try_new(amide_real_t, filter_lines_temp_size(&filter->line, dim.z, dim.x));
+  if ((buffer == NULL) || (temp == NULL)) {
+    g_atomic_int_set(&filter->error, TRUE);
+    goto exit_strategy;
+  }
+
+  for (i_row=start; i_row < end; i_row++) {
+    i.y = i_row % dim.y;
+    i.g = (i_row / dim.y) % dim.g;
+    i.t = i_row / (dim.y*dim.g);
+    for (i.z=0; i.z < dim.z; i.z++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	buffer[i.z*dim.x+i.x] = AMITK_RAW_DATA_FLOAT_CONTENT(filter->filtered_ds->raw_data, i);
+    filter_lines(&filter->line, buffer, temp, dim.z, dim.x);
+    for (i.z=0; i.z < dim.z; i.z++)
+      for (i.x=0; i.x < dim.x; i.x++)
+	AMITK_RAW_DATA_FLOAT_SET_CONTENT(filter->filtered_ds->raw_data, i) = buffer[i.z*dim.x+i.x];
+  }
+
+ exit_strategy:
+  g_free(buffer);
+  g_free(temp);
 
+  return;
+}
 
-/* fills the data set "filtered_ds", with the results of the kernel convolved to data_set */
+/* fills the data set "filtered_ds", with the results of the gaussian filtering of data_set */
 /* assumptions:
    1- filtered_ds is of type FLOAT, 0D scaling
    2- scale of filtered_ds is 1.0
-   3- kernel is of type DOUBLE, is in complex packed format, and has odd dimensions in x,y,z,
-      and dimension 1 in t
+   3- kernel_size is odd, or 0 for the recursive filter
 
    notes:
-   1. kernel is modified (FFT'd) 
-   2. don't have a separate function for each data type, as getting the data_set data,
+   1. don't have a separate function for each data type, as getting the data_set data,
    is a tiny fraction of the computational time, use amitk_data_set_get_internal_value instead
  */
-static gboolean filter_fir(const AmitkDataSet * data_set,
-			   AmitkDataSet * filtered_ds,
-			   AmitkRawData * kernel,
-			   AmitkVoxel kernel_size,
-			   AmitkUpdateFunc update_func, 
-			   gpointer update_data) {
+static gboolean filter_gaussian(const AmitkDataSet * data_set,
+				AmitkDataSet * filtered_ds,
+				const gint kernel_size,
+				const amide_real_t fwhm,
+				AmitkUpdateFunc update_func, 
+				gpointer update_data) {
   
-  AmitkVoxel subset_size;
-  AmitkVoxel i_outer;
-  AmitkVoxel i_inner;
-  AmitkVoxel j_inner;
-  AmitkVoxel half;
+  filter_gaussian_t filter;
+  filter_progress_t progress;
   AmitkVoxel ds_dim;
-  AmitkRawData * subset=NULL;
-  gsl_fft_complex_wavetable * wavetable=NULL;
-  gsl_fft_complex_workspace * workspace = NULL;
+  AmitkAxis i_axis;
   gchar * temp_string;
-  gint image_num;
-  gint total_planes;
   gboolean continue_work=TRUE;
+  AmitkParallelFunc pass_func;
+  amide_real_t voxel_size;
+  gint num_items;
 
-  g_return_val_if_fail(kernel_size.t == 1, FALSE);
-  g_return_val_if_fail(kernel_size.g == 1, FALSE);
-  g_return_val_if_fail((kernel_size.z & 0x1), FALSE); /* needs to be odd */
-  g_return_val_if_fail((kernel_size.y & 0x1), FALSE); 
-  g_return_val_if_fail((kernel_size.x & 0x1), FALSE); 
-  g_return_val_if_fail(2*kernel_size.z < AMITK_FILTER_FFT_SIZE, FALSE);
-  g_return_val_if_fail(2*kernel_size.y < AMITK_FILTER_FFT_SIZE, FALSE);
-  g_return_val_if_fail(2*kernel_size.x < AMITK_FILTER_FFT_SIZE, FALSE);
+  g_return_val_if_fail((kernel_size == 0) || (kernel_size & 0x1), FALSE); /* needs to be odd */
 
   ds_dim = AMITK_DATA_SET_DIM(data_set);
+  filter.data_set = data_set;
+  filter.filtered_ds = filtered_ds;
+  filter.error = FALSE;
 
-  /* initialize gsl's FFT stuff */
-  wavetable = gsl_fft_complex_wavetable_alloc(AMITK_FILTER_FFT_SIZE);
-  workspace = gsl_fft_complex_workspace_alloc (AMITK_FILTER_FFT_SIZE);
-  if ((wavetable == NULL) || (workspace == NULL)) {
-    g_warning(_("Filtering: Failed to allocate wavetable and workspace"));
-    continue_work=FALSE;
-    goto exit_strategy;
+  progress.update_func = update_func;
+  progress.update_data = update_data;
+  progress.fraction = 1.0/(AMITK_AXIS_NUM+1);
+  progress.offset = 0.0;
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
   }
 
-  /* get space for our data subset*/
-  if ((subset = amitk_raw_data_new()) == NULL) {
-    g_warning(_("couldn't allocate memory space for the subset structure"));
-    continue_work=FALSE;
-    goto exit_strategy;
+  if (continue_work)
+    continue_work = amitk_parallel_for(AMITK_DATA_SET_TOTAL_PLANES(filtered_ds), 1, 
+				       filter_gaussian_copy, &filter,
+				       (update_func != NULL) ? filter_progress_update : NULL, &progress);
+
+  for (i_axis=0; (i_axis < AMITK_AXIS_NUM) && continue_work; i_axis++) {
+    progress.offset += progress.fraction;
+
+    switch(i_axis) {
+    case AMITK_AXIS_X:
+      voxel_size = AMITK_DATA_SET_VOXEL_SIZE_X(data_set);
+      pass_func = filter_gaussian_x;
+      num_items = AMITK_DATA_SET_TOTAL_PLANES(filtered_ds);
+      break;
+    case AMITK_AXIS_Y:
+      voxel_size = AMITK_DATA_SET_VOXEL_SIZE_Y(data_set);
+      pass_func = filter_gaussian_y;
+      num_items = AMITK_DATA_SET_TOTAL_PLANES(filtered_ds);
+      break;
+    case AMITK_AXIS_Z:
+    default:
+      voxel_size = AMITK_DATA_SET_VOXEL_SIZE_Z(data_set);
+      pass_func = filter_gaussian_z;
+      num_items = ds_dim.y*ds_dim.g*ds_dim.t;
+      break;
+    }
+
+    if (!filter_line_init(&filter.line, kernel_size, voxel_size, fwhm)) {
+      continue_work = FALSE;
+      break;
+    }
+
+    continue_work = amitk_parallel_for(num_items, 1, pass_func, &filter,
+				       (update_func != NULL) ? filter_progress_update : NULL, &progress);
+    g_free(filter.line.kernel);
+
+    if (g_atomic_int_get(&filter.error)) {
+      g_warning(_("Couldn't allocate memory space for the filtering buffers"));
+      continue_work = FALSE;
+    }
   }
-  subset->format = AMITK_FORMAT_DOUBLE;
-  subset->dim.t = subset->dim.g = 1;
-  subset->dim.z = subset->dim.y = AMITK_FILTER_FFT_SIZE;
-  subset->dim.x = 2*AMITK_FILTER_FFT_SIZE; /* real and complex parts */
 
-  subset_size.t = subset_size.g = 1;
-  subset_size.z = AMITK_FILTER_FFT_SIZE-kernel_size.z+1;
-  subset_size.y = AMITK_FILTER_FFT_SIZE-kernel_size.y+1;
-  subset_size.x = AMITK_FILTER_FFT_SIZE-kernel_size.x+1;
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
+  return continue_work;
+}
 
-  half.t = half.g = 0;
-  half.z = kernel_size.z>>1;
-  half.y = kernel_size.y>>1;
-  half.x = kernel_size.x>>1;
 
-  if ((subset->data = amitk_raw_data_get_data_mem(subset)) == NULL) {
-    g_warning(_("Couldn't allocate memory space for the subset data"));
-    continue_work=FALSE;
-    goto exit_strategy;
+/* notes on the median filter
+   - the window slides along x, so each step only removes the column of voxels
+     leaving the window and adds the column entering it
+   - for 8 and 16 bit integer data with a scaling that's constant over the frame,
+     the window is kept as a histogram of the raw values (Huang's algorithm), with
+     a coarse histogram on top so the median can jump a block of bins at a time
+     (Perreault and Hebert).  Bins are ordered by their scaled value, with an
+     extra bin for the zeros past the edge of the data set
+   - everything else keeps the window as a sorted array, merging in the entering
+     column and dropping the leaving one in a single pass.  Each column is only
+     sorted once, the sorted columns of the window are kept around so the leaving
+     one doesn't have to be regathered.  The merge is still linear in the window
+     size, so this is O(k^3) per voxel for a k^3 kernel, versus O(k^2) for the
+     histogram
+   - voxels past the edge count as zeros, as do non-finite voxels
+   - planes are farmed out with amitk_parallel_for.  When filtering in place
+     (data_set == filtered_ds), frames are done one at a time into a buffer
+*/
+#define MEDIAN_BLOCK_SHIFT 8
+#define MEDIAN_BLOCK_SIZE (1 << MEDIAN_BLOCK_SHIFT)
+#define MEDIAN_COLUMN_SLOT(filter, x) ((((x) % (filter)->kernel_dim.x) + (filter)->kernel_dim.x) % (filter)->kernel_dim.x)
+
+typedef struct {
+  const AmitkDataSet * data_set;
+  AmitkRawData * output;
+  gboolean output_is_frame; /* output is a single frame/gate buffer */
+  gint first_plane;
+  AmitkVoxel kernel_dim;
+  AmitkVoxel mid_dim;
+  gint error; /* atomic */
+} filter_median_t;
+
+/* sliding histogram state */
+typedef struct {
+  gint * bin_of_raw; /* raw value - raw_min -> bin */
+  amide_data_t * value_of_bin;
+  gint * fine;
+  gint * coarse;
+  gint pad_bin;
+  gint raw_min;
+  gint median_bin;
+  gint below; /* number of entries in bins below median_bin */
+  gint median_rank;
+} median_histogram_t;
+
+/* can we use the histogram version on this data set */
+static gboolean median_histogram_usable(const AmitkDataSet * ds) {
+
+  switch(AMITK_RAW_DATA_FORMAT(AMITK_DATA_SET_RAW_DATA(ds))) {
+  case AMITK_FORMAT_UBYTE:
+  case AMITK_FORMAT_SBYTE:
+  case AMITK_FORMAT_USHORT:
+  case AMITK_FORMAT_SSHORT:
+    break;
+  default:
+    return FALSE;
   }
 
-  /* FFT the kernel */
-  amitk_filter_3D_FFT(kernel, wavetable, workspace);
+  switch(AMITK_DATA_SET_SCALING_TYPE(ds)) {
+  case AMITK_SCALING_TYPE_2D:
+  case AMITK_SCALING_TYPE_2D_WITH_INTERCEPT:
+    return FALSE; /* scaling can change between the planes in the window */
+  default:
+    return TRUE;
+  }
+}
 
-  if (update_func != NULL) {
-    temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
-    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
-    g_free(temp_string);
+static void median_format_range(const AmitkFormat format, gint * pmin, gint * pmax) {
+  switch(format) {
+  case AMITK_FORMAT_UBYTE:  *pmin = 0;      *pmax = G_MAXUINT8;  break;
+  case AMITK_FORMAT_SBYTE:  *pmin = G_MININT8;  *pmax = G_MAXINT8;  break;
+  case AMITK_FORMAT_USHORT: *pmin = 0;      *pmax = G_MAXUINT16; break;
+  case AMITK_FORMAT_SSHORT: 
+  default:                  *pmin = G_MININT16; *pmax = G_MAXINT16; break;
   }
-  total_planes = ds_dim.z*ds_dim.t*ds_dim.g;
+}
 
-  /* start the overlap and add FFT method */
-  i_outer.t = i_inner.t = j_inner.t = 0;
-  i_outer.g = i_inner.g = j_inner.g = 0;
-  for (i_outer.t = 0; (i_outer.t < ds_dim.t) && continue_work; i_outer.t++) {
-    for (i_outer.g = 0; (i_outer.g < ds_dim.g) && continue_work; i_outer.g++) {
-#if AMIDE_DEBUG
-      g_print("Filtering Frame %d/Gate %d\n", i_outer.t, i_outer.g);
-#endif
-      for (i_outer.z = 0; (i_outer.z < ds_dim.z) && continue_work; i_outer.z+= subset_size.z) {
+static gint median_raw_value(const AmitkRawData * raw_data, const AmitkVoxel i) {
+  switch(AMITK_RAW_DATA_FORMAT(raw_data)) {
+  case AMITK_FORMAT_UBYTE:  return AMITK_RAW_DATA_UBYTE_CONTENT(raw_data, i);
+  case AMITK_FORMAT_SBYTE:  return AMITK_RAW_DATA_SBYTE_CONTENT(raw_data, i);
+  case AMITK_FORMAT_USHORT: return AMITK_RAW_DATA_USHORT_CONTENT(raw_data, i);
+  case AMITK_FORMAT_SSHORT: 
+  default:                  return AMITK_RAW_DATA_SSHORT_CONTENT(raw_data, i);
+  }
+}
 
-	if (update_func != NULL) {
-	  image_num = i_outer.z+i_outer.t*ds_dim.z+i_outer.g*ds_dim.z*ds_dim.t;
-	  continue_work = (*update_func)(update_data, NULL, ((gdouble) image_num)/((gdouble) total_planes));
-	}
+static void median_histogram_free(median_histogram_t * hist) {
+  g_free(hist->bin_of_raw);
+  g_free(hist->value_of_bin);
+  g_free(hist->fine);
+  g_free(hist->coarse);
+  return;
+}
 
-	for (i_outer.y = 0; i_outer.y < ds_dim.y; i_outer.y+= subset_size.y) {
-	  for (i_outer.x = 0; i_outer.x < ds_dim.x; i_outer.x+= subset_size.x) {
-  
-	    /* initialize the subset */
-	    for (j_inner.z = 0; j_inner.z < subset->dim.z; j_inner.z++) 
-	      for (j_inner.y = 0; j_inner.y < subset->dim.y; j_inner.y++) 
-		for (j_inner.x = 0; j_inner.x < subset->dim.x; j_inner.x++) 
-		  AMITK_RAW_DATA_DOUBLE_SET_CONTENT(subset, j_inner) = 0.0;
-	  
-	    /* copy data over from the actual data set */
-	    for (i_inner.z = 0, j_inner.z=0; 
-		 ((i_inner.z < subset_size.z) && (i_inner.z+i_outer.z) < ds_dim.z);
-		 i_inner.z++, j_inner.z++) 
-	      for (i_inner.y = 0, j_inner.y=0; 
-		   ((i_inner.y < subset_size.y) && (i_inner.y+i_outer.y) < ds_dim.y);
-		   i_inner.y++, j_inner.y++) 
-		for (i_inner.x = 0, j_inner.x=0; 
-		     ((i_inner.x < subset_size.x) && (i_inner.x+i_outer.x) < ds_dim.x);
-		     i_inner.x++, j_inner.x+=2) 
-		  AMITK_RAW_DATA_DOUBLE_SET_CONTENT(subset, j_inner) = 
-		    amitk_data_set_get_internal_value(data_set, voxel_add(i_outer, i_inner)); /* should be zero for out of range */
-	  
-	  
-	    /* FFT the data */
-	    amitk_filter_3D_FFT(subset, wavetable, workspace);
-	  
-	    /* multiple the data by the filter */
-	    amitk_filter_complex_mult(subset, kernel);
-	  
-	    /* and inverse FFT */
-	    amitk_filter_inverse_3D_FFT(subset, wavetable, workspace);
-	  
-	    /* and add in, at the same time we're shifting the data set over by half the
-	       kernel size */
-	    for (((i_inner.z = (i_outer.z == 0) ? 0 : -half.z),
-		  (j_inner.z = (i_outer.z == 0) ? half.z : 0)); 
-		 ((j_inner.z < AMITK_FILTER_FFT_SIZE) && 
-		  ((i_inner.z+i_outer.z) < AMITK_DATA_SET_DIM_Z(filtered_ds))); 
-		 i_inner.z++, j_inner.z++)
-	      for (((i_inner.y = (i_outer.y == 0) ? 0 : -half.y),
-		    (j_inner.y = (i_outer.y == 0) ? half.y : 0)); 
-		   ((j_inner.y < AMITK_FILTER_FFT_SIZE) && ((i_inner.y+i_outer.y) < AMITK_DATA_SET_DIM_Y(filtered_ds))); 
-		   i_inner.y++, j_inner.y++) 
-		for (((i_inner.x = (i_outer.x == 0) ? 0 : -half.x),
-		      (j_inner.x = (i_outer.x == 0) ? 2*half.x : 0)); 
-		     ((j_inner.x < 2*AMITK_FILTER_FFT_SIZE) && ((i_inner.x+i_outer.x) < AMITK_DATA_SET_DIM_X(filtered_ds))); 
-		     i_inner.x++, j_inner.x+=2) 
-		  AMITK_RAW_DATA_FLOAT_SET_CONTENT(filtered_ds->raw_data, voxel_add(i_outer,i_inner)) +=
-		    AMITK_RAW_DATA_DOUBLE_CONTENT(subset, j_inner);
+static gboolean median_histogram_alloc(median_histogram_t * hist, const AmitkFormat format) {
 
+  gint raw_min, raw_max;
+  gint num_bins;
 
-	  }
-	}
+  median_format_range(format, &raw_min, &raw_max);
+  num_bins = (raw_max-raw_min+2 + MEDIAN_BLOCK_SIZE-1) & ~(MEDIAN_BLOCK_SIZE-1);
+
+  hist->raw_min = raw_min;
+  hist->bin_of_raw = g_try_new(gint, raw_max-raw_min+1);
+  hist->value_of_bin = g_try_new(amide_data_t, num_bins);
+  hist->fine = g_try_new0(gint, num_bins);
+  hist->coarse = g_try_new0(gint, num_bins >> MEDIAN_BLOCK_SHIFT);
+  hist->median_bin = 0;
+  hist->below = 0;
+
+  if ((hist->bin_of_raw == NULL) || (hist->value_of_bin == NULL) || 
+      (hist->fine == NULL) || (hist->coarse == NULL)) {
+    median_histogram_free(hist);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* order the bins by the scaled value for the given frame/gate */
+static void median_histogram_set_scaling(median_histogram_t * hist, const AmitkFormat format,
+					 const amide_data_t factor, const amide_data_t intercept) {
+
+  gint raw_min, raw_max;
+  gint raw, i_raw, bin;
+  amide_data_t value;
+
+  median_format_range(format, &raw_min, &raw_max);
+
+  hist->pad_bin = -1;
+  for (i_raw=0, bin=0; i_raw <= raw_max-raw_min; i_raw++) {
+    raw = (factor >= 0.0) ? raw_min+i_raw : raw_max-i_raw;
+    value = factor*(((amide_data_t) raw) + intercept);
+    if ((hist->pad_bin < 0) && (value > 0.0)) {
+      hist->pad_bin = bin;
+      hist->value_of_bin[bin++] = 0.0;
+    }
+    hist->bin_of_raw[raw-raw_min] = bin;
+    hist->value_of_bin[bin++] = value;
+  }
+  if (hist->pad_bin < 0) {
+    hist->pad_bin = bin;
+    hist->value_of_bin[bin] = 0.0;
+  }
+
+  return;
+}
+
+static inline void median_histogram_add(median_histogram_t * hist, const gint bin, const gint count) {
+  hist->fine[bin] += count;
+  hist->coarse[bin >> MEDIAN_BLOCK_SHIFT] += count;
+  if (bin < hist->median_bin) hist->below += count;
+}
+
+/* move the median bin to where it now belongs */
+static amide_data_t median_histogram_median(median_histogram_t * hist) {
+
+  gint m = hist->median_rank;
+
+  while (hist->below > m) {
+    if (((hist->median_bin & (MEDIAN_BLOCK_SIZE-1)) == 0) && 
+	(hist->below - hist->coarse[(hist->median_bin >> MEDIAN_BLOCK_SHIFT)-1] > m)) {
+      hist->median_bin -= MEDIAN_BLOCK_SIZE;
+      hist->below -= hist->coarse[hist->median_bin >> MEDIAN_BLOCK_SHIFT];
+    } else {
+      hist->median_bin--;
+      hist->below -= hist->fine[hist->median_bin];
+    }
+  }
+
+  while (hist->below + hist->fine[hist->median_bin] <= m) {
+    if (((hist->median_bin & (MEDIAN_BLOCK_SIZE-1)) == 0) && 
+	(hist->below + hist->coarse[hist->median_bin >> MEDIAN_BLOCK_SHIFT] <= m)) {
+      hist->below += hist->coarse[hist->median_bin >> MEDIAN_BLOCK_SHIFT];
+      hist->median_bin += MEDIAN_BLOCK_SIZE;
+    } else {
+      hist->below += hist->fine[hist->median_bin];
+      hist->median_bin++;
+    }
+  }
+
+  return hist->value_of_bin[hist->median_bin];
+}
+
+/* add (count=1) or remove (count=-1) the column of voxels at x from the window
+   centered at i */
+static void median_histogram_column(median_histogram_t * hist, const filter_median_t * filter,
+				    const AmitkVoxel i, const gint x, const gint count) {
+
+  AmitkVoxel j;
+  AmitkVoxel dim;
+  const AmitkRawData * raw_data = AMITK_DATA_SET_RAW_DATA(filter->data_set);
+
+  dim = AMITK_DATA_SET_DIM(filter->data_set);
+  if ((x < 0) || (x >= dim.x)) {
+    median_histogram_add(hist, hist->pad_bin, count*filter->kernel_dim.z*filter->kernel_dim.y);
+    return;
+  }
+
+  j.t = i.t;
+  j.g = i.g;
+  j.x = x;
+  for (j.z = i.z-filter->mid_dim.z; j.z <= i.z+filter->mid_dim.z; j.z++)
+    for (j.y = i.y-filter->mid_dim.y; j.y <= i.y+filter->mid_dim.y; j.y++) 
+      if ((j.z < 0) || (j.z >= dim.z) || (j.y < 0) || (j.y >= dim.y))
+	median_histogram_add(hist, hist->pad_bin, count);
+      else
+	median_histogram_add(hist, hist->bin_of_raw[median_raw_value(raw_data, j)-hist->raw_min], count);
+
+  return;
+}
+
+/* get the values of the column of voxels at x from the window centered at i, sorted */
+static void median_sorted_column(const filter_median_t * filter, const AmitkVoxel i, 
+				 const gint x, amide_data_t * column) {
+
+  AmitkVoxel j;
+  AmitkVoxel dim;
+  amide_data_t value;
+  gint loc, k;
+
+  dim = AMITK_DATA_SET_DIM(filter->data_set);
+  j.t = i.t;
+  j.g = i.g;
+  j.x = x;
+  loc = 0;
+  for (j.z = i.z-filter->mid_dim.z; j.z <= i.z+filter->mid_dim.z; j.z++)
+    for (j.y = i.y-filter->mid_dim.y; j.y <= i.y+filter->mid_dim.y; j.y++) {
+      if ((x < 0) || (x >= dim.x) || (j.z < 0) || (j.z >= dim.z) || (j.y < 0) || (j.y >= dim.y))
+	value = 0.0;
+      else {
+	value = amitk_data_set_get_internal_value(filter->data_set, j);
+	if (!finite(value)) value = 0.0;
       }
+
+      /* insertion sort, columns are small */
+      for (k = loc; (k > 0) && (column[k-1] > value); k--)
+	column[k] = column[k-1];
+      column[k] = value;
+      loc++;
     }
-  } /* i_outer.t */
 
+  return;
+}
+
+static void median_output_voxel(const filter_median_t * filter, const AmitkVoxel i, 
+				const amide_data_t value) {
 
+  AmitkVoxel j = i;
 
+  if (filter->output_is_frame) 
+    j.t = j.g = 0;
+  AMITK_RAW_DATA_FLOAT_SET_CONTENT(filter->output, j) = value;
 
+  return;
+}
 
+static void median_plane_voxel(const filter_median_t * filter, const gint plane, AmitkVoxel * i) {
 
- exit_strategy:
+  AmitkVoxel dim = AMITK_DATA_SET_DIM(filter->data_set);
+  gint i_plane = plane + filter->first_plane;
 
-  if (wavetable != NULL) {
-    gsl_fft_complex_wavetable_free(wavetable);
-    wavetable = NULL;
+  i->z = i_plane % dim.z;
+  i->g = (i_plane / dim.z) % dim.g;
+  i->t = i_plane / (dim.z*dim.g);
+  i->y = i->x = 0;
+
+  return;
+}
+
+/* histogram median for planes [start, end) */
+static void filter_median_histogram_planes(gint start, gint end, gpointer data) {
+
+  filter_median_t * filter = data;
+  median_histogram_t hist;
+  AmitkFormat format;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  gint plane;
+  gint x;
+
+  format = AMITK_RAW_DATA_FORMAT(AMITK_DATA_SET_RAW_DATA(filter->data_set));
+  if (!median_histogram_alloc(&hist, format)) {
+    g_atomic_int_set(&filter->error, TRUE);
+    return;
   }
+  hist.median_rank = (filter->kernel_dim.x*filter->kernel_dim.y*filter->kernel_dim.z-1) >> 1;
+  dim = AMITK_DATA_SET_DIM(filter->data_set);
+
+  for (plane = start; plane < end; plane++) {
+    median_plane_voxel(filter, plane, &i);
+    median_histogram_set_scaling(&hist, format,
+				 amitk_data_set_get_internal_scaling_factor(filter->data_set, i),
+				 amitk_data_set_get_scaling_intercept(filter->data_set, i));
+    hist.median_bin = hist.pad_bin; /* histogram's empty, so any bin works */
+    hist.below = 0;
+
+    for (i.y = 0; i.y < dim.y; i.y++) {
+      for (x = -filter->mid_dim.x; x <= filter->mid_dim.x; x++)
+	median_histogram_column(&hist, filter, i, x, 1);
+
+      for (i.x = 0; i.x < dim.x; i.x++) {
+	if (i.x > 0) {
+	  median_histogram_column(&hist, filter, i, i.x-filter->mid_dim.x-1, -1);
+	  median_histogram_column(&hist, filter, i, i.x+filter->mid_dim.x, 1);
+	}
+	median_output_voxel(filter, i, median_histogram_median(&hist));
+      }
 
-  if (workspace != NULL) {
-    gsl_fft_complex_workspace_free(workspace);
-    workspace = NULL;
+      /* empty the histogram for the next row */
+      i.x = dim.x-1;
+      for (x = i.x-filter->mid_dim.x; x <= i.x+filter->mid_dim.x; x++)
+	median_histogram_column(&hist, filter, i, x, -1);
+    }
   }
-  
-  if (subset != NULL) {
-    g_object_unref(subset);
-    subset = NULL;
+
+  median_histogram_free(&hist);
+
+  return;
+}
+
+/* sorted window median for planes [start, end) */
+static void filter_median_sorted_planes(gint start, gint end, gpointer data) {
+
+  filter_median_t * filter = data;
+  amide_data_t * window=NULL;
+  amide_data_t * merged=NULL;
+  amide_data_t * columns=NULL; /* the window's sorted columns, column x is in slot x mod kernel_dim.x */
+  amide_data_t * column;
+  amide_data_t * leaving;
+  amide_data_t * entering=NULL;
+  amide_data_t * swap;
+  AmitkVoxel dim;
+  AmitkVoxel i;
+  gint window_size, column_size;
+  gint plane;
+  gint x;
+  gint i_window, i_merged, i_leaving, i_entering;
+
+  column_size = filter->kernel_dim.z*filter->kernel_dim.y;
+  window_size = column_size*filter->kernel_dim.x;
+  window = g_try_new(amide_data_t, window_size);
+  merged = g_try_new(amide_data_t, window_size);
+  columns = g_try_new(amide_data_t, window_size);
+  entering = g_try_new(amide_data_t, column_size);
+  if ((window == NULL) || (merged == NULL) || (columns == NULL) || (entering == NULL)) {
+    g_atomic_int_set(&filter->error, TRUE);
+    goto exit_strategy;
   }
+  dim = AMITK_DATA_SET_DIM(filter->data_set);
 
-  if (update_func != NULL) /* remove progress bar */
-    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+  for (plane = start; plane < end; plane++) {
+    median_plane_voxel(filter, plane, &i);
 
-  return continue_work;
+    for (i.y = 0; i.y < dim.y; i.y++) {
 
+      /* start off the window by merging in the columns */
+      i_window = 0;
+      for (x = -filter->mid_dim.x; x <= filter->mid_dim.x; x++) {
+	column = columns + MEDIAN_COLUMN_SLOT(filter, x)*column_size;
+	median_sorted_column(filter, i, x, column);
+	for (i_merged=0, i_entering=0, i_leaving=0; (i_leaving < i_window) || (i_entering < column_size); )
+	  if ((i_entering >= column_size) || 
+	      ((i_leaving < i_window) && (window[i_leaving] <= column[i_entering])))
+	    merged[i_merged++] = window[i_leaving++];
+	  else
+	    merged[i_merged++] = column[i_entering++];
+	i_window = i_merged;
+	swap = window; window = merged; merged = swap;
+      }
+
+      for (i.x = 0; i.x < dim.x; i.x++) {
+	if (i.x > 0) {
+	  /* the entering column takes over the leaving column's slot */
+	  leaving = columns + MEDIAN_COLUMN_SLOT(filter, i.x-filter->mid_dim.x-1)*column_size;
+	  median_sorted_column(filter, i, i.x+filter->mid_dim.x, entering);
+
+	  /* drop the leaving values, merge in the entering ones */
+	  i_merged = i_leaving = i_entering = 0;
+	  for (i_window = 0; i_window < window_size; i_window++) {
+	    if ((i_leaving < column_size) && (window[i_window] == leaving[i_leaving])) {
+	      i_leaving++;
+	      continue;
+	    }
+	    while ((i_entering < column_size) && (entering[i_entering] < window[i_window]))
+	      merged[i_merged++] = entering[i_entering++];
+	    merged[i_merged++] = window[i_window];
+	  }
+	  while (i_entering < column_size)
+	    merged[i_merged++] = entering[i_entering++];
+	  swap = window; window = merged; merged = swap;
+	  memcpy(leaving, entering, column_size*sizeof(amide_data_t));
+	}
+	median_output_voxel(filter, i, window[(window_size-1) >> 1]);
+      }
+    }
+  }
+
+ exit_strategy:
+  g_free(window);
+  g_free(merged);
+  g_free(columns);
+  g_free(entering);
+
+  return;
 }
 
-#endif
 
 /* assumptions:
    1- filtered_ds is of type FLOAT, 0D scaling
@@ -5073,23 +6339,18 @@ static gboolean filter_fir(const AmitkDataSet * data_set,
    3- kernel dimensions are odd
 
    notes:
-   1. don't have a separate function for each data type, as getting the data_set data,
-   is a tiny fraction of the computational time, use amitk_data_set_get_internal_value instead
-   2. data set can be the same as filtered_ds
+   1. data set can be the same as filtered_ds
  */
 static gboolean filter_median_3D(const AmitkDataSet * data_set, AmitkDataSet * filtered_ds,
 				 AmitkVoxel kernel_dim, AmitkUpdateFunc update_func, gpointer update_data) {
 
-  amide_data_t * partial_sort_data;
-  AmitkVoxel i,j, mid_dim, output_dim;
-  gint loc, median_size;
-  AmitkRawData * output_data;
-  AmitkVoxel ds_dim;
+  filter_median_t filter;
+  filter_progress_t progress;
+  AmitkParallelFunc planes_func;
+  AmitkVoxel ds_dim, frame_dim;
+  AmitkVoxel i, j;
   gchar * temp_string;
-  gint image_num;
-  gint total_planes;
-  div_t x;
-  gint divider;
+  gint num_frames, i_frame;
   gboolean continue_work=TRUE;
 
 
@@ -5122,101 +6383,65 @@ static gboolean filter_median_3D(const AmitkDataSet * data_set, AmitkDataSet * f
     g_warning(_("data set x dimension to small for kernel, setting kernel dimension to 1"));
   }
 
-  mid_dim.t = mid_dim.g = 0;
-  mid_dim.z = kernel_dim.z >> 1;
-  mid_dim.y = kernel_dim.y >> 1;
-  mid_dim.x = kernel_dim.x >> 1;
-
-  median_size = kernel_dim.z*kernel_dim.y*kernel_dim.x;
-
-  output_dim = ds_dim;
-  output_dim.t = output_dim.g = 1;
-  if ((output_data = amitk_raw_data_new_with_data(AMITK_FORMAT_FLOAT, output_dim)) == NULL) {
-    g_warning(_("couldn't allocate memory space for the internal raw data"));
-    return FALSE;
+  filter.data_set = data_set;
+  filter.kernel_dim = kernel_dim;
+  filter.mid_dim.t = filter.mid_dim.g = 0;
+  filter.mid_dim.z = kernel_dim.z >> 1;
+  filter.mid_dim.y = kernel_dim.y >> 1;
+  filter.mid_dim.x = kernel_dim.x >> 1;
+  filter.error = FALSE;
+  planes_func = median_histogram_usable(data_set) ? filter_median_histogram_planes : filter_median_sorted_planes;
+
+  /* filtering in place needs somewhere else to put the results, so go a frame at a time */
+  filter.output_is_frame = (data_set == filtered_ds);
+  if (filter.output_is_frame) {
+    frame_dim = ds_dim;
+    frame_dim.t = frame_dim.g = 1;
+    if ((filter.output = amitk_raw_data_new_with_data(AMITK_FORMAT_FLOAT, frame_dim)) == NULL) {
+      g_warning(_("couldn't allocate memory space for the internal raw data"));
+      return FALSE;
+    }
+    num_frames = ds_dim.t*ds_dim.g;
+  } else {
+    filter.output = g_object_ref(filtered_ds->raw_data);
+    num_frames = 1;
   }
-  amitk_raw_data_FLOAT_initialize_data(output_data, 0.0);
-  partial_sort_data = g_try_new(amide_data_t, median_size);
-  g_return_val_if_fail(partial_sort_data != NULL, FALSE);
 
   if (update_func != NULL) {
     temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
     continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
     g_free(temp_string);
   }
-  total_planes = ds_dim.z*ds_dim.t*ds_dim.g;
-  divider = ((total_planes/AMITK_UPDATE_DIVIDER) < 1) ? 1 : (total_planes/AMITK_UPDATE_DIVIDER);
-
+  progress.update_func = update_func;
+  progress.update_data = update_data;
+  progress.fraction = 1.0/num_frames;
 
-  /* iterate over all the voxels in the data_set */
-  i.t = i.g = 0;
-  for (j.t=0; (j.t < AMITK_DATA_SET_NUM_FRAMES(data_set)) && continue_work; j.t++) {
-    for (j.g=0; (j.g < AMITK_DATA_SET_NUM_GATES(data_set)) && continue_work; j.g++) {
-      for (i.z=0; (i.z < output_dim.z) && continue_work; i.z++) {
-
-	if (update_func != NULL) {
-	  image_num = i.z+j.t*ds_dim.z+j.g*ds_dim.z*ds_dim.t;
-	  x = div(image_num,divider);
-	  if (x.rem == 0)
-	    continue_work = (*update_func)(update_data, NULL, ((gdouble) image_num)/((gdouble) total_planes));
-	}
-
-	for (i.y=0; i.y < output_dim.y; i.y++) {
-	  for (i.x=0; i.x < output_dim.x; i.x++) {
-	    
-	    /* initialize the data for the iteration */
-	    loc = 0;
-	    for (j.z = i.z-mid_dim.z; j.z <= i.z+mid_dim.z; j.z++) {
-	      if ((j.z < 0) || (j.z >= ds_dim.z)) {
-		for (j.y=0; j.y < kernel_dim.y; j.y++) {
-		  for (j.x=0; j.x < kernel_dim.x; j.x++) {
-		    partial_sort_data[loc] = 0.0;
-		    loc++;
-		  }
-		}
-	      } else {
-		for (j.y = i.y-mid_dim.y; j.y <= i.y+mid_dim.y; j.y++) {
-		  if ((j.y < 0) || (j.y >= ds_dim.y)) {
-		    for (j.x=0; j.x < kernel_dim.x; j.x++) {
-		      partial_sort_data[loc] = 0.0;
-		      loc++;
-		    }
-		  } else {
-		    for (j.x = i.x-mid_dim.x; j.x <= i.x+mid_dim.x; j.x++) {
-		      if ((j.x < 0) || (j.x >= ds_dim.x)) {
-			partial_sort_data[loc] = 0.0;
-			loc++;
-		      } else {
-			partial_sort_data[loc] = amitk_data_set_get_internal_value(data_set, j);
-			loc++;
-		      }
-		    }
-		  }
-		}
-	      }
-	    } /* end initializing data */
-	    
-	    /* and store median value */
-	    AMITK_RAW_DATA_FLOAT_SET_CONTENT(output_data, i) = 
-	      amitk_filter_find_median_by_partial_sort(partial_sort_data, median_size);
-	    
-	  } /* i.x */
-	} /* i.y */
-      } /* i.z */
+  for (i_frame=0; (i_frame < num_frames) && continue_work; i_frame++) {
+    filter.first_plane = i_frame*ds_dim.z;
+    progress.offset = i_frame*progress.fraction;
 
+    continue_work = amitk_parallel_for(filter.output_is_frame ? ds_dim.z : AMITK_DATA_SET_TOTAL_PLANES(data_set), 
+				       1, planes_func, &filter,
+				       (update_func != NULL) ? filter_progress_update : NULL, &progress);
+    if (g_atomic_int_get(&filter.error)) {
+      g_warning(_("couldn't allocate memory space for the median filter"));
+      continue_work = FALSE;
+    }
 
-      /* copy the output_data over into the filtered_ds */
-      for (i.z=0, j.z=0; i.z < output_dim.z; i.z++, j.z++)
-	for (i.y=0, j.y=0; i.y < output_dim.y; i.y++, j.y++)
-	  for (i.x=0, j.x=0; i.x < output_dim.x; i.x++, j.x++)
+    /* copy the frame over into the filtered_ds */
+    if (continue_work && filter.output_is_frame) {
+      median_plane_voxel(&filter, 0, &j);
+      i.t = i.g = 0;
+      for (i.z=0, j.z=0; i.z < ds_dim.z; i.z++, j.z++)
+	for (i.y=0, j.y=0; i.y < ds_dim.y; i.y++, j.y++)
+	  for (i.x=0, j.x=0; i.x < ds_dim.x; i.x++, j.x++)
 	    AMITK_RAW_DATA_FLOAT_SET_CONTENT(filtered_ds->raw_data, j) = 
-	      AMITK_RAW_DATA_FLOAT_CONTENT(output_data, i);
-    } /* j.g */
-  } /* j.t */
+	      AMITK_RAW_DATA_FLOAT_CONTENT(filter.output, i);
+    }
+  }
 
   /* garbage collection */
-  g_object_unref(output_data); 
-  g_free(partial_sort_data);
+  g_object_unref(filter.output); 
 
   if (update_func != NULL) /* remove progress bar */
     (*update_func)(update_data, NULL, (gdouble) 2.0); 
@@ -5262,7 +6487,8 @@ static gboolean filter_median_linear(const AmitkDataSet * data_set,
 
 
 
-/* returns a filtered version of the given data set */
+/* returns a filtered version of the given data set.  For the gaussian filter, a
+   kernel_size of 0 uses the recursive filter, which has no kernel size limit */
 AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
 					  const AmitkFilter filter_type,
 					  const gint kernel_size,
@@ -5318,6 +6544,16 @@ AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
     filtered->frame_min = NULL;
   }
 
+  if (filtered->plane_stats != NULL) {
+    g_free(filtered->plane_stats);
+    filtered->plane_stats = NULL;
+  }
+
+  if (filtered->frame_stats != NULL) {
+    g_free(filtered->frame_stats);
+    filtered->frame_stats = NULL;
+  }
+
   /* set a new name for this guy */
   temp_string = g_strdup_printf(_("%s, %s filtered"), AMITK_OBJECT_NAME(ds),
 				amitk_filter_get_name(filter_type));
@@ -5341,27 +6577,9 @@ AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
 
   switch(filter_type) {
 
-#ifdef AMIDE_LIBGSL_SUPPORT
   case AMITK_FILTER_GAUSSIAN:
-    {
-      AmitkRawData * kernel;
-      AmitkVoxel kernel_size_3D;
-
-      kernel_size_3D.t=kernel_size_3D.g=1;
-      kernel_size_3D.z=kernel_size_3D.y=kernel_size_3D.x=kernel_size;
-
-      kernel = amitk_filter_calculate_gaussian_kernel_complex(kernel_size_3D, 
-							      AMITK_DATA_SET_VOXEL_SIZE(ds),
-							      fwhm);
-      if (kernel == NULL) {
-	g_warning(_("failed to calculate 3D gaussian kernel"));
-	goto error;
-      }
-      good = filter_fir(ds, filtered, kernel, kernel_size_3D, update_func, update_data);
-      g_object_unref(kernel);
-    }
+    good = filter_gaussian(ds, filtered, kernel_size, fwhm, update_func, update_data);
     break;
-#endif
 
   case AMITK_FILTER_MEDIAN_LINEAR:
     good = filter_median_linear(ds, filtered, kernel_size, update_func, update_data);
@@ -5548,86 +6766,15 @@ GList * amitk_data_sets_remove_with_slice_parent(GList * slices,const AmitkDataS
   return slices;
 }
 
-/* trim cache slice size down to max_size, removes from end */
-GList * slice_cache_trim(GList * slice_cache, gint max_size) {
-
-  GList * last;
-
-  while (g_list_length(slice_cache) > max_size) {
-    last = g_list_last(slice_cache);
-    slice_cache = g_list_remove_link(slice_cache, last);
-    amitk_objects_unref(last);
-  }
-
-  return slice_cache;
-}
-
-/* several things cause slice caches to get invalidated, so they don't need to be
-   explicitly checked here
-
-   1. Scale factor changes
-   2. The parent data set's space changing
-   3. The parent data set's voxel size changing
-   4. Any change to the raw data
-
-*/
-static AmitkDataSet * slice_cache_find (GList * slice_cache, AmitkDataSet * parent_ds, 
-					const amide_time_t start, const amide_time_t duration,
-					const amide_intpoint_t gate,
-					const AmitkCanvasPoint pixel_size, const AmitkVolume * view_volume) {
-
-  AmitkDataSet * slice;
-  AmitkVoxel dim;
-  amide_intpoint_t start_gate, end_gate;
-
-  if (slice_cache == NULL) {
-    return NULL;
-  } else {
-    slice = slice_cache->data;
-    if (AMITK_DATA_SET_SLICE_PARENT(slice) == parent_ds) 
-      if (amitk_space_equal(AMITK_SPACE(slice), AMITK_SPACE(view_volume))) 
-	if (REAL_EQUAL(slice->scan_start, start)) 
-	  if (REAL_EQUAL(amitk_data_set_get_frame_duration(slice,0), duration)) {
-	    if (gate < 0) {
-	      start_gate = AMITK_DATA_SET_VIEW_START_GATE(AMITK_DATA_SET_SLICE_PARENT(slice));
-	      end_gate = AMITK_DATA_SET_VIEW_END_GATE(AMITK_DATA_SET_SLICE_PARENT(slice));
-	    } else {
-	      start_gate = gate;
-	      end_gate = gate;
-	    }
-	    if (AMITK_DATA_SET_VIEW_START_GATE(slice) == start_gate)
-	      if (AMITK_DATA_SET_VIEW_END_GATE(slice) == end_gate)
-		if (REAL_EQUAL(slice->voxel_size.z,AMITK_VOLUME_Z_CORNER(view_volume))) {
-		  dim.x = ceil(fabs(AMITK_VOLUME_X_CORNER(view_volume))/pixel_size.x);
-		  dim.y = ceil(fabs(AMITK_VOLUME_Y_CORNER(view_volume))/pixel_size.y);
-		  dim.z = dim.t = dim.g = 1;
-		  if (VOXEL_EQUAL(dim, AMITK_DATA_SET_DIM(slice))) 
-		    if (AMITK_DATA_SET_INTERPOLATION(slice) == AMITK_DATA_SET_INTERPOLATION(parent_ds)) 
-		      if (AMITK_DATA_SET_RENDERING(slice) == AMITK_DATA_SET_RENDERING(parent_ds)) 
-			return slice;
-		}
-	  }
-  }
-  
-
-  /* this one's not it, keep looking */
-  return slice_cache_find(slice_cache->next, parent_ds, start, duration, gate, pixel_size, view_volume);
-}
-
-
-
 /* give a list of data_sets, returns a list of slices of equal size and orientation
-   intersecting these data_sets.  The slice_cache is a list of already generated slices,
-   if an appropriate slice is found in there, it'll be used */
+   intersecting these data_sets.  If use_cache is set, slices are taken from (and 
+   added to) the shared slice cache */
 /* notes
-   - in real practice, the parent data set's local cache is rarely used,
-     as most slices, if there in the local cache, will also be in the passed in cache
    - the "gate" parameter should ordinarily by -1 (ignored).  Only use it to override the
      the data set's view_start_gate/view_end_gate parameters 
  */
 GList * amitk_data_sets_get_slices(GList * objects,
-				   GList ** pslice_cache,
-				   const gint max_slice_cache_size,
+				   const gboolean use_cache,
 				   const amide_time_t start,
 				   const amide_time_t duration,
 				   const amide_intpoint_t gate,
@@ -5636,8 +6783,6 @@ GList * amitk_data_sets_get_slices(GList * objects,
 
 
   GList * slices=NULL;
-  AmitkDataSet * local_slice;
-  AmitkDataSet * canvas_slice=NULL;
   AmitkDataSet * slice;
   AmitkDataSet * parent_ds;
   gint num_data_sets=0;
@@ -5660,44 +6805,18 @@ GList * amitk_data_sets_get_slices(GList * objects,
       num_data_sets++;
       parent_ds = AMITK_DATA_SET(objects->data);
 
-      /* try to find it in the caches first */
-      if (pslice_cache != NULL)
-	canvas_slice = slice_cache_find(*pslice_cache, parent_ds, start, duration, 
-					gate, pixel_size, view_volume);
-
-      local_slice = slice_cache_find(parent_ds->slice_cache, parent_ds, start, duration, 
-				     gate, pixel_size, view_volume);
-
-      if (canvas_slice != NULL) {
-	slice = amitk_object_ref(canvas_slice);
-      } else if (local_slice != NULL) {
-	slice = amitk_object_ref(local_slice);
-      } else {/* generate a new one */
+      if (use_cache)
+	slice = amitk_slice_cache_get_slice(parent_ds, start, duration, gate, pixel_size, view_volume);
+      else
 	slice = amitk_data_set_get_slice(parent_ds, start, duration, gate, pixel_size, view_volume);
-      }
 
       g_return_val_if_fail(slice != NULL, slices);
 
       slices = g_list_prepend(slices, slice);
-
-      if ((canvas_slice == NULL) && (pslice_cache != NULL))
-	*pslice_cache = g_list_prepend(*pslice_cache, amitk_object_ref(slice)); /* most recently used first */
-      if (local_slice == NULL) {
-	parent_ds->slice_cache = g_list_prepend(parent_ds->slice_cache, amitk_object_ref(slice));
-
-	/* regulate the size of the local per dataset cache */
-	parent_ds->slice_cache = 
-	  slice_cache_trim(parent_ds->slice_cache, 
-			   3 * MAX(AMITK_DATA_SET_NUM_FRAMES(parent_ds), AMITK_DATA_SET_NUM_GATES(parent_ds)));
-      }
     }
     objects = objects->next;
   }
 
-  /* regulate the size of the global cache */
-  if (pslice_cache != NULL) 
-    *pslice_cache = slice_cache_trim(*pslice_cache, max_slice_cache_size);
-
 #ifdef SLICE_TIMING
   /* and wrapup our timing */
   gettimeofday(&tv2, NULL);
@@ -103,6 +103,10 @@ G_BEGIN_DECLS
 
 #define AMITK_DATA_SET_DISTRIBUTION_SIZE 256
 
+/* number of resolution levels in a data set's pyramid, level 0 is the data set
+   itself, each level after that is downsampled by 2 along each axis */
+#define AMITK_DATA_SET_PYRAMID_LEVELS 4
+
 typedef enum {
   AMITK_OPERATION_UNARY_RESCALE,
   AMITK_OPERATION_UNARY_REMOVE_NEGATIVES,
@@ -239,6 +243,15 @@ typedef enum { /*< skip >*/
   AMITK_EXPORT_METHOD_NUM
 } AmitkExportMethod;
 
+/* summary statistics over a plane, frame, or the whole data set, only finite values are counted */
+typedef struct {
+  amide_data_t min; /* 0.0 if there aren't any finite values */
+  amide_data_t max;
+  amide_data_t sum;
+  amide_data_t sum_squares;
+  guint64 num_finite;
+} AmitkDataStats;
+
 typedef struct _AmitkDataSetClass AmitkDataSetClass;
 typedef struct _AmitkDataSet AmitkDataSet;
 
@@ -300,16 +313,22 @@ struct _AmitkDataSet
   /* parameters calculated as needed or on loading the object */
   /* in theory, could be recalculated on the fly, but used enough we'll store... */
   AmitkRawData * distribution; /* 1D array of data distribution, used in thresholding */
+  GRecMutex stats_mutex; /* guards calculating the statistics, which can happen from worker threads */
   gboolean min_max_calculated; /* the min/max values can be calculated on demand */
   amide_data_t global_max;
   amide_data_t global_min;
   amide_data_t * frame_max; 
   amide_data_t * frame_min;
+  AmitkDataStats * plane_stats; /* indexed by (frame*num_gates+gate)*dim_z+z */
+  AmitkDataStats * frame_stats;
+  AmitkDataStats global_stats;
   AmitkRawData * current_scaling_factor; /* external_scaling * internal_scaling_factor[] */
+  AmitkDataSet * pyramid[AMITK_DATA_SET_PYRAMID_LEVELS-1]; /* levels 1 and up, built as needed */
+  GMutex pyramid_mutex; /* protects pyramid[] and pyramid_epoch */
+  gint pyramid_epoch; /* bumped when the pyramid is dropped or goes out of sync */
+  gint slice_cache_epoch; /* bumped (atomically) whenever cached slices go stale */
   amide_intpoint_t num_view_gates;
 
-  GList * slice_cache;
-
   /* only used by derived data sets (slices and projections)  */
   /* this is a weak pointer, it should be NULL'ed automatically by gtk on the parent's destruction */
   AmitkDataSet * slice_parent; 
@@ -400,6 +419,13 @@ amide_data_t   amitk_data_set_get_frame_max      (AmitkDataSet * ds,
 						  const guint frame);
 amide_data_t   amitk_data_set_get_frame_min      (AmitkDataSet * ds,
 						  const guint frame);
+AmitkDataStats amitk_data_set_get_global_stats   (AmitkDataSet * ds);
+AmitkDataStats amitk_data_set_get_frame_stats    (AmitkDataSet * ds,
+						  const guint frame);
+AmitkDataStats amitk_data_set_get_plane_stats    (AmitkDataSet * ds,
+						  const guint frame,
+						  const guint gate,
+						  const guint z);
 AmitkColorTable amitk_data_set_get_color_table_to_use(AmitkDataSet * ds, 
 						      const AmitkViewMode view_mode);
 void           amitk_data_set_set_modality       (AmitkDataSet * ds,
@@ -500,22 +526,32 @@ amide_time_t   amitk_data_set_get_frame_duration (const AmitkDataSet * ds,
 amide_time_t   amitk_data_set_get_min_frame_duration (const AmitkDataSet * ds);
 void           amitk_data_set_calc_far_corner    (AmitkDataSet * ds);
 
-/* note: calling any of the get_*_max or get_*_min functions will automatically
-   call calc_min_max if needed.  The main reason to call this function independently
-   is if you know the min/max values will be needed later, and you'd like to put up a 
-   progress dialog. */
+/* note: calling any of the get_*_max, get_*_min, or get_*_stats functions will 
+   automatically call calc_min_max if needed.  The main reason to call this function 
+   independently is if you know the min/max values will be needed later, and you'd 
+   like to put up a progress dialog.  calc_min_max gathers the per plane, per frame,
+   and global statistics in a single pass over the data. */
 void           amitk_data_set_calc_min_max       (AmitkDataSet * ds,
 						  AmitkUpdateFunc update_func,
 						  gpointer update_data);
 void           amitk_data_set_calc_min_max_if_needed(AmitkDataSet * ds,
 						     AmitkUpdateFunc update_func,
 						     gpointer update_data);
+void           amitk_data_set_invalidate_stats   (AmitkDataSet * ds);
 void           amitk_data_set_slice_calc_min_max (AmitkDataSet * ds,
 						  const amide_intpoint_t frame,
 						  const amide_intpoint_t gate,
 						  const amide_intpoint_t z,
 						  amitk_format_DOUBLE_t * pmin,
 						  amitk_format_DOUBLE_t * pmax);
+void           amitk_data_set_threshold_plane    (AmitkDataSet * ds,
+						  const amide_intpoint_t frame,
+						  const amide_intpoint_t gate,
+						  const amide_intpoint_t z,
+						  const amide_data_t min,
+						  const amide_data_t max,
+						  guint8 * mask,
+						  const gint row_stride);
 amide_data_t   amitk_data_set_get_max            (AmitkDataSet * ds, 
 						  const amide_time_t start, 
 						  const amide_time_t duration);
@@ -573,6 +609,24 @@ AmitkDataSet * amitk_data_set_get_slice           (AmitkDataSet * ds,
 						   const amide_intpoint_t gate,
 						   const AmitkCanvasPoint pixel_size,
 						   const AmitkVolume * slice_volume);
+AmitkDataSet * amitk_data_set_get_display_slice   (AmitkDataSet * ds,
+						   const amide_time_t start,
+						   const amide_time_t duration,
+						   const amide_intpoint_t gate,
+						   const AmitkCanvasPoint pixel_size,
+						   const AmitkVolume * slice_volume);
+AmitkDataSet * amitk_data_set_get_slice_at_level  (AmitkDataSet * ds,
+						   const amide_time_t start,
+						   const amide_time_t duration,
+						   const amide_intpoint_t gate,
+						   const AmitkCanvasPoint pixel_size,
+						   const AmitkVolume * slice_volume,
+						   const gint level);
+AmitkDataSet * amitk_data_set_get_pyramid_level   (AmitkDataSet * ds,
+						   const gint level);
+gint           amitk_data_set_get_pyramid_level_for_slice(const AmitkDataSet * ds,
+							  const AmitkCanvasPoint pixel_size,
+							  const AmitkVolume * slice_volume);
 void           amitk_data_set_get_line_profile    (AmitkDataSet * ds,
 						   const amide_time_t start,
 						   const amide_time_t duration,
@@ -588,8 +642,7 @@ amide_time_t   amitk_data_sets_get_min_frame_duration(GList * objects);
 amide_real_t   amitk_data_sets_get_min_voxel_size    (GList * objects);
 amide_real_t   amitk_data_sets_get_max_min_voxel_size(GList * objects);
 GList *        amitk_data_sets_get_slices            (GList * objects,
-						      GList ** pslice_cache,
-						      const gint max_slice_cache_size,
+						      const gboolean use_cache,
 						      const amide_time_t start,
 						      const amide_time_t duration,
 						      const amide_intpoint_t gate,
@@ -622,6 +675,8 @@ AmitkDataSet * amitk_data_sets_math_binary           (AmitkDataSet * ds1,
 #define amitk_data_set_get_gate_time_mem(ds) (g_try_new0(amide_time_t,(ds)->raw_data->dim.g))
 #define amitk_data_set_get_frame_duration_mem(ds) (g_try_new0(amide_time_t,(ds)->raw_data->dim.t))
 #define amitk_data_set_get_frame_min_max_mem(ds) (g_try_new0(amide_data_t,(ds)->raw_data->dim.t))
+#define amitk_data_set_get_frame_stats_mem(ds) (g_try_new0(AmitkDataStats,(ds)->raw_data->dim.t))
+#define amitk_data_set_get_plane_stats_mem(ds) (g_try_new0(AmitkDataStats,AMITK_DATA_SET_TOTAL_PLANES(ds)))
 
 
 const gchar *   amitk_scaling_type_get_name       (const AmitkScalingType scaling_type);
@@ -26,6 +26,7 @@
 #include "amide_config.h"
 #include "amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'.h"
 #include "amitk_data_set_FLOAT_0D_SCALING.h"
+#include "amitk_parallel.h"
 
 #ifdef AMIDE_DEBUG
 #include <stdlib.h>
@@ -34,45 +35,177 @@
 #define DIM_TYPE_`'m4_Scale_Dim`'
 #define DATA_TYPE_`'m4_Variable_Type`'
 
+/* don't bother splitting a slice up into chunks smaller than this many rows */
+#define SLICE_MIN_ROWS_PER_CHUNK 8
 
-/* function to calculate the max/min values of a slice within a data set */
-void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'calc_slice_min_max(AmitkDataSet * data_set,
-											     const amide_intpoint_t frame,
-											     const amide_intpoint_t gate,
-											     const amide_intpoint_t z,
-											     amitk_format_DOUBLE_t * pmin,
-											     amitk_format_DOUBLE_t * pmax) {
+
+/* the raw data formats that can hold non-finite values */
+#if defined(DATA_TYPE_FLOAT) || defined(DATA_TYPE_DOUBLE)
+#define RAW_FINITE(value) finite(value)
+#else
+#define RAW_FINITE(value) TRUE
+#endif
+
+/* the scaling factor (and intercept) are constant over a plane, so the plane
+   can be walked straight through the raw data */
+static void plane_scaling(AmitkDataSet * data_set, const AmitkVoxel i,
+			  amide_data_t * pscale, amide_data_t * pintercept) {
+
+  *pscale = *(AMITK_RAW_DATA_DOUBLE_`'m4_Scale_Dim`'_POINTER(data_set->current_scaling_factor, i));
+  *pintercept = m4_ifelse(m4_Intercept, `INTERCEPT_',
+    `*(AMITK_RAW_DATA_DOUBLE_`'m4_Scale_Dim`'_POINTER(data_set->internal_scaling_intercept, i))',
+    `0.0');
+
+  return;
+}
+
+/* function to calculate the statistics of a plane within a data set in one pass */
+void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'calc_plane_stats(AmitkDataSet * data_set,
+											   const amide_intpoint_t frame,
+											   const amide_intpoint_t gate,
+											   const amide_intpoint_t z,
+											   AmitkDataStats * stats) {
 
   AmitkVoxel i;
-  amide_data_t max, min, temp;
-  AmitkVoxel dim;
-  
-  dim = AMITK_DATA_SET_DIM(data_set);
+  const amitk_format_`'m4_Variable_Type`'_t * data;
+  amide_data_t scale, intercept, value;
+  amide_data_t raw_min, raw_max, raw_sum, raw_sum_squares;
+  amide_data_t temp;
+  guint64 num_finite;
+  gint num_voxels, j;
+
+  i.t = frame;
+  i.g = gate;
+  i.z = z;
+  i.y = i.x = 0;
+
+  data = AMITK_RAW_DATA_`'m4_Variable_Type`'_POINTER(data_set->raw_data, i);
+  num_voxels = AMITK_DATA_SET_DIM_X(data_set)*AMITK_DATA_SET_DIM_Y(data_set);
+  plane_scaling(data_set, i, &scale, &intercept);
+
+  /* accumulate on the raw values, and apply the scaling at the end */
+  raw_min = G_MAXDOUBLE;
+  raw_max = -G_MAXDOUBLE;
+  raw_sum = raw_sum_squares = 0.0;
+  num_finite = 0;
+  for (j=0; j<num_voxels; j++) {
+    value = data[j];
+    if (RAW_FINITE(value)) {
+      raw_min = (value < raw_min) ? value : raw_min;
+      raw_max = (value > raw_max) ? value : raw_max;
+      raw_sum += value;
+      raw_sum_squares += value*value;
+      num_finite++;
+    }
+  }
+
+  if ((num_finite == 0) || !finite(scale) || !finite(intercept)) {
+    stats->min = stats->max = 0.0; /* just throw in zero */
+    stats->sum = stats->sum_squares = 0.0;
+    stats->num_finite = 0;
+    return;
+  }
+
+  stats->min = scale*(raw_min+intercept);
+  stats->max = scale*(raw_max+intercept);
+  if (stats->min > stats->max) {
+    temp = stats->min;
+    stats->min = stats->max;
+    stats->max = temp;
+  }
+  stats->sum = scale*(raw_sum + num_finite*intercept);
+  stats->sum_squares = scale*scale*
+    (raw_sum_squares + 2.0*intercept*raw_sum + num_finite*intercept*intercept);
+  stats->num_finite = num_finite;
+
+  return;
+}
+
+/* sets mask[x] to 1 for the voxels of a plane with min <= value <= max, and to 0
+   for the rest, successive rows of the mask are row_stride apart */
+void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'threshold_plane(AmitkDataSet * data_set,
+											  const amide_intpoint_t frame,
+											  const amide_intpoint_t gate,
+											  const amide_intpoint_t z,
+											  const amide_data_t min,
+											  const amide_data_t max,
+											  guint8 * mask,
+											  const gint row_stride) {
+
+  AmitkVoxel i;
+  const amitk_format_`'m4_Variable_Type`'_t * data;
+  amide_data_t scale, intercept, value;
+  gint x;
 
   i.t = frame;
   i.g = gate;
   i.z = z;
   i.y = i.x = 0;
 
-  temp = AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set, i);
-  if (finite(temp)) max = min = temp;   
-  else max = min = 0.0; /* just throw in zero */
+  data = AMITK_RAW_DATA_`'m4_Variable_Type`'_POINTER(data_set->raw_data, i);
+  plane_scaling(data_set, i, &scale, &intercept);
+
+  for (i.y=0; i.y < AMITK_DATA_SET_DIM_Y(data_set); i.y++) {
+    for (x=0; x < AMITK_DATA_SET_DIM_X(data_set); x++) {
+      value = scale*(((amide_data_t) data[x])+intercept);
+      mask[x] = ((value >= min) && (value <= max));
+    }
+    data += AMITK_DATA_SET_DIM_X(data_set);
+    mask += row_stride;
+  }
+
+  return;
+}
+
+/* shared between the threads binning the distribution */
+typedef struct {
+  AmitkDataSet * data_set;
+  amide_data_t min;
+  amide_data_t scale;
+  amide_data_t * bins; /* protected by the mutex */
+  GMutex mutex;
+} distribution_t;
+
+/* bin planes [start, end) into a local distribution, and add it into the shared one */
+static void distribution_planes(gint start, gint end, gpointer data) {
+
+  distribution_t * distribution = data;
+  AmitkDataSet * data_set = distribution->data_set;
+  amide_data_t bins[AMITK_DATA_SET_DISTRIBUTION_SIZE];
+  const amitk_format_`'m4_Variable_Type`'_t * raw;
+  amide_data_t scale, intercept, value;
+  AmitkVoxel dim, i;
+  gint num_voxels, i_plane, j, bin;
 
-  for (i.y = 0; i.y < dim.y; i.y++) 
-    for (i.x = 0; i.x < dim.x; i.x++) {
-      temp = AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set, i);
-      if (finite(temp)) {
-	if (temp > max) max = temp;
-	else if (temp < min) min = temp;
+  dim = AMITK_DATA_SET_DIM(data_set);
+  num_voxels = dim.x*dim.y;
+  for (bin=0; bin < AMITK_DATA_SET_DISTRIBUTION_SIZE; bin++)
+    bins[bin] = 0.0;
+
+  for (i_plane=start; i_plane < end; i_plane++) {
+    i.x = i.y = 0;
+    i.z = i_plane % dim.z;
+    i.g = (i_plane / dim.z) % dim.g;
+    i.t = i_plane / (dim.z*dim.g);
+
+    raw = AMITK_RAW_DATA_`'m4_Variable_Type`'_POINTER(data_set->raw_data, i);
+    plane_scaling(data_set, i, &scale, &intercept);
+
+    for (j=0; j<num_voxels; j++) {
+      value = scale*(((amide_data_t) raw[j]) + intercept);
+      if (finite(value)) {
+	bin = distribution->scale*(value-distribution->min);
+	bin = CLAMP(bin, 0, AMITK_DATA_SET_DISTRIBUTION_SIZE-1);
+	bins[bin] += 1.0;
       }
     }
+  }
 
-  if (pmin != NULL)
-    *pmin = min;
+  g_mutex_lock(&distribution->mutex);
+  for (bin=0; bin < AMITK_DATA_SET_DISTRIBUTION_SIZE; bin++)
+    distribution->bins[bin] += bins[bin];
+  g_mutex_unlock(&distribution->mutex);
 
-  if (pmax != NULL)
-    *pmax = max;
-  
   return;
 }
 
@@ -81,27 +214,24 @@ void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'calc_d
 									    AmitkUpdateFunc update_func,
 									    gpointer update_data) {
 
-  AmitkVoxel i,j;
-  amide_data_t scale, diff;
+  amide_data_t diff;
   AmitkVoxel distribution_dim;
-  AmitkVoxel data_set_dim;
+  AmitkVoxel j;
   gchar * temp_string;
-  div_t x;
-  gint divider;
-  gint total_planes;
-  gint i_plane;
   gboolean continue_work=TRUE;
   AmitkRawData * distribution;
+  distribution_t binning;
 
   if (data_set->distribution != NULL)
     return;
 
-  data_set_dim = AMITK_DATA_SET_DIM(data_set);
-  diff = amitk_data_set_get_global_max(data_set) - amitk_data_set_get_global_min(data_set);
+  binning.data_set = data_set;
+  binning.min = amitk_data_set_get_global_min(data_set);
+  diff = amitk_data_set_get_global_max(data_set) - binning.min;
   if (diff == 0.0)
-    scale = 0.0;
+    binning.scale = 0.0;
   else
-    scale = (AMITK_DATA_SET_DISTRIBUTION_SIZE-1)/diff;
+    binning.scale = (AMITK_DATA_SET_DISTRIBUTION_SIZE-1)/diff;
   
   distribution_dim.x = AMITK_DATA_SET_DISTRIBUTION_SIZE;
   distribution_dim.y = distribution_dim.z = distribution_dim.g = distribution_dim.t = 1;
@@ -113,38 +243,24 @@ void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'calc_d
 
   /* initialize the distribution array */
   amitk_raw_data_DOUBLE_initialize_data(distribution, 0.0);
+  binning.bins = distribution->data;
+  g_mutex_init(&binning.mutex);
   
   if (update_func != NULL) {
     temp_string = g_strdup_printf(_("Generating distribution data for:\n   %s"), AMITK_OBJECT_NAME(data_set));
     continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
     g_free(temp_string);
   }
-  total_planes = AMITK_DATA_SET_TOTAL_PLANES(data_set);
-  divider = ((total_planes/AMITK_UPDATE_DIVIDER) < 1) ? 1 : (total_planes/AMITK_UPDATE_DIVIDER);
 
   /* now "bin" the data */
-  j = zero_voxel;
-  i_plane=0;
-  for (i.t = 0; (i.t < data_set_dim.t) && continue_work; i.t++) {
-    for (i.g = 0; (i.g < data_set_dim.g) && continue_work; i.g++) {
-      for ( i.z = 0; (i.z < data_set_dim.z) && continue_work; i.z++, i_plane++) {
-	if (update_func != NULL) {
-	  x = div(i_plane,divider);
-	  if (x.rem == 0)
-	    continue_work = (*update_func)(update_data, NULL, ((gdouble) i_plane)/((gdouble) total_planes));
-	}
-
-	for (i.y = 0; i.y < data_set_dim.y; i.y++) 
-	  for (i.x = 0; i.x < data_set_dim.x; i.x++) {
-	    j.x = scale*(AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,i)-amitk_data_set_get_global_min(data_set));
-	    AMITK_RAW_DATA_DOUBLE_SET_CONTENT(distribution,j) += 1.0;
-	  }
-      }
-    }
-  }
+  if (continue_work)
+    continue_work = amitk_parallel_for(AMITK_DATA_SET_TOTAL_PLANES(data_set), 1,
+				       distribution_planes, &binning,
+				       update_func, update_data);
+  g_mutex_clear(&binning.mutex);
 
   if (update_func != NULL) /* remove progress bar */
-    continue_work = (*update_func)(update_data, NULL, (gdouble) 2.0); 
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
 
   if (!continue_work) {   /* if we quit, get out of here */
     g_object_unref(distribution);
@@ -153,6 +269,7 @@ void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'calc_d
   
   /* do some log scaling so the distribution is more meaningful, and doesn't get
      swamped by outlyers */
+  j = zero_voxel;
   for (j.x = 0; j.x < distribution_dim.x ; j.x++) 
     AMITK_RAW_DATA_DOUBLE_SET_CONTENT(distribution,j) = 
       log10(AMITK_RAW_DATA_DOUBLE_CONTENT(distribution,j)+1.0);
@@ -165,6 +282,415 @@ void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'calc_d
 
 
 
+/* everything the slice row workers need to know, shared read-only between the threads */
+typedef struct {
+  AmitkDataSet * data_set;
+  amide_intpoint_t start_frame;
+  amide_intpoint_t end_frame;
+  amide_data_t * time_weights; /* indexed from start_frame */
+  amide_intpoint_t * gates;
+  gint num_gates;
+  amide_real_t z_steps;
+  AmitkVoxel start;
+  AmitkVoxel end;
+
+  /* the data set point at the center of the first slice voxel, and what stepping
+     one voxel along each of the slice's axes corresponds to in the data set */
+  AmitkPoint start_point;
+  AmitkPoint stride[AMITK_AXIS_NUM];
+
+  /* if each of the slice's axes only moves along one of the data set's axes, 
+     the data set voxel for a slice voxel is just the sum of per axis offsets */
+  gboolean aligned;
+  AmitkVoxel * aligned_offsets[AMITK_AXIS_NUM];
+
+  amide_data_t * weights;
+  amide_data_t * intermediate_data;
+} slice_rows_t;
+
+/* scratch space for interpolating one row of a slice */
+typedef struct {
+  AmitkVoxel * near;  /* the data set voxel the point falls in */
+  AmitkVoxel * far;   /* which way (-1 or +1) the next nearest voxel is along each axis */
+  AmitkPoint * near_weight;
+  AmitkPoint * far_weight;
+} trilinear_row_t;
+
+/* combine a pair of values, if one of them is off the edge of the data set we take
+   the other one, but only if it's at least as close */
+#define TRILINEAR_PAIR(near_value, far_value, near_weight, far_weight)	\
+  (isnan(near_value) ? (((far_weight) >= (near_weight)) ? (far_value) : NAN) : \
+   isnan(far_value) ? (((near_weight) < (far_weight)) ? NAN : (near_value)) : \
+   ((near_value)*(near_weight) + (far_value)*(far_weight)))
+
+/* trilinearly interpolates num_pixels points in the data set, starting at start_point and
+   stepping by stride.  This is done in two passes, the first figures out the voxels and
+   weights for the whole row, which is simple arithmetic that the compiler can vectorize,
+   the second does the lookups and blending.  row_empties gets set for any point whose
+   neighborhood runs off the edge of the data set.  There's no hand written SSE/AVX
+   or runtime CPU dispatch here, we build with too many compilers for intrinsics, 
+   so the vectorizing is left to the compiler. */
+static void trilinear_row(AmitkDataSet * data_set,
+			  const amide_intpoint_t frame,
+			  const amide_intpoint_t gate,
+			  const AmitkPoint start_point,
+			  const AmitkPoint stride,
+			  const gint num_pixels,
+			  trilinear_row_t * scratch,
+			  amide_data_t * row_values,
+			  gboolean * row_empties) {
+
+  AmitkVoxel * near = scratch->near;
+  AmitkVoxel * far = scratch->far;
+  AmitkPoint * near_weight = scratch->near_weight;
+  AmitkPoint * far_weight = scratch->far_weight;
+  AmitkVoxel dim = data_set->raw_data->dim;
+  AmitkPoint voxel_size = data_set->voxel_size;
+  AmitkPoint diff;
+  AmitkVoxel i_voxel;
+  amide_data_t box_value[8];
+  gboolean frame_gate_empty;
+  gint i;
+  guint l;
+
+  frame_gate_empty = (frame < 0) || (frame >= dim.t) || (gate < 0) || (gate >= dim.g);
+
+  /* first pass, where does each point fall */
+  for (i=0; i < num_pixels; i++) {
+    diff.x = (start_point.x + i*stride.x)/voxel_size.x;
+    diff.y = (start_point.y + i*stride.y)/voxel_size.y;
+    diff.z = (start_point.z + i*stride.z)/voxel_size.z;
+    near[i].x = (amide_intpoint_t) diff.x;
+    near[i].y = (amide_intpoint_t) diff.y;
+    near[i].z = (amide_intpoint_t) diff.z;
+
+    /* offset from the center of the nearest voxel, in voxels */
+    diff.x -= near[i].x+0.5;
+    diff.y -= near[i].y+0.5;
+    diff.z -= near[i].z+0.5;
+    far[i].x = (diff.x < 0) ? -1 : 1;
+    far[i].y = (diff.y < 0) ? -1 : 1;
+    far[i].z = (diff.z < 0) ? -1 : 1;
+    near_weight[i].x = 1.0-fabs(diff.x);
+    near_weight[i].y = 1.0-fabs(diff.y);
+    near_weight[i].z = 1.0-fabs(diff.z);
+    far_weight[i].x = 1.0-fabs(diff.x-far[i].x);
+    far_weight[i].y = 1.0-fabs(diff.y-far[i].y);
+    far_weight[i].z = 1.0-fabs(diff.z-far[i].z);
+  }
+
+  /* second pass, look up the 8 voxels around each point and blend them. The box is
+     ordered with bit 0/1/2 of the index picking the far voxel along x/y/z */
+  i_voxel.t = frame;
+  i_voxel.g = gate;
+  for (i=0; i < num_pixels; i++) {
+    row_empties[i] = 
+      (MIN(near[i].x, near[i].x+far[i].x) < 0) || (MAX(near[i].x, near[i].x+far[i].x) >= dim.x) ||
+      (MIN(near[i].y, near[i].y+far[i].y) < 0) || (MAX(near[i].y, near[i].y+far[i].y) >= dim.y) ||
+      (MIN(near[i].z, near[i].z+far[i].z) < 0) || (MAX(near[i].z, near[i].z+far[i].z) >= dim.z) ||
+      frame_gate_empty;
+
+    for (l=0; l<8; l++) {
+      i_voxel.x = (l & 0x1) ? near[i].x+far[i].x : near[i].x;
+      i_voxel.y = (l & 0x2) ? near[i].y+far[i].y : near[i].y;
+      i_voxel.z = (l & 0x4) ? near[i].z+far[i].z : near[i].z;
+      if (!row_empties[i] || amitk_raw_data_includes_voxel(data_set->raw_data, i_voxel))
+	box_value[l] = AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set, i_voxel);
+      else
+	box_value[l] = NAN;
+    }
+
+    if (row_empties[i]) { /* slow algorithm - checking for empties */
+      for (l=0; l<8; l+=2)
+	box_value[l] = TRILINEAR_PAIR(box_value[l], box_value[l+1], near_weight[i].x, far_weight[i].x);
+      for (l=0; l<8; l+=4)
+	box_value[l] = TRILINEAR_PAIR(box_value[l], box_value[l+2], near_weight[i].y, far_weight[i].y);
+      row_values[i] = TRILINEAR_PAIR(box_value[0], box_value[4], near_weight[i].z, far_weight[i].z);
+    } else { /* faster */
+      for (l=0; l<8; l+=2)
+	box_value[l] = box_value[l]*near_weight[i].x + box_value[l+1]*far_weight[i].x;
+      for (l=0; l<8; l+=4)
+	box_value[l] = box_value[l]*near_weight[i].y + box_value[l+2]*far_weight[i].y;
+      row_values[i] = box_value[0]*near_weight[i].z + box_value[4]*far_weight[i].z;
+    }
+  }
+
+  return;
+}
+
+/* trilinear interpolation for slice rows [start_row, end_row), rows are relative to start.y */
+static void get_slice_rows_trilinear(gint start_row, gint end_row, gpointer data) {
+
+  slice_rows_t * rows = data;
+  AmitkDataSet * data_set = rows->data_set;
+  amide_intpoint_t frame;
+  amide_intpoint_t z;
+  amide_intpoint_t i_gate;
+  gint row, i, num_pixels;
+  guint k;
+  amide_data_t weight;
+  amide_data_t time_weight;
+  AmitkPoint ds_point;
+  trilinear_row_t scratch;
+  amide_data_t * row_values;
+  gboolean * row_empties;
+  amide_data_t * intermediate_data = rows->intermediate_data;
+  amide_data_t * weights = rows->weights;
+  gboolean first_plane;
+
+  num_pixels = rows->end.x-rows->start.x+1;
+  scratch.near = g_new(AmitkVoxel, num_pixels);
+  scratch.far = g_new(AmitkVoxel, num_pixels);
+  scratch.near_weight = g_new(AmitkPoint, num_pixels);
+  scratch.far_weight = g_new(AmitkPoint, num_pixels);
+  row_values = g_new(amide_data_t, num_pixels);
+  row_empties = g_new(gboolean, num_pixels);
+
+  /* iterate over the frames we'll be incorporating into this slice */
+  for (frame = rows->start_frame; frame <= rows->end_frame; frame++) {
+    time_weight = rows->time_weights[frame-rows->start_frame];
+      
+    for (i_gate=0; i_gate < rows->num_gates; i_gate++) {
+
+      /* iterate over the number of planes we'll be compressing into this slice */
+      for (z = 0; z < ceil(rows->z_steps); z++) {
+	  
+	/* weight is between 0 and 1, this is used to weight the last voxel in the slice's z direction */
+	if (floor(rows->z_steps) > z)
+	  weight = time_weight/rows->z_steps;
+	else
+	  weight = time_weight*(rows->z_steps-floor(rows->z_steps)) / rows->z_steps;
+
+	/* MIP/MINIP need to initialize based on the first plane we encounter */
+	first_plane = ((z == 0) && (frame == rows->start_frame) && (i_gate == 0));
+	  
+	for (row = start_row, k=start_row*num_pixels; row < end_row; row++) {
+	    
+	  /* where the center of the first slice voxel in this row falls in the data set */
+	  POINT_MADD(1.0, rows->start_point, ((amide_real_t) z), rows->stride[AMITK_AXIS_Z], ds_point);
+	  POINT_MADD(1.0, ds_point, ((amide_real_t) row), rows->stride[AMITK_AXIS_Y], ds_point);
+
+	  trilinear_row(data_set, frame, rows->gates[i_gate], ds_point, rows->stride[AMITK_AXIS_X], 
+			num_pixels, &scratch, row_values, row_empties);
+
+	  /* separate into MPR/MIP/minIP algorithms */
+	  switch(data_set->rendering) {
+	  case AMITK_RENDERING_MPR:
+	    for (i=0; i < num_pixels; i++, k++) {
+	      if (!row_empties[i] || !isnan(row_values[i])) {
+		intermediate_data[k] += weight*row_values[i];
+		weights[k] += weight;
+	      }
+	    }
+	    break;
+	  case AMITK_RENDERING_MIP:
+	    for (i=0; i < num_pixels; i++, k++) {
+	      if (first_plane) 
+		intermediate_data[k] = row_values[i];
+	      else if (row_empties[i])
+		intermediate_data[k] = MAX(row_values[i], intermediate_data[k]);
+	      else
+		intermediate_data[k] = MAX(intermediate_data[k], row_values[i]);
+	    }
+	    break;
+	  case AMITK_RENDERING_MINIP:
+	    for (i=0; i < num_pixels; i++, k++) {
+	      if (first_plane) 
+		intermediate_data[k] = row_values[i];
+	      else if (row_empties[i])
+		intermediate_data[k] = MIN(row_values[i], intermediate_data[k]);
+	      else
+		intermediate_data[k] = MIN(intermediate_data[k], row_values[i]);
+	    }
+	    break;
+	  default:
+	    break;
+	  }
+	} /* y */
+      } /* z */
+    } /* gates */
+  } /* frames */
+
+  g_free(scratch.near);
+  g_free(scratch.far);
+  g_free(scratch.near_weight);
+  g_free(scratch.far_weight);
+  g_free(row_values);
+  g_free(row_empties);
+
+  return;
+}
+
+
+/* figure out which data set voxel each slice voxel in the given row and plane falls into */
+static void get_slice_row_voxels(const slice_rows_t * rows,
+				 const amide_intpoint_t frame,
+				 const amide_intpoint_t gate,
+				 const amide_intpoint_t z,
+				 const gint row,
+				 AmitkVoxel * row_voxels) {
+
+  AmitkPoint ds_point;
+  AmitkVoxel row_offset;
+  const AmitkVoxel * x_offsets;
+  gint i, num_pixels;
+
+  num_pixels = rows->end.x-rows->start.x+1;
+
+  if (rows->aligned) {
+    row_offset.x = rows->aligned_offsets[AMITK_AXIS_Y][row].x + rows->aligned_offsets[AMITK_AXIS_Z][z].x;
+    row_offset.y = rows->aligned_offsets[AMITK_AXIS_Y][row].y + rows->aligned_offsets[AMITK_AXIS_Z][z].y;
+    row_offset.z = rows->aligned_offsets[AMITK_AXIS_Y][row].z + rows->aligned_offsets[AMITK_AXIS_Z][z].z;
+    x_offsets = rows->aligned_offsets[AMITK_AXIS_X];
+    for (i=0; i < num_pixels; i++) {
+      row_voxels[i].x = row_offset.x + x_offsets[i].x;
+      row_voxels[i].y = row_offset.y + x_offsets[i].y;
+      row_voxels[i].z = row_offset.z + x_offsets[i].z;
+      row_voxels[i].g = gate;
+      row_voxels[i].t = frame;
+    }
+  } else {
+    POINT_MADD(1.0, rows->start_point, ((amide_real_t) z), rows->stride[AMITK_AXIS_Z], ds_point);
+    POINT_MADD(1.0, ds_point, ((amide_real_t) row), rows->stride[AMITK_AXIS_Y], ds_point);
+    for (i=0; i < num_pixels; i++) {
+      POINT_TO_VOXEL(ds_point, rows->data_set->voxel_size, frame, gate, row_voxels[i]);
+      POINT_ADD(ds_point, rows->stride[AMITK_AXIS_X], ds_point); 
+    }
+  }
+
+  return;
+}
+
+/* nearest neighbor lookup for slice rows [start_row, end_row), rows are relative to start.y */
+static void get_slice_rows_nearest(gint start_row, gint end_row, gpointer data) {
+
+  slice_rows_t * rows = data;
+  AmitkDataSet * data_set = rows->data_set;
+  amide_intpoint_t frame;
+  amide_intpoint_t z;
+  amide_intpoint_t i_gate;
+  gint row, i, num_pixels;
+  guint k;
+  amide_data_t weight;
+  amide_data_t time_weight;
+  AmitkVoxel * row_voxels;
+  amide_data_t * intermediate_data = rows->intermediate_data;
+  amide_data_t * weights = rows->weights;
+  gboolean first_plane;
+
+  num_pixels = rows->end.x-rows->start.x+1;
+  row_voxels = g_new(AmitkVoxel, num_pixels);
+
+  /* iterate over the number of frames we'll be incorporating into this slice */
+  for (frame = rows->start_frame; frame <= rows->end_frame; frame++) {
+    time_weight = rows->time_weights[frame-rows->start_frame];
+
+    /* iterate over gates */
+    for (i_gate=0; i_gate < rows->num_gates; i_gate++) {
+
+      /* iterate over the number of planes we'll be compressing into this slice */
+      for (z = 0; z < ceil(rows->z_steps); z++) { 
+
+	/* weight is between 0 and 1, this is used to weight the last voxel  in the slice's z direction */
+	if (floor(rows->z_steps) > z)
+	  weight = time_weight/rows->z_steps;
+	else
+	  weight = time_weight*(rows->z_steps-floor(rows->z_steps)) / rows->z_steps;
+
+	/* MIP/MINIP need to initialize based on the first plane we encounter */
+	first_plane = ((z == 0) && (frame == rows->start_frame) && (i_gate == 0));
+
+	for (row = start_row, k=start_row*num_pixels; row < end_row; row++) {
+	  get_slice_row_voxels(rows, frame, rows->gates[i_gate], z, row, row_voxels);
+
+	  /* separate into MPR and MIP/MINIP algorithms, the branch is kept out of the x loop */
+	  switch(data_set->rendering) {
+	  case AMITK_RENDERING_MPR:
+	    for (i=0; i < num_pixels; i++, k++) { 
+	      if (amitk_raw_data_includes_voxel(data_set->raw_data,row_voxels[i])) {
+		intermediate_data[k] +=
+		  weight*AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,row_voxels[i]);
+		weights[k] += weight;
+	      }
+	    }
+	    break;
+	  case AMITK_RENDERING_MIP:
+	    if (first_plane) {
+	      for (i=0; i < num_pixels; i++, k++) 
+		if (!amitk_raw_data_includes_voxel(data_set->raw_data,row_voxels[i])) 
+		  intermediate_data[k] = NAN;
+		else
+		  intermediate_data[k] =
+		    AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,row_voxels[i]);
+	    } else {
+	      for (i=0; i < num_pixels; i++, k++) 
+		if (amitk_raw_data_includes_voxel(data_set->raw_data,row_voxels[i])) 
+		  intermediate_data[k] = 
+		    MAX(intermediate_data[k],
+			AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,row_voxels[i]));
+	    }
+	    break;
+	  case AMITK_RENDERING_MINIP:
+	    if (first_plane) {
+	      for (i=0; i < num_pixels; i++, k++) 
+		if (!amitk_raw_data_includes_voxel(data_set->raw_data,row_voxels[i])) 
+		  intermediate_data[k] = NAN;
+		else
+		  intermediate_data[k] =
+		    AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,row_voxels[i]);
+	    } else {
+	      for (i=0; i < num_pixels; i++, k++) 
+		if (amitk_raw_data_includes_voxel(data_set->raw_data,row_voxels[i])) 
+		  intermediate_data[k] = 
+		    MIN(intermediate_data[k],
+			AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,row_voxels[i]));
+	    }
+	    break;
+	  default:
+	    break;
+	  } /* MIP vs NON-MIP */
+	} /* y */
+      } /* z */
+    } /* iterating over gates */
+  } /* iterating over frames */
+
+  g_free(row_voxels);
+
+  return;
+}
+
+
+
+/* checks if each of the slice's axes steps along just one of the data set's axes
+   (e.g. a transverse/coronal/sagittal view), and if so, which one */
+static gboolean slice_aligned_axes(const AmitkPoint stride[], AmitkAxis aligned_axis[]) {
+
+  AmitkAxis i_axis, j_axis;
+  amide_real_t component, largest;
+  gboolean used[AMITK_AXIS_NUM] = {FALSE, FALSE, FALSE};
+
+  for (i_axis = 0; i_axis < AMITK_AXIS_NUM; i_axis++) {
+    largest = 0.0;
+    for (j_axis = 0; j_axis < AMITK_AXIS_NUM; j_axis++) {
+      component = fabs(point_get_component(stride[i_axis], j_axis));
+      if (component > largest) {
+	largest = component;
+	aligned_axis[i_axis] = j_axis;
+      }
+    }
+    if ((largest <= 0.0) || used[aligned_axis[i_axis]]) return FALSE;
+    used[aligned_axis[i_axis]] = TRUE;
+
+    for (j_axis = 0; j_axis < AMITK_AXIS_NUM; j_axis++) 
+      if ((j_axis != aligned_axis[i_axis]) &&
+	  (fabs(point_get_component(stride[i_axis], j_axis)) > EPSILON*largest))
+	return FALSE;
+  }
+
+  return TRUE;
+}
+
+
 /* returns a slice  with the appropriate data from the data_set */
 AmitkDataSet * amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'get_slice(AmitkDataSet * data_set,
 											      const amide_time_t start_time,
@@ -178,36 +704,33 @@ AmitkDataSet * amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Interce
 
   AmitkDataSet * slice = NULL;
   AmitkVoxel i_voxel;
-  amide_intpoint_t z;
-  amide_real_t max_diff, voxel_length, z_steps;
+  amide_real_t voxel_length, z_steps;
   AmitkPoint alt;
-  AmitkPoint stride[AMITK_AXIS_NUM], last[AMITK_AXIS_NUM];
   AmitkAxis i_axis;
-  guint k, l;
-  amide_data_t weight;
-  amide_data_t time_weight;
-  amide_intpoint_t start_frame, end_frame;
+  guint k;
+  amide_intpoint_t start_frame, end_frame, i_frame;
   amide_intpoint_t i_gate;
   amide_time_t end_time;
-  AmitkPoint box_point[8];
-  AmitkVoxel box_voxel[8];
   AmitkVoxel start, end;
-  amide_data_t box_value[8];
-  AmitkPoint slice_point, ds_point,start_point,diff, nearest_point;
   AmitkSpace * slice_space;
   AmitkSpace * data_set_space;
 #if AMIDE_DEBUG
   gchar * temp_string;
   AmitkPoint center_point;
 #endif
-  AmitkVoxel ds_voxel;
-  amide_data_t weight1, weight2;
   amide_data_t * weights=NULL;
   amide_data_t * intermediate_data=NULL;
+  amide_data_t * time_weights=NULL;
+  amide_intpoint_t * gates=NULL;
   AmitkCorners intersection_corners;
   AmitkVoxel dim;
   gint num_gates;
-  gboolean empties=FALSE;
+  slice_rows_t rows;
+  AmitkParallelFunc rows_func;
+  AmitkAxis aligned_axis[AMITK_AXIS_NUM];
+  AmitkVoxel * offsets[AMITK_AXIS_NUM] = {NULL, NULL, NULL};
+  gint num_steps[AMITK_AXIS_NUM];
+  gint i_step;
 
   /* ----- figure out what frames of this data set to include ----*/
   end_time = start_time+duration;
@@ -220,6 +743,39 @@ AmitkDataSet * amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Interce
   else
     num_gates = 1;
 
+  /* figure out the weighting for each frame */
+  if ((time_weights = g_try_malloc(sizeof(amide_data_t)*(end_frame-start_frame+1))) == NULL) {
+    g_warning(_("couldn't allocate memory space for the time weights, wanted %d elements"), end_frame-start_frame+1);
+    goto error;
+  }
+  for (i_frame = start_frame; i_frame <= end_frame; i_frame++) {
+    /* averaging over more then one frame */
+    if (end_frame-start_frame > 0) {
+      if (i_frame == start_frame)
+	time_weights[i_frame-start_frame] = (amitk_data_set_get_end_time(data_set, start_frame)-start_time)/(duration*num_gates);
+      else if (i_frame == end_frame)
+	time_weights[i_frame-start_frame] = (end_time-amitk_data_set_get_start_time(data_set, end_frame))/(duration*num_gates);
+      else
+	time_weights[i_frame-start_frame] = amitk_data_set_get_frame_duration(data_set, i_frame)/(duration*num_gates);
+    } else
+      time_weights[i_frame-start_frame] = 1.0/((gdouble) num_gates);
+  }
+
+  /* and which gates we'll be looking at */
+  if ((gates = g_try_malloc(sizeof(amide_intpoint_t)*num_gates)) == NULL) {
+    g_warning(_("couldn't allocate memory space for the gates, wanted %d elements"), num_gates);
+    goto error;
+  }
+  for (i_gate=0; i_gate < num_gates; i_gate++) {
+    if (gate < 0)
+      gates[i_gate] = i_gate+AMITK_DATA_SET_VIEW_START_GATE(data_set);
+    else
+      gates[i_gate] = i_gate+gate;
+
+    if (gates[i_gate] >= AMITK_DATA_SET_NUM_GATES(data_set))
+      gates[i_gate] -= AMITK_DATA_SET_NUM_GATES(data_set);
+  }
+
   /* ------------------------- */
 
   dim.x = ceil(fabs(AMITK_VOLUME_X_CORNER(slice_volume))/pixel_size.x);
@@ -345,375 +901,76 @@ AmitkDataSet * amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Interce
       AMITK_RAW_DATA_DOUBLE_SET_CONTENT(slice->raw_data,i_voxel) = NAN;
 
 
+  /* fill in what the row workers need */
+  rows.data_set = data_set;
+  rows.start_frame = start_frame;
+  rows.end_frame = end_frame;
+  rows.time_weights = time_weights;
+  rows.gates = gates;
+  rows.num_gates = num_gates;
+  rows.z_steps = z_steps;
+  rows.start = start;
+  rows.end = end;
+  rows.weights = weights;
+  rows.intermediate_data = intermediate_data;
+  rows.aligned = FALSE;
+
+  /* figure out what point in the data set we're going to start at */
+  rows.start_point.x = ((amide_real_t) start.x+0.5) * slice->voxel_size.x;
+  rows.start_point.y = ((amide_real_t) start.y+0.5) * slice->voxel_size.y;
+  if (ceil(z_steps) > 1.0)
+    rows.start_point.z = voxel_length/2.0;
+  else
+    rows.start_point.z = slice->voxel_size.z/2.0; /* only one iteration in z */
+  rows.start_point = amitk_space_s2s(slice_space, data_set_space, rows.start_point);
+
+  /* figure out what stepping one voxel in a given direction in our slice cooresponds to in our data set,
+     the mapping is affine, so the workers can just walk these instead of transforming every voxel */
+  for (i_axis = 0; i_axis < AMITK_AXIS_NUM; i_axis++) {
+    alt.x = (i_axis == AMITK_AXIS_X) ? slice->voxel_size.x : 0.0;
+    alt.y = (i_axis == AMITK_AXIS_Y) ? slice->voxel_size.y : 0.0;
+    alt.z = (i_axis == AMITK_AXIS_Z) ? voxel_length : 0.0;
+    alt = point_add(point_sub(amitk_space_s2b(slice_space, alt),
+			      AMITK_SPACE_OFFSET(slice_space)),
+		    AMITK_SPACE_OFFSET(data_set_space));
+    rows.stride[i_axis] = amitk_space_b2s(data_set_space, alt);
+  }
+
   switch(data_set->interpolation) {
     
   case AMITK_INTERPOLATION_TRILINEAR:
-
-    /* iterate over the frames we'll be incorporating into this slice */
-    for (ds_voxel.t = start_frame; ds_voxel.t <= end_frame; ds_voxel.t++) {
-      
-      /* averaging over more then one frame */
-      if (end_frame-start_frame > 0) {
-	if (ds_voxel.t == start_frame)
-	  time_weight = (amitk_data_set_get_end_time(data_set, start_frame)-start_time)/(duration*num_gates);
-	else if (ds_voxel.t == end_frame)
-	  time_weight = (end_time-amitk_data_set_get_start_time(data_set, end_frame))/(duration*num_gates);
-	else
-	  time_weight = amitk_data_set_get_frame_duration(data_set, ds_voxel.t)/(duration*num_gates);
-      } else
-	time_weight = 1.0/((gdouble) num_gates);
-      
-      for (i_gate=0; i_gate < num_gates; i_gate++) {
-	if (gate < 0)
-	  ds_voxel.g = i_gate+AMITK_DATA_SET_VIEW_START_GATE(data_set);
-	else
-	  ds_voxel.g = i_gate+gate;
-	
-	if (ds_voxel.g >= AMITK_DATA_SET_NUM_GATES(data_set))
-	  ds_voxel.g -= AMITK_DATA_SET_NUM_GATES(data_set);
-
-	/* initialize the .t/.g components of box_voxel */
-	for (l=0; l<8; l=l+1) {
-	  box_voxel[l].t = ds_voxel.t;
-	  box_voxel[l].g = ds_voxel.g;
-	}
-
-	/* iterate over the number of planes we'll be compressing into this slice */
-	for (z = 0; z < ceil(z_steps); z++) {
-	  
-	  /* the slices z_coordinate for this iteration's slice voxel */
-	  if (ceil(z_steps) > 1.0)
-	    slice_point.z = (z+0.5)*voxel_length;
-	  else
-	    slice_point.z = (0.5)*slice->voxel_size.z; /* only one iteration in z */
-	  
-	  /* weight is between 0 and 1, this is used to weight the last voxel in the slice's z direction */
-	  if (floor(z_steps) > z)
-	    weight = time_weight/z_steps;
-	  else
-	    weight = time_weight*(z_steps-floor(z_steps)) / z_steps;
-	  
-	  /* iterate over the y dimension */
-	  for (i_voxel.y = start.y,k=0; i_voxel.y <= end.y; i_voxel.y++) {
-	    
-	    /* the slice y_coordinate of the center of this iteration's slice voxel */
-	    slice_point.y = (((amide_real_t) i_voxel.y)+0.5)*slice->voxel_size.y;
-	    
-	    /* the slice x coord of the center of the first slice voxel in this loop */
-	    slice_point.x = (((amide_real_t) start.x)+0.5)*slice->voxel_size.x;
-	    
-	    /* iterate over the x dimension */
-	    for (i_voxel.x = start.x; i_voxel.x <= end.x; i_voxel.x++,k++) {
-	      
-	      /* translate the current point in slice space into the data set's coordinate frame */
-	      ds_point = amitk_space_s2s(slice_space, data_set_space, slice_point);
-	      
-	      /* get the nearest neighbor in the data set to this slice voxel */
-	      POINT_TO_VOXEL_COORDS_ONLY(ds_point, data_set->voxel_size, ds_voxel);
-	      VOXEL_TO_POINT(ds_voxel, data_set->voxel_size, nearest_point);
-	      
-	      /* figure out which way to go to get the nearest voxels to our slice voxel*/
-	      POINT_SUB(ds_point, nearest_point, diff);
-	      
-	      /* figure out which voxels to look at */
-	      for (l=0; l<8; l=l+1) {
-		if (diff.x < 0)
-		  box_voxel[l].x = (l & 0x1) ? ds_voxel.x-1 : ds_voxel.x;
-		else /* diff.x >= 0 */
-		  box_voxel[l].x = (l & 0x1) ? ds_voxel.x : ds_voxel.x+1;
-		if (diff.y < 0)
-		  box_voxel[l].y = (l & 0x2) ? ds_voxel.y-1 : ds_voxel.y;
-		else /* diff.y >= 0 */
-		  box_voxel[l].y = (l & 0x2) ? ds_voxel.y : ds_voxel.y+1;
-		if (diff.z < 0)
-		  box_voxel[l].z = (l & 0x4) ? ds_voxel.z-1 : ds_voxel.z;
-		else /* diff.z >= 0 */
-		  box_voxel[l].z = (l & 0x4) ? ds_voxel.z : ds_voxel.z+1;
-		
-		VOXEL_TO_POINT(box_voxel[l], data_set->voxel_size, box_point[l]);
-		
-		/* get the value of the point on the box */
-		if (amitk_raw_data_includes_voxel(data_set->raw_data, box_voxel[l]))
-		  box_value[l] = AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set, box_voxel[l]);
-		else {
-		  box_value[l] = NAN;
-		  empties = TRUE;
-		}
-	      }
-	      
-	      if (empties) { /* slow algorithm - checking for empties */
-		/* reset value */
-		empties = FALSE; 
-
-		/* do the x direction linear interpolation of the sets of two points */
-		for (l=0;l<8;l=l+2) {
-		  max_diff = box_point[l+1].x-box_point[l].x;
-		  weight1 = ((max_diff - (ds_point.x - box_point[l].x))/max_diff);
-		  weight2 = ((max_diff - (box_point[l+1].x - ds_point.x))/max_diff);
-		  if (isnan(box_value[l])) {
-		    if (weight2 >= weight1)
-		      box_value[l] = box_value[l+1];
-		    /* else box_value[l] left as is (NAN/empty) */
-		  } else if (isnan(box_value[l+1])) {
-		    if (weight1 < weight2)
-		      box_value[l] = NAN;
-		    /* else box_value[l] left as is */
-		  } else
-		    box_value[l] = (box_value[l] * weight1) + (box_value[l+1] * weight2);
-		}
-		
-		/* do the y direction linear interpolation of the sets of two points */
-		for (l=0;l<8;l=l+4) {
-		  max_diff = box_point[l+2].y-box_point[l].y;
-		  weight1 = ((max_diff - (ds_point.y - box_point[l].y))/max_diff);
-		  weight2 = ((max_diff - (box_point[l+2].y - ds_point.y))/max_diff);
-		  if (isnan(box_value[l])) {
-		    if (weight2 >= weight1)
-		      box_value[l] = box_value[l+2];
-		    /* else box_value[l] left as is (NAN/empty) */
-		  } else if (isnan(box_value[l+2])) {
-		    if (weight1 < weight2)
-		      box_value[l] = NAN;
-		    /* else box_value[l] left as is */
-		  } else
-		    box_value[l] = (box_value[l] * weight1) + (box_value[l+2] * weight2);
-		}
-		
-		/* do the z direction linear interpolation of the sets of two points */
-		for (l=0;l<8;l=l+8) {
-		  max_diff = box_point[l+4].z-box_point[l].z;
-		  weight1 = ((max_diff - (ds_point.z - box_point[l].z))/max_diff);
-		  weight2 = ((max_diff - (box_point[l+4].z - ds_point.z))/max_diff);
-		  if (isnan(box_value[l])) {
-		    if (weight2 >= weight1)
-		      box_value[l] = box_value[l+4];
-		    /* else box_value[l] left as is (NAN/empty) */
-		  } else if (isnan(box_value[l+4])) {
-		    if (weight1 < weight2)
-		      box_value[l] = NAN;
-		    /* else box_value[l] left as is */
-		  } else
-		    box_value[l] = (box_value[l] * weight1) + (box_value[l+4] * weight2);
-		}
-
-		/* separate into MPR/MIP/minIP algorithms */
-		if (data_set->rendering == AMITK_RENDERING_MPR) { /* MPR */
-		  if (!isnan(box_value[0])) {
-		    intermediate_data[k] += weight*box_value[0];
-		    weights[k] += weight;
-		  }
-		} else { /* MIP or MINIP */
-		  if ((z == 0) && (ds_voxel.t == start_frame) && (i_gate == 0)) 
-		    intermediate_data[k]=box_value[0];
-		  else if (data_set->rendering == AMITK_RENDERING_MIP)  /* MIP */
-		    intermediate_data[k] = MAX(box_value[0], intermediate_data[k]);
-		  else  /* MINIP */
-		    intermediate_data[k] = MIN(box_value[0], intermediate_data[k]);
-		}
-
-	      } else { /* faster */
-		/* do the x direction linear interpolation of the sets of two points */
-		for (l=0;l<8;l=l+2) {
-		  max_diff = box_point[l+1].x-box_point[l].x;
-		  weight1 = ((max_diff - (ds_point.x - box_point[l].x))/max_diff);
-		  weight2 = ((max_diff - (box_point[l+1].x - ds_point.x))/max_diff);
-		  box_value[l] = (box_value[l] * weight1) + (box_value[l+1] * weight2);
-		}
-		
-		/* do the y direction linear interpolation of the sets of two points */
-		for (l=0;l<8;l=l+4) {
-		  max_diff = box_point[l+2].y-box_point[l].y;
-		  weight1 = ((max_diff - (ds_point.y - box_point[l].y))/max_diff);
-		  weight2 = ((max_diff - (box_point[l+2].y - ds_point.y))/max_diff);
-		  box_value[l] = (box_value[l] * weight1) + (box_value[l+2] * weight2);
-		}
-		
-		/* do the z direction linear interpolation of the sets of two points */
-		for (l=0;l<8;l=l+8) {
-		  max_diff = box_point[l+4].z-box_point[l].z;
-		  weight1 = ((max_diff - (ds_point.z - box_point[l].z))/max_diff);
-		  weight2 = ((max_diff - (box_point[l+4].z - ds_point.z))/max_diff);
-		  box_value[l] = (box_value[l] * weight1) + (box_value[l+4] * weight2);
-		}
-
-		/* separate into MPR/MIP/minIP algorithms */
-		if (data_set->rendering == AMITK_RENDERING_MPR) { /* MPR */
-		  intermediate_data[k] += weight*box_value[0];
-		  weights[k] += weight;
-		} else { /* MIP or MINIP */
-		  if ((z == 0) && (ds_voxel.t == start_frame) && (i_gate == 0)) 
-		    intermediate_data[k]=box_value[0];
-		  else if (data_set->rendering == AMITK_RENDERING_MIP)  /* MIP */
-		    intermediate_data[k] = MAX(intermediate_data[k], box_value[0]);
-		  else  /* MINIP */
-		    intermediate_data[k] = MIN(intermediate_data[k], box_value[0]);
-		}
-	      } /* slow (empties) vs fast algorithm */
-	      
-	      slice_point.x += slice->voxel_size.x; 
-	    }
-	  }
-	}
-      }
-    }
+    rows_func = get_slice_rows_trilinear;
     break;
 
   case AMITK_INTERPOLATION_NEAREST_NEIGHBOR:
   default:  
-    /* figure out what point in the data set we're going to start at */
-    start_point.x = ((amide_real_t) start.x+0.5) * slice->voxel_size.x;
-    start_point.y = ((amide_real_t) start.y+0.5) * slice->voxel_size.y;
-    if (ceil(z_steps) > 1.0)
-      start_point.z = voxel_length/2.0;
-    else
-      start_point.z = slice->voxel_size.z/2.0; /* only one iteration in z */
-    start_point = amitk_space_s2s(slice_space, data_set_space, start_point);
-
-    /* figure out what stepping one voxel in a given direction in our slice cooresponds to in our data set */
-    for (i_axis = 0; i_axis < AMITK_AXIS_NUM; i_axis++) {
-      alt.x = (i_axis == AMITK_AXIS_X) ? slice->voxel_size.x : 0.0;
-      alt.y = (i_axis == AMITK_AXIS_Y) ? slice->voxel_size.y : 0.0;
-      alt.z = (i_axis == AMITK_AXIS_Z) ? voxel_length : 0.0;
-      alt = point_add(point_sub(amitk_space_s2b(slice_space, alt),
-				AMITK_SPACE_OFFSET(slice_space)),
-		      AMITK_SPACE_OFFSET(data_set_space));
-      stride[i_axis] = amitk_space_b2s(data_set_space, alt);
+    /* the common case is a slice that lines up with the data set's axes, then we can
+       precompute the voxel offsets along each axis and skip the per voxel conversions */
+    rows.aligned = slice_aligned_axes(rows.stride, aligned_axis);
+    num_steps[AMITK_AXIS_X] = end.x-start.x+1;
+    num_steps[AMITK_AXIS_Y] = end.y-start.y+1;
+    num_steps[AMITK_AXIS_Z] = ceil(z_steps);
+    for (i_axis = 0; (i_axis < AMITK_AXIS_NUM) && rows.aligned; i_axis++) {
+      if ((offsets[i_axis] = g_try_malloc(sizeof(AmitkVoxel)*num_steps[i_axis])) == NULL) {
+	rows.aligned = FALSE; /* just fall back to the general case */
+      } else {
+	for (i_step = 0; i_step < num_steps[i_axis]; i_step++) {
+	  alt = zero_point;
+	  point_set_component(&alt, aligned_axis[i_axis],
+			      point_get_component(rows.start_point, aligned_axis[i_axis]) +
+			      i_step*point_get_component(rows.stride[i_axis], aligned_axis[i_axis]));
+	  POINT_TO_VOXEL_COORDS_ONLY(alt, data_set->voxel_size, offsets[i_axis][i_step]);
+	}
+	rows.aligned_offsets[i_axis] = offsets[i_axis];
+      }
     }
-
-    /* iterate over the number of frames we'll be incorporating into this slice */
-    for (ds_voxel.t = start_frame; ds_voxel.t <= end_frame; ds_voxel.t++) {
-
-      /* averaging over more then one frame */
-      if (end_frame-start_frame > 0) {
-	if (ds_voxel.t == start_frame)
-	  time_weight = (amitk_data_set_get_end_time(data_set, start_frame)-start_time)/(duration*num_gates);
-	else if (ds_voxel.t == end_frame)
-	  time_weight = (end_time-amitk_data_set_get_start_time(data_set, end_frame))/(duration*num_gates);
-	else
-	  time_weight = amitk_data_set_get_frame_duration(data_set, ds_voxel.t)/(duration*num_gates);
-      } else
-	time_weight = 1.0/((gdouble) num_gates);
-
-      /* iterate over gates */
-      for (i_gate=0; i_gate < num_gates; i_gate++) {
-	if (gate < 0)
-	  ds_voxel.g = i_gate+AMITK_DATA_SET_VIEW_START_GATE(data_set);
-	else
-	  ds_voxel.g = i_gate+gate;
-
-	if (ds_voxel.g >= AMITK_DATA_SET_NUM_GATES(data_set))
-	  ds_voxel.g -= AMITK_DATA_SET_NUM_GATES(data_set);
-
-	ds_point = start_point;
-
-	/* separate into MPR and MIP/MINIP algorithms. A fair amount
-	   of code is duplicated within the algorithms. The reason
-	   they aren't combined is to keep the MPR vs MIP/MINIP branch
-	   point out of the loop and speed things up slightly for the
-	   most commonly used selection (MPR) */
-
-	switch(data_set->rendering) {
-
-	case AMITK_RENDERING_MPR:
-	  /* iterate over the number of planes we'll be compressing into this slice */
-	  for (z = 0; z < ceil(z_steps); z++) { 
-	    last[AMITK_AXIS_Z] = ds_point;
-	  
-	    /* weight is between 0 and 1, this is used to weight the last voxel  in the slice's z direction */
-	    if (floor(z_steps) > z)
-	      weight = time_weight/z_steps;
-	    else
-	      weight = time_weight*(z_steps-floor(z_steps)) / z_steps;
-	  
-	    /* iterate over x and y */
-	    for (i_voxel.y = start.y, k=0; i_voxel.y <= end.y; i_voxel.y++) { 
-	      last[AMITK_AXIS_Y] = ds_point;
-	      for (i_voxel.x = start.x; i_voxel.x <= end.x; i_voxel.x++, k++) { 
-		POINT_TO_VOXEL_COORDS_ONLY(ds_point, data_set->voxel_size, ds_voxel);
-		if (amitk_raw_data_includes_voxel(data_set->raw_data,ds_voxel)) {
-		  intermediate_data[k] +=
-		    weight*AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,ds_voxel);
-		  weights[k] += weight;
-		}
-		POINT_ADD(ds_point, stride[AMITK_AXIS_X], ds_point); 
-	      } /* x */
-	      POINT_ADD(last[AMITK_AXIS_Y], stride[AMITK_AXIS_Y], ds_point);
-	    } /* y */
-	    
-	    POINT_ADD(last[AMITK_AXIS_Z], stride[AMITK_AXIS_Z], ds_point); 
-	  } /* z */
-	  break;
-
-	case AMITK_RENDERING_MIP:
-	case AMITK_RENDERING_MINIP:
-
-	  /* iterate over the number of planes we'll be compressing into this slice */
-	  for (z = 0; z < ceil(z_steps); z++) { 
-	    last[AMITK_AXIS_Z] = ds_point;
-
-	    /* need to initialize based on the first plane we encounter */
-	    if ((z == 0) && (ds_voxel.t == start_frame) && (i_gate == 0)) {
-	      /* iterate over x and y */
-	      for (i_voxel.y = start.y,k=0; i_voxel.y <= end.y; i_voxel.y++) {
-		last[AMITK_AXIS_Y] = ds_point;
-		for (i_voxel.x = start.x; i_voxel.x <= end.x; i_voxel.x++,k++) {
-		  POINT_TO_VOXEL_COORDS_ONLY(ds_point, data_set->voxel_size, ds_voxel);
-		  if (!amitk_raw_data_includes_voxel(data_set->raw_data,ds_voxel)) 
-		    intermediate_data[k] = NAN;
-		  else
-		    intermediate_data[k] =
-		      AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,ds_voxel);
-		  POINT_ADD(ds_point, stride[AMITK_AXIS_X], ds_point); 
-		} /* x */
-		POINT_ADD(last[AMITK_AXIS_Y], stride[AMITK_AXIS_Y], ds_point);
-	      } /* y */
-
-	    } else { /* iterate over everything that's not the first plane */
-
-	      if (data_set->rendering == AMITK_RENDERING_MIP) {
-		/* iterate over x and y */
-		for (i_voxel.y = start.y,k=0; i_voxel.y <= end.y; i_voxel.y++) { 
-		  last[AMITK_AXIS_Y] = ds_point;
-		  for (i_voxel.x = start.x; i_voxel.x <= end.x; i_voxel.x++,k++) { 
-		    POINT_TO_VOXEL_COORDS_ONLY(ds_point, data_set->voxel_size, ds_voxel);
-		    if (amitk_raw_data_includes_voxel(data_set->raw_data,ds_voxel)) 
-		      intermediate_data[k] = 
-			MAX(intermediate_data[k],
-			    AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,ds_voxel));
-		    POINT_ADD(ds_point, stride[AMITK_AXIS_X], ds_point); 
-		  } /* x */
-		  POINT_ADD(last[AMITK_AXIS_Y], stride[AMITK_AXIS_Y], ds_point);
-		} /* y */ 
-	      } else { /* AMITK_RENDERING_MINIP */
-		/* iterate over x and y */
-		for (i_voxel.y = start.y,k=0; i_voxel.y <= end.y; i_voxel.y++) { 
-		  last[AMITK_AXIS_Y] = ds_point;
-		  for (i_voxel.x = start.x; i_voxel.x <= end.x; i_voxel.x++,k++) { 
-		    POINT_TO_VOXEL_COORDS_ONLY(ds_point, data_set->voxel_size, ds_voxel);
-		    if (amitk_raw_data_includes_voxel(data_set->raw_data,ds_voxel)) 
-		      intermediate_data[k] = 
-			MIN(intermediate_data[k],
-			    AMITK_DATA_SET_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Intercept`'CONTENT(data_set,ds_voxel));
-		    POINT_ADD(ds_point, stride[AMITK_AXIS_X], ds_point); 
-		  } /* x */
-		  POINT_ADD(last[AMITK_AXIS_Y], stride[AMITK_AXIS_Y], ds_point);
-		} /* y */ 
-	      } /* end else, MIP vs MINIP */
-	    } /* end else */
-	      
-	    POINT_ADD(last[AMITK_AXIS_Z], stride[AMITK_AXIS_Z], ds_point); 
-	  } /* z */
-	  break;
-
-	default:
-	  break;
-	} /* MIP vs NON-MIP */
-
-      } /* iterating over gates */
-    } /* iterating over frames */
+    rows_func = get_slice_rows_nearest;
     break;
   }
 
+  /* each row of the slice is independent, so split the rows up between the worker threads */
+  amitk_parallel_for(end.y-start.y+1, SLICE_MIN_ROWS_PER_CHUNK, rows_func, &rows, NULL, NULL);
+
   /* fill in data/normalize if needed */
   i_voxel.t = i_voxel.g = i_voxel.z = 0;
   if (data_set->rendering == AMITK_RENDERING_MPR) {
@@ -733,6 +990,10 @@ AmitkDataSet * amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_`'m4_Interce
 
   if (weights != NULL) g_free(weights);
   if (intermediate_data != NULL) g_free(intermediate_data);
+  if (time_weights != NULL) g_free(time_weights);
+  if (gates != NULL) g_free(gates);
+  for (i_axis = 0; i_axis < AMITK_AXIS_NUM; i_axis++)
+    if (offsets[i_axis] != NULL) g_free(offsets[i_axis]);
 
   return slice;
 }
@@ -71,18 +71,32 @@
      - (*(AMITK_RAW_DATA_DOUBLE_`'m4_Scale_Dim`'_POINTER((data_set)->internal_scaling_intercept, (i)))))
 
 /* function declarations */
-void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_calc_slice_min_max(AmitkDataSet * data_set,
-									     const amide_intpoint_t frame,
-									     const amide_intpoint_t gate,
-									     const amide_intpoint_t z,
-									     amitk_format_DOUBLE_t * pmin,
-									     amitk_format_DOUBLE_t * pmax);
-void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_INTERCEPT_calc_slice_min_max(AmitkDataSet * data_set,
-										       const amide_intpoint_t frame,
-										       const amide_intpoint_t gate,
-										       const amide_intpoint_t z,
-										       amitk_format_DOUBLE_t * pmin,
-										       amitk_format_DOUBLE_t * pmax);
+void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_calc_plane_stats(AmitkDataSet * data_set,
+									   const amide_intpoint_t frame,
+									   const amide_intpoint_t gate,
+									   const amide_intpoint_t z,
+									   AmitkDataStats * stats);
+void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_INTERCEPT_calc_plane_stats(AmitkDataSet * data_set,
+										     const amide_intpoint_t frame,
+										     const amide_intpoint_t gate,
+										     const amide_intpoint_t z,
+										     AmitkDataStats * stats);
+void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_threshold_plane(AmitkDataSet * data_set,
+									  const amide_intpoint_t frame,
+									  const amide_intpoint_t gate,
+									  const amide_intpoint_t z,
+									  const amide_data_t min,
+									  const amide_data_t max,
+									  guint8 * mask,
+									  const gint row_stride);
+void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_INTERCEPT_threshold_plane(AmitkDataSet * data_set,
+										    const amide_intpoint_t frame,
+										    const amide_intpoint_t gate,
+										    const amide_intpoint_t z,
+										    const amide_data_t min,
+										    const amide_data_t max,
+										    guint8 * mask,
+										    const gint row_stride);
 void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_calc_distribution(AmitkDataSet * data_set,
 									     AmitkUpdateFunc update_func,
 									    gpointer update_data);
@@ -32,9 +32,6 @@
 #endif
 #include <math.h>
 #include "amitk_raw_data.h"
-#ifdef AMIDE_LIBGSL_SUPPORT
-#include <gsl/gsl_fft_complex.h>
-#endif
 
 G_BEGIN_DECLS
 
@@ -45,23 +42,16 @@ typedef enum {
   AMITK_FILTER_NUM
 } AmitkFilter;
 
-#define AMITK_FILTER_FFT_SIZE 64
-
+/* below this sigma (in voxels) the recursive gaussian is off by a few percent, and
+   a short FIR kernel is cheap anyway, so the FIR kernel is used instead */
+#define AMITK_FILTER_RECURSIVE_MIN_SIGMA 3.0
 
-AmitkRawData * amitk_filter_calculate_gaussian_kernel_complex(const AmitkVoxel kernel_size,
-							      const AmitkPoint voxel_size,
-							      const amide_real_t fwhm);
 
-#ifdef AMIDE_LIBGSL_SUPPORT
-void amitk_filter_3D_FFT(AmitkRawData * data, 
-			 gsl_fft_complex_wavetable * wavetable,
-			 gsl_fft_complex_workspace * workspace);
-void amitk_filter_inverse_3D_FFT(AmitkRawData * data, 
-				 gsl_fft_complex_wavetable * wavetable,
-				 gsl_fft_complex_workspace * workspace);
-void amitk_filter_complex_mult(AmitkRawData * data, AmitkRawData * kernel);
-#endif
-amide_data_t amitk_filter_find_median_by_partial_sort(amide_data_t * partial_sort_data, gint size);
+amide_real_t * amitk_filter_calculate_gaussian_kernel_1D(const gint kernel_size,
+							   const amide_real_t voxel_size,
+							   const amide_real_t fwhm);
+void amitk_filter_calculate_recursive_gaussian_coefs(const amide_real_t sigma,
+						     amide_real_t coefs[4]);
 
 const gchar * amitk_filter_get_name(const AmitkFilter filter);
 
@@ -32,6 +32,7 @@
 #include "amitk_marshal.h"
 #include "amitk_type_builtins.h"
 #include "amitk_study.h"
+#include "amitk_trace.h"
 
 
 
@@ -623,8 +624,10 @@ AmitkObject * amitk_object_read_xml(gchar * xml_filename, FILE * study_file, gui
   gchar * version;
   gchar * name;
   AmitkObjectType i_type, type;
+  gint64 trace_start;
 
 
+  trace_start = AMITK_TRACE_BEGIN();
   if ((doc = xml_open_doc(xml_filename, study_file, location, size, perror_buf))==NULL)
     return NULL; /* error message appended by function */
 
@@ -688,6 +691,7 @@ AmitkObject * amitk_object_read_xml(gchar * xml_filename, FILE * study_file, gui
   g_free(version);
 
   xmlFreeDoc(doc);
+  AMITK_TRACE_END("amitk_object_read_xml", trace_start);
   return new_object;
 }
 
@@ -0,0 +1,252 @@
+/* amitk_parallel.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+/* notes
+   - work is handed out in chunks from a shared counter, the calling thread
+     pulls chunks as well, so a job always finishes even if the pool is busy
+   - the update function is only ever called from the calling thread, so
+     it's safe to pass in gtk progress dialog callbacks
+   - calls made from within a worker thread run serially, so nested
+     parallel loops don't oversubscribe the processors
+*/
+
+#include "amide_config.h"
+#include "amitk_parallel.h"
+#include "amitk_trace.h"
+#include "amide_intl.h"
+
+/* average number of chunks handed to each thread, more chunks gives better load balancing */
+#define CHUNKS_PER_THREAD 4
+
+/* how often to poke the update function while waiting on the workers, in microseconds */
+#define UPDATE_INTERVAL (G_TIME_SPAN_SECOND/10)
+
+typedef struct {
+  AmitkParallelFunc func;
+  gpointer data;
+  gint num_items;
+  gint chunk_size;
+  gint next_item; /* atomic */
+  gint cancelled; /* atomic */
+  gint ref_count; /* atomic */
+
+  /* protected by mutex */
+  gint items_done;
+  GMutex mutex;
+  GCond cond;
+} parallel_job_t;
+
+static gint requested_threads = 0;
+static GThreadPool * thread_pool = NULL;
+static GPrivate in_worker = G_PRIVATE_INIT(NULL);
+G_LOCK_DEFINE_STATIC(thread_pool);
+
+
+static void job_unref(parallel_job_t * job) {
+
+  if (g_atomic_int_dec_and_test(&job->ref_count)) {
+    g_mutex_clear(&job->mutex);
+    g_cond_clear(&job->cond);
+    g_free(job);
+  }
+
+  return;
+}
+
+/* grab the next chunk of work and process it, returns FALSE if nothing was left */
+static gboolean job_run_chunk(parallel_job_t * job) {
+
+  gint start, end;
+  gint64 trace_start;
+
+  if (g_atomic_int_get(&job->cancelled))
+    return FALSE;
+
+  start = g_atomic_int_add(&job->next_item, job->chunk_size);
+  if (start >= job->num_items)
+    return FALSE;
+  end = MIN(start+job->chunk_size, job->num_items);
+
+  trace_start = AMITK_TRACE_BEGIN();
+  (*job->func)(start, end, job->data);
+  AMITK_TRACE_END("parallel_chunk", trace_start);
+
+  g_mutex_lock(&job->mutex);
+  job->items_done += end-start;
+  g_cond_broadcast(&job->cond);
+  g_mutex_unlock(&job->mutex);
+
+  return TRUE;
+}
+
+static void worker_func(gpointer data, gpointer user_data) {
+
+  parallel_job_t * job = data;
+
+  g_private_set(&in_worker, GINT_TO_POINTER(TRUE));
+  while (job_run_chunk(job));
+  job_unref(job);
+
+  return;
+}
+
+static GThreadPool * get_thread_pool(gint num_threads) {
+
+  GError * error=NULL;
+
+  G_LOCK(thread_pool);
+  if (thread_pool == NULL) {
+    /* the calling thread also does work, so need one less thread in the pool */
+    thread_pool = g_thread_pool_new(worker_func, NULL, num_threads-1, FALSE, &error);
+    if (thread_pool == NULL) {
+      g_warning(_("Couldn't start worker threads: %s"), error->message);
+      g_error_free(error);
+    }
+  } else if (g_thread_pool_get_max_threads(thread_pool) != num_threads-1) {
+    g_thread_pool_set_max_threads(thread_pool, num_threads-1, NULL);
+  }
+  G_UNLOCK(thread_pool);
+
+  return thread_pool;
+}
+
+
+
+void amitk_parallel_set_num_threads(gint num_threads) {
+
+  if (num_threads < 0) num_threads = 0;
+  if (num_threads > AMITK_PARALLEL_MAX_THREADS) num_threads = AMITK_PARALLEL_MAX_THREADS;
+  g_atomic_int_set(&requested_threads, num_threads);
+
+  return;
+}
+
+/* returns the number of threads we'll actually use, including the calling thread */
+gint amitk_parallel_get_num_threads(void) {
+
+  gint num_threads;
+
+  num_threads = g_atomic_int_get(&requested_threads);
+  if (num_threads == 0)
+    num_threads = g_get_num_processors();
+
+  return CLAMP(num_threads, 1, AMITK_PARALLEL_MAX_THREADS);
+}
+
+/* split the items [0, num_items) into chunks of at least min_chunk_size and farm
+   them out to the worker threads.  Returns FALSE if the user cancelled out through
+   the update_func.  func needs to be safe to call from multiple threads at once
+   on non-overlapping ranges. */
+gboolean amitk_parallel_for(const gint num_items,
+			    const gint min_chunk_size,
+			    AmitkParallelFunc func,
+			    gpointer data,
+			    AmitkUpdateFunc update_func,
+			    gpointer update_data) {
+
+  gint num_threads;
+  gint num_workers;
+  gint chunk_size;
+  gint start, end;
+  gint claimed;
+  gint i_worker;
+  gboolean continue_work=TRUE;
+  parallel_job_t * job;
+  GThreadPool * pool=NULL;
+
+  g_return_val_if_fail(func != NULL, FALSE);
+  if (num_items <= 0) return TRUE;
+
+  num_threads = amitk_parallel_get_num_threads();
+  chunk_size = num_items/(num_threads*CHUNKS_PER_THREAD);
+  if (chunk_size < min_chunk_size) chunk_size = min_chunk_size;
+  if (chunk_size < 1) chunk_size = 1;
+  num_workers = MIN(num_threads, (num_items+chunk_size-1)/chunk_size);
+
+  if ((num_workers > 1) && (g_private_get(&in_worker) == NULL))
+    pool = get_thread_pool(num_threads);
+
+  /* serial path */
+  if (pool == NULL) {
+    for (start=0; (start < num_items) && continue_work; start = end) {
+      end = MIN(start+chunk_size, num_items);
+      (*func)(start, end, data);
+      if (update_func != NULL)
+	continue_work = (*update_func)(update_data, NULL, ((gdouble) end)/((gdouble) num_items));
+    }
+    return continue_work;
+  }
+
+  job = g_new0(parallel_job_t, 1);
+  job->func = func;
+  job->data = data;
+  job->num_items = num_items;
+  job->chunk_size = chunk_size;
+  job->ref_count = num_workers; /* workers + the calling thread */
+  g_mutex_init(&job->mutex);
+  g_cond_init(&job->cond);
+
+  for (i_worker=1; i_worker < num_workers; i_worker++)
+    g_thread_pool_push(pool, job, NULL);
+
+  /* do our share of the work */
+  while (continue_work && job_run_chunk(job)) {
+    if (update_func != NULL) {
+      g_mutex_lock(&job->mutex);
+      end = job->items_done;
+      g_mutex_unlock(&job->mutex);
+      continue_work = (*update_func)(update_data, NULL, ((gdouble) end)/((gdouble) num_items));
+    }
+  }
+
+  /* everything's been handed out, keep the progress bar (and cancel button)
+     alive while the workers finish up */
+  if (update_func != NULL) {
+    g_mutex_lock(&job->mutex);
+    while (continue_work && (job->items_done < num_items)) {
+      g_cond_wait_until(&job->cond, &job->mutex, g_get_monotonic_time() + UPDATE_INTERVAL);
+      end = job->items_done;
+      g_mutex_unlock(&job->mutex);
+      continue_work = (*update_func)(update_data, NULL, ((gdouble) end)/((gdouble) num_items));
+      g_mutex_lock(&job->mutex);
+    }
+    g_mutex_unlock(&job->mutex);
+  }
+
+  if (!continue_work)
+    g_atomic_int_set(&job->cancelled, TRUE);
+
+  /* push the counter past the end so nothing else gets claimed, then wait for
+     the chunks that are already in progress */
+  claimed = MIN(g_atomic_int_add(&job->next_item, num_items), num_items);
+  g_mutex_lock(&job->mutex);
+  while (job->items_done < claimed)
+    g_cond_wait(&job->cond, &job->mutex);
+  g_mutex_unlock(&job->mutex);
+
+  job_unref(job);
+
+  return continue_work;
+}
@@ -0,0 +1,57 @@
+/* amitk_parallel.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifndef __AMITK_PARALLEL_H__
+#define __AMITK_PARALLEL_H__
+
+/* header files that are always needed with this file */
+#include <glib.h>
+#include "amitk_type.h"
+
+G_BEGIN_DECLS
+
+/* the maximum number of worker threads we'll ever use */
+#define AMITK_PARALLEL_MAX_THREADS 64
+
+/* work function, should process items [start, end) */
+typedef void (*AmitkParallelFunc) (gint start, gint end, gpointer data);
+
+
+/* ------------ external functions ---------- */
+
+/* num_threads of 0 means one thread per processor, 1 means do everything serially */
+void           amitk_parallel_set_num_threads (gint num_threads);
+gint           amitk_parallel_get_num_threads (void);
+gboolean       amitk_parallel_for             (const gint num_items,
+					       const gint min_chunk_size,
+					       AmitkParallelFunc func,
+					       gpointer data,
+					       AmitkUpdateFunc update_func,
+					       gpointer update_data);
+
+G_END_DECLS
+
+#endif /* __AMITK_PARALLEL_H__ */
+
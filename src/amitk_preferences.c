@@ -32,6 +32,9 @@
 #include "amitk_marshal.h"
 #include "amitk_type_builtins.h"
 #include "amitk_data_set.h"
+#include "amitk_parallel.h"
+#include "amitk_slice_cache.h"
+#include "amitk_trace.h"
 
 #define GCONF_AMIDE_ROI "ROI"
 #define GCONF_AMIDE_CANVAS "CANVAS"
@@ -157,6 +160,12 @@ static void preferences_init (AmitkPreferences * preferences) {
   preferences->warnings_to_console = 
     amide_gconf_get_bool_with_default(GCONF_AMIDE_MISC,"WarningsToConsole", AMITK_PREFERENCES_DEFAULT_WARNINGS_TO_CONSOLE);
 
+  /* only turn tracing on, it may have been started from the environment */
+  preferences->trace = 
+    amide_gconf_get_bool_with_default(GCONF_AMIDE_MISC,"Trace", AMITK_PREFERENCES_DEFAULT_TRACE);
+  if (preferences->trace)
+    amitk_trace_set_enabled(TRUE);
+
   preferences->prompt_for_save_on_exit = 
     amide_gconf_get_bool_with_default(GCONF_AMIDE_MISC,"PromptForSaveOnExit", AMITK_PREFERENCES_DEFAULT_PROMPT_FOR_SAVE_ON_EXIT);
 
@@ -166,6 +175,19 @@ static void preferences_init (AmitkPreferences * preferences) {
   preferences->default_directory = 
     amide_gconf_get_string_with_default(GCONF_AMIDE_MISC,"DefaultDirectory", AMITK_PREFERENCES_DEFAULT_DEFAULT_DIRECTORY);
 
+  preferences->compress_xif = 
+    amide_gconf_get_bool_with_default(GCONF_AMIDE_MISC,"CompressXif", AMITK_PREFERENCES_DEFAULT_COMPRESS_XIF);
+  amitk_raw_data_set_compress_xif(preferences->compress_xif);
+
+  preferences->num_threads = 
+    amide_gconf_get_int_with_default(GCONF_AMIDE_MISC,"NumThreads", AMITK_PREFERENCES_DEFAULT_NUM_THREADS);
+  amitk_parallel_set_num_threads(preferences->num_threads);
+
+  preferences->slice_cache_size = 
+    amide_gconf_get_int_with_default(GCONF_AMIDE_MISC,"SliceCacheSize", AMITK_PREFERENCES_DEFAULT_SLICE_CACHE_SIZE);
+  preferences->slice_cache_size = CLAMP(preferences->slice_cache_size, 0, AMITK_SLICE_CACHE_MAX_SIZE);
+  amitk_slice_cache_set_max_bytes(((guint64) preferences->slice_cache_size) << 20);
+
   for (i_modality=0; i_modality<AMITK_MODALITY_NUM; i_modality++) {
     temp_str = g_strdup_printf("DefaultColorTable%s", amitk_modality_get_name(i_modality));
     preferences->color_table[i_modality] = 
@@ -349,6 +371,20 @@ void amitk_preferences_set_warnings_to_console(AmitkPreferences * preferences, g
   return;
 }
 
+/* turning tracing off writes out the trace */
+void amitk_preferences_set_trace(AmitkPreferences * preferences, gboolean new_value) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (AMITK_PREFERENCES_TRACE(preferences) != new_value) {
+    preferences->trace = new_value;
+    amide_gconf_set_bool(GCONF_AMIDE_MISC,"Trace",new_value);
+    amitk_trace_set_enabled(new_value);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
 void amitk_preferences_set_prompt_for_save_on_exit(AmitkPreferences * preferences, gboolean new_value) {
 
   g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
@@ -398,6 +434,52 @@ void amitk_preferences_set_default_directory(AmitkPreferences * preferences, con
   return;
 }
 
+void amitk_preferences_set_compress_xif(AmitkPreferences * preferences, gboolean new_value) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (AMITK_PREFERENCES_COMPRESS_XIF(preferences) != new_value) {
+    preferences->compress_xif = new_value;
+    amide_gconf_set_bool(GCONF_AMIDE_MISC,"CompressXif",new_value);
+    amitk_raw_data_set_compress_xif(new_value);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
+void amitk_preferences_set_num_threads(AmitkPreferences * preferences, gint num_threads) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (num_threads < 0) num_threads = 0;
+  if (num_threads > AMITK_PARALLEL_MAX_THREADS) num_threads = AMITK_PARALLEL_MAX_THREADS;
+
+  if (AMITK_PREFERENCES_NUM_THREADS(preferences) != num_threads) {
+    preferences->num_threads = num_threads;
+    amide_gconf_set_int(GCONF_AMIDE_MISC,"NumThreads",num_threads);
+    amitk_parallel_set_num_threads(num_threads);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
+/* size is in megabytes, 0 turns off the slice cache */
+void amitk_preferences_set_slice_cache_size(AmitkPreferences * preferences, gint slice_cache_size) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (slice_cache_size < 0) slice_cache_size = 0;
+  if (slice_cache_size > AMITK_SLICE_CACHE_MAX_SIZE) slice_cache_size = AMITK_SLICE_CACHE_MAX_SIZE;
+
+  if (AMITK_PREFERENCES_SLICE_CACHE_SIZE(preferences) != slice_cache_size) {
+    preferences->slice_cache_size = slice_cache_size;
+    amide_gconf_set_int(GCONF_AMIDE_MISC,"SliceCacheSize",slice_cache_size);
+    amitk_slice_cache_set_max_bytes(((guint64) slice_cache_size) << 20);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
 void amitk_preferences_set_color_table(AmitkPreferences * preferences,
 				       AmitkModality modality,
 				       AmitkColorTable color_table) {
@@ -41,10 +41,14 @@ G_BEGIN_DECLS
 #define	AMITK_PREFERENCES_GET_CLASS(object)  (G_TYPE_CHECK_GET_CLASS ((object), AMITK_TYPE_PREFERENCES, AmitkPreferencesClass))
 
 #define AMITK_PREFERENCES_WARNINGS_TO_CONSOLE(object)     (AMITK_PREFERENCES(object)->warnings_to_console)
+#define AMITK_PREFERENCES_TRACE(object)                   (AMITK_PREFERENCES(object)->trace)
 
 #define AMITK_PREFERENCES_PROMPT_FOR_SAVE_ON_EXIT(object) (AMITK_PREFERENCES(object)->prompt_for_save_on_exit)
 #define AMITK_PREFERENCES_WHICH_DEFAULT_DIRECTORY(object) (AMITK_PREFERENCES(object)->which_default_directory)
 #define AMITK_PREFERENCES_DEFAULT_DIRECTORY(object)       (AMITK_PREFERENCES(object)->default_directory)
+#define AMITK_PREFERENCES_COMPRESS_XIF(object)            (AMITK_PREFERENCES(object)->compress_xif)
+#define AMITK_PREFERENCES_NUM_THREADS(object)             (AMITK_PREFERENCES(object)->num_threads)
+#define AMITK_PREFERENCES_SLICE_CACHE_SIZE(object)        (AMITK_PREFERENCES(object)->slice_cache_size)
 
 #define AMITK_PREFERENCES_CANVAS_ROI_WIDTH(pref)                (AMITK_PREFERENCES(pref)->canvas_roi_width)
 #ifdef AMIDE_LIBGNOMECANVAS_AA
@@ -81,10 +85,14 @@ typedef enum {
 #define AMITK_PREFERENCES_DEFAULT_CANVAS_TARGET_EMPTY_AREA 5
 #define AMITK_PREFERENCES_DEFAULT_PANEL_LAYOUT AMITK_PANEL_LAYOUT_MIXED
 #define AMITK_PREFERENCES_DEFAULT_WARNINGS_TO_CONSOLE FALSE
+#define AMITK_PREFERENCES_DEFAULT_TRACE FALSE
 #define AMITK_PREFERENCES_DEFAULT_PROMPT_FOR_SAVE_ON_EXIT TRUE
 #define AMITK_PREFERENCES_DEFAULT_SAVE_XIF_AS_DIRECTORY FALSE
 #define AMITK_PREFERENCES_DEFAULT_WHICH_DEFAULT_DIRECTORY AMITK_WHICH_DEFAULT_DIRECTORY_NONE
 #define AMITK_PREFERENCES_DEFAULT_DEFAULT_DIRECTORY NULL
+#define AMITK_PREFERENCES_DEFAULT_COMPRESS_XIF FALSE
+#define AMITK_PREFERENCES_DEFAULT_NUM_THREADS 0 /* one per processor */
+#define AMITK_PREFERENCES_DEFAULT_SLICE_CACHE_SIZE 256 /* megabytes */
 #define AMITK_PREFERENCES_DEFAULT_THRESHOLD_STYLE AMITK_THRESHOLD_STYLE_MIN_MAX
 
 #define AMITK_PREFERENCES_MIN_ROI_WIDTH 1
@@ -103,12 +111,18 @@ struct _AmitkPreferences {
 
   /* debug preferences */
   gboolean warnings_to_console;
+  gboolean trace; /* record a performance trace */
 
   /* file saving preferences */
   gboolean prompt_for_save_on_exit;
   gboolean save_xif_as_directory;
   AmitkWhichDefaultDirectory which_default_directory;
   gchar * default_directory;
+  gboolean compress_xif;
+
+  /* processing preferences */
+  gint num_threads; /* 0 = one per processor */
+  gint slice_cache_size; /* in megabytes, 0 = no caching */
 
   /* canvas preferences -> study preferences */
   gint canvas_roi_width;
@@ -168,6 +182,8 @@ void                amitk_preferences_set_panel_layout           (AmitkPreferenc
 							          AmitkPanelLayout panel_layout);
 void                amitk_preferences_set_warnings_to_console    (AmitkPreferences * preferences, 
 								  gboolean new_value);
+void                amitk_preferences_set_trace                  (AmitkPreferences * preferences, 
+								  gboolean new_value);
 void                amitk_preferences_set_prompt_for_save_on_exit(AmitkPreferences * preferences,
 								  gboolean new_value);
 void                amitk_preferences_set_xif_as_directory       (AmitkPreferences * preferences,
@@ -176,6 +192,12 @@ void                amitk_preferences_set_which_default_directory(AmitkPreferenc
 								  const AmitkWhichDefaultDirectory which_default_directory);
 void                amitk_preferences_set_default_directory      (AmitkPreferences * preferences,
 								  const gchar * directory);
+void                amitk_preferences_set_compress_xif           (AmitkPreferences * preferences,
+								  gboolean new_value);
+void                amitk_preferences_set_num_threads            (AmitkPreferences * preferences,
+								  gint num_threads);
+void                amitk_preferences_set_slice_cache_size       (AmitkPreferences * preferences,
+								  gint slice_cache_size);
 void                amitk_preferences_set_color_table            (AmitkPreferences * preferences,
 								  AmitkModality modality,
 								  AmitkColorTable color_table);
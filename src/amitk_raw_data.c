@@ -27,13 +27,22 @@
 
 #include <sys/stat.h>
 #include <stdio.h>
+#include <string.h>
+#ifdef AMIDE_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
 
 #include "amitk_raw_data.h"
 #include "amitk_marshal.h"
 #include "amitk_type_builtins.h"
+#include "amitk_parallel.h"
+#include "amitk_trace.h"
 
 #define DATA_CONTENT(data, dim, voxel) ((data)[(voxel).x + (dim).x*(voxel).y])
 
+/* raw data smaller than this isn't worth mapping, just read it in */
+#define MAP_THRESHOLD_BYTES 0x1000000
+
 /* external variables */
 guint amitk_format_sizes[] = {
   sizeof(amitk_format_UBYTE_t),
@@ -213,6 +222,7 @@ static void raw_data_init (AmitkRawData * raw_data) {
   raw_data->dim = zero_voxel;
   raw_data->data = NULL;
   raw_data->format = AMITK_FORMAT_DOUBLE;
+  raw_data->mapped_file = NULL;
 
   return;
 }
@@ -222,7 +232,11 @@ static void raw_data_finalize (GObject *object) {
 
   AmitkRawData * raw_data = AMITK_RAW_DATA(object);
 
-  if (raw_data->data != NULL) {
+  if (raw_data->mapped_file != NULL) {
+    g_mapped_file_unref(raw_data->mapped_file);
+    raw_data->mapped_file = NULL;
+    raw_data->data = NULL;
+  } else if (raw_data->data != NULL) {
 #ifdef AMIDE_DEBUG
     //g_print("\tfreeing raw data\n");
 #endif
@@ -354,9 +368,11 @@ AmitkRawData * amitk_raw_data_import_raw_file(const gchar * file_name,
   div_t x;
   gint divider;
   gboolean continue_work = TRUE;
+  gint64 trace_start;
 
   g_return_val_if_fail((file_name != NULL) || (existing_file != NULL), NULL);
 
+  trace_start = AMITK_TRACE_BEGIN();
   if (update_func != NULL) {
     temp_string = g_strdup_printf(_("Reading: %s"), (file_name != NULL) ? file_name : "raw data");
     continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
@@ -779,8 +795,662 @@ AmitkRawData * amitk_raw_data_import_raw_file(const gchar * file_name,
   if (update_func != NULL) 
     (*update_func)(update_data, NULL, (gdouble) 2.0); 
 
+  AMITK_TRACE_END("amitk_raw_data_import_raw_file", trace_start);
+  return raw_data;
+
+}
+
+
+/* if the data on disk is already in the format we use in memory, we can map
+   the file and let the OS page the data in as it gets used, instead of reading
+   the whole thing in up front.  The mapping is copy on write, so changes to the
+   data never make it back to the file.
+
+   Returns NULL if the data can't be mapped (wrong byte order, misaligned, too
+   small to be worth it, etc.), in which case amitk_raw_data_import_raw_file
+   should be used instead.  No warnings are given.
+
+   notes:
+   1. either file_name, or existing_file need to be specified.
+      If existing_file is not being used, it must be NULL
+   2. mapping is not done on win32, as files can't be deleted while mapped,
+      and we delete the old file when saving over a study
+*/
+AmitkRawData * amitk_raw_data_map_raw_file(const gchar * file_name, 
+					   FILE * existing_file,
+					   AmitkRawFormat raw_format,
+					   AmitkVoxel dim,
+					   guint64 file_offset) {
+
+#if defined(G_OS_WIN32) || (GLIB_SIZEOF_VOID_P < 8)
+  /* also don't bother on 32bit platforms, where address space is tight */
+  return NULL;
+#else
+  FILE * new_file_pointer=NULL;
+  FILE * file_pointer;
+  AmitkFormat format;
+  GMappedFile * mapped_file;
+  GError * error=NULL;
+  guint64 num_bytes;
+  AmitkRawData * raw_data;
+
+  g_return_val_if_fail((file_name != NULL) || (existing_file != NULL), NULL);
+
+  /* only native formats can be used directly */
+  if (raw_format == AMITK_RAW_FORMAT_ASCII_8_NE) return NULL;
+  format = amitk_raw_format_to_format(raw_format);
+  if (amitk_format_to_raw_format(format) != raw_format) return NULL;
+
+  /* keep the data aligned, the mapping itself is page aligned */
+  if ((file_offset % amitk_format_sizes[format]) != 0) return NULL;
+
+  num_bytes = ((guint64) dim.x)*dim.y*dim.z*dim.g*dim.t*amitk_raw_format_sizes[raw_format];
+  if (num_bytes < MAP_THRESHOLD_BYTES) return NULL;
+
+  if (existing_file == NULL) {
+    if ((new_file_pointer = fopen(file_name, "rb")) == NULL) 
+      return NULL;
+    file_pointer = new_file_pointer;
+  } else {
+    file_pointer = existing_file;
+  }
+
+  /* writable here means a private copy on write mapping, the file's only opened for reading */
+  mapped_file = g_mapped_file_new_from_fd(fileno(file_pointer), TRUE, &error);
+  if (new_file_pointer != NULL) fclose(new_file_pointer); /* mapping stays valid */
+  if (mapped_file == NULL) {
+#ifdef AMIDE_DEBUG
+    g_print("couldn't map raw data: %s\n", error->message);
+#endif
+    g_error_free(error);
+    return NULL;
+  }
+
+  /* make sure the file's big enough, otherwise let the normal reader complain */
+  if ((g_mapped_file_get_contents(mapped_file) == NULL) ||
+      (file_offset + num_bytes > g_mapped_file_get_length(mapped_file))) {
+    g_mapped_file_unref(mapped_file);
+    return NULL;
+  }
+
+  raw_data = amitk_raw_data_new();
+  raw_data->format = format;
+  raw_data->dim = dim;
+  raw_data->mapped_file = mapped_file;
+  raw_data->data = g_mapped_file_get_contents(mapped_file) + file_offset;
+
+  return raw_data;
+#endif
+}
+
+
+#ifdef AMIDE_ZLIB_SUPPORT
+
+/* the chunked encoding is a header, an index giving the offset (from the start
+   of the header) and compressed size of each chunk, and then the chunks
+   themselves.  Each chunk is one plane, compressed on its own, so the format
+   allows any plane to be pulled out without touching the rest of the data, 
+   although read_chunked currently still decompresses every plane, as 
+   AmitkRawData keeps the whole data set in memory.  The header and index
+   are always little endian, the planes are in the byte order given by the
+   raw_format.  Before compression, integer data is delta encoded along the
+   plane, and multibyte data has its bytes shuffled so that all the first bytes
+   come first, then all the second bytes, etc., both of which help zlib a lot. */
+#define CHUNKED_MAGIC "AMIDEZCH"
+#define CHUNKED_MAGIC_LENGTH 8
+#define CHUNKED_VERSION 1
+#define CHUNKED_HEADER_ENTRIES 4 /* version, flags, num_chunks, voxels_per_chunk */
+#define CHUNKED_HEADER_SIZE (CHUNKED_MAGIC_LENGTH + CHUNKED_HEADER_ENTRIES*sizeof(guint64))
+#define CHUNKED_FLAG_SHUFFLE 0x1
+#define CHUNKED_FLAG_DELTA 0x2
+#define CHUNKED_ENCODING_NAME "chunked_zlib"
+#define CHUNKED_COMPRESSION_LEVEL 1 /* favor speed, most of the gain comes from the preconditioning */
+#define CHUNKED_MIN_BYTES 0x10000 /* anything smaller isn't worth compressing */
+#define CHUNKED_BATCH_BYTES 0x4000000 /* how much data to (de)compress at a time */
+
+typedef struct {
+  guchar * data; /* start of the raw data */
+  gsize voxels_per_chunk;
+  guint bytes_per_voxel;
+  guint flags;
+  gboolean swap; /* reading only, the data's in the other byte order */
+  gint first_chunk; /* chunk number of buffers[0] */
+  guchar ** buffers; /* compressed chunks */
+  guint64 * sizes; /* compressed sizes */
+  gint error; /* atomic */
+} chunked_batch_t;
+
+static gboolean compress_xif = FALSE;
+
+static void chunk_delta_encode(guchar * buffer, const gsize num, const guint bytes) {
+
+  gsize i;
+
+  switch(bytes) {
+  case 1:
+    for (i=num-1; i > 0; i--) buffer[i] -= buffer[i-1];
+    break;
+  case 2:
+    {
+      guint16 * p = (guint16 *) buffer;
+      for (i=num-1; i > 0; i--) p[i] -= p[i-1];
+    }
+    break;
+  case 4:
+    {
+      guint32 * p = (guint32 *) buffer;
+      for (i=num-1; i > 0; i--) p[i] -= p[i-1];
+    }
+    break;
+  default:
+    g_error("unexpected case in %s at line %d", __FILE__, __LINE__);
+    break;
+  }
+
+  return;
+}
+
+static void chunk_delta_decode(guchar * buffer, const gsize num, const guint bytes) {
+
+  gsize i;
+
+  switch(bytes) {
+  case 1:
+    for (i=1; i < num; i++) buffer[i] += buffer[i-1];
+    break;
+  case 2:
+    {
+      guint16 * p = (guint16 *) buffer;
+      for (i=1; i < num; i++) p[i] += p[i-1];
+    }
+    break;
+  case 4:
+    {
+      guint32 * p = (guint32 *) buffer;
+      for (i=1; i < num; i++) p[i] += p[i-1];
+    }
+    break;
+  default:
+    g_error("unexpected case in %s at line %d", __FILE__, __LINE__);
+    break;
+  }
+
+  return;
+}
+
+static void chunk_shuffle(guchar * dest, const guchar * src, const gsize num, const guint bytes) {
+
+  gsize i;
+  guint b;
+
+  for (b=0; b < bytes; b++)
+    for (i=0; i < num; i++)
+      dest[b*num+i] = src[i*bytes+b];
+
+  return;
+}
+
+/* if swap is set, also flips the byte order of each voxel */
+static void chunk_unshuffle(guchar * dest, const guchar * src, const gsize num, const guint bytes,
+			    const gboolean swap) {
+
+  gsize i;
+  guint b, dest_b;
+
+  for (b=0; b < bytes; b++) {
+    dest_b = swap ? bytes-1-b : b;
+    for (i=0; i < num; i++)
+      dest[i*bytes+dest_b] = src[b*num+i];
+  }
+
+  return;
+}
+
+static void chunk_swap(guchar * buffer, const gsize num, const guint bytes) {
+
+  gsize i;
+  guint b;
+  guchar temp;
+
+  for (i=0; i < num; i++, buffer += bytes)
+    for (b=0; b < bytes/2; b++) {
+      temp = buffer[b];
+      buffer[b] = buffer[bytes-1-b];
+      buffer[bytes-1-b] = temp;
+    }
+
+  return;
+}
+
+static void compress_chunks(gint start, gint end, gpointer data) {
+
+  chunked_batch_t * batch = data;
+  gsize chunk_bytes = batch->voxels_per_chunk*batch->bytes_per_voxel;
+  guchar * delta_buffer=NULL;
+  guchar * shuffle_buffer=NULL;
+  const guchar * src;
+  uLongf dest_length;
+  gint i;
+
+  if ((batch->flags & CHUNKED_FLAG_DELTA) &&
+      ((delta_buffer = g_try_malloc(chunk_bytes)) == NULL))
+    goto error;
+  if ((batch->flags & CHUNKED_FLAG_SHUFFLE) &&
+      ((shuffle_buffer = g_try_malloc(chunk_bytes)) == NULL))
+    goto error;
+
+  for (i=start; i < end; i++) {
+    src = batch->data + ((gsize) (batch->first_chunk+i))*chunk_bytes;
+
+    if (batch->flags & CHUNKED_FLAG_DELTA) {
+      memcpy(delta_buffer, src, chunk_bytes);
+      chunk_delta_encode(delta_buffer, batch->voxels_per_chunk, batch->bytes_per_voxel);
+      src = delta_buffer;
+    }
+    if (batch->flags & CHUNKED_FLAG_SHUFFLE) {
+      chunk_shuffle(shuffle_buffer, src, batch->voxels_per_chunk, batch->bytes_per_voxel);
+      src = shuffle_buffer;
+    }
+
+    dest_length = compressBound(chunk_bytes);
+    if ((batch->buffers[i] = g_try_malloc(dest_length)) == NULL)
+      goto error;
+    if (compress2(batch->buffers[i], &dest_length, src, chunk_bytes, CHUNKED_COMPRESSION_LEVEL) != Z_OK)
+      goto error;
+    batch->sizes[i] = dest_length;
+  }
+
+  goto exit;
+
+ error:
+  g_atomic_int_set(&batch->error, TRUE);
+
+ exit:
+  if (delta_buffer != NULL) g_free(delta_buffer);
+  if (shuffle_buffer != NULL) g_free(shuffle_buffer);
+
+  return;
+}
+
+static void decompress_chunks(gint start, gint end, gpointer data) {
+
+  chunked_batch_t * batch = data;
+  gsize chunk_bytes = batch->voxels_per_chunk*batch->bytes_per_voxel;
+  guchar * shuffle_buffer=NULL;
+  guchar * dest;
+  uLongf dest_length;
+  gint i;
+
+  if ((batch->flags & CHUNKED_FLAG_SHUFFLE) &&
+      ((shuffle_buffer = g_try_malloc(chunk_bytes)) == NULL))
+    goto error;
+
+  for (i=start; i < end; i++) {
+    dest = batch->data + ((gsize) (batch->first_chunk+i))*chunk_bytes;
+
+    dest_length = chunk_bytes;
+    if (uncompress((batch->flags & CHUNKED_FLAG_SHUFFLE) ? shuffle_buffer : dest, &dest_length, 
+		   batch->buffers[i], batch->sizes[i]) != Z_OK)
+      goto error;
+    if (dest_length != chunk_bytes)
+      goto error;
+
+    if (batch->flags & CHUNKED_FLAG_SHUFFLE) 
+      chunk_unshuffle(dest, shuffle_buffer, batch->voxels_per_chunk, batch->bytes_per_voxel, batch->swap);
+    else if (batch->swap)
+      chunk_swap(dest, batch->voxels_per_chunk, batch->bytes_per_voxel);
+
+    if (batch->flags & CHUNKED_FLAG_DELTA)
+      chunk_delta_decode(dest, batch->voxels_per_chunk, batch->bytes_per_voxel);
+  }
+
+  goto exit;
+
+ error:
+  g_atomic_int_set(&batch->error, TRUE);
+
+ exit:
+  if (shuffle_buffer != NULL) g_free(shuffle_buffer);
+
+  return;
+}
+
+/* writes out the raw data in the chunked format at the current position in the file.
+   Returns FALSE on failure. */
+static gboolean write_chunked(AmitkRawData * raw_data, FILE * file_pointer) {
+
+  chunked_batch_t batch;
+  gint num_chunks, chunks_per_batch, num_in_batch;
+  gsize chunk_bytes;
+  guint64 * index=NULL;
+  guint64 header[CHUNKED_HEADER_ENTRIES];
+  guint64 chunk_location;
+  long start_location, end_location;
+  gint i, i_chunk;
+  gboolean success=FALSE;
+
+  batch.data = raw_data->data;
+  batch.voxels_per_chunk = raw_data->dim.x*raw_data->dim.y;
+  batch.bytes_per_voxel = amitk_format_sizes[raw_data->format];
+  batch.flags = 0;
+  if (batch.bytes_per_voxel > 1)
+    batch.flags |= CHUNKED_FLAG_SHUFFLE;
+  if ((raw_data->format != AMITK_FORMAT_FLOAT) && (raw_data->format != AMITK_FORMAT_DOUBLE))
+    batch.flags |= CHUNKED_FLAG_DELTA;
+  batch.swap = FALSE;
+  batch.buffers = NULL;
+  batch.sizes = NULL;
+  batch.error = FALSE;
+
+  num_chunks = raw_data->dim.z*raw_data->dim.g*raw_data->dim.t;
+  chunk_bytes = batch.voxels_per_chunk*batch.bytes_per_voxel;
+  chunks_per_batch = CLAMP(CHUNKED_BATCH_BYTES/chunk_bytes, 1, num_chunks);
+
+  if ((index = g_try_malloc0(2*num_chunks*sizeof(guint64))) == NULL) {
+    g_warning(_("couldn't allocate memory space for the chunk index"));
+    goto exit;
+  }
+  if (((batch.buffers = g_try_malloc0(chunks_per_batch*sizeof(guchar *))) == NULL) ||
+      ((batch.sizes = g_try_malloc0(chunks_per_batch*sizeof(guint64))) == NULL)) {
+    g_warning(_("couldn't allocate memory space for compression buffers"));
+    goto exit;
+  }
+
+  /* the header, and a placeholder index that gets filled in at the end */
+  start_location = ftell(file_pointer);
+  header[0] = GUINT64_TO_LE(CHUNKED_VERSION);
+  header[1] = GUINT64_TO_LE(batch.flags);
+  header[2] = GUINT64_TO_LE(num_chunks);
+  header[3] = GUINT64_TO_LE(batch.voxels_per_chunk);
+  if ((fwrite(CHUNKED_MAGIC, 1, CHUNKED_MAGIC_LENGTH, file_pointer) != CHUNKED_MAGIC_LENGTH) ||
+      (fwrite(header, sizeof(guint64), CHUNKED_HEADER_ENTRIES, file_pointer) != CHUNKED_HEADER_ENTRIES) ||
+      (fwrite(index, sizeof(guint64), 2*num_chunks, file_pointer) != 2*num_chunks)) 
+    goto write_error;
+  chunk_location = CHUNKED_HEADER_SIZE + 2*num_chunks*sizeof(guint64);
+
+  for (batch.first_chunk=0; batch.first_chunk < num_chunks; batch.first_chunk += num_in_batch) {
+    num_in_batch = MIN(chunks_per_batch, num_chunks-batch.first_chunk);
+
+    amitk_parallel_for(num_in_batch, 1, compress_chunks, &batch, NULL, NULL);
+    if (g_atomic_int_get(&batch.error)) {
+      g_warning(_("couldn't compress raw data"));
+      goto exit;
+    }
+
+    for (i=0; i < num_in_batch; i++) {
+      i_chunk = batch.first_chunk+i;
+      if (fwrite(batch.buffers[i], 1, batch.sizes[i], file_pointer) != batch.sizes[i])
+	goto write_error;
+      index[2*i_chunk] = GUINT64_TO_LE(chunk_location);
+      index[2*i_chunk+1] = GUINT64_TO_LE(batch.sizes[i]);
+      chunk_location += batch.sizes[i];
+      g_free(batch.buffers[i]);
+      batch.buffers[i] = NULL;
+    }
+  }
+
+  /* go back and fill in the index */
+  end_location = ftell(file_pointer);
+  if ((fseek(file_pointer, start_location+CHUNKED_HEADER_SIZE, SEEK_SET) != 0) ||
+      (fwrite(index, sizeof(guint64), 2*num_chunks, file_pointer) != 2*num_chunks) ||
+      (fseek(file_pointer, end_location, SEEK_SET) != 0))
+    goto write_error;
+
+  success = TRUE;
+  goto exit;
+
+ write_error:
+  g_warning(_("incomplete save of compressed raw data"));
+
+ exit:
+  if (batch.buffers != NULL) {
+    for (i=0; i < chunks_per_batch; i++)
+      if (batch.buffers[i] != NULL) 
+	g_free(batch.buffers[i]);
+    g_free(batch.buffers);
+  }
+  if (batch.sizes != NULL) g_free(batch.sizes);
+  if (index != NULL) g_free(index);
+
+  return success;
+}
+
+/* reads in all num_chunks chunks (planes) into the raw data */
+static gboolean read_chunks(FILE * file_pointer, long file_offset, const guint64 * index,
+			    chunked_batch_t * batch, gint num_chunks,
+			    AmitkUpdateFunc update_func, gpointer update_data) {
+
+  gint num_in_batch, i;
+  guint64 batch_bytes;
+  guint64 location;
+  gsize chunk_bytes;
+  gboolean continue_work=TRUE;
+  gboolean success=FALSE;
+  gint max_in_batch;
+
+  chunk_bytes = batch->voxels_per_chunk*batch->bytes_per_voxel;
+  max_in_batch = CLAMP(CHUNKED_BATCH_BYTES/chunk_bytes, 1, num_chunks);
+
+  if (((batch->buffers = g_try_malloc0(max_in_batch*sizeof(guchar *))) == NULL) ||
+      ((batch->sizes = g_try_malloc0(max_in_batch*sizeof(guint64))) == NULL)) {
+    g_warning(_("couldn't allocate memory space for compression buffers"));
+    goto exit;
+  }
+
+  for (batch->first_chunk = 0; 
+       (batch->first_chunk < num_chunks) && continue_work; 
+       batch->first_chunk += num_in_batch) {
+
+    /* read in the compressed chunks, the reading has to be done serially */
+    batch_bytes = 0;
+    for (num_in_batch = 0; 
+	 (num_in_batch < max_in_batch) && (batch->first_chunk+num_in_batch < num_chunks); 
+	 num_in_batch++) {
+      i = batch->first_chunk+num_in_batch;
+      location = GUINT64_FROM_LE(index[2*i]);
+      batch->sizes[num_in_batch] = GUINT64_FROM_LE(index[2*i+1]);
+      if ((batch->sizes[num_in_batch] > compressBound(chunk_bytes)) || 
+	  (!xml_check_file_32bit_okay(file_offset+location))) {
+	g_warning(_("corrupt chunk index in compressed raw data"));
+	goto exit;
+      }
+      if ((batch->buffers[num_in_batch] = g_try_malloc(batch->sizes[num_in_batch])) == NULL) {
+	g_warning(_("couldn't malloc %zd bytes for file buffer\n"), (gsize) batch->sizes[num_in_batch]);
+	goto exit;
+      }
+      if ((fseek(file_pointer, file_offset+location, SEEK_SET) != 0) ||
+	  (fread(batch->buffers[num_in_batch], 1, batch->sizes[num_in_batch], file_pointer) != 
+	   batch->sizes[num_in_batch])) {
+	g_warning(_("couldn't read compressed raw data"));
+	g_free(batch->buffers[num_in_batch]);
+	batch->buffers[num_in_batch] = NULL;
+	goto exit;
+      }
+      batch_bytes += batch->sizes[num_in_batch];
+      if (batch_bytes >= CHUNKED_BATCH_BYTES) {
+	num_in_batch++;
+	break;
+      }
+    }
+
+    /* and decompress them in parallel */
+    amitk_parallel_for(num_in_batch, 1, decompress_chunks, batch, NULL, NULL);
+
+    for (i=0; i < num_in_batch; i++) {
+      g_free(batch->buffers[i]);
+      batch->buffers[i] = NULL;
+    }
+
+    if (g_atomic_int_get(&batch->error)) {
+      g_warning(_("couldn't decompress raw data, file is corrupt"));
+      goto exit;
+    }
+
+    if (update_func != NULL)
+      continue_work = (*update_func)(update_data, NULL, 
+				     ((gdouble) (batch->first_chunk+num_in_batch))/
+				     ((gdouble) num_chunks));
+  }
+
+  success = continue_work;
+
+ exit:
+  if (batch->buffers != NULL) {
+    for (i=0; i < max_in_batch; i++)
+      if (batch->buffers[i] != NULL) 
+	g_free(batch->buffers[i]);
+    g_free(batch->buffers);
+    batch->buffers = NULL;
+  }
+  if (batch->sizes != NULL) {
+    g_free(batch->sizes);
+    batch->sizes = NULL;
+  }
+
+  return success;
+}
+
+/* reads in raw data saved in the chunked format */
+static AmitkRawData * read_chunked(const gchar * file_name, 
+				   FILE * existing_file,
+				   AmitkRawFormat raw_format,
+				   AmitkVoxel dim,
+				   long file_offset,
+				   AmitkUpdateFunc update_func,
+				   gpointer update_data) {
+
+  FILE * new_file_pointer=NULL;
+  FILE * file_pointer;
+  AmitkRawData * raw_data=NULL;
+  AmitkFormat format;
+  chunked_batch_t batch;
+  gchar magic[CHUNKED_MAGIC_LENGTH];
+  guint64 header[CHUNKED_HEADER_ENTRIES];
+  guint64 * index=NULL;
+  guint64 flags;
+  guint bytes_per_voxel;
+  gint num_chunks;
+  gchar * temp_string;
+
+  g_return_val_if_fail((file_name != NULL) || (existing_file != NULL), NULL);
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Reading: %s"), (file_name != NULL) ? file_name : "raw data");
+    (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  /* the writer only ever writes out little or big endian data */
+  if ((raw_format == AMITK_RAW_FORMAT_ASCII_8_NE) ||
+      (raw_format == AMITK_RAW_FORMAT_UINT_32_PDP) ||
+      (raw_format == AMITK_RAW_FORMAT_SINT_32_PDP) ||
+      (raw_format == AMITK_RAW_FORMAT_FLOAT_32_PDP)) {
+    g_warning(_("unsupported raw format for compressed raw data"));
+    goto error_condition;
+  }
+  format = amitk_raw_format_to_format(raw_format);
+
+  if (existing_file == NULL) {
+    if ((new_file_pointer = fopen(file_name, "rb")) == NULL) {
+      g_warning(_("couldn't open raw data file %s"), file_name);
+      goto error_condition;
+    }
+    file_pointer = new_file_pointer;
+  } else {
+    file_pointer = existing_file;
+  }
+
+  if (fseek(file_pointer, file_offset, SEEK_SET) != 0) {
+    g_warning(_("could not seek forward %ld bytes in raw data file"),file_offset);
+    goto error_condition;
+  }
+
+  /* check the header */
+  if ((fread(magic, 1, CHUNKED_MAGIC_LENGTH, file_pointer) != CHUNKED_MAGIC_LENGTH) ||
+      (fread(header, sizeof(guint64), CHUNKED_HEADER_ENTRIES, file_pointer) != CHUNKED_HEADER_ENTRIES) ||
+      (strncmp(magic, CHUNKED_MAGIC, CHUNKED_MAGIC_LENGTH) != 0)) {
+    g_warning(_("compressed raw data header is corrupt"));
+    goto error_condition;
+  }
+  if (GUINT64_FROM_LE(header[0]) > CHUNKED_VERSION) {
+    g_warning(_("compressed raw data was written by a newer version of AMIDE"));
+    goto error_condition;
+  }
+  /* the flags come from the file, so make sure we know how to undo them */
+  flags = GUINT64_FROM_LE(header[1]);
+  bytes_per_voxel = amitk_format_sizes[format];
+  if ((flags & ~((guint64) (CHUNKED_FLAG_SHUFFLE | CHUNKED_FLAG_DELTA))) ||
+      ((flags & CHUNKED_FLAG_DELTA) && 
+       (bytes_per_voxel != 1) && (bytes_per_voxel != 2) && (bytes_per_voxel != 4))) {
+    g_warning(_("compressed raw data uses an encoding this version of AMIDE can't read"));
+    goto error_condition;
+  }
+
+  num_chunks = dim.z*dim.g*dim.t;
+  if ((num_chunks <= 0) || (dim.x*dim.y <= 0) ||
+      (GUINT64_FROM_LE(header[2]) != num_chunks) ||
+      (GUINT64_FROM_LE(header[3]) != ((guint64) dim.x)*dim.y)) {
+    g_warning(_("compressed raw data doesn't match the given dimensions"));
+    goto error_condition;
+  }
+
+  if ((index = g_try_malloc(2*num_chunks*sizeof(guint64))) == NULL) {
+    g_warning(_("couldn't allocate memory space for the chunk index"));
+    goto error_condition;
+  }
+  if (fread(index, sizeof(guint64), 2*num_chunks, file_pointer) != 2*num_chunks) {
+    g_warning(_("compressed raw data index is corrupt"));
+    goto error_condition;
+  }
+
+  raw_data = amitk_raw_data_new_with_data(format, dim);
+  if (raw_data == NULL) {
+    g_warning(_("couldn't allocate memory space for the raw data set structure"));
+    goto error_condition;
+  }
+
+  batch.data = raw_data->data;
+  batch.voxels_per_chunk = dim.x*dim.y;
+  batch.bytes_per_voxel = bytes_per_voxel;
+  batch.flags = flags;
+  batch.swap = (batch.bytes_per_voxel > 1) && (amitk_format_to_raw_format(format) != raw_format);
+  batch.buffers = NULL;
+  batch.sizes = NULL;
+  batch.error = FALSE;
+
+  if (!read_chunks(file_pointer, file_offset, index, &batch, num_chunks, update_func, update_data))
+    goto error_condition;
+
+  goto exit_condition;
+
+ error_condition:
+  if (raw_data != NULL)
+    g_object_unref(raw_data);
+  raw_data = NULL;
+
+ exit_condition:
+  if (new_file_pointer != NULL)
+    fclose(new_file_pointer);
+
+  if (index != NULL)
+    g_free(index);
+
+  if (update_func != NULL) 
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
   return raw_data;
+}
+
+#endif /* AMIDE_ZLIB_SUPPORT */
 
+
+/* whether amitk_raw_data_write_xml should compress the raw data, only
+   has an effect if we were compiled with zlib */
+void amitk_raw_data_set_compress_xif(const gboolean compress) {
+#ifdef AMIDE_ZLIB_SUPPORT
+  compress_xif = compress;
+#endif
+  return;
 }
 
 
@@ -803,6 +1473,9 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
   size_t bytes_per_unit;
   size_t total_to_write;
   size_t total_wrote = 0;
+#ifdef AMIDE_ZLIB_SUPPORT
+  gboolean compressed = FALSE;
+#endif
 
   if (study_file == NULL) {
     /* make a guess as to our filename */
@@ -840,6 +1513,19 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
   num_to_write = amitk_raw_data_num_voxels(raw_data);
   bytes_per_unit = amitk_format_sizes[AMITK_RAW_DATA_FORMAT(raw_data)]; 
   total_to_write = num_to_write;
+
+#ifdef AMIDE_ZLIB_SUPPORT
+  if (compress_xif && (num_to_write*bytes_per_unit >= CHUNKED_MIN_BYTES)) {
+    if (!write_chunked(raw_data, file_pointer)) {
+      g_free(xml_filename);
+      g_free(raw_filename);
+      if (study_file == NULL) fclose(file_pointer);
+      return;
+    }
+    compressed = TRUE;
+    num_to_write = 0;
+  }
+#endif
    
   /* write in small chunks (<=16MB) to get around a bad samba/cygwin interaction */
   while(num_to_write > 0) {
@@ -875,6 +1561,10 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
   amitk_voxel_write_xml(doc->children, "dim", raw_data->dim);
   xml_save_string(doc->children,"raw_format", 
 		  amitk_raw_format_get_name(amitk_format_to_raw_format(raw_data->format)));
+#ifdef AMIDE_ZLIB_SUPPORT
+  if (compressed)
+    xml_save_string(doc->children,"raw_data_encoding", CHUNKED_ENCODING_NAME);
+#endif
 
   /* store the info on our associated data */
   if (study_file == NULL) {
@@ -921,6 +1611,7 @@ AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
   guint64 offset, dummy;
   long offset_long=0;
   AmitkVoxel dim;
+  gchar * encoding;
 
 
   if ((doc = xml_open_doc(xml_filename, study_file, location, size, perror_buf)) == NULL)
@@ -956,6 +1647,9 @@ AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
       raw_format = i_raw_format;
 
   g_free(temp_string);
+
+  /* NULL means the data's stored uncompressed */
+  encoding = xml_get_string(nodes, "raw_data_encoding");
   
   /* get the filename or location of our associated data */
   if (study_file == NULL) {
@@ -976,10 +1670,27 @@ AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
   }
 
 
-  raw_data = amitk_raw_data_import_raw_file(raw_filename, study_file, raw_format, dim, offset_long, 
-					    update_func, update_data);
+  if (encoding != NULL) {
+#ifdef AMIDE_ZLIB_SUPPORT
+    if (g_ascii_strcasecmp(encoding, CHUNKED_ENCODING_NAME) == 0)
+      raw_data = read_chunked(raw_filename, study_file, raw_format, dim, offset_long,
+			      update_func, update_data);
+    else
+#endif
+      {
+	amitk_append_str_with_newline(perror_buf, _("Unsupported raw data encoding: %s"), encoding);
+	raw_data = NULL;
+      }
+  } else {
+    /* try mapping the data first, so the data only gets paged in as needed */
+    raw_data = amitk_raw_data_map_raw_file(raw_filename, study_file, raw_format, dim, offset_long);
+    if (raw_data == NULL)
+      raw_data = amitk_raw_data_import_raw_file(raw_filename, study_file, raw_format, dim, offset_long, 
+						update_func, update_data);
+  }
 
   /* and we're done */
+  if (encoding != NULL) g_free(encoding);
   if (raw_filename != NULL) g_free(raw_filename);
   xmlFreeDoc(doc);
 
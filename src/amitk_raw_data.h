@@ -47,6 +47,7 @@ G_BEGIN_DECLS
 #define AMITK_RAW_DATA_DIM_Z(rd)          (AMITK_RAW_DATA(rd)->dim.z)
 #define AMITK_RAW_DATA_DIM_G(rd)          (AMITK_RAW_DATA(rd)->dim.g)
 #define AMITK_RAW_DATA_DIM_T(rd)          (AMITK_RAW_DATA(rd)->dim.t)
+#define AMITK_RAW_DATA_MAPPED(rd)         (AMITK_RAW_DATA(rd)->mapped_file != NULL)
 
 /* glib doesn't define these for PDP */
 #ifdef G_BIG_ENDIAN
@@ -121,6 +122,10 @@ struct _AmitkRawData {
   AmitkVoxel dim;
   gpointer data;
   AmitkFormat format;
+
+  /* if non-NULL, data points into this (copy on write) mapping of the file
+     the data was loaded from, instead of being allocated with g_try_malloc */
+  GMappedFile * mapped_file;
   
 };
 
@@ -170,6 +175,12 @@ AmitkRawData *  amitk_raw_data_import_raw_file      (const gchar * file_name,
 						     long file_offset,
 						     AmitkUpdateFunc update_func,
 						     gpointer update_data);
+AmitkRawData *  amitk_raw_data_map_raw_file         (const gchar * file_name,
+						     FILE * existing_file,
+						     AmitkRawFormat raw_format,
+						     AmitkVoxel dim,
+						     guint64 file_offset);
+void            amitk_raw_data_set_compress_xif     (const gboolean compress);
 void            amitk_raw_data_write_xml            (AmitkRawData  * raw_data, const gchar * name,
 						     FILE * study_file, gchar ** output_filename, 
 						     guint64 * location, guint64 * size);
@@ -841,15 +841,10 @@ void amitk_roi_erase_volume(const AmitkRoi * roi,
     for (i_gate=0; i_gate<AMITK_DATA_SET_NUM_GATES(ds); i_gate++) 
       amitk_roi_calculate_on_data_set(roi, ds, i_frame, i_gate, outside, FALSE, erase_volume, ds);
 
-  /* recalc max and min */
+  /* mark the statistics and distribution as invalid, and recalc max and min */
+  amitk_data_set_invalidate_stats(ds);
   amitk_data_set_calc_min_max(ds, update_func, update_data);
 
-  /* mark the distribution data as invalid */
-  if (AMITK_DATA_SET_DISTRIBUTION(ds) != NULL) {
-    g_object_unref(AMITK_DATA_SET_DISTRIBUTION(ds));
-    ds->distribution = NULL;
-  }
-
   /* this is a no-op to get a data_set_changed signal */
   amitk_data_set_set_value(AMITK_DATA_SET(ds), zero_voxel,
 			   amitk_data_set_get_value(AMITK_DATA_SET(ds), zero_voxel),
@@ -30,6 +30,7 @@
 #include <sys/time.h>
 #include <glib.h>
 #include "amitk_roi_`'m4_Variable_Type`'.h"
+#include "amitk_parallel.h"
 
 
 #define ROI_TYPE_`'m4_Variable_Type`'
@@ -426,122 +427,142 @@ AmitkDataSet * amitk_roi_`'m4_Variable_Type`'_get_intersection_slice(const Amitk
 
 
 #if defined(ROI_TYPE_ISOCONTOUR_2D) || defined(ROI_TYPE_ISOCONTOUR_3D) 
-/* the data in temp_rd is setup as follows:
-   bit 1 -> is the voxel in the isocontour
-   bit 2 -> has the voxel been checked 
-   bit 3 -> increment x for backup
-   bit 4 -> decrement x for backup
-   bit 5 -> increment y for backup
-   bit 6 -> decrement y for backup
-   bit 7 -> increment z for backup
-   bit 8 -> decrement z for backup
+/* the isocontour is grown in a mask the size of the data set, with a one
+   voxel border of zeros on each side (x and y, and z in the 3D case) so that
+   neighbors never need bounds checking:
+   ISOCONTOUR_CANDIDATE -> the voxel's value is within the isocontour range
+   ISOCONTOUR_IN -> the voxel is in the isocontour
 */
-static void isocontour_consider(const AmitkDataSet * ds,
-				const AmitkRawData * temp_rd, 
-				AmitkVoxel ds_voxel, 
-				const amide_data_t iso_min_value,
-				const amide_data_t iso_max_value,
-				const AmitkRoiIsocontourRange iso_range) {
+#define ISOCONTOUR_CANDIDATE 0x01
+#define ISOCONTOUR_IN 0x02
 
+#ifdef ROI_TYPE_ISOCONTOUR_3D
+#define ISOCONTOUR_BORDER_Z 1
+#define ISOCONTOUR_NUM_NEIGHBORS 26
+#else
+#define ISOCONTOUR_BORDER_Z 0
+#define ISOCONTOUR_NUM_NEIGHBORS 8
+#endif
 
-  AmitkVoxel i_voxel;
-  AmitkVoxel roi_voxel;
-  gboolean found;
-  gboolean done;
-  amide_data_t voxel_value;
+#define ISOCONTOUR_MASK_INDEX(mask_dim, ix, iy, iz) \
+  ((((gsize) (iz)+ISOCONTOUR_BORDER_Z)*(mask_dim).y + ((iy)+1))*(mask_dim).x + ((ix)+1))
 
-  roi_voxel = ds_voxel;
-  roi_voxel.t = roi_voxel.g = 0;
-  i_voxel =roi_voxel;
-  done=FALSE;
+typedef struct {
+  AmitkDataSet * ds;
+  AmitkVoxel ds_voxel;
+  amide_data_t min_value;
+  amide_data_t max_value;
+  guint8 * mask;
+  AmitkVoxel mask_dim;
+} isocontour_t;
 
-  /* the starting point is in by definition */
-  AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd, roi_voxel) |= 0x03;
+#ifdef ROI_TYPE_ISOCONTOUR_3D
+/* threshold planes [start, end) of the data set into the mask */
+static void isocontour_threshold_planes(gint start, gint end, gpointer data) {
 
-  /* while we still have neighbor voxels to check */
-  while (!done) {
+  isocontour_t * iso = data;
+  gint z;
 
-    found = FALSE;
+  for (z=start; z<end; z++)
+    amitk_data_set_threshold_plane(iso->ds, iso->ds_voxel.t, iso->ds_voxel.g, z,
+				   iso->min_value, iso->max_value,
+				   iso->mask + ISOCONTOUR_MASK_INDEX(iso->mask_dim, 0, 0, z),
+				   iso->mask_dim.x);
 
-    /* find a neighbor to check, consider the 8 adjoining voxels, or 26 in the case of 3D */
-#ifdef ROI_TYPE_ISOCONTOUR_3D
-    for (i_voxel.z = (roi_voxel.z >= 1) ? roi_voxel.z-1 : 0;
-	 (i_voxel.z < temp_rd->dim.z) && (i_voxel.z <= roi_voxel.z+1) && (!found);
-	 i_voxel.z++)
+  return;
+}
 #endif
-      for (i_voxel.y = (roi_voxel.y >= 1) ? roi_voxel.y-1 : 0;
-	   (i_voxel.y < temp_rd->dim.y) && (i_voxel.y <= roi_voxel.y+1) && (!found);
-	   i_voxel.y++)
-	for (i_voxel.x = (roi_voxel.x >= 1) ? roi_voxel.x-1 : 0;
-	     (i_voxel.x < temp_rd->dim.x) && (i_voxel.x <= roi_voxel.x+1) && (!found);
-	     i_voxel.x++) 
-	  if (!(AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, i_voxel) & 0x02)) { /* don't recheck something we've already checked */
-	    AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x02; /* it's been checked */
-
-	    ds_voxel.z = i_voxel.z;
-	    ds_voxel.y = i_voxel.y;
-	    ds_voxel.x = i_voxel.x;
-
-	    voxel_value = amitk_data_set_get_value(ds, ds_voxel);
-	    if (((iso_range == AMITK_ROI_ISOCONTOUR_RANGE_ABOVE_MIN) && (voxel_value >= iso_min_value)) ||
-		((iso_range == AMITK_ROI_ISOCONTOUR_RANGE_BELOW_MAX) && (voxel_value <= iso_max_value)) ||
-		((iso_range == AMITK_ROI_ISOCONTOUR_RANGE_BETWEEN_MIN_MAX) && (voxel_value >= iso_min_value) && (voxel_value <= iso_max_value))) {
-
-	      AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x01; /* it's in */
-
-	      /* store backup info */
-#ifdef ROI_TYPE_ISOCONTOUR_3D
-	      if (i_voxel.z > roi_voxel.z)
-		AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x40;
-	      else if (i_voxel.z < roi_voxel.z)
-		AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x80;
+
+/* fills in iso->mask with the voxels connected to ds_voxel (8 neighbors, or 26 
+   in the 3D case) that are within the isocontour range, the starting voxel is 
+   in by definition.  The bounding box of the isocontour (in data set voxels, 
+   z is left alone in the 2D case) is returned in pmin_voxel and pmax_voxel.
+   Returns FALSE if the mask couldn't be allocated */
+static gboolean isocontour_consider(isocontour_t * iso,
+				    AmitkVoxel * pmin_voxel,
+				    AmitkVoxel * pmax_voxel) {
+
+  AmitkVoxel dim;
+  AmitkVoxel i_voxel;
+  gssize neighbors[ISOCONTOUR_NUM_NEIGHBORS];
+  gint dx, dy, dz, j;
+  GArray * work;
+  gsize index, neighbor, plane_size;
+
+  dim = AMITK_DATA_SET_DIM(iso->ds);
+  iso->mask_dim.x = dim.x+2;
+  iso->mask_dim.y = dim.y+2;
+  iso->mask_dim.z = dim.z+2*ISOCONTOUR_BORDER_Z;
+#ifdef ROI_TYPE_ISOCONTOUR_2D
+  iso->mask_dim.z = 1;
 #endif
-	      if (i_voxel.y > roi_voxel.y)
-		AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x10;
-	      else if (i_voxel.y < roi_voxel.y)
-		AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x20;
-	      if (i_voxel.x > roi_voxel.x)
-		AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x04;
-	      else if (i_voxel.x < roi_voxel.x)
-		AMITK_RAW_DATA_UBYTE_SET_CONTENT(temp_rd,i_voxel) |= 0x08;
-	      
-	      /* start next iteration at this voxel */
-	      roi_voxel = i_voxel; 
-	      found = TRUE;
-	    }
-	  }
+  iso->mask_dim.g = iso->mask_dim.t = 1;
+  plane_size = iso->mask_dim.x * (gsize) iso->mask_dim.y;
 
-        
-    if (!found) { /* all neighbors exhaustively checked, backup */
+  if ((iso->mask = g_try_malloc0(plane_size*iso->mask_dim.z)) == NULL) {
+    g_warning(_("couldn't allocate memory space for the isocontour"));
+    return FALSE;
+  }
 
-      /* backup to previous voxel */
-      i_voxel = roi_voxel;
+  /* mark the voxels within range, the planes are independent */
+#ifdef ROI_TYPE_ISOCONTOUR_3D
+  amitk_parallel_for(dim.z, 1, isocontour_threshold_planes, iso, NULL, NULL);
+#else
+  amitk_data_set_threshold_plane(iso->ds, iso->ds_voxel.t, iso->ds_voxel.g, iso->ds_voxel.z,
+				 iso->min_value, iso->max_value,
+				 iso->mask + ISOCONTOUR_MASK_INDEX(iso->mask_dim, 0, 0, 0),
+				 iso->mask_dim.x);
+#endif
+
+  /* offsets to the neighbors within the mask */
+  j = 0;
+  for (dz = -ISOCONTOUR_BORDER_Z; dz <= ISOCONTOUR_BORDER_Z; dz++)
+    for (dy = -1; dy <= 1; dy++)
+      for (dx = -1; dx <= 1; dx++)
+	if ((dx != 0) || (dy != 0) || (dz != 0))
+	  neighbors[j++] = (dz*(gssize) iso->mask_dim.y + dy)*iso->mask_dim.x + dx;
+
+  /* grow out from the starting voxel.  Voxels are marked as they go onto the
+     work list, so each is looked at once, and the order they're taken off
+     doesn't change what ends up in the isocontour */
+  work = g_array_new(FALSE, FALSE, sizeof(gsize));
+#ifdef ROI_TYPE_ISOCONTOUR_3D
+  index = ISOCONTOUR_MASK_INDEX(iso->mask_dim, iso->ds_voxel.x, iso->ds_voxel.y, iso->ds_voxel.z);
+#else
+  index = ISOCONTOUR_MASK_INDEX(iso->mask_dim, iso->ds_voxel.x, iso->ds_voxel.y, 0);
+#endif
+  iso->mask[index] = ISOCONTOUR_IN;
+  g_array_append_val(work, index);
+
+  *pmin_voxel = *pmax_voxel = iso->ds_voxel;
+  while (work->len > 0) {
+    index = g_array_index(work, gsize, work->len-1);
+    g_array_set_size(work, work->len-1);
+
+    i_voxel.x = index % iso->mask_dim.x - 1;
+    i_voxel.y = (index / iso->mask_dim.x) % iso->mask_dim.y - 1;
+    if (pmin_voxel->x > i_voxel.x) pmin_voxel->x = i_voxel.x;
+    if (pmax_voxel->x < i_voxel.x) pmax_voxel->x = i_voxel.x;
+    if (pmin_voxel->y > i_voxel.y) pmin_voxel->y = i_voxel.y;
+    if (pmax_voxel->y < i_voxel.y) pmax_voxel->y = i_voxel.y;
 #ifdef ROI_TYPE_ISOCONTOUR_3D
-      if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, roi_voxel) & 0x80)
-	i_voxel.z++;
-      else if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, roi_voxel) & 0x40)
-	i_voxel.z--;
+    i_voxel.z = index / plane_size - 1;
+    if (pmin_voxel->z > i_voxel.z) pmin_voxel->z = i_voxel.z;
+    if (pmax_voxel->z < i_voxel.z) pmax_voxel->z = i_voxel.z;
 #endif
 
-      if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, roi_voxel) & 0x20)
-	i_voxel.y++;
-      else if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, roi_voxel) & 0x10)
-	i_voxel.y--;
-
-      if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, roi_voxel) & 0x08)
-	i_voxel.x++;
-      else if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, roi_voxel) & 0x04)
-	i_voxel.x--;
-
-      /* the inital voxel will backup to itself, which is why we get out of the loop */
-      if (VOXEL_EQUAL(roi_voxel, i_voxel)) 
-	done = TRUE;
-      else
-	roi_voxel = i_voxel;
+    for (j=0; j<ISOCONTOUR_NUM_NEIGHBORS; j++) {
+      neighbor = index + neighbors[j];
+      if (iso->mask[neighbor] == ISOCONTOUR_CANDIDATE) {
+	iso->mask[neighbor] = ISOCONTOUR_IN;
+	g_array_append_val(work, neighbor);
+      }
     }
   }
 
-  return;
+  g_array_free(work, TRUE);
+
+  return TRUE;
 }
   
 
@@ -553,54 +574,38 @@ void amitk_roi_`'m4_Variable_Type`'_set_isocontour(AmitkRoi * roi, AmitkDataSet
 						   amide_data_t iso_max_value,
 						   AmitkRoiIsocontourRange iso_range) {
 
-  AmitkRawData * temp_rd;
+  isocontour_t iso;
   AmitkPoint temp_point;
   AmitkVoxel min_voxel, max_voxel, i_voxel;
-  amide_data_t temp_min_value, temp_max_value;
+  const guint8 * mask_row;
+  amitk_format_UBYTE_t * map_row;
 
   g_return_if_fail(roi->type == AMITK_ROI_TYPE_`'m4_Variable_Type`');
+  g_return_if_fail(amitk_raw_data_includes_voxel(AMITK_DATA_SET_RAW_DATA(ds), iso_voxel));
 
   /* what we're setting the isocontour too */
   roi->isocontour_min_value = iso_min_value; 
   roi->isocontour_max_value = iso_max_value; 
   roi->isocontour_range = iso_range; 
 
-  /* we first make a raw data set the size of the data set to record the in/out values */
-#if defined(ROI_TYPE_ISOCONTOUR_2D)
-  temp_rd = amitk_raw_data_new_2D_with_data0(AMITK_FORMAT_UBYTE, ds->raw_data->dim.y, ds->raw_data->dim.x);
-#elif defined(ROI_TYPE_ISOCONTOUR_3D)
-  temp_rd = amitk_raw_data_new_3D_with_data0(AMITK_FORMAT_UBYTE, ds->raw_data->dim.z, ds->raw_data->dim.y, ds->raw_data->dim.x);
-#endif
+  /* epsilon guards for floating point rounding, an open end of the range
+     is taken as infinite */
+  iso.ds = ds;
+  iso.ds_voxel = iso_voxel;
+  if (iso_range == AMITK_ROI_ISOCONTOUR_RANGE_BELOW_MAX)
+    iso.min_value = -HUGE_VAL;
+  else
+    iso.min_value = roi->isocontour_min_value-EPSILON*fabs(roi->isocontour_min_value); 
+  if (iso_range == AMITK_ROI_ISOCONTOUR_RANGE_ABOVE_MIN)
+    iso.max_value = HUGE_VAL;
+  else
+    iso.max_value = roi->isocontour_max_value+EPSILON*fabs(roi->isocontour_max_value); 
 
-  /* epsilon guards for floating point rounding */
-  temp_min_value = roi->isocontour_min_value-EPSILON*fabs(roi->isocontour_min_value); 
-  temp_max_value = roi->isocontour_max_value+EPSILON*fabs(roi->isocontour_max_value); 
+  /* fill in the mask */
+  if (!isocontour_consider(&iso, &min_voxel, &max_voxel))
+    return;
 
-  /* fill in the data set */
-  isocontour_consider(ds, temp_rd, iso_voxel, temp_min_value, temp_max_value, iso_range);
-  
-  /* figure out the min and max dimensions */
-  min_voxel = max_voxel = iso_voxel;
-  
-  i_voxel.t = i_voxel.g = 0;
-  for (i_voxel.z=0; i_voxel.z < temp_rd->dim.z; i_voxel.z++) {
-    for (i_voxel.y=0; i_voxel.y < temp_rd->dim.y; i_voxel.y++) {
-      for (i_voxel.x=0; i_voxel.x < temp_rd->dim.x; i_voxel.x++) {
-	if (AMITK_RAW_DATA_UBYTE_CONTENT(temp_rd, i_voxel) & 0x1) {
-	  if (min_voxel.x > i_voxel.x) min_voxel.x = i_voxel.x;
-	  if (max_voxel.x < i_voxel.x) max_voxel.x = i_voxel.x;
-	  if (min_voxel.y > i_voxel.y) min_voxel.y = i_voxel.y;
-	  if (max_voxel.y < i_voxel.y) max_voxel.y = i_voxel.y;
-#ifdef ROI_TYPE_ISOCONTOUR_3D
-	  if (min_voxel.z > i_voxel.z) min_voxel.z = i_voxel.z;
-	  if (max_voxel.z < i_voxel.z) max_voxel.z = i_voxel.z;
-#endif
-	}
-      }
-    }
-  }
-  
-  /* transfer the subset of the data set that contains positive information */
+  /* transfer the subset of the mask that contains positive information */
   if (roi->map_data != NULL)
     g_object_unref(roi->map_data);
 #if defined(ROI_TYPE_ISOCONTOUR_2D)
@@ -612,20 +617,21 @@ void amitk_roi_`'m4_Variable_Type`'_set_isocontour(AmitkRoi * roi, AmitkDataSet
 						   max_voxel.x-min_voxel.x+1);
 #endif
 
-  i_voxel.t = i_voxel.g = 0;
+  i_voxel.t = i_voxel.g = i_voxel.x = 0;
   for (i_voxel.z=0; i_voxel.z<roi->map_data->dim.z; i_voxel.z++)
-    for (i_voxel.y=0; i_voxel.y<roi->map_data->dim.y; i_voxel.y++)
-      for (i_voxel.x=0; i_voxel.x<roi->map_data->dim.x; i_voxel.x++) {
+    for (i_voxel.y=0; i_voxel.y<roi->map_data->dim.y; i_voxel.y++) {
 #if defined(ROI_TYPE_ISOCONTOUR_2D)
-	AMITK_RAW_DATA_UBYTE_SET_CONTENT(roi->map_data, i_voxel) = 
-	  0x01 & AMITK_RAW_DATA_UBYTE_2D_CONTENT(temp_rd, i_voxel.y+min_voxel.y, i_voxel.x+min_voxel.x);
+      mask_row = iso.mask + ISOCONTOUR_MASK_INDEX(iso.mask_dim, min_voxel.x, i_voxel.y+min_voxel.y, 0);
 #elif defined(ROI_TYPE_ISOCONTOUR_3D)
-	AMITK_RAW_DATA_UBYTE_SET_CONTENT(roi->map_data, i_voxel) =
-	  0x01 & AMITK_RAW_DATA_UBYTE_3D_CONTENT(temp_rd, i_voxel.z+min_voxel.z,i_voxel.y+min_voxel.y, i_voxel.x+min_voxel.x);
+      mask_row = iso.mask + ISOCONTOUR_MASK_INDEX(iso.mask_dim, min_voxel.x, i_voxel.y+min_voxel.y, i_voxel.z+min_voxel.z);
 #endif
-      }
+      map_row = AMITK_RAW_DATA_UBYTE_POINTER(roi->map_data, i_voxel);
+      for (i_voxel.x=0; i_voxel.x<roi->map_data->dim.x; i_voxel.x++)
+	map_row[i_voxel.x] = (mask_row[i_voxel.x] == ISOCONTOUR_IN);
+      i_voxel.x = 0;
+    }
 
-  g_object_unref(temp_rd);
+  g_free(iso.mask);
 
   /* mark the edges as such */
   i_voxel.t = i_voxel.g = 0;
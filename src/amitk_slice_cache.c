@@ -0,0 +1,432 @@
+/* amitk_slice_cache.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+/* notes
+   - slices are looked up through a hash table keyed on the parameters the
+     slice was requested with, and evicted least recently used first once
+     the cached slices take up more than the memory budget
+   - the hash rounds the floating point parameters to single precision, while
+     the comparison uses the usual REAL_EQUAL tolerance.  Values that are
+     within tolerance but round differently just miss and get regenerated.
+   - the parent data set is only used as an identifier, a slice's parent
+     is a weak pointer, and the parent removes its slices when it goes away
+   - several things cause slices to get invalidated (scale factor changes, the
+     parent's space or voxel size changing, changes to the raw data), these
+     are handled by the parent's invalidate_slice_cache signal.  The parent's
+     slice_cache_epoch gets bumped at the same time, and a slice that was
+     being generated across a bump doesn't get added to the cache
+   - everything's done under a lock, slices are generated and unref'ed
+     outside of it
+   - prefetched slices are flagged until they're first asked for, and only get
+     AMITK_SLICE_CACHE_PREFETCH_FRACTION of the budget, so speculative work
+     can't push out everything that's actually on display
+*/
+
+#include "amide_config.h"
+#include <string.h>
+#include "amitk_slice_cache.h"
+#include "amitk_trace.h"
+
+typedef struct {
+  const AmitkDataSet * parent; /* never dereferenced */
+  AmitkPoint offset;
+  AmitkAxes axes;
+  amide_time_t start;
+  amide_time_t duration;
+  amide_real_t thickness;
+  amide_intpoint_t start_gate;
+  amide_intpoint_t end_gate;
+  amide_intpoint_t dim_x;
+  amide_intpoint_t dim_y;
+  AmitkInterpolation interpolation;
+  AmitkRendering rendering;
+} slice_key_t;
+
+typedef struct {
+  slice_key_t key; /* needs to be first, the hash table is keyed on it */
+  AmitkDataSet * slice;
+  guint64 bytes;
+  gboolean prefetched; /* generated ahead of time, and not yet asked for */
+  GList * lru_link; /* our link in the lru queue */
+} slice_entry_t;
+
+static GHashTable * entries = NULL; /* slice_key_t -> slice_entry_t */
+static GHashTable * parents = NULL; /* parent data set -> number of cached slices */
+static GQueue lru = G_QUEUE_INIT; /* most recently used at the head */
+static AmitkSliceCacheStats stats = {0, 0, 0, 0, ((guint64) AMITK_SLICE_CACHE_DEFAULT_SIZE) << 20, 0, 0, 0, 0};
+G_LOCK_DEFINE_STATIC(slice_cache);
+
+
+static guint hash_real(const amide_real_t value) {
+
+  gfloat rounded = value;
+  guint32 bits;
+
+  if (rounded == 0.0) rounded = 0.0; /* -0.0 and 0.0 should hash the same */
+  memcpy(&bits, &rounded, sizeof(bits));
+
+  return bits;
+}
+
+static guint key_hash(gconstpointer data) {
+
+  const slice_key_t * key = data;
+  guint hash;
+
+  hash = g_direct_hash(key->parent);
+  hash = hash*31 + hash_real(key->offset.x);
+  hash = hash*31 + hash_real(key->offset.y);
+  hash = hash*31 + hash_real(key->offset.z);
+  hash = hash*31 + hash_real(key->start);
+  hash = hash*31 + hash_real(key->duration);
+  hash = hash*31 + key->start_gate;
+  hash = hash*31 + key->end_gate;
+  hash = hash*31 + key->dim_x;
+  hash = hash*31 + key->dim_y;
+  hash = hash*31 + key->interpolation;
+  hash = hash*31 + key->rendering;
+
+  return hash;
+}
+
+static gboolean key_equal(gconstpointer data1, gconstpointer data2) {
+
+  const slice_key_t * key1 = data1;
+  const slice_key_t * key2 = data2;
+  AmitkAxis i_axis;
+
+  if ((key1->parent != key2->parent) ||
+      (key1->start_gate != key2->start_gate) ||
+      (key1->end_gate != key2->end_gate) ||
+      (key1->dim_x != key2->dim_x) ||
+      (key1->dim_y != key2->dim_y) ||
+      (key1->interpolation != key2->interpolation) ||
+      (key1->rendering != key2->rendering))
+    return FALSE;
+
+  if (!REAL_EQUAL(key1->start, key2->start) ||
+      !REAL_EQUAL(key1->duration, key2->duration) ||
+      !REAL_EQUAL(key1->thickness, key2->thickness) ||
+      !POINT_EQUAL(key1->offset, key2->offset))
+    return FALSE;
+
+  for (i_axis=0; i_axis<AMITK_AXIS_NUM; i_axis++)
+    if (!POINT_EQUAL(key1->axes[i_axis], key2->axes[i_axis]))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* fill in the key for the slice that would get generated with these parameters */
+static void key_init(slice_key_t * key,
+		     const AmitkDataSet * ds,
+		     const amide_time_t start,
+		     const amide_time_t duration,
+		     const amide_intpoint_t gate,
+		     const AmitkCanvasPoint pixel_size,
+		     const AmitkVolume * view_volume) {
+
+  AmitkAxis i_axis;
+
+  key->parent = ds;
+  key->offset = AMITK_SPACE_OFFSET(view_volume);
+  for (i_axis=0; i_axis<AMITK_AXIS_NUM; i_axis++)
+    key->axes[i_axis] = AMITK_SPACE_AXES(view_volume)[i_axis];
+  key->start = start;
+  key->duration = duration;
+  key->thickness = AMITK_VOLUME_Z_CORNER(view_volume);
+  if (gate < 0) {
+    key->start_gate = AMITK_DATA_SET_VIEW_START_GATE(ds);
+    key->end_gate = AMITK_DATA_SET_VIEW_END_GATE(ds);
+  } else {
+    key->start_gate = gate;
+    key->end_gate = gate;
+  }
+  key->dim_x = ceil(fabs(AMITK_VOLUME_X_CORNER(view_volume))/pixel_size.x);
+  key->dim_y = ceil(fabs(AMITK_VOLUME_Y_CORNER(view_volume))/pixel_size.y);
+  key->interpolation = AMITK_DATA_SET_INTERPOLATION(ds);
+  key->rendering = AMITK_DATA_SET_RENDERING(ds);
+
+  return;
+}
+
+/* take an entry out of the cache, returns the slice for unref'ing outside the lock */
+static AmitkDataSet * entry_remove(slice_entry_t * entry) {
+
+  AmitkDataSet * slice;
+  guint count;
+
+  g_hash_table_remove(entries, &(entry->key));
+  g_queue_delete_link(&lru, entry->lru_link);
+
+  count = GPOINTER_TO_UINT(g_hash_table_lookup(parents, entry->key.parent));
+  if (count <= 1)
+    g_hash_table_remove(parents, entry->key.parent);
+  else
+    g_hash_table_insert(parents, (gpointer) entry->key.parent, GUINT_TO_POINTER(count-1));
+
+  stats.bytes -= entry->bytes;
+  stats.num_slices--;
+  if (entry->prefetched)
+    stats.prefetch_bytes -= entry->bytes;
+  AMITK_TRACE_COUNTER("slice_cache_bytes", stats.bytes);
+
+  slice = entry->slice;
+  g_free(entry);
+
+  return slice;
+}
+
+/* put a slice into the cache, should be called with the lock held */
+static void entry_add(const slice_key_t * key, AmitkDataSet * ds, AmitkDataSet * slice,
+		      const gboolean prefetched) {
+
+  slice_entry_t * entry;
+
+  entry = g_new(slice_entry_t, 1);
+  entry->key = *key;
+  entry->slice = amitk_object_ref(slice);
+  entry->bytes = sizeof(AmitkDataSet) +
+    amitk_raw_data_size_data_mem(AMITK_DATA_SET_RAW_DATA(slice));
+  entry->prefetched = prefetched;
+  g_queue_push_head(&lru, entry);
+  entry->lru_link = lru.head;
+  g_hash_table_insert(entries, &(entry->key), entry);
+  g_hash_table_insert(parents, (gpointer) ds,
+		      GUINT_TO_POINTER(GPOINTER_TO_UINT(g_hash_table_lookup(parents, ds))+1));
+  stats.bytes += entry->bytes;
+  stats.num_slices++;
+  if (prefetched)
+    stats.prefetch_bytes += entry->bytes;
+  AMITK_TRACE_COUNTER("slice_cache_bytes", stats.bytes);
+
+  return;
+}
+
+static void tables_init(void) {
+
+  if (entries == NULL) {
+    entries = g_hash_table_new(key_hash, key_equal);
+    parents = g_hash_table_new(g_direct_hash, g_direct_equal);
+  }
+
+  return;
+}
+
+/* evict least recently used slices until we're under budget, returns the
+   evicted slices for unref'ing outside the lock */
+static GList * trim(void) {
+
+  GList * evicted=NULL;
+  slice_entry_t * entry;
+
+  while ((stats.bytes > stats.max_bytes) && (lru.tail != NULL)) {
+    entry = lru.tail->data;
+    evicted = g_list_prepend(evicted, entry_remove(entry));
+    stats.evictions++;
+  }
+
+  return evicted;
+}
+
+static void unref_slices(GList * slices) {
+
+  if (slices != NULL)
+    amitk_objects_unref(slices);
+
+  return;
+}
+
+
+/* set the memory budget for cached slices, 0 turns off caching */
+void amitk_slice_cache_set_max_bytes(guint64 max_bytes) {
+
+  GList * evicted;
+
+  G_LOCK(slice_cache);
+  stats.max_bytes = max_bytes;
+  evicted = trim();
+  G_UNLOCK(slice_cache);
+
+  unref_slices(evicted);
+
+  return;
+}
+
+/* returns a slice of the data set, from the cache if we have one, otherwise it's
+   generated and added to the cache.  The returned slice should be unref'ed */
+AmitkDataSet * amitk_slice_cache_get_slice(AmitkDataSet * ds,
+					   const amide_time_t start,
+					   const amide_time_t duration,
+					   const amide_intpoint_t gate,
+					   const AmitkCanvasPoint pixel_size,
+					   const AmitkVolume * view_volume) {
+
+  slice_key_t key;
+  slice_entry_t * entry;
+  AmitkDataSet * slice=NULL;
+  GList * evicted;
+  gint epoch;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(AMITK_IS_VOLUME(view_volume), NULL);
+
+  key_init(&key, ds, start, duration, gate, pixel_size, view_volume);
+
+  G_LOCK(slice_cache);
+  tables_init();
+
+  entry = g_hash_table_lookup(entries, &key);
+  if (entry != NULL) {
+    stats.hits++;
+    if (entry->prefetched) {
+      entry->prefetched = FALSE;
+      stats.prefetch_bytes -= entry->bytes;
+      stats.prefetch_hits++;
+    }
+    g_queue_unlink(&lru, entry->lru_link);
+    g_queue_push_head_link(&lru, entry->lru_link);
+    slice = amitk_object_ref(entry->slice);
+  } else {
+    stats.misses++;
+  }
+  G_UNLOCK(slice_cache);
+
+  if (slice != NULL) return slice;
+
+  /* generate it outside the lock */
+  epoch = g_atomic_int_get(&(ds->slice_cache_epoch));
+  slice = amitk_data_set_get_display_slice(ds, start, duration, gate, pixel_size, view_volume);
+  if (slice == NULL) return NULL;
+
+  G_LOCK(slice_cache);
+  if ((stats.max_bytes > 0) && (g_hash_table_lookup(entries, &key) == NULL) &&
+      (epoch == g_atomic_int_get(&(ds->slice_cache_epoch))))
+    entry_add(&key, ds, slice, FALSE);
+  evicted = trim();
+  G_UNLOCK(slice_cache);
+
+  unref_slices(evicted);
+
+  return slice;
+}
+
+/* generates the slice into the cache ahead of it being asked for.  Nothing
+   is done if the slice is already cached, or if prefetched slices are
+   already using up their part of the budget. Returns TRUE if a slice was
+   generated */
+gboolean amitk_slice_cache_prefetch(AmitkDataSet * ds,
+				    const amide_time_t start,
+				    const amide_time_t duration,
+				    const amide_intpoint_t gate,
+				    const AmitkCanvasPoint pixel_size,
+				    const AmitkVolume * view_volume) {
+
+  slice_key_t key;
+  AmitkDataSet * slice;
+  GList * evicted;
+  gboolean skip;
+  gint epoch;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), FALSE);
+  g_return_val_if_fail(AMITK_IS_VOLUME(view_volume), FALSE);
+
+  key_init(&key, ds, start, duration, gate, pixel_size, view_volume);
+
+  G_LOCK(slice_cache);
+  tables_init();
+  skip = (g_hash_table_lookup(entries, &key) != NULL) ||
+    (stats.prefetch_bytes >= stats.max_bytes*AMITK_SLICE_CACHE_PREFETCH_FRACTION);
+  G_UNLOCK(slice_cache);
+
+  if (skip) return FALSE;
+
+  epoch = g_atomic_int_get(&(ds->slice_cache_epoch));
+  slice = amitk_data_set_get_display_slice(ds, start, duration, gate, pixel_size, view_volume);
+  if (slice == NULL) return FALSE;
+
+  G_LOCK(slice_cache);
+  if ((g_hash_table_lookup(entries, &key) == NULL) &&
+      (epoch == g_atomic_int_get(&(ds->slice_cache_epoch)))) {
+    entry_add(&key, ds, slice, TRUE);
+    stats.prefetches++;
+  }
+  evicted = trim();
+  G_UNLOCK(slice_cache);
+
+  unref_slices(evicted);
+  amitk_object_unref(slice);
+
+  return TRUE;
+}
+
+/* drop all the cached slices of the given data set */
+void amitk_slice_cache_remove_parent(const AmitkDataSet * parent_ds) {
+
+  GList * evicted=NULL;
+  GList * link;
+  GList * next;
+  slice_entry_t * entry;
+
+  G_LOCK(slice_cache);
+  if ((parents != NULL) && (g_hash_table_lookup(parents, parent_ds) != NULL)) {
+    for (link = lru.head; link != NULL; link = next) {
+      next = link->next;
+      entry = link->data;
+      if (entry->key.parent == parent_ds)
+	evicted = g_list_prepend(evicted, entry_remove(entry));
+    }
+  }
+  G_UNLOCK(slice_cache);
+
+  unref_slices(evicted);
+
+  return;
+}
+
+void amitk_slice_cache_clear(void) {
+
+  GList * evicted=NULL;
+
+  G_LOCK(slice_cache);
+  while (lru.head != NULL)
+    evicted = g_list_prepend(evicted, entry_remove(lru.head->data));
+  G_UNLOCK(slice_cache);
+
+  unref_slices(evicted);
+
+  return;
+}
+
+void amitk_slice_cache_get_stats(AmitkSliceCacheStats * pstats) {
+
+  g_return_if_fail(pstats != NULL);
+
+  G_LOCK(slice_cache);
+  *pstats = stats;
+  G_UNLOCK(slice_cache);
+
+  return;
+}
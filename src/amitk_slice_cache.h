@@ -0,0 +1,77 @@
+/* amitk_slice_cache.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifndef __AMITK_SLICE_CACHE_H__
+#define __AMITK_SLICE_CACHE_H__
+
+/* header files that are always needed with this file */
+#include "amitk_data_set.h"
+
+G_BEGIN_DECLS
+
+/* default memory budget for cached slices, in megabytes */
+#define AMITK_SLICE_CACHE_DEFAULT_SIZE 256
+#define AMITK_SLICE_CACHE_MAX_SIZE 65536
+
+/* the part of the budget that slices generated ahead of time can use */
+#define AMITK_SLICE_CACHE_PREFETCH_FRACTION 0.25
+
+typedef struct {
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+  guint64 bytes;
+  guint64 max_bytes;
+  guint num_slices;
+  guint64 prefetches; /* slices generated ahead of time */
+  guint64 prefetch_hits; /* prefetched slices that were then used */
+  guint64 prefetch_bytes; /* memory held by prefetched slices that haven't been used yet */
+} AmitkSliceCacheStats;
+
+
+/* ------------ external functions ---------- */
+
+/* there's one slice cache, shared by everything that displays slices */
+void           amitk_slice_cache_set_max_bytes (guint64 max_bytes);
+AmitkDataSet * amitk_slice_cache_get_slice     (AmitkDataSet * ds,
+						const amide_time_t start,
+						const amide_time_t duration,
+						const amide_intpoint_t gate,
+						const AmitkCanvasPoint pixel_size,
+						const AmitkVolume * view_volume);
+gboolean       amitk_slice_cache_prefetch      (AmitkDataSet * ds,
+						const amide_time_t start,
+						const amide_time_t duration,
+						const amide_intpoint_t gate,
+						const AmitkCanvasPoint pixel_size,
+						const AmitkVolume * view_volume);
+void           amitk_slice_cache_remove_parent (const AmitkDataSet * parent_ds);
+void           amitk_slice_cache_clear         (void);
+void           amitk_slice_cache_get_stats     (AmitkSliceCacheStats * stats);
+
+G_END_DECLS
+
+#endif /* __AMITK_SLICE_CACHE_H__ */
+
@@ -0,0 +1,360 @@
+/* amitk_trace.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+/* notes
+   - events are written out in the chrome trace event format, load the
+     file into chrome://tracing or https://ui.perfetto.dev to view it
+   - a per operation summary (count, total, mean, min, max) goes into a
+     text file next to the trace
+   - the trace is written out when tracing gets turned off, and at exit
+   - event names aren't copied, so they need to be string constants
+*/
+
+#include "amide_config.h"
+#include <stdio.h>
+#include <string.h>
+#include "amitk_trace.h"
+#include "amide_intl.h"
+
+typedef struct {
+  const gchar * name;
+  gint64 ts; /* microseconds from when tracing was turned on */
+  gint64 dur;
+  gdouble value;
+  gint tid;
+  gchar phase; /* 'X' complete, 'C' counter */
+} trace_event_t;
+
+typedef struct {
+  const gchar * name;
+  guint count;
+  gint64 total;
+  gint64 min;
+  gint64 max;
+} trace_summary_t;
+
+gint amitk_trace_active = 0;
+
+static GArray * events = NULL;
+static GHashTable * summaries = NULL;
+static gint64 origin = 0;
+static guint dropped = 0;
+static gchar * trace_filename = NULL;
+static gint next_tid = 1;
+static GPrivate thread_id = G_PRIVATE_INIT(NULL);
+G_LOCK_DEFINE_STATIC(trace);
+
+
+/* small integer ids for threads, the first thread to ask (main) gets 1 */
+static gint get_tid(void) {
+
+  gint tid;
+
+  tid = GPOINTER_TO_INT(g_private_get(&thread_id));
+  if (tid == 0) {
+    tid = g_atomic_int_add(&next_tid, 1);
+    g_private_set(&thread_id, GINT_TO_POINTER(tid));
+  }
+
+  return tid;
+}
+
+/* call with the lock held */
+static void trace_clear(void) {
+
+  if (events != NULL)
+    g_array_set_size(events, 0);
+  else
+    events = g_array_new(FALSE, FALSE, sizeof(trace_event_t));
+
+  if (summaries != NULL)
+    g_hash_table_remove_all(summaries);
+  else
+    summaries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+  dropped = 0;
+}
+
+static gint summary_compare(gconstpointer a, gconstpointer b) {
+
+  const trace_summary_t * summary_a = a;
+  const trace_summary_t * summary_b = b;
+
+  if (summary_a->total > summary_b->total) return -1;
+  else if (summary_a->total < summary_b->total) return 1;
+  else return strcmp(summary_a->name, summary_b->name);
+}
+
+/* "trace.json" -> "trace-summary.txt" */
+static gchar * summary_filename(const gchar * filename) {
+
+  gchar * base;
+  gchar * summary;
+
+  if (g_str_has_suffix(filename, ".json"))
+    base = g_strndup(filename, strlen(filename)-strlen(".json"));
+  else
+    base = g_strdup(filename);
+  summary = g_strconcat(base, "-summary.txt", NULL);
+  g_free(base);
+
+  return summary;
+}
+
+
+
+
+/* turns tracing on if AMIDE_TRACE is set, should be called from the main thread */
+void amitk_trace_init(void) {
+
+  const gchar * env;
+
+  get_tid();
+
+  env = g_getenv(AMITK_TRACE_ENVIRONMENT_VARIABLE);
+  if ((env != NULL) && (*env != '\0')) {
+    amitk_trace_set_filename(env);
+    amitk_trace_set_enabled(TRUE);
+  }
+
+  return;
+}
+
+/* writes out any trace in progress */
+void amitk_trace_shutdown(void) {
+
+  amitk_trace_set_enabled(FALSE);
+
+  G_LOCK(trace);
+  if (events != NULL) {
+    g_array_free(events, TRUE);
+    events = NULL;
+  }
+  if (summaries != NULL) {
+    g_hash_table_destroy(summaries);
+    summaries = NULL;
+  }
+  g_free(trace_filename);
+  trace_filename = NULL;
+  G_UNLOCK(trace);
+
+  return;
+}
+
+/* turning tracing off writes the trace to amitk_trace_get_filename */
+void amitk_trace_set_enabled(const gboolean enabled) {
+
+  gchar * filename;
+
+  if (enabled) {
+    if (g_atomic_int_get(&amitk_trace_active)) return;
+    G_LOCK(trace);
+    trace_clear();
+    origin = g_get_monotonic_time();
+    G_UNLOCK(trace);
+    g_atomic_int_set(&amitk_trace_active, 1);
+
+  } else {
+    if (!g_atomic_int_get(&amitk_trace_active)) return;
+    g_atomic_int_set(&amitk_trace_active, 0);
+    filename = amitk_trace_get_filename();
+    amitk_trace_write(filename);
+    g_free(filename);
+  }
+
+  return;
+}
+
+gboolean amitk_trace_get_enabled(void) {
+  return g_atomic_int_get(&amitk_trace_active);
+}
+
+void amitk_trace_set_filename(const gchar * filename) {
+
+  G_LOCK(trace);
+  g_free(trace_filename);
+  trace_filename = g_strdup(filename);
+  G_UNLOCK(trace);
+
+  return;
+}
+
+/* defaults to amide-trace.json in the temporary directory */
+/* returns a copy of the file name, which should be g_free'd */
+gchar * amitk_trace_get_filename(void) {
+
+  gchar * filename;
+
+  G_LOCK(trace);
+  if (trace_filename == NULL)
+    trace_filename = g_build_filename(g_get_tmp_dir(), AMITK_TRACE_DEFAULT_FILENAME, NULL);
+  filename = g_strdup(trace_filename);
+  G_UNLOCK(trace);
+
+  return filename;
+}
+
+/* records an operation that started at start (from g_get_monotonic_time) and ends now */
+void amitk_trace_complete(const gchar * name, const gint64 start) {
+
+  trace_event_t event;
+  trace_summary_t * summary;
+  gint64 now;
+
+  now = g_get_monotonic_time();
+  event.name = name;
+  event.dur = now-start;
+  event.value = 0.0;
+  event.tid = get_tid();
+  event.phase = 'X';
+
+  G_LOCK(trace);
+  if ((events != NULL) && (start >= origin)) {
+    event.ts = start-origin;
+    if (events->len < AMITK_TRACE_MAX_EVENTS)
+      g_array_append_val(events, event);
+    else
+      dropped++;
+
+    summary = g_hash_table_lookup(summaries, name);
+    if (summary == NULL) {
+      summary = g_new0(trace_summary_t, 1);
+      summary->name = name;
+      summary->min = event.dur;
+      g_hash_table_insert(summaries, (gpointer) name, summary);
+    }
+    summary->count++;
+    summary->total += event.dur;
+    if (event.dur < summary->min) summary->min = event.dur;
+    if (event.dur > summary->max) summary->max = event.dur;
+  }
+  G_UNLOCK(trace);
+
+  return;
+}
+
+void amitk_trace_counter(const gchar * name, const gdouble value) {
+
+  trace_event_t event;
+
+  event.name = name;
+  event.dur = 0;
+  event.value = value;
+  event.tid = get_tid();
+  event.phase = 'C';
+
+  G_LOCK(trace);
+  if (events != NULL) {
+    event.ts = g_get_monotonic_time()-origin;
+    if (events->len < AMITK_TRACE_MAX_EVENTS)
+      g_array_append_val(events, event);
+    else
+      dropped++;
+  }
+  G_UNLOCK(trace);
+
+  return;
+}
+
+/* writes the events recorded so far as a chrome trace, and the summary
+   next to it.  Returns FALSE on failure */
+gboolean amitk_trace_write(const gchar * filename) {
+
+  FILE * file_pointer;
+  gchar * summary_name;
+  gchar value_str[G_ASCII_DTOSTR_BUF_SIZE];
+  trace_event_t * event;
+  trace_summary_t * summary;
+  GList * summary_list;
+  GList * temp_list;
+  gint max_tid;
+  guint i;
+  gint tid;
+
+  g_return_val_if_fail(filename != NULL, FALSE);
+
+  G_LOCK(trace);
+  if (events == NULL) {
+    G_UNLOCK(trace);
+    return TRUE;
+  }
+
+  if ((file_pointer = fopen(filename, "w")) == NULL) {
+    G_UNLOCK(trace);
+    g_warning(_("couldn't open file for writing: %s"), filename);
+    return FALSE;
+  }
+
+  fprintf(file_pointer, "{\"displayTimeUnit\": \"ms\",\n");
+  fprintf(file_pointer, " \"otherData\": {\"version\": \"%s\", \"dropped_events\": \"%u\"},\n", VERSION, dropped);
+  fprintf(file_pointer, " \"traceEvents\": [\n");
+  fprintf(file_pointer, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"%s\"}}", PACKAGE);
+
+  max_tid = g_atomic_int_get(&next_tid);
+  for (tid=1; tid < max_tid; tid++)
+    fprintf(file_pointer, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+	    tid, tid == 1 ? "main" : "thread", tid);
+
+  for (i=0; i < events->len; i++) {
+    event = &g_array_index(events, trace_event_t, i);
+    if (event->phase == 'X')
+      fprintf(file_pointer, ",\n  {\"name\": \"%s\", \"cat\": \"amide\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT "}",
+	      event->name, event->tid, event->ts, event->dur);
+    else /* counter values need a '.' whatever the locale */
+      fprintf(file_pointer, ",\n  {\"name\": \"%s\", \"cat\": \"amide\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, \"ts\": %" G_GINT64_FORMAT ", \"args\": {\"value\": %s}}",
+	      event->name, event->tid, event->ts, 
+	      g_ascii_formatd(value_str, sizeof(value_str), "%g", event->value));
+  }
+  fprintf(file_pointer, "\n ]\n}\n");
+  fclose(file_pointer);
+
+  /* and the summary */
+  summary_name = summary_filename(filename);
+  if ((file_pointer = fopen(summary_name, "w")) == NULL) {
+    G_UNLOCK(trace);
+    g_warning(_("couldn't open file for writing: %s"), summary_name);
+    g_free(summary_name);
+    return FALSE;
+  }
+  g_free(summary_name);
+
+  summary_list = g_list_sort(g_hash_table_get_values(summaries), summary_compare);
+  fprintf(file_pointer, "# %-38s %10s %12s %12s %12s %12s\n",
+	  "operation", "count", "total (ms)", "mean (ms)", "min (ms)", "max (ms)");
+  for (temp_list = summary_list; temp_list != NULL; temp_list = temp_list->next) {
+    summary = temp_list->data;
+    fprintf(file_pointer, "  %-38s %10u %12.3f %12.3f %12.3f %12.3f\n",
+	    summary->name, summary->count, summary->total/1000.0,
+	    summary->total/(1000.0*summary->count), summary->min/1000.0, summary->max/1000.0);
+  }
+  if (dropped > 0)
+    fprintf(file_pointer, "# %u events were past the limit and left out of the trace\n", dropped);
+  g_list_free(summary_list);
+  fclose(file_pointer);
+
+  G_UNLOCK(trace);
+
+  return TRUE;
+}
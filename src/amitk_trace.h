@@ -0,0 +1,76 @@
+/* amitk_trace.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifndef __AMITK_TRACE_H__
+#define __AMITK_TRACE_H__
+
+/* header files that are always needed with this file */
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* setting this environment variable to a file name turns on tracing at startup */
+#define AMITK_TRACE_ENVIRONMENT_VARIABLE "AMIDE_TRACE"
+#define AMITK_TRACE_DEFAULT_FILENAME "amide-trace.json"
+
+/* past this many events only the per-operation summary is kept up to date */
+#define AMITK_TRACE_MAX_EVENTS (1<<20)
+
+/* usage, name needs to be a string constant:
+
+     gint64 trace_start;
+     ...
+     trace_start = AMITK_TRACE_BEGIN();
+     do_work();
+     AMITK_TRACE_END("do_work", trace_start);
+
+   when tracing is off, this is just a test of an integer */
+#define AMITK_TRACE_BEGIN() \
+  (G_UNLIKELY(amitk_trace_active) ? g_get_monotonic_time() : 0)
+#define AMITK_TRACE_END(name, start) \
+  G_STMT_START { if (G_UNLIKELY((start) != 0)) amitk_trace_complete((name), (start)); } G_STMT_END
+#define AMITK_TRACE_COUNTER(name, value) \
+  G_STMT_START { if (G_UNLIKELY(amitk_trace_active)) amitk_trace_counter((name), (value)); } G_STMT_END
+
+/* don't touch directly, use amitk_trace_set_enabled */
+extern gint amitk_trace_active;
+
+/* ------------ external functions ---------- */
+
+void           amitk_trace_init              (void);
+void           amitk_trace_shutdown          (void);
+void           amitk_trace_set_enabled       (const gboolean enabled);
+gboolean       amitk_trace_get_enabled       (void);
+void           amitk_trace_set_filename      (const gchar * filename);
+gchar *        amitk_trace_get_filename      (void);
+void           amitk_trace_complete          (const gchar * name,
+					      const gint64 start);
+void           amitk_trace_counter           (const gchar * name,
+					      const gdouble value);
+gboolean       amitk_trace_write             (const gchar * filename);
+
+G_END_DECLS
+
+#endif /* __AMITK_TRACE_H__ */
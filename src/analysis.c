@@ -25,6 +25,8 @@
 
 #include "amide_config.h"
 #include "analysis.h"
+#include "amitk_parallel.h"
+#include "amitk_trace.h"
 #include <glib.h>
 #include <sys/stat.h>
 
@@ -45,8 +47,28 @@
 
 #define EMPTY 0.0
 
+/* one roi/data set/frame/gate combination that needs calculating */
+typedef struct {
+  AmitkRoi * roi;
+  AmitkDataSet * ds;
+  guint frame;
+  guint gate;
+  analysis_frame_t * frame_analysis; /* where the result gets linked in */
+  analysis_gate_t * result;
+} analysis_task_t;
+
+typedef struct {
+  GArray * tasks;
+  analysis_calculation_t calculation_type;
+  gboolean accurate;
+  gdouble subfraction;
+  gdouble threshold_percentage;
+  gdouble threshold_value;
+} analysis_tasks_t;
+
 static analysis_gate_t * analysis_gate_unref(analysis_gate_t *gate_analysis);
-static analysis_gate_t * analysis_gate_init(AmitkRoi * roi, AmitkDataSet *ds,guint frame, 
+static analysis_gate_t * analysis_gate_calc(AmitkRoi * roi, AmitkDataSet *ds,
+					    guint frame, guint gate,
 					    analysis_calculation_t calculation_type,
 					    gboolean accurate,
 					    gdouble subfraction, 
@@ -54,23 +76,206 @@ static analysis_gate_t * analysis_gate_init(AmitkRoi * roi, AmitkDataSet *ds,gui
 					    gdouble threshold_value);
 static analysis_frame_t * analysis_frame_unref(analysis_frame_t * frame_analysis);
 static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, AmitkDataSet *ds, 
-					      analysis_calculation_t calculation_type,
-					      gboolean accurate,
-					      gdouble subfraction, 
-					      gdouble threshold_percentage,
-					      gdouble threshold_value);
+					      GArray * tasks);
 static analysis_volume_t * analysis_volume_unref(analysis_volume_t *volume_analysis);
 static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * volumes, 
-						analysis_calculation_t calculation_type,
-						gboolean accurate,
-						gdouble subfraction, 
-						gdouble threshold_percentage, 
-						gdouble threshold_value);
+						GArray * tasks);
+
+
+/* initial number of voxels the data arrays can hold, they double from there */
+#define DATA_INITIAL_SIZE 1024
+
+/* the ordering we sort by, highest to lowest with NaN's at the end */
+#define VALUE_GREATER(a,b) (((a) > (b)) || (isnan(b) && !isnan(a)))
+
+/* same, but equal values stay in the order they were recorded in */
+#define ELEMENT_GREATER(a,ai,b,bi) \
+  (VALUE_GREATER(a,b) || (!VALUE_GREATER(b,a) && ((ai) < (bi))))
+
+static void data_free(analysis_data_t * data) {
+
+  g_free(data->values);
+  g_free(data->weights);
+  g_free(data->voxels);
+  g_free(data->indices);
+  data->values = NULL;
+  data->weights = NULL;
+  data->voxels = NULL;
+  data->indices = NULL;
+  data->len = data->allocated = 0;
+
+  return;
+}
+
+static gboolean data_grow(analysis_data_t * data) {
+
+  guint new_size;
+  gpointer temp;
+
+  if (data->allocated == 0)
+    new_size = DATA_INITIAL_SIZE;
+  else
+    new_size = 2*data->allocated;
+  if (new_size <= data->allocated) return FALSE; /* overflow */
+
+  if ((temp = g_try_realloc(data->values, new_size*sizeof(amide_data_t))) == NULL)
+    return FALSE;
+  data->values = temp;
+
+  if ((temp = g_try_realloc(data->weights, new_size*sizeof(amide_real_t))) == NULL)
+    return FALSE;
+  data->weights = temp;
+
+  if ((temp = g_try_realloc(data->voxels, new_size*sizeof(AmitkVoxel))) == NULL)
+    return FALSE;
+  data->voxels = temp;
+
+  if ((temp = g_try_realloc(data->indices, new_size*sizeof(guint))) == NULL)
+    return FALSE;
+  data->indices = temp;
+
+  data->allocated = new_size;
+
+  return TRUE;
+}
+
+static void data_swap(analysis_data_t * data, const guint i, const guint j) {
+
+  amide_data_t temp_value;
+  amide_real_t temp_weight;
+  AmitkVoxel temp_voxel;
+  guint temp_index;
+
+  temp_value = data->values[i];
+  data->values[i] = data->values[j];
+  data->values[j] = temp_value;
+
+  temp_weight = data->weights[i];
+  data->weights[i] = data->weights[j];
+  data->weights[j] = temp_weight;
+
+  temp_voxel = data->voxels[i];
+  data->voxels[i] = data->voxels[j];
+  data->voxels[j] = temp_voxel;
+
+  temp_index = data->indices[i];
+  data->indices[i] = data->indices[j];
+  data->indices[j] = temp_index;
+
+  return;
+}
+
+/* partially orders the elements in [left, right] so that element n ends up
+   with the value it would have if the whole range were sorted from highest 
+   to lowest, with everything before it >= and everything after it <=.  This
+   is Hoare's selection algorithm, order(N) on average */
+static void data_select(analysis_data_t * data, gint64 left, gint64 right, const gint64 n) {
+
+  amide_data_t * values = data->values;
+  guint * indices = data->indices;
+  amide_data_t pivot;
+  guint pivot_index;
+  gint64 i, j, mid;
+
+  while (right > left) {
+
+    /* median of three, keeps already sorted data from going order(N^2),
+       and leaves sentinels at both ends for the scans below */
+    mid = left + (right-left)/2;
+    if (ELEMENT_GREATER(values[mid], indices[mid], values[left], indices[left])) 
+      data_swap(data, mid, left);
+    if (ELEMENT_GREATER(values[right], indices[right], values[left], indices[left])) 
+      data_swap(data, right, left);
+    if (ELEMENT_GREATER(values[right], indices[right], values[mid], indices[mid])) 
+      data_swap(data, right, mid);
+    pivot = values[mid];
+    pivot_index = indices[mid];
+
+    i = left;
+    j = right;
+    while (i <= j) {
+      while (ELEMENT_GREATER(values[i], indices[i], pivot, pivot_index)) i++;
+      while (ELEMENT_GREATER(pivot, pivot_index, values[j], indices[j])) j--;
+      if (i <= j) {
+	data_swap(data, i, j);
+	i++;
+	j--;
+      }
+    }
+
+    if (n <= j)
+      right = j;
+    else if (n >= i)
+      left = i;
+    else
+      return; /* n is the pivot */
+  }
+
+  return;
+}
+
+/* index of the highest value in [start, end) */
+static guint data_max_index(const analysis_data_t * data, const guint start, const guint end) {
+
+  guint i, max_i;
+
+  max_i = start;
+  for (i=start+1; i<end; i++)
+    if (ELEMENT_GREATER(data->values[i], data->indices[i], data->values[max_i], data->indices[max_i]))
+      max_i = i;
+
+  return max_i;
+}
+
+/* index of the lowest value in [start, end) */
+static guint data_min_index(const analysis_data_t * data, const guint start, const guint end) {
+
+  guint i, min_i;
+
+  min_i = start;
+  for (i=start+1; i<end; i++)
+    if (ELEMENT_GREATER(data->values[min_i], data->indices[min_i], data->values[i], data->indices[i]))
+      min_i = i;
+
+  return min_i;
+}
 
+static gint sorted_order_comparison(gconstpointer a, gconstpointer b, gpointer user_data) {
 
-void free_array_element(gpointer data, gpointer user_data) {
-  analysis_element_t * element = data;
-  g_free(element);
+  const analysis_data_t * data = user_data;
+  guint ia = *((const guint *) a);
+  guint ib = *((const guint *) b);
+
+  if (ELEMENT_GREATER(data->values[ia], data->indices[ia], data->values[ib], data->indices[ib]))
+    return -1;
+  else if (ELEMENT_GREATER(data->values[ib], data->indices[ib], data->values[ia], data->indices[ia]))
+    return 1;
+  else
+    return 0;
+}
+
+/* returns an array of indices into the gate's data, ordered from the highest
+   to the lowest value.  Returns NULL if there's no data or we're out of memory,
+   otherwise free with g_free */
+guint * analysis_gate_sorted_order(const analysis_gate_t * gate_analysis) {
+
+  guint * order;
+  guint i;
+
+  g_return_val_if_fail(gate_analysis != NULL, NULL);
+  if (gate_analysis->data.len == 0) return NULL;
+
+  if ((order = g_try_new(guint, gate_analysis->data.len)) == NULL) {
+    g_warning(_("couldn't allocate memory space for sorting roi data"));
+    return NULL;
+  }
+
+  for (i=0; i<gate_analysis->data.len; i++)
+    order[i] = i;
+  g_qsort_with_data(order, gate_analysis->data.len, sizeof(guint), 
+		    sorted_order_comparison, (gpointer) &(gate_analysis->data));
+
+  return order;
 }
 
 static analysis_gate_t * analysis_gate_unref(analysis_gate_t * gate_analysis) {
@@ -89,8 +294,7 @@ static analysis_gate_t * analysis_gate_unref(analysis_gate_t * gate_analysis) {
   /* if we've removed all reference's, free the roi */
   if (gate_analysis->ref_count == 0) {
 
-    g_ptr_array_foreach(gate_analysis->data_array, free_array_element, NULL); /* free the elements */
-    g_ptr_array_free(gate_analysis->data_array, TRUE); /* TRUE frees the array of pointers to elements as well */
+    data_free(&(gate_analysis->data));
 
     /* recursively delete rest of list */
     return_list = analysis_gate_unref(gate_analysis->next_gate_analysis);
@@ -107,99 +311,91 @@ static analysis_gate_t * analysis_gate_unref(analysis_gate_t * gate_analysis) {
 static void record_stats(AmitkVoxel ds_voxel,
 			 amide_data_t value,
 			 amide_real_t voxel_fraction,
-			 gpointer data) {
+			 gpointer user_data) {
 
-  GPtrArray * array = data;
-  analysis_element_t * element;
+  analysis_data_t * data = user_data;
   
-  /* crashes if alloc fails, but I don't want to do error checking in the inner loop... 
-     let's not run out of memory */
-  if (voxel_fraction > 0.0) {
-    element = g_malloc(sizeof(analysis_element_t)); 
-    
-    element->value = value;
-    element->weight = voxel_fraction;
-    element->ds_voxel = ds_voxel;
-    g_ptr_array_add(array, element);
+  if ((voxel_fraction > 0.0) && !data->failed) {
+    if (data->len == data->allocated) 
+      if (!data_grow(data)) {
+	data->failed = TRUE;
+	return;
+      }
+
+    data->values[data->len] = value;
+    data->weights[data->len] = voxel_fraction;
+    data->voxels[data->len] = ds_voxel;
+    data->indices[data->len] = data->len;
+    data->len++;
   }
 
   return;
 }
 
-static gint array_comparison(gconstpointer a, gconstpointer b) {
-
-  const analysis_element_t * ea = *((analysis_element_t **) a);
-  const analysis_element_t * eb = *((analysis_element_t **) b);
-
-  if (ea->value > eb->value) 
-    return -1;
-  else if (ea->value < eb->value) 
-    return 1;
-  else
-    return 0;
-}
-
 
 
-/* note, the following function for weight variance calculation is
-   derived from statistics/wvariance_source.c from gsl version 1.3.  
-   copyright Jim Davies, Brian Gough, released under GPL. */
+/* weighted mean and variance over the first num_elements in a single pass,
+   using West's weighted version of Welford's running update.  This avoids
+   the cancellation problems of a naive sum of squares. */
 /* The variance is divided by N-1, since the mean in a sense is being
    "estimated" from the data set....  If anyone else with more
    statistical experience disagrees, please speak up */
-static gdouble wvariance (GPtrArray * array, guint num_elements, gdouble wmean)
-{
-  analysis_element_t * element;
-  gdouble wsumofsquares = 0 ;
-  gdouble Wa = 0;
-  gdouble Wb = 0;
-  gdouble wi;
-  gdouble delta;
-  gdouble factor;
+static void data_calc_moments(const analysis_data_t * data, const guint num_elements,
+			      analysis_gate_t * analysis) {
+
+  gdouble total=0.0;
+  gdouble Wa=0.0;
+  gdouble Wb=0.0;
+  gdouble wmean=0.0;
+  gdouble wsumofsquares=0.0;
+  gdouble wi, value, delta;
   guint i;
 
-  if (num_elements < 2) return NAN;
-
-  /* find the weight sum of the squares */
-  /* computes sum(wi*(valuei-mean))/sum(wi) */
-  /* and computes the weighted version of N/(N-1) */
-  for (i = 0; i < num_elements; i++) {
-    element = g_ptr_array_index(array, i);
-    wi = element->weight;
-
-    if (wi > 0) {
-      delta = element->value-wmean;
-      Wa += wi ;
-      Wb += wi*wi;
-      wsumofsquares += (delta * delta - wsumofsquares) * (wi / Wa);
-    } 
+  for (i=0; i<num_elements; i++) {
+    wi = data->weights[i];
+    value = data->values[i];
+
+    total += wi*value;
+    Wa += wi;
+    Wb += wi*wi;
+    delta = value-wmean;
+    wmean += delta*(wi/Wa);
+    wsumofsquares += wi*delta*(value-wmean);
   }
 
-  factor = (Wa*Wa)/((Wa*Wa)-Wb);
+  analysis->total = total;
+  analysis->fractional_voxels = Wa;
+  analysis->mean = total/Wa;
+
+  /* the weighted version of N/(N-1) */
+  if (num_elements < 2)
+    analysis->var = NAN;
+  else
+    analysis->var = (wsumofsquares/Wa) * (Wa*Wa)/((Wa*Wa)-Wb);
 
-  return factor*wsumofsquares;
+  return;
 }
 
 
 
-/* calculate an analysis of several statistical values for an roi on a given data set frame/gate. */
-static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi, 
-						    AmitkDataSet * ds, 
-						    guint frame,
-						    guint gate,
-						    analysis_calculation_t calculation_type,
-						    gboolean accurate,
-						    gdouble subfraction,
-						    gdouble threshold_percentage,
-						    gdouble threshold_value) {
+/* calculate an analysis of several statistical values for an roi on a given data set frame/gate. 
+   Note, this gets called from multiple threads at once, so it should only read from
+   the roi and data set */
+static analysis_gate_t * analysis_gate_calc(AmitkRoi * roi, 
+					    AmitkDataSet * ds, 
+					    guint frame,
+					    guint gate,
+					    analysis_calculation_t calculation_type,
+					    gboolean accurate,
+					    gdouble subfraction,
+					    gdouble threshold_percentage,
+					    gdouble threshold_value) {
 
-  GPtrArray * data_array;
+  analysis_data_t data = {NULL, NULL, NULL, NULL, 0, 0, FALSE};
   analysis_gate_t * analysis;
   guint subfraction_voxels;
   guint i;
-  analysis_element_t * element;
   gdouble max;
-  gboolean done;
 #ifdef AMIDE_DEBUG
   struct timeval tv1;
   struct timeval tv2;
@@ -210,71 +406,50 @@ static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi,
   gettimeofday(&tv1, NULL);
 #endif
 
-  if (gate == AMITK_DATA_SET_NUM_GATES(ds)) return NULL; /* check if we're done */
-
-  /* and now calculate this gate's data */
-  if ((data_array = g_ptr_array_new()) == NULL) {
+  /* fill the arrays with the appropriate info from the data set */
+  amitk_roi_calculate_on_data_set(roi, ds, frame, gate,FALSE, accurate, record_stats, &data);
+  if (data.failed) {
     g_warning(_("couldn't allocate memory space for data array for frame %d/gate %d"), frame, gate);
+    data_free(&data);
     return NULL;
   }
-  /* fill the array with the appropriate info from the data set */
-  /* note, I really only need a partial sort to get the median value, but
-     glib doesn't have one (only has a full qsort), so I'll just do that.
-     Partial sort would be order(N), qsort is order(NlogN), so it's not that
-     much worse.
-
-     If I used a partial sort, I'd have to iterate over the subfraction to find the 
-     max and min, and I'd have to do another partial sort to find the median 
-  */
-  amitk_roi_calculate_on_data_set(roi, ds, frame, gate,FALSE, accurate, record_stats, data_array);
-  g_ptr_array_sort(data_array, array_comparison);
   
+  /* note, no sorting is done here.  The thresholds are found with linear
+     scans, and the highest subfraction_voxels elements are moved to the
+     front of the arrays with a selection (order N) instead of a full sort
+     (order NlogN).  The median is found with another selection on that
+     front part. */
   switch(calculation_type) {
   case ALL_VOXELS:
-    subfraction_voxels = data_array->len;
+    subfraction_voxels = data.len;
     break;
   case HIGHEST_FRACTION_VOXELS:
-    subfraction_voxels = ceil(subfraction*data_array->len);
+    subfraction_voxels = ceil(subfraction*data.len);
 
-    if ((subfraction_voxels == 0) && (data_array->len > 0))
+    if ((subfraction_voxels == 0) && (data.len > 0))
       subfraction_voxels = 1; /* have at least one voxel if the roi is in the data set*/
 
     break;
   case VOXELS_NEAR_MAX:
     subfraction_voxels = 0;
 
-    if (data_array->len > 0) {
-      element = g_ptr_array_index(data_array, 0);
-      max = element->value;
-      done = FALSE;
-      for (i=0; i<data_array->len && !done; i++) {
-	element = g_ptr_array_index(data_array, i);
-	if (element->value >= max*threshold_percentage/100.0)
+    if (data.len > 0) {
+      max = data.values[data_max_index(&data, 0, data.len)];
+      for (i=0; i<data.len; i++) 
+	if (data.values[i] >= max*threshold_percentage/100.0)
 	  subfraction_voxels++;
-	else
-	  done = TRUE;
-      }
     }
 
-    if ((subfraction_voxels == 0) && (data_array->len > 0))
+    if ((subfraction_voxels == 0) && (data.len > 0))
       subfraction_voxels = 1; /* have at least one voxel if the roi is in the data set*/
 
     break;
   case VOXELS_GREATER_THAN_VALUE:
     subfraction_voxels = 0;
 
-    if (data_array->len > 0) {
-      element = g_ptr_array_index(data_array, 0);
-      max = element->value;
-      done = FALSE;
-      for (i=0; i<data_array->len && !done; i++) {
-	element = g_ptr_array_index(data_array, i);
-	if (element->value >= threshold_value)
-	  subfraction_voxels++;
-	else
-	  done = TRUE;
-      }
-    }
+    for (i=0; i<data.len; i++) 
+      if (data.values[i] >= threshold_value)
+	subfraction_voxels++;
     break;
   default:
     subfraction_voxels=0;
@@ -285,12 +460,13 @@ static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi,
   /* fill in our gate_analysis structure */
   if ((analysis =  g_try_new(analysis_gate_t,1)) == NULL) {
     g_warning(_("couldn't allocate memory space for roi analysis of frame %d/gate %d"), frame, gate);
+    data_free(&data);
     return analysis;
   }
   analysis->ref_count = 1;
+  analysis->next_gate_analysis = NULL;
 
   /* set values */
-  analysis->data_array = data_array;
   analysis->duration = amitk_data_set_get_frame_duration(ds, frame);
   analysis->time_midpoint = amitk_data_set_get_midpt_time(ds, frame);
   analysis->gate_time = amitk_data_set_get_gate_time(ds, gate);
@@ -311,38 +487,28 @@ static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi,
 
   } else { 
 
-    /* max */
-    element = g_ptr_array_index(data_array, 0);
-    analysis->max = element->value;
+    /* move the highest subfraction_voxels elements to the front */
+    if (subfraction_voxels < data.len)
+      data_select(&data, 0, data.len-1, subfraction_voxels-1);
 
-    /* min */
-    element = g_ptr_array_index(data_array, subfraction_voxels-1);
-    analysis->min = element->value;
+    /* max and min */
+    analysis->max = data.values[data_max_index(&data, 0, subfraction_voxels)];
+    analysis->min = data.values[data_min_index(&data, 0, subfraction_voxels)];
 
     /* median */
     if (subfraction_voxels & 0x1) { /* odd */
-      element = g_ptr_array_index(data_array, (subfraction_voxels-1)/2);
-      analysis->median = element->value;
-    } else { /* even */
-      element = g_ptr_array_index(data_array, subfraction_voxels/2-1);
-      analysis->median = 0.5*element->value;
-      element = g_ptr_array_index(data_array, subfraction_voxels/2);
-      analysis->median += 0.5*element->value;
-    }
-
-    /* total and #fractional_voxels */
-    for (i=0; i<subfraction_voxels; i++) {
-      element = g_ptr_array_index(data_array, i);
-      analysis->total += element->weight*element->value;
-      analysis->fractional_voxels += element->weight;
+      data_select(&data, 0, subfraction_voxels-1, (subfraction_voxels-1)/2);
+      analysis->median = data.values[(subfraction_voxels-1)/2];
+    } else { /* even - the other middle value is the highest of the lower half */
+      data_select(&data, 0, subfraction_voxels-1, subfraction_voxels/2-1);
+      analysis->median = 0.5*data.values[subfraction_voxels/2-1];
+      analysis->median += 0.5*data.values[data_max_index(&data, subfraction_voxels/2, subfraction_voxels)];
     }
 
-    /* calculate the mean */
-    analysis->mean = analysis->total/analysis->fractional_voxels;
-
-    /* calculate variance */
-    analysis->var = wvariance(data_array, subfraction_voxels, analysis->mean);
+    /* total, #fractional_voxels, mean, and variance */
+    data_calc_moments(&data, subfraction_voxels, analysis);
   }
+  analysis->data = data;
   
 #ifdef AMIDE_DEBUG
   /* and wrapup our timing */
@@ -354,27 +520,58 @@ static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi,
 	  AMITK_OBJECT_NAME(roi), AMITK_OBJECT_NAME(ds), frame, gate, time2-time1);
 #endif
 
+  return analysis;
+}
 
-  /* now let's recurse  */
-  analysis->next_gate_analysis = 
-    analysis_gate_init_recurse(roi, ds, frame, gate+1, calculation_type, accurate, 
-			       subfraction, threshold_percentage, threshold_value);
+/* work function for amitk_parallel_for, each task writes only its own result */
+static void analysis_tasks_calc(gint start, gint end, gpointer user_data) {
+
+  analysis_tasks_t * tasks = user_data;
+  analysis_task_t * task;
+  gint64 trace_start;
+  gint i;
+
+  for (i=start; i<end; i++) {
+    task = &g_array_index(tasks->tasks, analysis_task_t, i);
+    trace_start = AMITK_TRACE_BEGIN();
+    task->result = analysis_gate_calc(task->roi, task->ds, task->frame, task->gate,
+				      tasks->calculation_type, tasks->accurate,
+				      tasks->subfraction, tasks->threshold_percentage,
+				      tasks->threshold_value);
+    AMITK_TRACE_END("analysis_gate_calc", trace_start);
+  }
 
-  return analysis;
+  return;
 }
 
+/* link the calculated gates into their frames, in gate order.  As before, a
+   gate that failed to calculate ends the list for that frame */
+static void analysis_tasks_merge(GArray * tasks) {
+
+  analysis_task_t * task;
+  analysis_gate_t ** link=NULL;
+  gboolean broken=FALSE;
+  guint i;
 
+  for (i=0; i<tasks->len; i++) {
+    task = &g_array_index(tasks, analysis_task_t, i);
 
-static analysis_gate_t * analysis_gate_init(AmitkRoi * roi, AmitkDataSet * ds,
-					    guint frame, 
-					    analysis_calculation_t calculation_type,
-					    gboolean accurate,
-					    gdouble subfraction,
-					    gdouble threshold_percentage,
-					    gdouble threshold_value) {
+    if (task->gate == 0) { /* first gate of a new frame */
+      link = &(task->frame_analysis->gate_analyses);
+      broken = FALSE;
+    }
+
+    if (broken || (task->result == NULL)) {
+      broken = TRUE;
+      task->result = analysis_gate_unref(task->result);
+    } else {
+      *link = task->result;
+      link = &(task->result->next_gate_analysis);
+      task->result = NULL;
+    }
+  }
 
-  return analysis_gate_init_recurse(roi, ds, frame, 0, calculation_type, accurate,
-				    subfraction, threshold_percentage, threshold_value);
+  return;
 }
 
 
@@ -407,17 +604,15 @@ static analysis_frame_t * analysis_frame_unref(analysis_frame_t * frame_analysis
 }
 
 
-/* returns a calculated analysis structure of an roi on a frame of a data set */
+/* returns an analysis structure of an roi on a frame of a data set, the gates
+   themselves get added to the task list to be calculated later */
 static analysis_frame_t * analysis_frame_init_recurse(AmitkRoi * roi, 
 						      AmitkDataSet *ds, 
 						      guint frame,
-						      analysis_calculation_t calculation_type,
-						      gboolean accurate,
-						      gdouble subfraction,
-						      gdouble threshold_percentage,
-						      gdouble threshold_value) {
+						      GArray * tasks) {
   
   analysis_frame_t * temp_frame_analysis;
+  analysis_task_t task;
   
   if (frame == AMITK_DATA_SET_NUM_FRAMES(ds)) return NULL; /* check if we're done */
 
@@ -427,27 +622,27 @@ static analysis_frame_t * analysis_frame_init_recurse(AmitkRoi * roi,
   }
   
   temp_frame_analysis->ref_count = 1;
+  temp_frame_analysis->gate_analyses = NULL;
 
-  /* calculate this one */
-  temp_frame_analysis->gate_analyses = 
-    analysis_gate_init(roi, ds, frame, calculation_type, accurate, subfraction, 
-		       threshold_percentage, threshold_value);
+  /* queue up this one's gates */
+  task.roi = roi;
+  task.ds = ds;
+  task.frame = frame;
+  task.frame_analysis = temp_frame_analysis;
+  task.result = NULL;
+  for (task.gate=0; task.gate < AMITK_DATA_SET_NUM_GATES(ds); task.gate++)
+    g_array_append_val(tasks, task);
 
   /* recurse */
   temp_frame_analysis->next_frame_analysis = 
-    analysis_frame_init_recurse(roi, ds, frame+1, calculation_type, accurate, subfraction, 
-				threshold_percentage, threshold_value);
+    analysis_frame_init_recurse(roi, ds, frame+1, tasks);
 
   return temp_frame_analysis;
 }
 
 
 static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, AmitkDataSet *ds, 
-					      analysis_calculation_t calculation_type,
-					      gboolean accurate,
-					      gdouble subfraction,
-					      gdouble threshold_percentage,
-					      gdouble threshold_value) {
+					      GArray * tasks) {
 
   /* sanity checks */
   g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
@@ -457,8 +652,7 @@ static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, AmitkDataSet *ds,
     return NULL;
   }
 
-  return analysis_frame_init_recurse(roi, ds, 0, calculation_type, accurate, subfraction, 
-				     threshold_percentage, threshold_value);
+  return analysis_frame_init_recurse(roi, ds, 0, tasks);
 }
 
 
@@ -495,11 +689,7 @@ static analysis_volume_t * analysis_volume_unref(analysis_volume_t * volume_anal
 
 /* returns an initialized roi analysis of a list of volumes */
 static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * data_sets, 
-						analysis_calculation_t calculation_type,
-						gboolean accurate,
-						gdouble subfraction,
-						gdouble threshold_percentage,
-						gdouble threshold_value) {
+						GArray * tasks) {
   
   analysis_volume_t * temp_volume_analysis;
 
@@ -518,13 +708,11 @@ static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * data_set
 
   /* calculate this one */
   temp_volume_analysis->frame_analyses = 
-    analysis_frame_init(roi, temp_volume_analysis->data_set, calculation_type, accurate,
-			subfraction, threshold_percentage, threshold_value);
+    analysis_frame_init(roi, temp_volume_analysis->data_set, tasks);
 
   /* recurse */
   temp_volume_analysis->next_volume_analysis = 
-    analysis_volume_init(roi, data_sets->next, calculation_type, accurate,
-			 subfraction, threshold_percentage, threshold_value);
+    analysis_volume_init(roi, data_sets->next, tasks);
 
   
   return temp_volume_analysis;
@@ -567,14 +755,14 @@ analysis_roi_t * analysis_roi_unref(analysis_roi_t * roi_analysis) {
   return return_list;
 }
 
-/* returns an initialized list of roi analyses */
-analysis_roi_t * analysis_roi_init(AmitkStudy * study, GList * rois, 
-				   GList * data_sets, 
-				   analysis_calculation_t calculation_type,
-				   gboolean accurate,
-				   gdouble subfraction, 
-				   gdouble threshold_percentage,
-				   gdouble threshold_value) {
+static analysis_roi_t * analysis_roi_init_recurse(AmitkStudy * study, GList * rois, 
+						  GList * data_sets, 
+						  analysis_calculation_t calculation_type,
+						  gboolean accurate,
+						  gdouble subfraction, 
+						  gdouble threshold_percentage,
+						  gdouble threshold_value,
+						  GArray * tasks) {
   
   analysis_roi_t * temp_roi_analysis;
   
@@ -596,17 +784,75 @@ analysis_roi_t * analysis_roi_init(AmitkStudy * study, GList * rois,
 
   /* calculate this one */
   temp_roi_analysis->volume_analyses = 
-    analysis_volume_init(temp_roi_analysis->roi, data_sets, calculation_type, accurate,
-			 subfraction, threshold_percentage, threshold_value);
+    analysis_volume_init(temp_roi_analysis->roi, data_sets, tasks);
 
   /* recurse */
   temp_roi_analysis->next_roi_analysis = 
-    analysis_roi_init(study, rois->next, data_sets, calculation_type, accurate,
-		      subfraction, threshold_percentage, threshold_value);
+    analysis_roi_init_recurse(study, rois->next, data_sets, calculation_type, accurate,
+			      subfraction, threshold_percentage, threshold_value, tasks);
 
   
   return temp_roi_analysis;
 }
 
+/* returns an initialized list of roi analyses.  The structure is built up first,
+   with each roi/data set/frame/gate combination queued up as a task, the tasks are
+   then calculated in parallel and linked back into the structure in order.  
+   Returns NULL if the user cancelled through the update_func */
+analysis_roi_t * analysis_roi_init(AmitkStudy * study, GList * rois, 
+				   GList * data_sets, 
+				   analysis_calculation_t calculation_type,
+				   gboolean accurate,
+				   gdouble subfraction, 
+				   gdouble threshold_percentage,
+				   gdouble threshold_value,
+				   AmitkUpdateFunc update_func,
+				   gpointer update_data) {
+
+  analysis_roi_t * roi_analyses;
+  analysis_tasks_t tasks;
+  gboolean continue_work=TRUE;
+  gchar * temp_string;
+  gint64 trace_start;
+  gint64 trace_calc;
+
+  trace_start = AMITK_TRACE_BEGIN();
+  tasks.tasks = g_array_new(FALSE, FALSE, sizeof(analysis_task_t));
+  tasks.calculation_type = calculation_type;
+  tasks.accurate = accurate;
+  tasks.subfraction = subfraction;
+  tasks.threshold_percentage = threshold_percentage;
+  tasks.threshold_value = threshold_value;
+
+  roi_analyses = analysis_roi_init_recurse(study, rois, data_sets, calculation_type, accurate, 
+					   subfraction, threshold_percentage, threshold_value, 
+					   tasks.tasks);
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Calculating ROI statistics"));
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  /* tasks vary a lot in size, so hand them out one at a time */
+  trace_calc = AMITK_TRACE_BEGIN();
+  if (continue_work)
+    continue_work = amitk_parallel_for(tasks.tasks->len, 1, analysis_tasks_calc, &tasks,
+				       update_func, update_data);
+  AMITK_TRACE_END("analysis_tasks_calc", trace_calc);
+
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0);
+
+  analysis_tasks_merge(tasks.tasks);
+  g_array_free(tasks.tasks, TRUE);
+
+  if (!continue_work) 
+    roi_analyses = analysis_roi_unref(roi_analyses);
+
+  AMITK_TRACE_END("analysis_roi_init", trace_start);
+  return roi_analyses;
+}
+
 
 
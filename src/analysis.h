@@ -49,17 +49,24 @@ typedef struct _analysis_study_t analysis_study_t;
 
 
 
-typedef struct analysis_element_t {
-  amide_data_t value;
-  amide_real_t weight;
-  AmitkVoxel ds_voxel;
-} analysis_element_t;
+/* the voxels of the roi, as parallel arrays.  Note, the order gets shuffled
+   when the stats are calculated, use analysis_gate_sorted_order to walk
+   through them from highest to lowest value */
+typedef struct analysis_data_t {
+  amide_data_t * values;
+  amide_real_t * weights;
+  AmitkVoxel * voxels;
+  guint * indices; /* order the voxels were recorded in, used to break ties */
+  guint len;
+  guint allocated;
+  gboolean failed; /* couldn't grow the arrays */
+} analysis_data_t;
 
 
 struct _analysis_gate_t {
 
-  /* roi data - array of analysis_element's */
-  GPtrArray * data_array;
+  /* roi data */
+  analysis_data_t data;
 
   /* stats */
   amide_data_t mean;
@@ -110,6 +117,7 @@ struct _analysis_roi_t {
 
 /* external functions */
 analysis_roi_t * analysis_roi_unref(analysis_roi_t *roi_analysis);
+guint * analysis_gate_sorted_order(const analysis_gate_t * gate_analysis);
 
 /* note, subfraction is only used for calculation_type == HIGHEST_FRACTION_VOXELS,
    threshold_percentage is only used for calculation_type == VOXELS_NEAR_MAX
@@ -121,7 +129,9 @@ analysis_roi_t * analysis_roi_init(AmitkStudy * study,
 				   gboolean accurate,
 				   gdouble subfraction, 
 				   gdouble threshold_percentage, 
-				   gdouble threshold_value);
+				   gdouble threshold_value,
+				   AmitkUpdateFunc update_func,
+				   gpointer update_data);
 
 #endif /* __ANALYSIS_H__ */
 
@@ -0,0 +1,771 @@
+/* batch.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+/* Headless batch mode.  Invoked as
+
+     amide --batch SCRIPT [FILE1] [FILE2] ...
+
+   The files are loaded into a single study, and then the commands in SCRIPT
+   (or stdin if SCRIPT is "-") are run against it, one per line.  Arguments
+   are split with shell quoting rules, including '#' starting a comment
+   (a quoted or mid-word '#' is just a character).  Data sets are referred to by name.  Results of filter and math
+   operations are added to the study as new data sets.  Processing stops at
+   the first command that fails.
+
+   Files can be AMIDE XIF studies (flat files or directories), or anything
+   that can be imported.  Any other directory gets imported through its
+   DICOMDIR file, and is an error if it doesn't have one.  Files that would
+   have to be guessed as raw data are an error, as there's no dialog to ask
+   for their format; use load-raw for those.  Where the DICOM import would
+   ask a question, only the data set of the given file gets loaded, and
+   files missing from a DICOMDIR are skipped.
+
+     threads N                      number of worker threads (0 = all cores)
+     load FILE                      load a XIF study or import a data file
+     load-raw FILE FORMAT X Y Z VX VY VZ [FRAMES [GATES [OFFSET]]]
+                                    import raw data, FORMAT is e.g. float-32-le,
+                                    voxel sizes are in mm, OFFSET in bytes
+     filter DS TYPE SIZE [FWHM]     TYPE is gaussian, median-linear or median-3d
+     math DS1 OP DS2                OP is add, sub, multiply, division or t2star
+     align MOVING FIXED             mutual information registration
+     fads DS TYPE FACTORS FILE      factor analysis of a dynamic data set, TYPE is
+                                    pca, pls or two-compartment.  The factor curves
+                                    go to FILE, the factor images get added to DS
+     rename DS NAME
+     remove DS
+     stats FILE                     csv statistics for every roi and data set
+     export DS FILE [raw|dicom|medcon]
+     save FILE                      save the study as a XIF file
+*/
+
+#include "amide_config.h"
+#include <stdio.h>
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "amide.h"
+#include "amitk_common.h"
+#include "amitk_parallel.h"
+#include "amitk_study.h"
+#include "amitk_type_builtins.h"
+#include "analysis.h"
+#include "alignment_mutual_information.h"
+#include "fads.h"
+#include "batch.h"
+
+typedef struct batch_t {
+  AmitkPreferences * preferences;
+  AmitkStudy * study;
+  gchar * message;
+  gint percent;
+} batch_t;
+
+typedef gboolean (* batch_func_t)(batch_t * batch, gint argc, gchar ** argv);
+
+typedef struct batch_command_t {
+  const gchar * name;
+  gint min_args;
+  gint max_args;
+  batch_func_t func;
+  const gchar * usage;
+} batch_command_t;
+
+
+/* progress goes to stderr, a line per message with a running percentage */
+static gboolean batch_update(gpointer data, char * message, gdouble fraction) {
+
+  batch_t * batch = data;
+  gint percent;
+
+  if (message != NULL) {
+    g_free(batch->message);
+    batch->message = g_strdup(message);
+    batch->percent = -1;
+  }
+
+  if ((fraction >= 0.0) && (fraction <= 1.0) && (batch->message != NULL)) {
+    percent = (gint) (100.0*fraction);
+    if (percent/10 != batch->percent/10) {
+      fprintf(stderr, "%s %3d%%\r", batch->message, percent);
+      batch->percent = percent;
+    }
+  } else if ((fraction > 1.0) && (batch->percent >= 0)) {
+    fprintf(stderr, "%s done\n", batch->message);
+    batch->percent = -1;
+  }
+
+  return TRUE;
+}
+
+static gboolean batch_lookup_enum(GType type, const gchar * nick, gint * value) {
+
+  GEnumClass * enum_class;
+  GEnumValue * enum_value;
+
+  enum_class = g_type_class_ref(type);
+  enum_value = g_enum_get_value_by_nick(enum_class, nick);
+  if (enum_value != NULL) *value = enum_value->value;
+  g_type_class_unref(enum_class);
+
+  return (enum_value != NULL);
+}
+
+/* returns a referenced data set with the given name, or NULL */
+static AmitkDataSet * batch_find_data_set(batch_t * batch, const gchar * name) {
+
+  GList * data_sets;
+  GList * temp;
+  AmitkDataSet * ds = NULL;
+
+  data_sets = amitk_object_get_children_of_type(AMITK_OBJECT(batch->study),
+						AMITK_OBJECT_TYPE_DATA_SET, TRUE);
+  for (temp = data_sets; (temp != NULL) && (ds == NULL); temp = temp->next)
+    if (g_strcmp0(AMITK_OBJECT_NAME(temp->data), name) == 0)
+      ds = amitk_object_ref(temp->data);
+  amitk_objects_unref(data_sets);
+
+  if (ds == NULL)
+    g_warning(_("no data set named: %s"), name);
+
+  return ds;
+}
+
+static void batch_add_data_set(batch_t * batch, AmitkDataSet * ds) {
+
+  amitk_object_add_child(AMITK_OBJECT(batch->study), AMITK_OBJECT(ds));
+  amitk_study_set_view_thickness(batch->study,
+				 amitk_data_sets_get_min_voxel_size(AMITK_OBJECT_CHILDREN(batch->study)));
+}
+
+static gboolean batch_threads(batch_t * batch, gint argc, gchar ** argv) {
+
+  amitk_parallel_set_num_threads(atoi(argv[1]));
+  g_message(_("using %d threads"), amitk_parallel_get_num_threads());
+
+  return TRUE;
+}
+
+/* load a XIF study, or import a data file or DICOM directory, into the batch's study */
+static gboolean batch_load_file(batch_t * batch, const gchar * filename) {
+
+  struct stat file_info;
+  AmitkStudy * study;
+  GList * children;
+  GList * new_data_sets;
+  AmitkDataSet * new_ds;
+  gchar * studyname=NULL;
+  gchar * dicomdir_filename;
+  gboolean successful;
+
+  if (stat(filename, &file_info) != 0) {
+    g_warning(_("%s does not exist"), filename);
+    return FALSE;
+  }
+
+  if (amitk_is_xif_flat_file(filename, NULL, NULL) ||
+      amitk_is_xif_directory(filename, NULL, NULL)) {
+    if ((study = amitk_study_load_xml(filename)) == NULL) {
+      g_warning(_("Failed to load in as XIF file: %s"), filename);
+      return FALSE;
+    }
+
+    if (AMITK_OBJECT_CHILDREN(batch->study) == NULL) {
+      /* nothing loaded yet, the study becomes ours */
+      amitk_object_unref(batch->study);
+      batch->study = study;
+    } else {
+      /* otherwise move its objects over */
+      children = amitk_objects_ref(AMITK_OBJECT_CHILDREN(study));
+      amitk_object_remove_children(AMITK_OBJECT(study), children);
+      amitk_object_add_children(AMITK_OBJECT(batch->study), children);
+      amitk_objects_unref(children);
+      amitk_object_unref(study);
+      amitk_study_set_view_thickness(batch->study,
+				     amitk_data_sets_get_min_voxel_size(AMITK_OBJECT_CHILDREN(batch->study)));
+    }
+
+  } else if (!S_ISDIR(file_info.st_mode)) {
+    new_data_sets = amitk_data_set_import_file(AMITK_IMPORT_METHOD_GUESS, 0, filename, &studyname,
+					       batch->preferences, batch_update, batch);
+    if (new_data_sets == NULL) {
+      g_warning(_("%s is not an AMIDE study or importable file type, use load-raw for raw data"), filename);
+      return FALSE;
+    }
+
+    if ((AMITK_OBJECT_CHILDREN(batch->study) == NULL) && (studyname != NULL))
+      amitk_study_suggest_name(batch->study, studyname);
+    g_free(studyname);
+
+    while (new_data_sets != NULL) {
+      new_ds = new_data_sets->data;
+      batch_add_data_set(batch, new_ds);
+      new_data_sets = g_list_remove(new_data_sets, new_ds);
+      new_ds = amitk_object_unref(new_ds);
+    }
+
+  } else {
+    /* a directory of DICOM files, import it through its DICOMDIR */
+    dicomdir_filename = g_build_filename(filename, "DICOMDIR", NULL);
+    if (!g_file_test(dicomdir_filename, G_FILE_TEST_IS_REGULAR)) {
+      g_warning(_("%s is a directory, but is not an AMIDE XIF directory and has no DICOMDIR file"), 
+		filename);
+      g_free(dicomdir_filename);
+      return FALSE;
+    }
+    successful = batch_load_file(batch, dicomdir_filename);
+    g_free(dicomdir_filename);
+    return successful;
+  }
+
+  return TRUE;
+}
+
+static gboolean batch_load(batch_t * batch, gint argc, gchar ** argv) {
+  return batch_load_file(batch, argv[1]);
+}
+
+static gboolean batch_load_raw(batch_t * batch, gint argc, gchar ** argv) {
+
+  gint raw_format;
+  AmitkVoxel dim;
+  AmitkPoint voxel_size;
+  guint file_offset;
+  gchar * name;
+  AmitkDataSet * ds;
+
+  if (!batch_lookup_enum(AMITK_TYPE_RAW_FORMAT, argv[2], &raw_format)) {
+    g_warning(_("unknown raw data format: %s"), argv[2]);
+    return FALSE;
+  }
+
+  dim.x = atoi(argv[3]);
+  dim.y = atoi(argv[4]);
+  dim.z = atoi(argv[5]);
+  dim.t = (argc > 9) ? atoi(argv[9]) : 1;
+  dim.g = (argc > 10) ? atoi(argv[10]) : 1;
+  voxel_size.x = g_ascii_strtod(argv[6], NULL);
+  voxel_size.y = g_ascii_strtod(argv[7], NULL);
+  voxel_size.z = g_ascii_strtod(argv[8], NULL);
+  file_offset = (argc > 11) ? atoi(argv[11]) : 0;
+
+  if ((dim.x < 1) || (dim.y < 1) || (dim.z < 1) || (dim.t < 1) || (dim.g < 1)) {
+    g_warning(_("bad dimensions for %s"), argv[1]);
+    return FALSE;
+  }
+  if ((voxel_size.x <= 0.0) || (voxel_size.y <= 0.0) || (voxel_size.z <= 0.0)) {
+    g_warning(_("bad voxel size for %s"), argv[1]);
+    return FALSE;
+  }
+
+  name = g_path_get_basename(argv[1]);
+  ds = amitk_data_set_import_raw_file(argv[1], raw_format, dim, file_offset,
+				      batch->preferences, AMITK_MODALITY_PET,
+				      name, voxel_size, 1.0, batch_update, batch);
+  g_free(name);
+  if (ds == NULL) {
+    g_warning(_("Failed to import raw data file: %s"), argv[1]);
+    return FALSE;
+  }
+
+  batch_add_data_set(batch, ds);
+  amitk_object_unref(ds);
+
+  return TRUE;
+}
+
+static gboolean batch_filter(batch_t * batch, gint argc, gchar ** argv) {
+
+  AmitkDataSet * ds;
+  AmitkDataSet * filtered_ds;
+  gint filter;
+  gint kernel_size;
+  amide_real_t fwhm;
+
+  if (!batch_lookup_enum(AMITK_TYPE_FILTER, argv[2], &filter)) {
+    g_warning(_("unknown filter type: %s"), argv[2]);
+    return FALSE;
+  }
+
+  kernel_size = atoi(argv[3]);
+  fwhm = (argc > 4) ? g_ascii_strtod(argv[4], NULL) : 1.0;
+
+  if ((ds = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+
+  filtered_ds = amitk_data_set_get_filtered(ds, filter, kernel_size, fwhm,
+					    batch_update, batch);
+  amitk_object_unref(ds);
+  if (filtered_ds == NULL) {
+    g_warning(_("Failed to generate filtered data set"));
+    return FALSE;
+  }
+
+  batch_add_data_set(batch, filtered_ds);
+  amitk_object_unref(filtered_ds);
+
+  return TRUE;
+}
+
+static gboolean batch_math(batch_t * batch, gint argc, gchar ** argv) {
+
+  AmitkDataSet * ds1;
+  AmitkDataSet * ds2;
+  AmitkDataSet * result_ds;
+  gint operation;
+
+  if (!batch_lookup_enum(AMITK_TYPE_OPERATION_BINARY, argv[2], &operation)) {
+    g_warning(_("unknown operation: %s"), argv[2]);
+    return FALSE;
+  }
+
+  if ((ds1 = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+  if ((ds2 = batch_find_data_set(batch, argv[3])) == NULL) {
+    amitk_object_unref(ds1);
+    return FALSE;
+  }
+
+  result_ds = amitk_data_sets_math_binary(ds1, ds2, operation, 0.0, 0.0, FALSE, FALSE,
+					  batch_update, batch);
+  amitk_object_unref(ds1);
+  amitk_object_unref(ds2);
+  if (result_ds == NULL) {
+    g_warning(_("Math operation failed - results not added to study"));
+    return FALSE;
+  }
+
+  batch_add_data_set(batch, result_ds);
+  amitk_object_unref(result_ds);
+
+  return TRUE;
+}
+
+static gboolean batch_align(batch_t * batch, gint argc, gchar ** argv) {
+
+#ifdef AMIDE_LIBGSL_SUPPORT
+  AmitkDataSet * moving_ds;
+  AmitkDataSet * fixed_ds;
+  AmitkSpace * transform;
+  gdouble metric;
+  gint iterations;
+
+  if ((moving_ds = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+  if ((fixed_ds = batch_find_data_set(batch, argv[2])) == NULL) {
+    amitk_object_unref(moving_ds);
+    return FALSE;
+  }
+
+  transform = alignment_mutual_information_multires(moving_ds, fixed_ds,
+						    AMITK_STUDY_VIEW_START_TIME(batch->study),
+						    AMITK_STUDY_VIEW_DURATION(batch->study),
+						    ALIGNMENT_MI_NORMALIZED, &metric, &iterations,
+						    batch_update, batch);
+  if (transform != NULL) {
+    amitk_space_transform(AMITK_SPACE(moving_ds), transform);
+    g_message(_("aligned %s to %s: metric %g after %d iterations"),
+	      argv[1], argv[2], metric, iterations);
+    g_object_unref(transform);
+  } else {
+    g_warning(_("Failed to align %s to %s"), argv[1], argv[2]);
+  }
+
+  amitk_object_unref(moving_ds);
+  amitk_object_unref(fixed_ds);
+
+  return (transform != NULL);
+#else
+  g_warning(_("Mutual information alignment requires AMIDE to be compiled with libgsl support"));
+  return FALSE;
+#endif
+}
+
+/* factor analysis, with the same defaults as the fads wizard and no blood curve constraints */
+static gboolean batch_fads(batch_t * batch, gint argc, gchar ** argv) {
+
+#ifdef AMIDE_LIBGSL_SUPPORT
+  AmitkDataSet * ds;
+  gint num_factors;
+
+  num_factors = atoi(argv[3]);
+  if (num_factors < 1) {
+    g_warning(_("need at least one factor"));
+    return FALSE;
+  }
+
+  if ((ds = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+
+  if (AMITK_DATA_SET_NUM_FRAMES(ds) < 2) {
+    g_warning(_("%s needs multiple frames for factor analysis"), argv[1]);
+    amitk_object_unref(ds);
+    return FALSE;
+  }
+
+  if (strcmp(argv[2], "pca") == 0) {
+    fads_pca(ds, num_factors, argv[4], batch_update, batch);
+  } else if (strcmp(argv[2], "pls") == 0) {
+    fads_pls(ds, num_factors, FADS_MINIMIZER_CONJUGATE_PR, 1e6, 1e-2, FALSE, 0.0,
+	     argv[4], 0, NULL, NULL, NULL, batch_update, batch);
+  } else if (strcmp(argv[2], "two-compartment") == 0) {
+    fads_two_comp(ds, FADS_MINIMIZER_CONJUGATE_PR, 1e6, num_factors-1, 0.01, 0.1, 1e-2, FALSE,
+		  argv[4], 0, NULL, NULL, batch_update, batch);
+  } else {
+    g_warning(_("unknown factor analysis type: %s"), argv[2]);
+    amitk_object_unref(ds);
+    return FALSE;
+  }
+
+  amitk_object_unref(ds);
+  return TRUE;
+#else
+  g_warning(_("Factor analysis requires AMIDE to be compiled with libgsl support"));
+  return FALSE;
+#endif
+}
+
+static gboolean batch_rename(batch_t * batch, gint argc, gchar ** argv) {
+
+  AmitkDataSet * ds;
+
+  if ((ds = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+
+  amitk_object_set_name(AMITK_OBJECT(ds), argv[2]);
+  amitk_object_unref(ds);
+
+  return TRUE;
+}
+
+static gboolean batch_remove(batch_t * batch, gint argc, gchar ** argv) {
+
+  AmitkDataSet * ds;
+  gboolean successful;
+
+  if ((ds = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+
+  successful = amitk_object_remove_child(AMITK_OBJECT_PARENT(ds), AMITK_OBJECT(ds));
+  amitk_object_unref(ds);
+
+  return successful;
+}
+
+/* quote a field for the csv file, doubling any embedded quotes */
+static gchar * batch_csv_quote(const gchar * str) {
+
+  GString * quoted;
+  const gchar * c;
+
+  quoted = g_string_new("\"");
+  for (c = (str == NULL) ? "" : str; *c != '\0'; c++) {
+    if (*c == '"') g_string_append_c(quoted, '"');
+    g_string_append_c(quoted, *c);
+  }
+  g_string_append_c(quoted, '"');
+
+  return g_string_free(quoted, FALSE);
+}
+
+static gboolean batch_stats(batch_t * batch, gint argc, gchar ** argv) {
+
+  GList * rois;
+  GList * data_sets;
+  analysis_roi_t * roi_analyses;
+  analysis_roi_t * temp_roi_analyses;
+  analysis_volume_t * volume_analyses;
+  analysis_frame_t * frame_analyses;
+  analysis_gate_t * gate_analyses;
+  amide_real_t voxel_volume;
+  guint frame;
+  guint gate;
+  FILE * file_pointer;
+  gchar * saved_locale;
+  gchar * roi_name;
+  gchar * ds_name;
+
+  rois = amitk_object_get_children_of_type(AMITK_OBJECT(batch->study),
+					   AMITK_OBJECT_TYPE_ROI, TRUE);
+  data_sets = amitk_object_get_children_of_type(AMITK_OBJECT(batch->study),
+						AMITK_OBJECT_TYPE_DATA_SET, TRUE);
+  if ((rois == NULL) || (data_sets == NULL)) {
+    g_warning(_("Need ROI's and data sets to calculate statistics"));
+    amitk_objects_unref(rois);
+    amitk_objects_unref(data_sets);
+    return FALSE;
+  }
+
+  roi_analyses = analysis_roi_init(batch->study, rois, data_sets, ALL_VOXELS, FALSE,
+				   0.0, 0.0, 0.0, batch_update, batch);
+  amitk_objects_unref(rois);
+  amitk_objects_unref(data_sets);
+  if (roi_analyses == NULL) {
+    g_warning(_("Failed to calculate statistics"));
+    return FALSE;
+  }
+
+  if ((file_pointer = fopen(argv[1], "w")) == NULL) {
+    g_warning(_("couldn't open: %s for writing roi data"), argv[1]);
+    analysis_roi_unref(roi_analyses);
+    return FALSE;
+  }
+
+  /* the decimal point has to be a period, the comma is the separator */
+  saved_locale = g_strdup(setlocale(LC_NUMERIC,NULL));
+  setlocale(LC_NUMERIC,"POSIX");
+
+  fprintf(file_pointer, "ROI,Data Set,Frame,Duration (s),Midpt (s),Gate,Gate Time (s),"
+	  "Median,Mean,Var,Std Dev,Min,Max,Size (mm^3),Frac. Voxels,Voxels\n");
+
+  for (temp_roi_analyses = roi_analyses; temp_roi_analyses != NULL;
+       temp_roi_analyses = temp_roi_analyses->next_roi_analysis) {
+    roi_name = batch_csv_quote(AMITK_OBJECT_NAME(temp_roi_analyses->roi));
+    for (volume_analyses = temp_roi_analyses->volume_analyses; volume_analyses != NULL;
+	 volume_analyses = volume_analyses->next_volume_analysis) {
+      voxel_volume = AMITK_DATA_SET_VOXEL_VOLUME(volume_analyses->data_set);
+      ds_name = batch_csv_quote(AMITK_OBJECT_NAME(volume_analyses->data_set));
+
+      for (frame_analyses = volume_analyses->frame_analyses, frame=0; frame_analyses != NULL;
+	   frame_analyses = frame_analyses->next_frame_analysis, frame++) {
+	for (gate_analyses = frame_analyses->gate_analyses, gate=0; gate_analyses != NULL;
+	     gate_analyses = gate_analyses->next_gate_analysis, gate++) {
+	  fprintf(file_pointer, "%s,%s,%d,%.3f,%.3f,%d,%.3f,%g,%g,%g,%g,%g,%g,%g,%.2f,%d\n",
+		  roi_name, ds_name,
+		  frame, gate_analyses->duration, gate_analyses->time_midpoint,
+		  gate, gate_analyses->gate_time,
+		  gate_analyses->median, gate_analyses->mean, gate_analyses->var,
+		  sqrt(gate_analyses->var), gate_analyses->min, gate_analyses->max,
+		  gate_analyses->fractional_voxels*voxel_volume,
+		  gate_analyses->fractional_voxels, gate_analyses->voxels);
+	}
+      }
+      g_free(ds_name);
+    }
+    g_free(roi_name);
+  }
+
+  setlocale(LC_NUMERIC, saved_locale);
+  g_free(saved_locale);
+
+  fclose(file_pointer);
+  analysis_roi_unref(roi_analyses);
+
+  return TRUE;
+}
+
+static gboolean batch_export(batch_t * batch, gint argc, gchar ** argv) {
+
+  AmitkDataSet * ds;
+  AmitkExportMethod method;
+  const gchar * format;
+  gboolean successful;
+
+  format = (argc > 3) ? argv[3] : "raw";
+  if (g_ascii_strcasecmp(format, "raw") == 0) {
+    method = AMITK_EXPORT_METHOD_RAW;
+#ifdef AMIDE_LIBDCMDATA_SUPPORT
+  } else if (g_ascii_strcasecmp(format, "dicom") == 0) {
+    method = AMITK_EXPORT_METHOD_DCMTK;
+#endif
+#ifdef AMIDE_LIBMDC_SUPPORT
+  } else if (g_ascii_strcasecmp(format, "medcon") == 0) {
+    method = AMITK_EXPORT_METHOD_LIBMDC;
+#endif
+  } else {
+    g_warning(_("unsupported export format: %s"), format);
+    return FALSE;
+  }
+
+  if ((ds = batch_find_data_set(batch, argv[1])) == NULL)
+    return FALSE;
+
+  successful = amitk_data_set_export_to_file(ds, method, 0, argv[2],
+					     AMITK_OBJECT_NAME(batch->study), FALSE,
+					     AMITK_DATA_SET_VOXEL_SIZE(ds), NULL,
+					     batch_update, batch);
+  amitk_object_unref(ds);
+
+  return successful;
+}
+
+static gboolean batch_save(batch_t * batch, gint argc, gchar ** argv) {
+
+  if (!amitk_study_save_xml(batch->study, argv[1], FALSE)) {
+    g_warning(_("Failure Saving File: %s"), argv[1]);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static batch_command_t batch_commands[] = {
+  {"threads", 1, 1, batch_threads, "threads N"},
+  {"load",    1, 1, batch_load,    "load FILE"},
+  {"load-raw", 8, 11, batch_load_raw, "load-raw FILE FORMAT X Y Z VX VY VZ [FRAMES [GATES [OFFSET]]]"},
+  {"filter",  3, 4, batch_filter,  "filter DS TYPE SIZE [FWHM]"},
+  {"math",    3, 3, batch_math,    "math DS1 OP DS2"},
+  {"align",   2, 2, batch_align,   "align MOVING FIXED"},
+  {"fads",    4, 4, batch_fads,    "fads DS TYPE FACTORS FILE"},
+  {"rename",  2, 2, batch_rename,  "rename DS NAME"},
+  {"remove",  1, 1, batch_remove,  "remove DS"},
+  {"stats",   1, 1, batch_stats,   "stats FILE"},
+  {"export",  2, 3, batch_export,  "export DS FILE [raw|dicom|medcon]"},
+  {"save",    1, 1, batch_save,    "save FILE"},
+  {NULL}
+};
+
+/* runs one line of the script, blank lines and comments succeed trivially */
+static gboolean batch_run_line(batch_t * batch, const gchar * line, gint line_number) {
+
+  gchar ** argv;
+  gint argc;
+  GError * error=NULL;
+  batch_command_t * command;
+  gboolean successful;
+
+  if (!g_shell_parse_argv(line, &argc, &argv, &error)) {
+    /* empty and comment-only lines come back as errors too */
+    if (error->code == G_SHELL_ERROR_EMPTY_STRING) {
+      g_error_free(error);
+      return TRUE;
+    }
+    g_warning(_("line %d: %s"), line_number, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  for (command = batch_commands; command->name != NULL; command++)
+    if (strcmp(command->name, argv[0]) == 0) break;
+
+  if (command->name == NULL) {
+    g_warning(_("line %d: unknown command %s"), line_number, argv[0]);
+    successful = FALSE;
+  } else if ((argc-1 < command->min_args) || (argc-1 > command->max_args)) {
+    g_warning(_("line %d: usage: %s"), line_number, command->usage);
+    successful = FALSE;
+  } else {
+    g_message(_("line %d: %s"), line_number, line);
+    successful = command->func(batch, argc, argv);
+  }
+
+  g_strfreev(argv);
+
+  return successful;
+}
+
+static void batch_log_handler(const gchar *log_domain,
+			      GLogLevelFlags log_level,
+			      const gchar *message,
+			      gpointer user_data) {
+
+  fprintf(stderr, "%s: %s\n", PACKAGE, message);
+  fflush(stderr);
+}
+
+gboolean batch_requested(int argc, char * argv[]) {
+
+  gint i;
+
+  for (i=1; i<argc; i++)
+    if (strcmp(argv[i], BATCH_OPTION) == 0)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* returns the exit status for the program */
+int batch_main(int argc, char * argv[]) {
+
+  batch_t batch;
+  const gchar * script_name=NULL;
+  gchar * script;
+  gchar ** lines;
+  GString * input;
+  GError * error=NULL;
+  gchar buffer[1024];
+  gint i;
+  gint status=0;
+
+  g_log_set_handler (NULL, G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_WARNING | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG,
+		     batch_log_handler, NULL);
+
+  batch.preferences = amitk_preferences_new();
+  batch.study = amitk_study_new(batch.preferences);
+  batch.message = NULL;
+  batch.percent = -1;
+
+  /* the first argument after the option is the script, the rest get loaded */
+  for (i=1; (i<argc) && (status == 0); i++) {
+    if (strcmp(argv[i], BATCH_OPTION) == 0) {
+      continue;
+    } else if (script_name == NULL) {
+      script_name = argv[i];
+    } else {
+      if (!batch_load_file(&batch, argv[i]))
+	status = 1;
+    }
+  }
+
+  if (script_name == NULL) {
+    fprintf(stderr, _("usage: %s %s SCRIPT [FILE1] [FILE2] ...\n"), PACKAGE, BATCH_OPTION);
+    status = 1;
+  }
+
+  /* read in the script */
+  script = NULL;
+  if (status == 0) {
+    if (strcmp(script_name, "-") == 0) {
+      input = g_string_new(NULL);
+      while (fgets(buffer, sizeof(buffer), stdin) != NULL)
+	g_string_append(input, buffer);
+      script = g_string_free(input, FALSE);
+    } else if (!g_file_get_contents(script_name, &script, NULL, &error)) {
+      g_warning(_("couldn't read %s: %s"), script_name, error->message);
+      g_error_free(error);
+      status = 1;
+    }
+  }
+
+  if (script != NULL) {
+    lines = g_strsplit(script, "\n", -1);
+    for (i=0; (lines[i] != NULL) && (status == 0); i++) {
+      /* g_shell_parse_argv takes care of comments */
+      g_strstrip(lines[i]);
+      if (!batch_run_line(&batch, lines[i], i+1))
+	status = 1;
+    }
+    g_strfreev(lines);
+    g_free(script);
+  }
+
+  amitk_object_unref(batch.study);
+  g_object_unref(batch.preferences);
+  g_free(batch.message);
+
+  return status;
+}
@@ -0,0 +1,39 @@
+/* batch.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/* header files that are always needed with this file */
+#include "amitk_preferences.h"
+
+/* defines */
+#define BATCH_OPTION "--batch"
+
+/* external functions */
+gboolean batch_requested(int argc, char * argv[]);
+int      batch_main(int argc, char * argv[]);
+
+#endif /* __BATCH_H__ */
@@ -0,0 +1,700 @@
+/* benchmark.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+/* Benchmarks for the imaging core.  Invoked as
+
+     amide --benchmark [--size N] [--format FORMAT] [--frames N] [--gates N]
+                       [--repeat N] [--threads N] [--output FILE]
+
+   A synthetic phantom is generated (a warm ellipsoid with a hot sphere whose
+   uptake rises over the frames and which moves over the gates, plus seeded
+   noise so runs are reproducible), and each operation is timed --repeat
+   times.  The results are written as JSON, with the minimum, median, and
+   mean wall clock time of each operation in seconds.  "make benchmark" in
+   the src directory runs this with the default settings.
+*/
+
+#include "amide_config.h"
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amide.h"
+#include "amitk_filter.h"
+#include "amitk_parallel.h"
+#include "amitk_study.h"
+#include "amitk_type_builtins.h"
+#include "analysis.h"
+#include "alignment_mutual_information.h"
+#include "benchmark.h"
+
+#define BENCHMARK_DEFAULT_SIZE 128
+#define BENCHMARK_DEFAULT_FRAMES 1
+#define BENCHMARK_DEFAULT_GATES 1
+#define BENCHMARK_DEFAULT_REPEAT 5
+#define BENCHMARK_SEED 20170101
+#define BENCHMARK_MAX_VALUE 100.0
+#define BENCHMARK_OBLIQUE_ANGLE (M_PI/6.0)
+
+typedef struct benchmark_t {
+  AmitkPreferences * preferences;
+  AmitkStudy * study;
+  AmitkDataSet * ds;
+  gint repeat;
+  gchar * temp_dir;
+  amide_time_t start;
+  amide_time_t duration;
+  gint64 start_time;
+  GArray * times;
+  GString * results;
+} benchmark_t;
+
+static gboolean benchmark_flag=FALSE;
+static gint benchmark_size=BENCHMARK_DEFAULT_SIZE;
+static gchar * benchmark_format=NULL;
+static gint benchmark_frames=BENCHMARK_DEFAULT_FRAMES;
+static gint benchmark_gates=BENCHMARK_DEFAULT_GATES;
+static gint benchmark_repeat=BENCHMARK_DEFAULT_REPEAT;
+static gint benchmark_threads=-1;
+static gchar * benchmark_output=NULL;
+
+static GOptionEntry benchmark_entries[] = {
+  { "benchmark", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &benchmark_flag, NULL, NULL },
+  { "size", 0, 0, G_OPTION_ARG_INT, &benchmark_size, "phantom dimension along each axis", "N" },
+  { "format", 0, 0, G_OPTION_ARG_STRING, &benchmark_format, "phantom data format (ubyte, sshort, float, ...)", "FORMAT" },
+  { "frames", 0, 0, G_OPTION_ARG_INT, &benchmark_frames, "number of frames in the phantom", "N" },
+  { "gates", 0, 0, G_OPTION_ARG_INT, &benchmark_gates, "number of gates in the phantom", "N" },
+  { "repeat", 0, 0, G_OPTION_ARG_INT, &benchmark_repeat, "number of times each operation is timed", "N" },
+  { "threads", 0, 0, G_OPTION_ARG_INT, &benchmark_threads, "number of worker threads (0 = all cores)", "N" },
+  { "output", 0, 0, G_OPTION_ARG_FILENAME, &benchmark_output, "write the results to FILE instead of stdout", "FILE" },
+  { NULL }
+};
+
+
+static void benchmark_start(benchmark_t * bench) {
+  bench->start_time = g_get_monotonic_time();
+}
+
+static void benchmark_stop(benchmark_t * bench) {
+
+  gdouble elapsed;
+
+  elapsed = (g_get_monotonic_time() - bench->start_time)/((gdouble) G_TIME_SPAN_SECOND);
+  g_array_append_val(bench->times, elapsed);
+}
+
+static gint benchmark_compare_times(gconstpointer a, gconstpointer b) {
+
+  const gdouble * time_a = a;
+  const gdouble * time_b = b;
+
+  if (*time_a < *time_b) return -1;
+  else if (*time_a > *time_b) return 1;
+  else return 0;
+}
+
+/* adds the recorded times as an entry in the results, and clears them */
+static void benchmark_report(benchmark_t * bench, const gchar * name) {
+
+  gdouble median;
+  gdouble mean=0.0;
+  gchar min_str[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar median_str[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar mean_str[G_ASCII_DTOSTR_BUF_SIZE];
+  gchar max_str[G_ASCII_DTOSTR_BUF_SIZE];
+  guint n;
+  guint i;
+
+  n = bench->times->len;
+  if (n == 0) {
+    g_warning(_("benchmark %s has no timings"), name);
+    return;
+  }
+
+  g_array_sort(bench->times, benchmark_compare_times);
+  for (i=0; i<n; i++)
+    mean += g_array_index(bench->times, gdouble, i);
+  mean /= n;
+  if (n & 0x1)
+    median = g_array_index(bench->times, gdouble, n/2);
+  else
+    median = (g_array_index(bench->times, gdouble, n/2-1) + g_array_index(bench->times, gdouble, n/2))/2.0;
+
+  /* JSON always wants a '.', whatever the locale */
+  g_ascii_formatd(min_str, sizeof(min_str), "%.6f", g_array_index(bench->times, gdouble, 0));
+  g_ascii_formatd(median_str, sizeof(median_str), "%.6f", median);
+  g_ascii_formatd(mean_str, sizeof(mean_str), "%.6f", mean);
+  g_ascii_formatd(max_str, sizeof(max_str), "%.6f", g_array_index(bench->times, gdouble, n-1));
+  g_string_append_printf(bench->results,
+			 "%s    {\"name\": \"%s\", \"runs\": %d, \"min\": %s, \"median\": %s, \"mean\": %s, \"max\": %s}",
+			 bench->results->len > 0 ? ",\n" : "",
+			 name, n, min_str, median_str, mean_str, max_str);
+  g_message("%-48s %10.4f s", name, median);
+
+  g_array_set_size(bench->times, 0);
+}
+
+/* returns a new data set with the synthetic phantom */
+static AmitkDataSet * benchmark_phantom(benchmark_t * bench, AmitkFormat format, AmitkVoxel dim) {
+
+  AmitkDataSet * ds;
+  AmitkVoxel i;
+  AmitkPoint voxel_size;
+  GRand * rand;
+  gdouble c_x, c_y, c_z;
+  gdouble dx, dy, dz;
+  gdouble radius, hot_radius, hot_y;
+  gdouble hot_value, value;
+
+  ds = amitk_data_set_new_with_data(bench->preferences, AMITK_MODALITY_PET, format, dim, AMITK_SCALING_TYPE_0D);
+  if (ds == NULL) {
+    g_warning(_("couldn't allocate memory space for the phantom"));
+    return NULL;
+  }
+
+  amitk_object_set_name(AMITK_OBJECT(ds), "phantom");
+  voxel_size = one_point;
+  amitk_data_set_set_voxel_size(ds, voxel_size);
+  amitk_data_set_calc_far_corner(ds);
+  for (i.t=0; i.t < dim.t; i.t++)
+    amitk_data_set_set_frame_duration(ds, i.t, 60.0);
+  for (i.g=0; i.g < dim.g; i.g++)
+    amitk_data_set_set_gate_time(ds, i.g, 1.0/dim.g);
+
+  rand = g_rand_new_with_seed(BENCHMARK_SEED);
+  c_x = dim.x/2.0;
+  c_y = dim.y/2.0;
+  c_z = dim.z/2.0;
+  radius = 0.4*MIN(MIN(dim.x, dim.y), dim.z);
+  hot_radius = 0.25*radius;
+
+  for (i.t=0; i.t < dim.t; i.t++) {
+    hot_value = 10.0 + 80.0*(1.0-exp(-(i.t+1.0)/2.0));
+    for (i.g=0; i.g < dim.g; i.g++) {
+      hot_y = c_y + 0.2*radius*sin(2.0*M_PI*i.g/dim.g);
+      for (i.z=0; i.z < dim.z; i.z++)
+	for (i.y=0; i.y < dim.y; i.y++)
+	  for (i.x=0; i.x < dim.x; i.x++) {
+	    dx = i.x+0.5-c_x;
+	    dy = i.y+0.5-c_y;
+	    dz = i.z+0.5-c_z;
+	    if ((dx*dx)/(radius*radius) + (dy*dy)/(0.7*0.7*radius*radius) + (dz*dz)/(radius*radius) > 1.0) {
+	      value = 0.0;
+	    } else {
+	      dx -= 0.4*radius;
+	      dy = i.y+0.5-hot_y;
+	      if (dx*dx + dy*dy + dz*dz < hot_radius*hot_radius)
+		value = hot_value;
+	      else
+		value = 10.0;
+	      value += g_rand_double_range(rand, -2.0, 2.0);
+	    }
+	    amitk_data_set_set_internal_value(ds, i, CLAMP(value, 0.0, BENCHMARK_MAX_VALUE), FALSE);
+	  }
+    }
+  }
+  g_rand_free(rand);
+
+  return ds;
+}
+
+/* a view volume through the center of the phantom */
+static AmitkVolume * benchmark_view_volume(benchmark_t * bench, AmitkView view,
+					   gboolean oblique, amide_real_t thickness) {
+
+  AmitkVolume * volume;
+  AmitkPoint corner;
+  AmitkPoint axis;
+  amide_real_t fov;
+
+  volume = amitk_volume_new();
+  amitk_space_set_view_space(AMITK_SPACE(volume), view, AMITK_LAYOUT_LINEAR);
+  if (oblique) {
+    axis.x = axis.y = axis.z = 1.0/sqrt(3.0);
+    amitk_space_rotate_on_vector(AMITK_SPACE(volume), axis, BENCHMARK_OBLIQUE_ANGLE, zero_point);
+  }
+
+  fov = point_mag(AMITK_VOLUME_CORNER(bench->ds));
+  corner.x = corner.y = fov;
+  corner.z = thickness;
+  amitk_volume_set_corner(volume, corner);
+  amitk_volume_set_center(volume, amitk_volume_get_center(AMITK_VOLUME(bench->ds)));
+
+  return volume;
+}
+
+/* slices of all three orthogonal views */
+static void benchmark_slices(benchmark_t * bench) {
+
+  AmitkRendering rendering;
+  AmitkInterpolation interpolation;
+  AmitkView view;
+  AmitkVolume * volumes[AMITK_VIEW_NUM];
+  AmitkCanvasPoint pixel_size;
+  amide_real_t voxel_dim;
+  amide_real_t thickness;
+  GList * data_sets;
+  GList * slices;
+  gboolean oblique;
+  gchar * name;
+  gint i;
+
+  voxel_dim = point_min_dim(AMITK_DATA_SET_VOXEL_SIZE(bench->ds));
+  pixel_size.x = pixel_size.y = voxel_dim;
+  data_sets = g_list_append(NULL, bench->ds);
+
+  for (rendering = AMITK_RENDERING_MPR; rendering <= AMITK_RENDERING_MIP; rendering++) {
+    amitk_data_set_set_rendering(bench->ds, rendering);
+    thickness = (rendering == AMITK_RENDERING_MPR) ? voxel_dim : point_mag(AMITK_VOLUME_CORNER(bench->ds));
+
+    for (oblique = FALSE; oblique <= TRUE; oblique++) {
+      for (view=0; view < AMITK_VIEW_NUM; view++)
+	volumes[view] = benchmark_view_volume(bench, view, oblique, thickness);
+
+      for (interpolation=0; interpolation < AMITK_INTERPOLATION_NUM; interpolation++) {
+	amitk_data_set_set_interpolation(bench->ds, interpolation);
+
+	for (i=0; i<bench->repeat; i++) {
+	  benchmark_start(bench);
+	  for (view=0; view < AMITK_VIEW_NUM; view++) {
+	    slices = amitk_data_sets_get_slices(data_sets, FALSE, bench->start, bench->duration, -1,
+						pixel_size, volumes[view]);
+	    amitk_objects_unref(slices);
+	  }
+	  benchmark_stop(bench);
+	}
+
+	name = g_strdup_printf("slices/%s/%s/%s", amitk_rendering_get_name(rendering),
+			       oblique ? "oblique" : "orthogonal",
+			       amitk_interpolation_get_name(interpolation));
+	benchmark_report(bench, name);
+	g_free(name);
+      }
+
+      for (view=0; view < AMITK_VIEW_NUM; view++)
+	amitk_object_unref(volumes[view]);
+    }
+  }
+
+  amitk_data_set_set_rendering(bench->ds, AMITK_RENDERING_MPR);
+  amitk_data_set_set_interpolation(bench->ds, AMITK_INTERPOLATION_TRILINEAR);
+  g_list_free(data_sets);
+}
+
+static void benchmark_stats(benchmark_t * bench) {
+
+  gint i;
+
+  for (i=0; i<bench->repeat; i++) {
+    amitk_data_set_invalidate_stats(bench->ds);
+    benchmark_start(bench);
+    amitk_data_set_calc_min_max(bench->ds, NULL, NULL);
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench, "calc_min_max");
+
+  for (i=0; i<bench->repeat; i++) {
+    amitk_data_set_invalidate_stats(bench->ds);
+    amitk_data_set_calc_min_max(bench->ds, NULL, NULL);
+    benchmark_start(bench);
+    amitk_data_set_calc_distribution(bench->ds, NULL, NULL);
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench, "calc_distribution");
+}
+
+static void benchmark_filters(benchmark_t * bench) {
+
+  AmitkFilter filter;
+  AmitkDataSet * filtered_ds;
+  gint kernel_size;
+  amide_real_t fwhm;
+  gchar * name;
+  gint i;
+
+  fwhm = 2.0*point_min_dim(AMITK_DATA_SET_VOXEL_SIZE(bench->ds));
+  for (filter=0; filter < AMITK_FILTER_NUM; filter++) {
+    kernel_size = (filter == AMITK_FILTER_GAUSSIAN) ? 15 : 3;
+    for (i=0; i<bench->repeat; i++) {
+      benchmark_start(bench);
+      filtered_ds = amitk_data_set_get_filtered(bench->ds, filter, kernel_size, fwhm, NULL, NULL);
+      benchmark_stop(bench);
+      if (filtered_ds != NULL)
+	amitk_object_unref(filtered_ds);
+    }
+
+    name = g_strdup_printf("filter/%s", amitk_filter_get_name(filter));
+    benchmark_report(bench, name);
+    g_free(name);
+  }
+}
+
+/* one roi of each type, added to the study.  Timing the isocontour
+   flood fill while we're at it */
+static void benchmark_rois(benchmark_t * bench) {
+
+  AmitkRoiType roi_type;
+  AmitkRoi * roi;
+  AmitkDataSet * slice;
+  AmitkVolume * volume;
+  AmitkCanvasPoint pixel_size;
+  AmitkPoint center;
+  AmitkPoint corner;
+  AmitkPoint point;
+  AmitkVoxel voxel;
+  AmitkVoxel center_voxel;
+  gint freehand_radius;
+  analysis_roi_t * roi_analyses;
+  GList * rois;
+  GList * data_sets;
+  gchar * name;
+  gint i;
+
+  center = amitk_volume_get_center(AMITK_VOLUME(bench->ds));
+  point = amitk_space_b2s(AMITK_SPACE(bench->ds), center);
+  POINT_TO_VOXEL(point, AMITK_DATA_SET_VOXEL_SIZE(bench->ds), 0, 0, center_voxel);
+  freehand_radius = benchmark_size/8;
+  corner = point_cmult(0.5, AMITK_VOLUME_CORNER(bench->ds));
+  data_sets = g_list_append(NULL, bench->ds);
+
+  for (roi_type=0; roi_type < AMITK_ROI_TYPE_NUM; roi_type++) {
+    roi = amitk_roi_new(roi_type);
+    amitk_object_set_name(AMITK_OBJECT(roi), amitk_roi_type_get_name(roi_type));
+
+    switch(roi_type) {
+    case AMITK_ROI_TYPE_ISOCONTOUR_2D:
+      volume = benchmark_view_volume(bench, AMITK_VIEW_TRANSVERSE, FALSE,
+				     AMITK_DATA_SET_VOXEL_SIZE_Z(bench->ds));
+      pixel_size.x = AMITK_DATA_SET_VOXEL_SIZE_X(bench->ds);
+      pixel_size.y = AMITK_DATA_SET_VOXEL_SIZE_Y(bench->ds);
+      slice = amitk_data_set_get_slice(bench->ds, bench->start, bench->duration, 0, pixel_size, volume);
+      amitk_object_unref(volume);
+      point = amitk_space_b2s(AMITK_SPACE(slice), center);
+      POINT_TO_VOXEL(point, AMITK_DATA_SET_VOXEL_SIZE(slice), 0, 0, voxel);
+      for (i=0; i<bench->repeat; i++) {
+	benchmark_start(bench);
+	amitk_roi_set_isocontour(roi, slice, voxel, 5.0, 0.0, AMITK_ROI_ISOCONTOUR_RANGE_ABOVE_MIN);
+	benchmark_stop(bench);
+      }
+      amitk_object_unref(slice);
+      benchmark_report(bench, "roi_create/isocontour-2d");
+      break;
+    case AMITK_ROI_TYPE_ISOCONTOUR_3D:
+      for (i=0; i<bench->repeat; i++) {
+	benchmark_start(bench);
+	amitk_roi_set_isocontour(roi, bench->ds, center_voxel, 5.0, 0.0, AMITK_ROI_ISOCONTOUR_RANGE_ABOVE_MIN);
+	benchmark_stop(bench);
+      }
+      benchmark_report(bench, "roi_create/isocontour-3d");
+      break;
+    case AMITK_ROI_TYPE_FREEHAND_2D:
+    case AMITK_ROI_TYPE_FREEHAND_3D:
+      amitk_roi_set_voxel_size(roi, AMITK_DATA_SET_VOXEL_SIZE(bench->ds));
+      amitk_space_copy_in_place(AMITK_SPACE(roi), AMITK_SPACE(bench->ds));
+      point = point_sub(center, point_cmult(freehand_radius, AMITK_DATA_SET_VOXEL_SIZE(bench->ds)));
+      amitk_space_set_offset(AMITK_SPACE(roi), point);
+      voxel = zero_voxel;
+      voxel.x = voxel.y = freehand_radius;
+      if (roi_type == AMITK_ROI_TYPE_FREEHAND_3D) voxel.z = freehand_radius;
+      amitk_roi_manipulate_area(roi, FALSE, voxel, freehand_radius);
+      break;
+    default: /* geometric rois */
+      amitk_volume_set_corner(AMITK_VOLUME(roi), corner);
+      amitk_volume_set_center(AMITK_VOLUME(roi), center);
+      break;
+    }
+
+    amitk_object_add_child(AMITK_OBJECT(bench->study), AMITK_OBJECT(roi));
+
+    rois = g_list_append(NULL, roi);
+    for (i=0; i<bench->repeat; i++) {
+      benchmark_start(bench);
+      roi_analyses = analysis_roi_init(bench->study, rois, data_sets, ALL_VOXELS, FALSE,
+				       0.0, 0.0, 0.0, NULL, NULL);
+      benchmark_stop(bench);
+      if (roi_analyses != NULL)
+	analysis_roi_unref(roi_analyses);
+    }
+    g_list_free(rois);
+    amitk_object_unref(roi);
+
+    name = g_strdup_printf("roi_analysis/%s", amitk_roi_type_get_name(roi_type));
+    benchmark_report(bench, name);
+    g_free(name);
+  }
+
+  g_list_free(data_sets);
+}
+
+static void benchmark_alignment(benchmark_t * bench) {
+
+#ifdef AMIDE_LIBGSL_SUPPORT
+  AmitkDataSet * moving_ds;
+  AmitkSpace * transform;
+  AmitkPoint axis;
+  AmitkPoint shift;
+  gdouble metric;
+  gint iterations;
+  gint i;
+
+  /* a slightly rotated and shifted copy of the phantom */
+  moving_ds = AMITK_DATA_SET(amitk_object_copy(AMITK_OBJECT(bench->ds)));
+  axis.x = axis.y = 0.0;
+  axis.z = 1.0;
+  amitk_space_rotate_on_vector(AMITK_SPACE(moving_ds), axis, M_PI/36.0,
+			       amitk_volume_get_center(AMITK_VOLUME(moving_ds)));
+  shift.x = 2.0;
+  shift.y = -1.0;
+  shift.z = 1.0;
+  amitk_space_shift_offset(AMITK_SPACE(moving_ds), shift);
+
+  for (i=0; i<bench->repeat; i++) {
+    benchmark_start(bench);
+    transform = alignment_mutual_information_multires(moving_ds, bench->ds, bench->start, bench->duration,
+						      ALIGNMENT_MI_NORMALIZED, &metric, &iterations,
+						      NULL, NULL);
+    benchmark_stop(bench);
+    if (transform != NULL)
+      g_object_unref(transform);
+  }
+  amitk_object_unref(moving_ds);
+
+  benchmark_report(bench, "alignment/mutual_information");
+#endif
+}
+
+static void benchmark_files(benchmark_t * bench) {
+
+  AmitkStudy * study;
+  AmitkDataSet * ds;
+  AmitkRawFormat raw_format;
+  gchar * xif_filename;
+  gchar * raw_filename;
+  gchar * resliced_filename;
+  gint i;
+
+  xif_filename = g_build_filename(bench->temp_dir, "benchmark.xif", NULL);
+  raw_filename = g_build_filename(bench->temp_dir, "benchmark.raw", NULL);
+  resliced_filename = g_build_filename(bench->temp_dir, "benchmark_resliced.raw", NULL);
+
+  for (i=0; i<bench->repeat; i++) {
+    benchmark_start(bench);
+    amitk_study_save_xml(bench->study, xif_filename, FALSE);
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench, "xif/save");
+
+  for (i=0; i<bench->repeat; i++) {
+    benchmark_start(bench);
+    study = amitk_study_load_xml(xif_filename);
+    benchmark_stop(bench);
+    if (study != NULL)
+      amitk_object_unref(study);
+  }
+  benchmark_report(bench, "xif/load");
+
+  for (i=0; i<bench->repeat; i++) {
+    benchmark_start(bench);
+    amitk_data_set_export_to_file(bench->ds, AMITK_EXPORT_METHOD_RAW, 0, raw_filename,
+				  AMITK_OBJECT_NAME(bench->study), FALSE,
+				  AMITK_DATA_SET_VOXEL_SIZE(bench->ds), NULL, NULL, NULL);
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench, "raw/export");
+
+  /* raw exports are always native endian floats */
+  raw_format = (G_BYTE_ORDER == G_BIG_ENDIAN) ? AMITK_RAW_FORMAT_FLOAT_32_BE : AMITK_RAW_FORMAT_FLOAT_32_LE;
+  for (i=0; i<bench->repeat; i++) {
+    benchmark_start(bench);
+    ds = amitk_data_set_import_raw_file(raw_filename, raw_format, AMITK_DATA_SET_DIM(bench->ds), 0,
+					bench->preferences, AMITK_MODALITY_PET, "imported",
+					AMITK_DATA_SET_VOXEL_SIZE(bench->ds), 1.0, NULL, NULL);
+    benchmark_stop(bench);
+    if (ds != NULL)
+      amitk_object_unref(ds);
+  }
+  benchmark_report(bench, "raw/import");
+
+  for (i=0; i<bench->repeat; i++) {
+    benchmark_start(bench);
+    amitk_data_set_export_to_file(bench->ds, AMITK_EXPORT_METHOD_RAW, 0, resliced_filename,
+				  AMITK_OBJECT_NAME(bench->study), TRUE,
+				  AMITK_DATA_SET_VOXEL_SIZE(bench->ds), NULL, NULL, NULL);
+    benchmark_stop(bench);
+  }
+  benchmark_report(bench, "raw/export_resliced");
+
+  g_unlink(xif_filename);
+  g_unlink(raw_filename);
+  g_unlink(resliced_filename);
+  g_free(xif_filename);
+  g_free(raw_filename);
+  g_free(resliced_filename);
+}
+
+static void benchmark_log_handler(const gchar *log_domain,
+				  GLogLevelFlags log_level,
+				  const gchar *message,
+				  gpointer user_data) {
+
+  fprintf(stderr, "%s\n", message);
+  fflush(stderr);
+}
+
+gboolean benchmark_requested(int argc, char * argv[]) {
+
+  gint i;
+
+  for (i=1; i<argc; i++)
+    if (strcmp(argv[i], BENCHMARK_OPTION) == 0)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* returns the exit status for the program */
+int benchmark_main(int argc, char * argv[]) {
+
+  benchmark_t bench;
+  GOptionContext * context;
+  GError * error=NULL;
+  GEnumClass * enum_class;
+  GEnumValue * enum_value;
+  AmitkFormat format;
+  AmitkVoxel dim;
+  FILE * file_pointer;
+  gchar * host_name;
+  gchar total_str[G_ASCII_DTOSTR_BUF_SIZE];
+  gint64 total_time;
+
+  context = g_option_context_new(_("- benchmark the imaging core"));
+  g_option_context_add_main_entries(context, benchmark_entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  enum_class = g_type_class_ref(AMITK_TYPE_FORMAT);
+  enum_value = g_enum_get_value_by_nick(enum_class, benchmark_format != NULL ? benchmark_format : "float");
+  format = (enum_value != NULL) ? enum_value->value : AMITK_FORMAT_FLOAT;
+  g_type_class_unref(enum_class);
+  if (enum_value == NULL) {
+    fprintf(stderr, _("unknown data format: %s\n"), benchmark_format);
+    return 1;
+  }
+
+  if ((benchmark_size < 8) || (benchmark_frames < 1) || (benchmark_gates < 1) || (benchmark_repeat < 1)) {
+    fprintf(stderr, _("size must be at least 8, and frames, gates, and repeat at least 1\n"));
+    return 1;
+  }
+
+  g_log_set_handler (NULL, G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_WARNING | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG,
+		     benchmark_log_handler, NULL);
+
+  bench.preferences = amitk_preferences_new();
+  if (benchmark_threads >= 0)
+    amitk_parallel_set_num_threads(benchmark_threads);
+
+  bench.temp_dir = g_dir_make_tmp("amide-benchmark-XXXXXX", &error);
+  if (bench.temp_dir == NULL) {
+    g_warning(_("couldn't create a temporary directory: %s"), error->message);
+    g_error_free(error);
+    g_object_unref(bench.preferences);
+    return 1;
+  }
+
+  dim.x = dim.y = dim.z = benchmark_size;
+  dim.g = benchmark_gates;
+  dim.t = benchmark_frames;
+  bench.ds = benchmark_phantom(&bench, format, dim);
+  if (bench.ds == NULL) {
+    g_rmdir(bench.temp_dir);
+    g_free(bench.temp_dir);
+    g_object_unref(bench.preferences);
+    return 1;
+  }
+
+  bench.study = amitk_study_new(bench.preferences);
+  amitk_object_set_name(AMITK_OBJECT(bench.study), "benchmark");
+  amitk_object_add_child(AMITK_OBJECT(bench.study), AMITK_OBJECT(bench.ds));
+  amitk_study_set_view_thickness(bench.study, point_min_dim(AMITK_DATA_SET_VOXEL_SIZE(bench.ds)));
+  bench.start = amitk_data_set_get_start_time(bench.ds, 0);
+  bench.duration = amitk_data_set_get_end_time(bench.ds, dim.t-1) - bench.start;
+  bench.repeat = benchmark_repeat;
+  bench.times = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  bench.results = g_string_new(NULL);
+
+  total_time = g_get_monotonic_time();
+  benchmark_stats(&bench);
+  benchmark_slices(&bench);
+  benchmark_filters(&bench);
+  benchmark_rois(&bench);
+  benchmark_alignment(&bench);
+  benchmark_files(&bench);
+  total_time = g_get_monotonic_time() - total_time;
+
+  if (benchmark_output != NULL) {
+    if ((file_pointer = fopen(benchmark_output, "w")) == NULL) {
+      g_warning(_("couldn't open: %s for writing benchmark results"), benchmark_output);
+      file_pointer = stdout;
+    }
+  } else {
+    file_pointer = stdout;
+  }
+
+  host_name = g_strescape(g_get_host_name(), NULL);
+  fprintf(file_pointer, "{\n");
+  fprintf(file_pointer, "  \"version\": \"%s\",\n", VERSION);
+  fprintf(file_pointer, "  \"host\": \"%s\",\n", host_name);
+  fprintf(file_pointer, "  \"processors\": %d,\n", g_get_num_processors());
+  fprintf(file_pointer, "  \"threads\": %d,\n", amitk_parallel_get_num_threads());
+  fprintf(file_pointer, "  \"phantom\": {\"dim\": [%d, %d, %d, %d, %d], \"format\": \"%s\", \"seed\": %d},\n",
+	  dim.x, dim.y, dim.z, dim.g, dim.t,
+	  benchmark_format != NULL ? benchmark_format : "float", BENCHMARK_SEED);
+  fprintf(file_pointer, "  \"repeat\": %d,\n", bench.repeat);
+  fprintf(file_pointer, "  \"total\": %s,\n", 
+	  g_ascii_formatd(total_str, sizeof(total_str), "%.3f", total_time/((gdouble) G_TIME_SPAN_SECOND)));
+  fprintf(file_pointer, "  \"results\": [\n%s\n  ]\n", bench.results->str);
+  fprintf(file_pointer, "}\n");
+  g_free(host_name);
+
+  if (file_pointer != stdout)
+    fclose(file_pointer);
+
+  g_rmdir(bench.temp_dir);
+  g_free(bench.temp_dir);
+  g_string_free(bench.results, TRUE);
+  g_array_free(bench.times, TRUE);
+  amitk_object_unref(bench.ds);
+  amitk_object_unref(bench.study);
+  g_object_unref(bench.preferences);
+
+  return 0;
+}
@@ -35,6 +35,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include "amitk_data_set_DOUBLE_0D_SCALING.h"
+#include "amitk_parallel.h"
 #include <glib/gstdio.h> /* make sure we get g_mkdir on mingw32 */
 
 /* dcmtk redefines a lot of things that they shouldn't... */
@@ -60,6 +61,15 @@ static void * j2k_to_raw(DcmDataset *pdata, AmitkDataSet const *pds);
 
 const gchar * dcmtk_version = OFFIS_DCMTK_VERSION;
 
+/* when scanning files for series information, elements bigger than this
+   (i.e. the pixel data) are left on disk */
+#define HEADER_MAX_READ_LENGTH 256
+
+/* minimum number of files to hand to a thread at a time */
+#define FILES_PER_CHUNK 4
+
+G_LOCK_DEFINE_STATIC(time_conversion);
+
 /* based on dcmftest.cc - part of dcmtk */
 gboolean dcmtk_test_dicom(const gchar * filename) {
 
@@ -210,14 +220,8 @@ static AmitkDataSet * read_dicom_file(const gchar * filename,
   }
 
 
-  /* register global decompression codecs */
-  DJDecoderRegistration::registerCodecs(EDC_photometricInterpretation,
-					EUC_default,
-					EPC_default,
-					OFFalse);
-  DcmRLEDecoderRegistration::registerCodecs();
-
-  /* uncompress the raw data in case this is a JPEG encoded file */
+  /* uncompress the raw data in case this is a JPEG encoded file, note
+     the decompression codecs need to have already been registered */
   result = dcm_dataset->chooseRepresentation(EXS_LittleEndianExplicit, NULL);
   if (result.bad()) {
 
@@ -641,12 +645,15 @@ static AmitkDataSet * read_dicom_file(const gchar * filename,
 
     time_structure.tm_isdst = -1; /* "-1" is suppose to let the system figure it out */
 
+    /* asctime uses a static buffer, and we may be reading several files at once */
+    G_LOCK(time_conversion);
     if (mktime(&time_structure) != -1) {
       amitk_data_set_set_scan_date(ds, asctime(&time_structure));
       valid = TRUE;
     } else {
       valid = FALSE;
     }
+    G_UNLOCK(time_conversion);
   }
 
   if (!valid) {
@@ -817,8 +824,6 @@ static AmitkDataSet * read_dicom_file(const gchar * filename,
 
  function_end:
 
-  /* deregister global decompression codecs */
-  DJDecoderRegistration::cleanup();
  if (valid_J2K && buffer) { /* Free allocated buffer */
    //g_free((gpointer)buffer);
    //buffer=NULL;
@@ -1030,6 +1035,43 @@ static GList * separate_duplicate_slices(GList * slices_to_combine, GList ** pre
   return slices_to_combine;
 }
 
+typedef struct {
+  AmitkDataSet * ds;
+  AmitkDataSet ** slices;
+  gint dim_z;
+  gint num_gates;
+} transfer_slices_t;
+
+/* where in the data set a given slice goes */
+static AmitkVoxel slice_voxel(gint i_file, gint dim_z, gint num_gates) {
+
+  AmitkVoxel i;
+  div_t x;
+
+  x = div(i_file, dim_z);
+  i=zero_voxel;
+  if (num_gates > 1)
+    i.g = x.quot;
+  else
+    i.t = x.quot;
+  i.z = x.rem;
+
+  return i;
+}
+
+/* each slice goes into its own plane, so these can run in parallel */
+static void transfer_slices_func(gint start, gint end, gpointer data) {
+
+  transfer_slices_t * transfer = (transfer_slices_t *) data;
+  gint i_file;
+
+  for (i_file=start; i_file < end; i_file++) 
+    transfer_slice(transfer->ds, transfer->slices[i_file], 
+		   slice_voxel(i_file, transfer->dim_z, transfer->num_gates));
+
+  return;
+}
+
 static AmitkDataSet * import_slices_as_dataset(GList * slices, 
 					       gint num_frames, 
 					       gint num_gates,
@@ -1052,12 +1094,15 @@ static AmitkDataSet * import_slices_as_dataset(GList * slices,
   amide_real_t old_thickness=0.0;
   AmitkPoint voxel_size;
   gboolean figured_out_dimz=FALSE;
+  transfer_slices_t transfer;
+  GList * temp_slices;
 
   g_return_val_if_fail(slices != NULL, NULL);
 
   screwed_up_timing=FALSE;
   screwed_up_thickness=FALSE;
   num_files = g_list_length(slices);
+  transfer.slices = NULL;
 
   
   /* special stuff for 1st slice */
@@ -1201,18 +1246,22 @@ static AmitkDataSet * import_slices_as_dataset(GList * slices,
       
   initial_offset = AMITK_SPACE_OFFSET(slice_ds);
 
+  /* copy the image data over */
+  if ((transfer.slices = (AmitkDataSet **) g_try_malloc(num_files*sizeof(AmitkDataSet *))) == NULL) {
+    g_warning(_("couldn't allocate space for the slice list"));
+    goto error;
+  }
+  for (i_file=0, temp_slices=slices; i_file < num_files; i_file++, temp_slices=temp_slices->next)
+    transfer.slices[i_file] = (AmitkDataSet *) temp_slices->data;
+  transfer.ds = ds;
+  transfer.dim_z = dim.z;
+  transfer.num_gates = num_gates;
+  amitk_parallel_for(num_files, FILES_PER_CHUNK, transfer_slices_func, &transfer, NULL, NULL);
+
   /* and process all the images */
   for (i_file=0; i_file < num_files; i_file++) {
-    slice_ds = (AmitkDataSet *) g_list_nth_data(slices,i_file);
-
-    x = div(i_file, dim.z);
-    i=zero_voxel;
-    if (num_gates > 1)
-      i.g = x.quot;
-    else
-      i.t = x.quot;
-    i.z = x.rem;
-    transfer_slice(ds, slice_ds, i);
+    slice_ds = transfer.slices[i_file];
+    i = slice_voxel(i_file, dim.z, num_gates);
 
     /* record frame/gate duration if needed */
     if (i.z == 0) {
@@ -1388,6 +1437,8 @@ static AmitkDataSet * import_slices_as_dataset(GList * slices,
   }
 
  end:
+  if (transfer.slices != NULL)
+    g_free(transfer.slices);
 
   return ds;
 }
@@ -1452,6 +1503,43 @@ static GList * organize_and_import_slices_as_datasets(GList ** premaining_slices
   return returned_sets;
 }
 
+typedef struct {
+  gchar * filename;
+  AmitkDataSet * slice_ds;
+  gchar * studyname;
+  gint num_frames;
+  gint num_gates;
+  gint num_slices;
+  gchar * error_buf;
+} dicom_file_t;
+
+typedef struct {
+  AmitkPreferences * preferences;
+  dicom_file_t * files;
+} read_dicom_files_t;
+
+/* each file is decoded into its own single slice data set, which then gets
+   copied into place by import_slices_as_dataset.  Decoding straight into the
+   final data set isn't possible here, as where a file's slice goes (and the
+   final dimensions) aren't known until all the slices have been read in and 
+   sorted by their geometry and timing, and that and the per slice scaling
+   come out of read_dicom_file along with the pixel data */
+static void read_dicom_files_func(gint start, gint end, gpointer data) {
+
+  read_dicom_files_t * read = (read_dicom_files_t *) data;
+  dicom_file_t * file;
+  gint i_file;
+
+  for (i_file=start; i_file < end; i_file++) {
+    file = &(read->files[i_file]);
+    file->slice_ds = read_dicom_file(file->filename, &(file->studyname), read->preferences, 
+				     &(file->num_frames), &(file->num_gates), &(file->num_slices), 
+				     NULL, NULL, &(file->error_buf));
+  }
+
+  return;
+}
+
 static GList * import_files_as_datasets(GList * image_files, 
 					gchar ** pstudyname,
 					AmitkPreferences * preferences, 
@@ -1462,48 +1550,90 @@ static GList * import_files_as_datasets(GList * image_files,
 
   GList * returned_sets=NULL;
   AmitkDataSet * slice_ds=NULL;
-  div_t x;
-  gchar * slice_name;
   gint image;
   gint num_frames=1;
   gint num_gates=1;
   gint num_slices=-1;
   gint num_files;
   GList * slices=NULL;
+  GList * temp_files;
   gboolean continue_work=TRUE;
-  gint divider;
+  read_dicom_files_t read;
+  dicom_file_t * file;
 
   num_files = g_list_length(image_files);
   g_return_val_if_fail(num_files != 0, NULL);
 
   if (update_func != NULL) 
     continue_work = (*update_func)(update_data, _("Importing File(s) Through DCMTK"), (gdouble) 0.0);
-  divider = (num_files/AMITK_UPDATE_DIVIDER < 1.0) ? 1 : (gint) rint(num_files/AMITK_UPDATE_DIVIDER);
 
-  for (image=0; (image < num_files) && (continue_work); image++) {
-    
-    if (update_func != NULL) {
-      x = div(image,divider);
-      if (x.rem == 0)
-	continue_work = (*update_func)(update_data, NULL, ((gdouble) image)/((gdouble) num_files));
-    }
+  read.preferences = preferences;
+  if ((read.files = (dicom_file_t *) g_try_malloc(num_files*sizeof(dicom_file_t))) == NULL) {
+    g_warning(_("couldn't allocate space for the file list"));
+    goto cleanup;
+  }
+  for (image=0, temp_files=image_files; image < num_files; image++, temp_files=temp_files->next) {
+    file = &(read.files[image]);
+    file->filename = (gchar *) temp_files->data;
+    file->slice_ds = NULL;
+    file->studyname = NULL;
+    file->num_frames = 1;
+    file->num_gates = 1;
+    file->num_slices = -1;
+    file->error_buf = NULL;
+  }
 
+  /* our gobject types aren't registered in a thread safe manner, make sure
+     that's already been done before the worker threads start creating objects */
+  g_type_class_unref(g_type_class_ref(AMITK_TYPE_DATA_SET));
+  g_type_class_unref(g_type_class_ref(AMITK_TYPE_RAW_DATA));
 
-    slice_name = (gchar *) g_list_nth_data(image_files,image);
+  /* register global decompression codecs, these are shared by all the threads */
+  DJDecoderRegistration::registerCodecs(EDC_photometricInterpretation,
+					EUC_default,
+					EPC_default,
+					OFFalse);
+  DcmRLEDecoderRegistration::registerCodecs();
 
-    slice_ds = read_dicom_file(slice_name, pstudyname,preferences, 
-			       &num_frames, &num_gates, &num_slices, NULL, NULL, perror_buf);
+  /* read in and decode the files in parallel */
+  if (continue_work)
+    continue_work = amitk_parallel_for(num_files, FILES_PER_CHUNK, read_dicom_files_func, &read,
+				       update_func, update_data);
+
+  /* deregister global decompression codecs */
+  DJDecoderRegistration::cleanup();
+  DcmRLEDecoderRegistration::cleanup();
+
+  /* now go through the results in order, as if the files had been read one at a time.
+     Each file's frames/gates/slices start out at 1/1/-1, anything else means the file
+     reported a value, and later files override earlier ones */
+  for (image=0; (image < num_files) && continue_work; image++) {
+    file = &(read.files[image]);
+
+    if (file->error_buf != NULL) 
+      amitk_append_str_with_newline(perror_buf, "%s", file->error_buf);
+    if ((file->studyname != NULL) && (pstudyname != NULL)) {
+      *pstudyname = file->studyname;
+      file->studyname = NULL;
+    }
+    if (file->num_frames != 1) num_frames = file->num_frames;
+    if (file->num_gates != 1) num_gates = file->num_gates;
+    if (file->num_slices != -1) num_slices = file->num_slices;
+
+    slice_ds = file->slice_ds;
+    file->slice_ds = NULL;
     if (slice_ds == NULL) {
-      goto cleanup;
+      continue_work = FALSE;
     } else if ((AMITK_DATA_SET_DIM_Z(slice_ds) != 1) && (num_files > 1)) {
       /* can handle multiple dicom files each with a single slice, or one dicom file with multiple slices,
 	 can't handle multiple files each with multiple slices */
       g_warning(_("no support for multislice files within DICOM directory format"));
       amitk_object_unref(slice_ds);
       slice_ds = NULL;
-      goto cleanup;
-    } 
-    slices = g_list_append(slices, slice_ds);
+      continue_work = FALSE;
+    } else {
+      slices = g_list_append(slices, slice_ds);
+    }
   }
   if (!continue_work) goto cleanup;
 
@@ -1518,6 +1648,16 @@ static GList * import_files_as_datasets(GList * image_files,
   if (update_func != NULL) /* remove progress bar */
     (*update_func) (update_data, NULL, (gdouble) 2.0); 
 
+  if (read.files != NULL) {
+    for (image=0; image < num_files; image++) {
+      file = &(read.files[image]);
+      if (file->slice_ds != NULL) amitk_object_unref(file->slice_ds);
+      if (file->studyname != NULL) g_free(file->studyname);
+      if (file->error_buf != NULL) g_free(file->error_buf);
+    }
+    g_free(read.files);
+  }
+
   slices = free_slices(slices);
 
   return returned_sets;
@@ -1584,7 +1724,8 @@ static slice_info_t * get_slice_info(const gchar * filename) {
   slice_info_t * info=NULL;
   Sint32 return_sint32;
 
-  result = dcm_format.loadFile(filename);
+  /* only need the header information here, leave the pixel data on disk */
+  result = dcm_format.loadFile(filename, EXS_Unknown, EGL_noChange, HEADER_MAX_READ_LENGTH);
   if (result.bad()) return NULL;
 
   dcm_dataset = dcm_format.getDataset();
@@ -1619,6 +1760,23 @@ static slice_info_t * get_slice_info(const gchar * filename) {
   return info;
 }
 
+typedef struct {
+  gchar ** filenames;
+  slice_info_t ** infos;
+} scan_slices_t;
+
+static void scan_slices_func(gint start, gint end, gpointer data) {
+
+  scan_slices_t * scan = (scan_slices_t *) data;
+  gint i;
+
+  for (i=start; i < end; i++)
+    if (dcmtk_test_dicom(scan->filenames[i]))
+      scan->infos[i] = get_slice_info(scan->filenames[i]);
+
+  return;
+}
+
 static gboolean check_str(gchar * str1, gchar * str2) {
 
   if ((str1 == NULL) && (str2 == NULL))
@@ -1752,6 +1910,10 @@ static GList * import_files(const gchar * filename,
   gboolean use_this_one;
   GtkWidget * question;
   gint return_val;
+  GPtrArray * candidates;
+  GList * new_info=NULL;
+  scan_slices_t scan;
+  guint j;
 
   /* note, I generate a "regularized_filename" rather than just using filename, to insure that 
    when the filenames get sorted alphabetically, they're all of the same "./filename" form. */
@@ -1773,33 +1935,48 @@ static GList * import_files(const gchar * filename,
   /* ------- find all dicom files in the directory ------------ */
   if (update_func != NULL) 
     continue_work = (*update_func)(update_data, _("Scanning Files to find additional DICOM Slices"), (gdouble) 0.0);
-    
+
+  candidates = g_ptr_array_new();
   if ((dir = opendir(dirname))!=NULL) {
     while (((entry = readdir(dir)) != NULL) && (continue_work)) {
 
       if (update_func != NULL)
 	continue_work = (*update_func)(update_data, NULL, -1.0);
 
-      if (dirname == NULL)
-	new_filename = g_strdup_printf("%s", entry->d_name);
-      else
-	new_filename = g_strdup_printf("%s%s%s", dirname, G_DIR_SEPARATOR_S,entry->d_name);
-
       if (strcmp(basename, entry->d_name) != 0) { /* we've already got the initial filename */
-	if (dcmtk_test_dicom(new_filename)) {
-	  info = get_slice_info(new_filename);
-	  if (info != NULL) 
-	    raw_info = g_list_append(raw_info, info); /* we have a match */
-	}
+	if (dirname == NULL)
+	  new_filename = g_strdup_printf("%s", entry->d_name);
+	else
+	  new_filename = g_strdup_printf("%s%s%s", dirname, G_DIR_SEPARATOR_S,entry->d_name);
+	g_ptr_array_add(candidates, new_filename);
       }
-
-      g_free(new_filename);
     }
     if (dir != NULL) closedir(dir);
   }
   if (dirname != NULL) g_free(dirname);
   if (basename != NULL) g_free(basename);
 
+  /* and read in the headers of the candidate files in parallel */
+  scan.filenames = (gchar **) candidates->pdata;
+  scan.infos = NULL;
+  if (continue_work && (candidates->len > 0)) {
+    if ((scan.infos = (slice_info_t **) g_try_malloc0(candidates->len*sizeof(slice_info_t *))) == NULL) {
+      g_warning(_("couldn't allocate space for the file list"));
+    } else {
+      continue_work = amitk_parallel_for(candidates->len, FILES_PER_CHUNK, scan_slices_func, &scan,
+					 update_func, update_data);
+      for (j=candidates->len; j > 0; j--)
+	if (scan.infos[j-1] != NULL) 
+	  new_info = g_list_prepend(new_info, scan.infos[j-1]); /* we have a match */
+      raw_info = g_list_concat(raw_info, new_info);
+      g_free(scan.infos);
+    }
+  }
+
+  for (j=0; j < candidates->len; j++)
+    g_free(g_ptr_array_index(candidates, j));
+  g_ptr_array_free(candidates, TRUE);
+
   if (update_func != NULL) /* remove progress bar */
     (*update_func) (update_data, NULL, (gdouble) 2.0); 
 
@@ -1837,7 +2014,11 @@ static GList * import_files(const gchar * filename,
 
   /* check if we want to load in everything or not */
   all_datasets=FALSE;
-  if (g_list_length(all_slices) > 1) {
+  if ((g_list_length(all_slices) > 1) && (gdk_display_get_default() == NULL)) {
+    /* no display to ask on (batch mode), just load the specified file's data set */
+    g_warning(_("Multiple data sets were found in the same directory as %s, only loading the one corresponding to that file"), 
+	      filename);
+  } else if (g_list_length(all_slices) > 1) {
     /* make sure we really want to delete */
     question = gtk_message_dialog_new(NULL,
 				      GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -2002,7 +2183,13 @@ static GList * import_dir(const gchar * filename,
 						     lowercase_image_name1);
 	      g_free(lowercase_image_name1);
 
-	      if (!dcmtk_test_dicom(lowercase_image_name2)) {
+	      if (gdk_display_get_default() == NULL) {
+		/* no display to ask on (batch mode), skip missing files, 
+		   but don't go substituting files behind the user's back */
+		g_warning(_("For series: %s\n\nListed in DICOMDIR: %s\n\nCould not read DICOM file: %s"),
+			  object_name, filename, image_name2);
+		ignore_missing_files = TRUE;
+	      } else if (!dcmtk_test_dicom(lowercase_image_name2)) {
 		question = 
 		  gtk_message_dialog_new(NULL, GTK_DIALOG_DESTROY_WITH_PARENT, 
 					 GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
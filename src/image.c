@@ -27,6 +27,7 @@
 #include "image.h"
 #include "amitk_data_set_DOUBLE_0D_SCALING.h"
 #include "amitk_study.h"
+#include "amitk_trace.h"
 
 
 #define OBJECT_ICON_XSIZE 24
@@ -562,6 +563,25 @@ GdkPixbuf * image_from_colortable(const AmitkColorTable color_table,
 }
 
 
+/* colors row y of a slice (or projection) with a compiled color table */
+static void slice_row_to_rgba(AmitkDataSet * slice, 
+			      const AmitkColorTableLut * lut,
+			      const amide_intpoint_t y,
+			      rgba_t * row) {
+
+  AmitkVoxel i;
+
+  i.t = i.g = i.z = i.x = 0;
+  i.y = y;
+  amitk_color_table_lut_map(lut, 
+			    AMITK_RAW_DATA_DOUBLE_POINTER(AMITK_DATA_SET_RAW_DATA(slice), i),
+			    *AMITK_RAW_DATA_DOUBLE_0D_SCALING_POINTER(slice->current_scaling_factor, i),
+			    row, AMITK_DATA_SET_DIM_X(slice));
+
+  return;
+}
+
+
 GdkPixbuf * image_from_projection(AmitkDataSet * projection) {
 
   guchar * rgb_data;
@@ -569,8 +589,10 @@ GdkPixbuf * image_from_projection(AmitkDataSet * projection) {
   AmitkVoxel dim;
   amide_data_t max,min;
   GdkPixbuf * temp_image;
-  rgba_t rgba_temp;
+  rgba_t * row;
   AmitkColorTable color_table;
+  AmitkColorTableLut * lut;
+  guint location;
   
   /* sanity checks */
   g_return_val_if_fail(AMITK_IS_DATA_SET(projection), NULL);
@@ -582,25 +604,39 @@ GdkPixbuf * image_from_projection(AmitkDataSet * projection) {
     return NULL;
   }
 
+  if ((row = g_try_new(rgba_t, dim.x)) == NULL) {
+    g_warning(_("couldn't allocate memory for rgba_data for projection image"));
+    g_free(rgb_data);
+    return NULL;
+  }
+
   amitk_data_set_get_thresholding_min_max(projection, projection,
 					  AMITK_DATA_SET_SCAN_START(projection),
 					  amitk_data_set_get_frame_duration(projection,0),
 					  &min, &max);
       
   color_table = AMITK_DATA_SET_COLOR_TABLE(projection, AMITK_VIEW_MODE_SINGLE);
+  lut = amitk_color_table_lut_get(color_table, min, max);
+  if (lut == NULL) {
+    g_free(row);
+    g_free(rgb_data);
+    return NULL;
+  }
 
-  i.t = i.g = i.z = 0;
-  for (i.y = 0; i.y < dim.y; i.y++) 
-    for (i.x = 0; i.x < dim.x; i.x++) {
-      rgba_temp =
-	amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(projection,i), 
-				 color_table,min, max);
+  for (i.y = 0; i.y < dim.y; i.y++) {
+    slice_row_to_rgba(projection, lut, i.y, row);
 	  
-      /* compensate for the fact that X defines the origin as top left, not bottom left */
-	rgb_data[(dim.y-i.y-1)*dim.x*3 + i.x*3+0] = rgba_temp.r;
-	rgb_data[(dim.y-i.y-1)*dim.x*3 + i.x*3+1] = rgba_temp.g;
-	rgb_data[(dim.y-i.y-1)*dim.x*3 + i.x*3+2] = rgba_temp.b;
+    /* compensate for the fact that X defines the origin as top left, not bottom left */
+    location = (dim.y-i.y-1)*dim.x*3;
+    for (i.x = 0; i.x < dim.x; i.x++, location+=3) {
+      rgb_data[location+0] = row[i.x].r;
+      rgb_data[location+1] = row[i.x].g;
+      rgb_data[location+2] = row[i.x].b;
     }
+  }
+
+  amitk_color_table_lut_unref(lut);
+  g_free(row);
 
   /* from the rgb_data, generate a GdkPixbuf */
   temp_image = gdk_pixbuf_new_from_data(rgb_data, GDK_COLORSPACE_RGB,
@@ -618,9 +654,8 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
   AmitkVoxel dim;
   amide_data_t max,min;
   GdkPixbuf * temp_image;
-  guint index;
-  rgba_t rgba_temp;
   AmitkColorTable color_table;
+  AmitkColorTableLut * lut;
 
   /* sanity checks */
   g_return_val_if_fail(AMITK_IS_DATA_SET(slice), NULL);
@@ -640,21 +675,18 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
 					  &min, &max);
       
   color_table = amitk_data_set_get_color_table_to_use(AMITK_DATA_SET_SLICE_PARENT(slice), view_mode);
+  lut = amitk_color_table_lut_get(color_table, min, max);
+  if (lut == NULL) {
+    g_free(rgba_data);
+    return NULL;
+  }
 
-  i.t = i.g = i.z = 0;
-  index=0;
+  /* rgba_t has the same layout as the pixbuf's pixels, so color straight into it.
+     compensate for the fact that X defines the origin as top left, not bottom left */
+  for (i.y = 0; i.y < dim.y; i.y++) 
+    slice_row_to_rgba(slice, lut, i.y, (rgba_t *) (rgba_data + 4*(dim.y-i.y-1)*dim.x));
 
-  /* compensate for the fact that X defines the origin as top left, not bottom left */
-  for (i.y = dim.y-1; i.y >= 0; i.y--) 
-    for (i.x = 0; i.x < dim.x; i.x++, index+=4) {
-      rgba_temp =
-	amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,i), color_table,min, max);
-      
-	rgba_data[index+0] = rgba_temp.r;
-	rgba_data[index+1] = rgba_temp.g;
-	rgba_data[index+2] = rgba_temp.b;
-	rgba_data[index+3] = rgba_temp.a;
-    }
+  amitk_color_table_lut_unref(lut);
 
   /* from the rgb_data, generate a GdkPixbuf */
   temp_image = gdk_pixbuf_new_from_data(rgba_data, GDK_COLORSPACE_RGB,
@@ -664,11 +696,55 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
   return temp_image;
 }
 
+/* blend a row of colors into the accumulated image.  Transparent pixels 
+   are averaged, otherwise the colors are alpha weighted.  Integer math gives
+   the same (truncated) results as doing the divisions in floating point, and 
+   the selects instead of branches let the compiler vectorize the loop */
+static void blend_row(rgba16_t * blend, const rgba_t * row, const gint num, const guint slice_num) {
+
+  guint32 total_alpha, divisor;
+  guint32 ar, ag, ab;
+  guint32 wr, wg, wb;
+  gint x;
+
+  for (x=0; x<num; x++) {
+    total_alpha = blend[x].a + row[x].a;
+    divisor = (total_alpha == 0) ? 1 : total_alpha;
+
+    ar = ((slice_num-1)*blend[x].r + row[x].r)/slice_num;
+    ag = ((slice_num-1)*blend[x].g + row[x].g)/slice_num;
+    ab = ((slice_num-1)*blend[x].b + row[x].b)/slice_num;
+
+    wr = (blend[x].r*blend[x].a + row[x].r*row[x].a)/divisor;
+    wg = (blend[x].g*blend[x].a + row[x].g*row[x].a)/divisor;
+    wb = (blend[x].b*blend[x].a + row[x].b*row[x].a)/divisor;
+
+    blend[x].r = (total_alpha == 0) ? ar : wr;
+    blend[x].g = (total_alpha == 0) ? ag : wg;
+    blend[x].b = (total_alpha == 0) ? ab : wb;
+    blend[x].a = total_alpha;
+  }
+
+  return;
+}
+
+/* any non-transparent pixels in the row replace what's in the rgb data */
+static void overlay_row(guchar * rgb, const rgba_t * row, const gint num) {
+
+  gint x;
+
+  for (x=0; x<num; x++) {
+    rgb[3*x+0] = (row[x].a != 0) ? row[x].r : rgb[3*x+0];
+    rgb[3*x+1] = (row[x].a != 0) ? row[x].g : rgb[3*x+1];
+    rgb[3*x+2] = (row[x].a != 0) ? row[x].b : rgb[3*x+2];
+  }
+
+  return;
+}
+
 /* note, generally call this function with gate -1, only use the gate
    parameter if you want to override the data set's specified gate */
 GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
-				 GList ** pslice_cache,
-				 const gint max_slice_cache_size,
 				 GList * objects,
 				 const AmitkDataSet * active_ds,
 				 const amide_time_t start,
@@ -680,38 +756,51 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
 				 const AmitkViewMode view_mode) {
 
   gint slice_num;
-  guint32 total_alpha;
   guchar * rgb_data;
   rgba16_t * rgba16_data;
+  rgba_t * row;
   guint location;
   AmitkVoxel i;
   AmitkVoxel dim;
   amide_data_t max,min;
   GdkPixbuf * temp_image;
-  rgba_t rgba_temp;
   GList * slices;
   GList * temp_slices;
   AmitkDataSet * slice;
   AmitkColorTable color_table;
+  AmitkColorTableLut * lut;
   AmitkDataSet * overlay_slice = NULL;
   gint j;
   AmitkCanvasPoint pixel_size2;
+  gint64 trace_start;
+  gint64 trace_color;
   
 
   /* sanity checks */
   g_return_val_if_fail(objects != NULL, NULL);
 
+  trace_start = AMITK_TRACE_BEGIN();
   pixel_size2.x = pixel_size2.y = pixel_size;
-  slices = amitk_data_sets_get_slices(objects, pslice_cache, max_slice_cache_size,
+  slices = amitk_data_sets_get_slices(objects, TRUE,
 				      start, duration, gate, pixel_size2,view_volume);
   g_return_val_if_fail(slices != NULL, NULL);
 
   /* get the dimensions.  since all slices have the same dimensions, we'll just get the first */
   dim = AMITK_DATA_SET_DIM(slices->data);
 
-  /* allocate and initialize space for a temporary storage buffer */
+  /* allocate space for a temporary storage buffer, for coloring in one row 
+     at a time, and for the true rgb buffer */
   rgba16_data = g_try_new(rgba16_t,dim.y*dim.x);
-  g_return_val_if_fail(rgba16_data != NULL, NULL);
+  row = g_try_new(rgba_t, dim.x);
+  rgb_data = g_try_new(guchar,3*dim.y*dim.x);
+  if ((rgba16_data == NULL) || (row == NULL) || (rgb_data == NULL)) {
+    g_warning(_("couldn't allocate memory for the data set image"));
+    g_free(rgba16_data);
+    g_free(row);
+    g_free(rgb_data);
+    amitk_objects_unref(slices);
+    return NULL;
+  }
 
   for (j=0; j<dim.y*dim.x; j++) {
     rgba16_data[j].r = 0;
@@ -721,6 +810,7 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
   }
 
   /* iterate through all the slices */
+  trace_color = AMITK_TRACE_BEGIN();
   temp_slices = slices;
   slice_num = 0;
 
@@ -737,52 +827,20 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
       
       
       color_table = amitk_data_set_get_color_table_to_use(AMITK_DATA_SET_SLICE_PARENT(slice), view_mode);
-      /* now add this slice into the rgba16 data */
-      i.t = i.g = i.z = 0;
-      location=0;
-      /* compensate for the fact that X defines the origin as top left, not bottom left */
-      for (i.y = dim.y-1; i.y >= 0; i.y--) 
-	for (i.x = 0; i.x < dim.x; i.x++, location++) {
-	  rgba_temp = 
-	    amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,i), color_table,min, max);
-	  
-	  total_alpha = rgba16_data[location].a + rgba_temp.a;
-	  if (total_alpha == 0) {
-	    rgba16_data[location].r = (((slice_num-1)*rgba16_data[location].r + 
-					rgba_temp.r)/
-				       ((gdouble) slice_num));
-	    rgba16_data[location].g = (((slice_num-1)*rgba16_data[location].g + 
-					rgba_temp.g)/
-				       ((gdouble) slice_num));
-	    rgba16_data[location].b = (((slice_num-1)*rgba16_data[location].b + 
-					rgba_temp.b)/
-				       ((gdouble) slice_num));
-	  } else if (rgba16_data[location].a == 0) {
-	    rgba16_data[location].r = rgba_temp.r;
-	    rgba16_data[location].g = rgba_temp.g;
-	    rgba16_data[location].b = rgba_temp.b;
-	    rgba16_data[location].a = rgba_temp.a;
-	  } else if (rgba_temp.a != 0) {
-	    rgba16_data[location].r = ((rgba16_data[location].r*rgba16_data[location].a 
-					+ rgba_temp.r*rgba_temp.a)/
-				       ((gdouble) total_alpha));
-	    rgba16_data[location].g = ((rgba16_data[location].g*rgba16_data[location].a 
-					+ rgba_temp.g*rgba_temp.a)/
-				       ((gdouble) total_alpha));
-	    rgba16_data[location].b = ((rgba16_data[location].b*rgba16_data[location].a 
-					+ rgba_temp.b*rgba_temp.a)/
-				       ((gdouble) total_alpha));
-	    rgba16_data[location].a = total_alpha;
-	  }
+      lut = amitk_color_table_lut_get(color_table, min, max);
+      if (lut != NULL) {
+	/* now add this slice into the rgba16 data */
+	/* compensate for the fact that X defines the origin as top left, not bottom left */
+	for (i.y = 0; i.y < dim.y; i.y++) {
+	  slice_row_to_rgba(slice, lut, i.y, row);
+	  blend_row(rgba16_data + (dim.y-i.y-1)*dim.x, row, dim.x, slice_num);
 	}
+	amitk_color_table_lut_unref(lut);
+      }
     }
     temp_slices = temp_slices->next;
   }
 
-  /* allocate space for the true rgb buffer */
-  rgb_data = g_try_new(guchar,3*dim.y*dim.x);
-  g_return_val_if_fail(rgb_data != NULL, NULL);
-
   /* now convert our temp rgb data to real rgb data */
   i.z = 0;
   location=0;
@@ -800,23 +858,18 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
 					      start, duration, &min, &max);
       
       color_table = amitk_data_set_get_color_table_to_use(AMITK_DATA_SET_SLICE_PARENT(overlay_slice), view_mode);
-
-      i.t = i.g = i.z = 0;
-      for (i.y = 0; i.y < dim.y; i.y++) 
-	for (i.x = 0; i.x < dim.x; i.x++) {
-	  rgba_temp = 
-	    amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(overlay_slice,i), 
-				     color_table,min, max);
+      lut = amitk_color_table_lut_get(color_table, min, max);
+      if (lut != NULL) {
+	for (i.y = 0; i.y < dim.y; i.y++) {
+	  slice_row_to_rgba(overlay_slice, lut, i.y, row);
 
 	  /* compensate for the fact that X defines the origin as top left, not bottom left */
-	  location = (dim.y - i.y - 1)*dim.x+i.x;
-	  if (rgba_temp.a != 0) {
-	    rgb_data[3*location+0] = rgba_temp.r;
-	    rgb_data[3*location+1] = rgba_temp.g;
-	    rgb_data[3*location+2] = rgba_temp.b;
-	  }
+	  overlay_row(rgb_data + 3*(dim.y - i.y - 1)*dim.x, row, dim.x);
 	}
+	amitk_color_table_lut_unref(lut);
+      }
   }
+  AMITK_TRACE_END("color_map", trace_color);
   
 
   /* from the rgb_data, generate a GdkPixbuf */
@@ -826,6 +879,7 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
 
   /* cleanup */
   g_free(rgba16_data);
+  g_free(row);
 
   if (pdisp_slices != NULL) {
     amitk_objects_unref((*pdisp_slices));
@@ -834,6 +888,7 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
     amitk_objects_unref(slices);
   }
 
+  AMITK_TRACE_END("image_from_data_sets", trace_start);
   return temp_image;
 }
 
@@ -32,6 +32,8 @@
 #include "render.h"
 #include "amitk_roi.h"
 #include "amitk_data_set_DOUBLE_0D_SCALING.h"
+#include "amitk_parallel.h"
+#include "amitk_trace.h"
 
 #include <sys/time.h>
 #include <time.h>
@@ -52,9 +54,43 @@ gchar * pixel_type_names[] = {
   N_("Opacity"),
   N_("Grayscale")
 };
+gchar * renderer_names[] = {
+  N_("VolPack"),
+  N_("Ray Caster")
+};
 
 rendering_voxel_t * dummy_voxel;
 
+
+/* an object's values, extracted into the layout of the rendering volume */
+typedef struct {
+  guint start_frame;
+  guint end_frame;
+  amide_time_t start;
+  amide_time_t duration;
+  gint start_gate;
+  gint end_gate;
+  gfloat * values;
+} rendering_volume_t;
+
+static void volume_free(rendering_volume_t * volume) {
+  g_free(volume->values);
+  g_free(volume);
+  return;
+}
+
+/* drop all the cached volumes of a rendering context */
+static void volume_cache_clear(rendering_t * rendering) {
+
+  while (rendering->volume_cache != NULL) {
+    volume_free(rendering->volume_cache->data);
+    rendering->volume_cache = g_list_delete_link(rendering->volume_cache, rendering->volume_cache);
+  }
+
+  return;
+}
+
+
 rendering_t * rendering_unref(rendering_t * rendering) {
   
   classification_t i_class;
@@ -94,6 +130,13 @@ rendering_t * rendering_unref(rendering_t * rendering) {
       rendering->vpc = NULL;
     }
 
+    if (rendering->raycast != NULL) {
+      raycast_volume_free(rendering->raycast);
+      rendering->raycast = NULL;
+    }
+
+    volume_cache_clear(rendering);
+
     if (rendering->image != NULL) {
       g_free(rendering->image);
       rendering->image = NULL;
@@ -133,6 +176,7 @@ rendering_t * rendering_init(const AmitkObject * object,
 			     const gboolean zero_fill,
 			     const gboolean optimize_rendering,
 			     const gboolean no_gradient_opacity,
+			     const renderer_t renderer,
 			     AmitkUpdateFunc update_func,
 			     gpointer update_data) {
 
@@ -143,6 +187,8 @@ rendering_t * rendering_init(const AmitkObject * object,
   gint init_gradient_ramp_x[] = RENDERING_GRADIENT_RAMP_X;
   gfloat init_gradient_ramp_y[] = RENDERING_GRADIENT_RAMP_Y;
   gfloat init_gradient_ramp_y_flat[] = RENDERING_GRADIENT_RAMP_Y_FLAT;
+  gboolean loaded;
+  gint64 trace_start;
 
   if (!(AMITK_IS_DATA_SET(object) || AMITK_IS_ROI(object)))
     return NULL;
@@ -156,7 +202,10 @@ rendering_t * rendering_init(const AmitkObject * object,
   new_rendering->need_reclassify = TRUE;
   
   /* start initializing what we can */
+  new_rendering->renderer = renderer;
   new_rendering->vpc = vpCreateContext();
+  new_rendering->raycast = NULL;
+  new_rendering->volume_cache = NULL;
   new_rendering->object = amitk_object_copy(object);
   new_rendering->name = g_strdup(AMITK_OBJECT_NAME(object));
   if (AMITK_IS_DATA_SET(object))
@@ -169,6 +218,12 @@ rendering_t * rendering_init(const AmitkObject * object,
     new_rendering->pixel_type = RENDERING_DEFAULT_PIXEL_TYPE;
 
   new_rendering->image = NULL;
+  new_rendering->image_dim = 0;
+  new_rendering->max_ray_opacity = 1.0;
+  new_rendering->min_voxel_opacity = 0.0;
+  new_rendering->depth_cueing = RENDERING_DEFAULT_DEPTH_CUEING;
+  new_rendering->front_factor = RENDERING_DEFAULT_FRONT_FACTOR;
+  new_rendering->depth_cueing_density = RENDERING_DEFAULT_DENSITY;
   new_rendering->rendering_data = NULL;
   new_rendering->curve_type[DENSITY_CLASSIFICATION] = CURVE_LINEAR;
   new_rendering->curve_type[GRADIENT_CLASSIFICATION] = CURVE_LINEAR;
@@ -322,7 +377,10 @@ rendering_t * rendering_init(const AmitkObject * object,
   }
 
   /* now copy the object data into the rendering context */
-  if (rendering_load_object(new_rendering, update_func, update_data) != TRUE) {
+  trace_start = AMITK_TRACE_BEGIN();
+  loaded = rendering_load_object(new_rendering, update_func, update_data);
+  AMITK_TRACE_END("rendering_load_object", trace_start);
+  if (!loaded) {
     new_rendering = rendering_unref(new_rendering);
     return new_rendering;
   }
@@ -343,6 +401,8 @@ gboolean rendering_reload_object(rendering_t * rendering,
   
   amide_time_t old_start, old_duration;
   guint frame;
+  gboolean loaded;
+  gint64 trace_start;
 
 
   old_start = rendering->start;
@@ -381,72 +441,246 @@ gboolean rendering_reload_object(rendering_t * rendering,
   rendering->need_rerender = TRUE;
   rendering->need_reclassify = TRUE; 
 
-  return rendering_load_object(rendering, update_func, update_data);
+  trace_start = AMITK_TRACE_BEGIN();
+  loaded = rendering_load_object(rendering, update_func, update_data);
+  AMITK_TRACE_END("rendering_load_object", trace_start);
+
+  return loaded;
 }
 
 
 
-/* function to update the rendering structure's concept of the object */
-gboolean rendering_load_object(rendering_t * rendering, 
-			       AmitkUpdateFunc update_func,
-			       gpointer update_data) {
+/* look for the already extracted values for the rendering context's current frames and gates */
+static gfloat * volume_cache_lookup(rendering_t * rendering) {
 
-  AmitkVoxel i_voxel, j_voxel;
-  rendering_density_t * density; /* buffer for density data */
-  guint density_size;/* size of density data */
-  guint context_size;/* size of context */
-  div_t x;
-  gint divider;
-  gchar * temp_string;
-  gboolean continue_work=TRUE;
-#ifdef AMIDE_DEBUG
-  struct timeval tv1;
-  struct timeval tv2;
-  gdouble time1;
-  gdouble time2;
+  AmitkDataSet * ds = AMITK_DATA_SET(rendering->object);
+  guint start_frame, end_frame;
+  GList * link;
+  rendering_volume_t * volume;
 
-  /* let's do some timing */
-  gettimeofday(&tv1, NULL);
-#endif
+  start_frame = amitk_data_set_get_frame(ds, rendering->start);
+  end_frame = amitk_data_set_get_frame(ds, rendering->start+rendering->duration);
 
+  for (link = rendering->volume_cache; link != NULL; link = link->next) {
+    volume = link->data;
+    if ((volume->start_frame == start_frame) && (volume->end_frame == end_frame) &&
+	(volume->start_gate == rendering->view_start_gate) && 
+	(volume->end_gate == rendering->view_end_gate) &&
+	((start_frame == end_frame) || /* within a single frame, the exact times don't matter */
+	 (REAL_EQUAL(volume->start, rendering->start) && REAL_EQUAL(volume->duration, rendering->duration)))) {
+      /* move to the front of the list */
+      rendering->volume_cache = g_list_remove_link(rendering->volume_cache, link);
+      rendering->volume_cache = g_list_concat(link, rendering->volume_cache);
+      return volume->values;
+    }
+  }
 
-  /* tell the volpack context the dimensions of our rendering context */
-  if (vpSetVolumeSize(rendering->vpc, rendering->dim.x, 
-		      rendering->dim.y, rendering->dim.z) != VP_OK) {
-    g_warning(_("Error Setting the Context Size (%s): %s"), 
-	      rendering->name, 
-	      vpGetErrorString(vpGetError(rendering->vpc)));
-    return FALSE;
+  return NULL;
+}
+
+/* add a volume to the cache, dropping the least recently used ones if
+   we're past RENDERING_VOLUME_CACHE_SIZE.  The most recent one is always kept */
+static void volume_cache_add(rendering_t * rendering, gfloat * values) {
+
+  AmitkDataSet * ds = AMITK_DATA_SET(rendering->object);
+  rendering_volume_t * volume;
+  GList * last;
+  guint64 volume_bytes;
+  guint max_volumes;
+
+  if ((volume = g_try_new(rendering_volume_t, 1)) == NULL) {
+    g_free(values);
+    return;
+  }
+  volume->start_frame = amitk_data_set_get_frame(ds, rendering->start);
+  volume->end_frame = amitk_data_set_get_frame(ds, rendering->start+rendering->duration);
+  volume->start = rendering->start;
+  volume->duration = rendering->duration;
+  volume->start_gate = rendering->view_start_gate;
+  volume->end_gate = rendering->view_end_gate;
+  volume->values = values;
+  rendering->volume_cache = g_list_prepend(rendering->volume_cache, volume);
+
+  volume_bytes = sizeof(gfloat) * rendering->dim.x * (guint64) rendering->dim.y * (guint64) rendering->dim.z;
+  max_volumes = MAX(1, (((guint64) RENDERING_VOLUME_CACHE_SIZE) << 20)/volume_bytes);
+  while (g_list_length(rendering->volume_cache) > max_volumes) {
+    last = g_list_last(rendering->volume_cache);
+    volume_free(last->data);
+    rendering->volume_cache = g_list_delete_link(rendering->volume_cache, last);
   }
 
-  /* allocate space for the raw data and the context */
-  density_size =  rendering->dim.x *  rendering->dim.y *  
-    rendering->dim.z * RENDERING_DENSITY_SIZE;
-  context_size =  rendering->dim.x *  rendering->dim.y * 
-     rendering->dim.z * RENDERING_BYTES_PER_VOXEL;
+  return;
+}
 
-  if ((density = (rendering_density_t * ) g_try_malloc0(density_size)) == NULL) {
-    g_warning(_("Could not allocate memory space for density data for %s"), 
-	      rendering->name);
-    return FALSE;
+
+typedef struct {
+  rendering_t * rendering;
+  gfloat * values;
+  gint unmatched_dimensions; /* atomic */
+
+  /* for rois */
+  AmitkVoxel start;
+  AmitkVoxel end;
+  AmitkPoint origin; /* center of voxel (0,0,0) in the roi's space */
+  AmitkPoint step[AMITK_AXIS_NUM]; /* one voxel along each axis, in the roi's space */
+  AmitkPoint center, radius, box_corner;
+  amide_real_t height;
+} extract_t;
+
+#define VALUES_INDEX(rendering, i_x, i_y, i_z) \
+  ((i_x) + (gsize) (rendering)->dim.x*((i_y) + (gsize) (rendering)->dim.y*(gsize) ((rendering)->dim.z-(i_z)-1)))
+
+/* pulls the data set values for planes [start_plane, end_plane) out as slices.
+   note, volpack needs a mirror reversal on the z axis */
+static void extract_data_set_planes(gint start_plane, gint end_plane, gpointer data) {
+
+  extract_t * extract = data;
+  rendering_t * rendering = extract->rendering;
+  AmitkVolume * slice_volume;
+  AmitkDataSet * slice;
+  AmitkPoint offset;
+  AmitkPoint temp_corner;
+  AmitkVoxel i_voxel, dim;
+  AmitkCanvasPoint pixel_size;
+
+  slice_volume = AMITK_VOLUME(amitk_object_copy(AMITK_OBJECT(rendering->extraction_volume)));
+
+  /* define the slice that we're trying to pull out of the data set */
+  temp_corner = AMITK_VOLUME_CORNER(slice_volume);
+  temp_corner.z = rendering->voxel_size;
+  amitk_volume_set_corner(slice_volume, temp_corner);
+  pixel_size.x = pixel_size.y = rendering->voxel_size;
+
+  i_voxel.t = i_voxel.g = 0;
+  for (i_voxel.z = start_plane; i_voxel.z < end_plane; i_voxel.z++) {
+    offset = zero_point; /* in extraction_volume space */
+    offset.z = i_voxel.z*rendering->voxel_size; 
+    amitk_space_set_offset(AMITK_SPACE(slice_volume), 
+			   amitk_space_s2b(AMITK_SPACE(rendering->extraction_volume), offset));
+
+    slice = amitk_data_set_get_slice(AMITK_DATA_SET(rendering->object), 
+				     rendering->start, 
+				     rendering->duration, 
+				     -1,
+				     pixel_size,
+				     slice_volume);
+    if (slice == NULL) continue;
+
+    if (((rendering->dim.x != AMITK_DATA_SET_DIM_X(slice)) || 
+	 (rendering->dim.y != AMITK_DATA_SET_DIM_Y(slice))) &&
+	g_atomic_int_compare_and_exchange(&(extract->unmatched_dimensions), FALSE, TRUE))
+      g_warning("unmatched dimensions between rendering and slices (%dx%d != %dx%d) in %s\n", 
+		rendering->dim.x, rendering->dim.y,
+		AMITK_DATA_SET_DIM_X(slice), AMITK_DATA_SET_DIM_Y(slice),
+		__FILE__);
+    dim.x = MIN(rendering->dim.x, AMITK_DATA_SET_DIM_X(slice));
+    dim.y = MIN(rendering->dim.y, AMITK_DATA_SET_DIM_Y(slice));
+
+    for (i_voxel.y = 0; i_voxel.y < dim.y; i_voxel.y++)
+      for (i_voxel.x = 0; i_voxel.x < dim.x; i_voxel.x++)
+	extract->values[VALUES_INDEX(rendering, i_voxel.x, i_voxel.y, i_voxel.z)] = 
+	  AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice, i_voxel);
+
+    amitk_object_unref(slice);
   }
 
+  amitk_object_unref(slice_volume);
+
+  return;
+}
+
+/* voxelizes the roi for planes [start_plane, end_plane) of the intersection, 
+   stepping through the roi's space instead of transforming each voxel */
+static void extract_roi_planes(gint start_plane, gint end_plane, gpointer data) {
+
+  extract_t * extract = data;
+  rendering_t * rendering = extract->rendering;
+  AmitkRoi * roi = AMITK_ROI(rendering->object);
+  AmitkVoxel i_voxel, j_voxel;
+  AmitkPoint plane_point, row_point, temp_point;
+  gint temp_int;
+
+  j_voxel.t = j_voxel.g = 0;
+  i_voxel.t = i_voxel.g = 0;
+  for (i_voxel.z = extract->start.z+start_plane; i_voxel.z < extract->start.z+end_plane; i_voxel.z++) {
+    plane_point = point_add(extract->origin, point_cmult(i_voxel.z, extract->step[AMITK_AXIS_Z]));
+
+    for (i_voxel.y = extract->start.y; i_voxel.y <= extract->end.y; i_voxel.y++) {
+      row_point = point_add(plane_point, point_cmult(i_voxel.y, extract->step[AMITK_AXIS_Y]));
+
+      for (i_voxel.x = extract->start.x; i_voxel.x <= extract->end.x; i_voxel.x++) {
+	temp_point = point_add(row_point, point_cmult(i_voxel.x, extract->step[AMITK_AXIS_X]));
+
+	switch(AMITK_ROI_TYPE(roi)) {
+	case AMITK_ROI_TYPE_ISOCONTOUR_2D:
+	case AMITK_ROI_TYPE_ISOCONTOUR_3D:
+	case AMITK_ROI_TYPE_FREEHAND_2D:
+	case AMITK_ROI_TYPE_FREEHAND_3D:
+	  POINT_TO_VOXEL_COORDS_ONLY(temp_point, roi->voxel_size, j_voxel);
+	  if (amitk_raw_data_includes_voxel(roi->map_data, j_voxel)) {
+	    temp_int = *AMITK_RAW_DATA_UBYTE_POINTER(roi->map_data, j_voxel);
+	    if (temp_int == 2)
+	      temp_int = RENDERING_DENSITY_MAX;
+	    else if (temp_int == 1)
+	      temp_int = RENDERING_DENSITY_MAX/2.0;
+	  } else
+	    temp_int = 0;
+	  break;
+	case AMITK_ROI_TYPE_ELLIPSOID:
+	  if (point_in_ellipsoid(temp_point, extract->center, extract->radius)) 
+	    temp_int = RENDERING_DENSITY_MAX;
+	  else temp_int = 0;
+	  break;
+	case AMITK_ROI_TYPE_BOX:
+	  if (point_in_box(temp_point, extract->box_corner))
+	    temp_int = RENDERING_DENSITY_MAX;
+	  else temp_int = 0;
+	  break;
+	case AMITK_ROI_TYPE_CYLINDER:
+	  if (point_in_elliptic_cylinder(temp_point, extract->center, extract->height, extract->radius)) 
+	    temp_int = RENDERING_DENSITY_MAX;
+	  else temp_int = 0;
+	  break;
+	default:
+	  temp_int=0;
+	  g_assert(TRUE); /* assert if we ever get here */
+	  break;
+	}
 
-  if (rendering->rendering_data != NULL) {
-    g_free(rendering->rendering_data);
-    rendering->rendering_data = NULL;
+	extract->values[VALUES_INDEX(rendering, i_voxel.x, i_voxel.y, i_voxel.z)] = temp_int;
+      }
+    }
   }
 
-  if ((rendering->rendering_data = (rendering_voxel_t * ) g_try_malloc(context_size)) == NULL) {
-    g_warning(_("Could not allocate memory space for rendering context volume for %s"), 
-	      rendering->name);
-    g_free(density);
-    return FALSE;
+  return;
+}
+
+/* returns the object's values laid out in the rendering volume, NULL on
+   failure or cancel.  For data sets, the values are kept in the volume
+   cache, so *pown is set to FALSE, for rois the caller needs to free them */
+static gfloat * extract_values(rendering_t * rendering, gboolean * pown,
+			       AmitkUpdateFunc update_func, gpointer update_data) {
+
+  extract_t extract;
+  gsize num_voxels;
+  gchar * temp_string;
+  gboolean continue_work=TRUE;
+
+  if (AMITK_IS_DATA_SET(rendering->object)) {
+    if ((extract.values = volume_cache_lookup(rendering)) != NULL) {
+      *pown = FALSE;
+      return extract.values;
+    }
   }
 
-  vpSetRawVoxels(rendering->vpc, rendering->rendering_data, context_size, 
-		 RENDERING_BYTES_PER_VOXEL,  rendering->dim.x * RENDERING_BYTES_PER_VOXEL,
-		 rendering->dim.x* rendering->dim.y * RENDERING_BYTES_PER_VOXEL);
+  num_voxels = rendering->dim.x * (gsize) rendering->dim.y * (gsize) rendering->dim.z;
+  if ((extract.values = g_try_malloc0(num_voxels*sizeof(gfloat))) == NULL) {
+    g_warning(_("Could not allocate memory space for density data for %s"), 
+	      rendering->name);
+    return NULL;
+  }
+  extract.rendering = rendering;
+  extract.unmatched_dimensions = FALSE;
 
   /* setup the progress information */
   if (update_func != NULL) {
@@ -454,212 +688,244 @@ gboolean rendering_load_object(rendering_t * rendering,
     continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
     g_free(temp_string);
   }
-  divider = ((rendering->dim.z/AMITK_UPDATE_DIVIDER) < 1) ? 1 : (rendering->dim.z/AMITK_UPDATE_DIVIDER);
 
   if (AMITK_IS_ROI(rendering->object)) {
-
-    AmitkPoint center, radius;
-    amide_real_t height;
-    AmitkPoint temp_point;
-    AmitkPoint box_corner;
-    gint temp_int;
-    AmitkVoxel start, end;
     AmitkCorners intersection_corners;
     AmitkPoint voxel_size;
+    AmitkPoint temp_point, step_point;
+    AmitkAxis i_axis;
 
     voxel_size.x = voxel_size.y = voxel_size.z = rendering->voxel_size;
     
-    radius = point_cmult(0.5, AMITK_VOLUME_CORNER(rendering->object));
-    center = amitk_space_b2s(AMITK_SPACE(rendering->object),
-			     amitk_volume_get_center(AMITK_VOLUME(rendering->object)));
-    height = AMITK_VOLUME_Z_CORNER(rendering->object);
-    box_corner = AMITK_VOLUME_CORNER(rendering->object);
-    j_voxel.t = j_voxel.g = j_voxel.z = i_voxel.t= i_voxel.g = 0;
+    extract.radius = point_cmult(0.5, AMITK_VOLUME_CORNER(rendering->object));
+    extract.center = amitk_space_b2s(AMITK_SPACE(rendering->object),
+				     amitk_volume_get_center(AMITK_VOLUME(rendering->object)));
+    extract.height = AMITK_VOLUME_Z_CORNER(rendering->object);
+    extract.box_corner = AMITK_VOLUME_CORNER(rendering->object);
 
     /* figure out the intersection between the rendering volume and the roi */
     if (!amitk_volume_volume_intersection_corners(rendering->extraction_volume, 
 						  AMITK_VOLUME(rendering->object), 
 						  intersection_corners)) {
-      start = end = zero_voxel;
+      extract.start = extract.end = zero_voxel;
     } else {
-      //      intersection_corners[1] = point_cmult(1.0-EPSILON, intersection_corners[1]);
-      POINT_TO_VOXEL(intersection_corners[0], voxel_size, 0, 0, start);
-      POINT_TO_VOXEL(intersection_corners[1], voxel_size, 1, 1, end);
-      end = voxel_sub(end, one_voxel);
+      POINT_TO_VOXEL(intersection_corners[0], voxel_size, 0, 0, extract.start);
+      POINT_TO_VOXEL(intersection_corners[1], voxel_size, 1, 1, extract.end);
+      extract.end = voxel_sub(extract.end, one_voxel);
     }
 
-    g_return_val_if_fail(end.x < rendering->dim.x, FALSE);
-    g_return_val_if_fail(end.y < rendering->dim.y, FALSE);
-    g_return_val_if_fail(end.z < rendering->dim.z, FALSE);
+    if ((extract.end.x >= rendering->dim.x) || (extract.end.y >= rendering->dim.y) ||
+	(extract.end.z >= rendering->dim.z)) {
+      g_free(extract.values);
+      g_return_val_if_reached(NULL);
+    }
 
-    for (i_voxel.z = start.z; (i_voxel.z <= end.z) && (continue_work); i_voxel.z++) {
-      if (update_func != NULL) {
-	x = div(i_voxel.z,divider);
-	if (x.rem == 0) 
-	  continue_work = (*update_func)(update_data, NULL, (gdouble) i_voxel.z/(end.z-start.z));
-      }
+    /* the mapping from our voxels into the roi's space is affine, so just need
+       the first voxel's center and the steps along each axis */
+    VOXEL_TO_POINT(zero_voxel, voxel_size, temp_point);
+    extract.origin = amitk_space_s2s(AMITK_SPACE(rendering->extraction_volume),
+				     AMITK_SPACE(rendering->object), temp_point);
+    for (i_axis=0; i_axis<AMITK_AXIS_NUM; i_axis++) {
+      step_point = temp_point;
+      point_set_component(&step_point, i_axis, point_get_component(temp_point, i_axis)+rendering->voxel_size);
+      extract.step[i_axis] = point_sub(amitk_space_s2s(AMITK_SPACE(rendering->extraction_volume),
+						       AMITK_SPACE(rendering->object), step_point),
+				       extract.origin);
+    }
 
-      for (i_voxel.y = start.y; i_voxel.y <=  end.y; i_voxel.y++)
-	for (i_voxel.x = start.x; i_voxel.x <=  end.x; i_voxel.x++) {
-	  VOXEL_TO_POINT(i_voxel, voxel_size, temp_point);
-	  temp_point = amitk_space_s2s(AMITK_SPACE(rendering->extraction_volume),
-				       AMITK_SPACE(rendering->object),temp_point);
-	  switch(AMITK_ROI_TYPE(rendering->object)) {
-	  case AMITK_ROI_TYPE_ISOCONTOUR_2D:
-	  case AMITK_ROI_TYPE_ISOCONTOUR_3D:
-	  case AMITK_ROI_TYPE_FREEHAND_2D:
-	  case AMITK_ROI_TYPE_FREEHAND_3D:
-	    POINT_TO_VOXEL(temp_point, AMITK_ROI(rendering->object)->voxel_size, 0, 0, j_voxel);
-	    if (amitk_raw_data_includes_voxel(AMITK_ROI(rendering->object)->map_data, j_voxel)) {
-	      temp_int = *AMITK_RAW_DATA_UBYTE_POINTER(AMITK_ROI(rendering->object)->map_data, j_voxel);
-	      if (temp_int == 2)
-		temp_int = RENDERING_DENSITY_MAX;
-	      else if (temp_int == 1)
-		temp_int = RENDERING_DENSITY_MAX/2.0;
-	    } else
-	      temp_int = 0;
-	    break;
-	  case AMITK_ROI_TYPE_ELLIPSOID:
-	    if (point_in_ellipsoid(temp_point, center, radius)) 
-	      temp_int = RENDERING_DENSITY_MAX;
-	    else temp_int = 0;
-	    break;
-	  case AMITK_ROI_TYPE_BOX:
-	    if (point_in_box(temp_point, box_corner))
-	      temp_int = RENDERING_DENSITY_MAX;
-	    else temp_int = 0;
-	    break;
-	  case AMITK_ROI_TYPE_CYLINDER:
-	    if (point_in_elliptic_cylinder(temp_point, center, height, radius)) 
-	      temp_int = RENDERING_DENSITY_MAX;
-	    else temp_int = 0;
-	    break;
-	  default:
-	    temp_int=0;
-	    g_assert(TRUE); /* assert if we ever get here */
-	    break;
-	  }
+    if (extract.end.z >= extract.start.z) 
+      continue_work = amitk_parallel_for(extract.end.z-extract.start.z+1, 1, extract_roi_planes, &extract,
+					 update_func, update_data);
 
-	  /* note, volpack needs a mirror reversal on the z axis */
-	  density[i_voxel.x +
-		  i_voxel.y*rendering->dim.x+
-		  (rendering->dim.z-i_voxel.z-1)*rendering->dim.y*rendering->dim.x] = temp_int;
-	}
-    }
+  } else { /* DATA SET */
+    /* make sure the global max/min are calculated before we go parallel */
+    amitk_data_set_get_global_max(AMITK_DATA_SET(rendering->object));
+    continue_work = amitk_parallel_for(rendering->dim.z, 1, extract_data_set_planes, &extract,
+				       update_func, update_data);
+  }
 
+  /* if we quit, get out of here */
+  if (update_func != NULL) 
+    continue_work = (*update_func)(update_data, NULL, (gdouble) 2.0) && continue_work; /* remove progress bar */
 
+  if (!continue_work) {
+    g_free(extract.values);
+    return NULL;
+  }
 
-  } else { /* DATA SET */
+  if (AMITK_IS_DATA_SET(rendering->object)) {
+    volume_cache_add(rendering, extract.values);
+    *pown = FALSE;
+  } else {
+    *pown = TRUE;
+  }
 
-    AmitkVolume * slice_volume;
-    AmitkDataSet * slice;
-    AmitkPoint new_offset;
-    AmitkPoint temp_corner;
-    amide_data_t temp_val, scale;
-    amide_data_t max, min;
-    AmitkVoxel dim;
-    gboolean unmatched_dimensions = FALSE;
-    AmitkCanvasPoint pixel_size;
+  return extract.values;
+}
 
-    
-    slice_volume = AMITK_VOLUME(amitk_object_copy(AMITK_OBJECT(rendering->extraction_volume)));
-
-    /* define the slice that we're trying to pull out of the data set */
-    temp_corner = AMITK_VOLUME_CORNER(slice_volume);
-    temp_corner.z = rendering->voxel_size;
-    amitk_volume_set_corner(slice_volume, temp_corner);
-
-    new_offset = zero_point; /* in slice_volume space */
-    new_offset.z = rendering->voxel_size; 
-
-    /* copy the info from a data set structure into our rendering_volume structure */
-    j_voxel.t = j_voxel.g = j_voxel.z = i_voxel.t= i_voxel.g = 0;
-    for (i_voxel.z = 0; ((i_voxel.z < rendering->dim.z) && continue_work); i_voxel.z++) {
-      if  (update_func != 0) {
-	x = div(i_voxel.z,divider);
-	if (x.rem == 0)
-	    continue_work = (*update_func)(update_data, NULL, (gdouble) i_voxel.z/rendering->dim.z);
-      }
-      
-      pixel_size.x = pixel_size.y = rendering->voxel_size;
-      slice = amitk_data_set_get_slice(AMITK_DATA_SET(rendering->object), 
-				       rendering->start, 
-				       rendering->duration, 
-				       -1,
-				       pixel_size,
-				       slice_volume);
-
-      if (!unmatched_dimensions && 
-	  ((rendering->dim.x != AMITK_DATA_SET_DIM_X(slice)) || 
-	   (rendering->dim.y != AMITK_DATA_SET_DIM_Y(slice)))) {
-	g_warning("unmatched dimensions between rendering and slices (%dx%d != %dx%d) in %s\n", 
-		  rendering->dim.x, rendering->dim.y,
-		  AMITK_DATA_SET_DIM_X(slice), AMITK_DATA_SET_DIM_Y(slice),
-		  __FILE__);
-	unmatched_dimensions = TRUE;
-      }
-      dim.x = MIN(rendering->dim.x, AMITK_DATA_SET_DIM_X(slice));
-      dim.y = MIN(rendering->dim.y, AMITK_DATA_SET_DIM_Y(slice));
-
-
-      amitk_data_set_get_thresholding_min_max(AMITK_DATA_SET_SLICE_PARENT(slice),
-					      AMITK_DATA_SET(slice),
-					      rendering->start, 
-					      rendering->duration, &min, &max);
-
-      scale = ((amide_data_t) RENDERING_DENSITY_MAX) / (max-min);
-
-      /* note, volpack needs a mirror reversal on the z axis */
-      if (rendering->zero_fill) {
-	for (j_voxel.y = i_voxel.y = 0; i_voxel.y <  dim.y; j_voxel.y++, i_voxel.y++)
-	  for (j_voxel.x = i_voxel.x = 0; i_voxel.x <  dim.x; j_voxel.x++, i_voxel.x++) {
-	    temp_val = scale * (AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,j_voxel)-min);
-	    if (temp_val > RENDERING_DENSITY_MAX) temp_val = 0.0;
-	    if (temp_val < 0.0) temp_val = 0.0;
-	    density[i_voxel.x+
-		    i_voxel.y*rendering->dim.x+
-		    (rendering->dim.z-i_voxel.z-1)* rendering->dim.y* rendering->dim.x] = temp_val;
-	  }
-      } else {
-	for (j_voxel.y = i_voxel.y = 0; i_voxel.y <  dim.y; j_voxel.y++, i_voxel.y++)
-	  for (j_voxel.x = i_voxel.x = 0; i_voxel.x <  dim.x; j_voxel.x++, i_voxel.x++) {
-	    temp_val = scale * (AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,j_voxel)-min);
-	    if (temp_val > RENDERING_DENSITY_MAX) temp_val = RENDERING_DENSITY_MAX;
-	    if (temp_val < 0.0) temp_val = 0.0;
-	    density[i_voxel.x+
-		    i_voxel.y*rendering->dim.x+
-		    (rendering->dim.z-i_voxel.z-1)* rendering->dim.y* rendering->dim.x] = temp_val;
-	  }
-      }
-      amitk_object_unref(slice);
 
-      /* advance the requested slice volume for next iteration */
-      amitk_space_set_offset(AMITK_SPACE(slice_volume), 
-			     amitk_space_s2b(AMITK_SPACE(slice_volume), new_offset));
-    }
-    amitk_object_unref(slice_volume);
+typedef struct {
+  rendering_t * rendering;
+  const gfloat * values;
+  rendering_density_t * density;
+  gfloat * float_density;
+  amide_data_t min;
+  amide_data_t scale;
+  amide_data_t high_value; /* what to use for values above the max */
+} convert_t;
+
+/* scale planes [start, end) of values into densities */
+static void convert_planes(gint start, gint end, gpointer data) {
+
+  convert_t * convert = data;
+  gsize plane_size;
+  gsize i, i_end;
+  amide_data_t temp_val;
+
+  plane_size = convert->rendering->dim.x * (gsize) convert->rendering->dim.y;
+  i_end = end*plane_size;
+  for (i = start*plane_size; i < i_end; i++) {
+    temp_val = convert->scale * (convert->values[i]-convert->min);
+    if (temp_val > RENDERING_DENSITY_MAX) temp_val = convert->high_value;
+    if (temp_val < 0.0) temp_val = 0.0;
+    if (convert->float_density != NULL) 
+      convert->float_density[i] = temp_val;
+    else
+      convert->density[i] = temp_val;
   }
 
-  /* if we quit, get out of here */
-  if (update_func != NULL) 
-    continue_work = (*update_func)(update_data, NULL, (gdouble) 2.0); /* remove progress bar */
+  return;
+}
 
-  if (!continue_work) {
-    g_free(density);
+/* function to update the rendering structure's concept of the object */
+gboolean rendering_load_object(rendering_t * rendering, 
+			       AmitkUpdateFunc update_func,
+			       gpointer update_data) {
+
+  rendering_density_t * density=NULL; /* buffer for density data */
+  gfloat * float_density=NULL; /* buffer for density data, for the ray caster */
+  guint density_size;/* size of density data */
+  guint context_size;/* size of context */
+  gsize num_voxels;
+  gfloat * values;
+  gboolean own_values;
+  convert_t convert;
+  amide_data_t max, min;
+  gint64 trace_start;
+#ifdef AMIDE_DEBUG
+  struct timeval tv1;
+  struct timeval tv2;
+  gdouble time1;
+  gdouble time2;
+
+  /* let's do some timing */
+  gettimeofday(&tv1, NULL);
+#endif
+
+  /* get the object's values, either from the cache or by extracting them */
+  trace_start = AMITK_TRACE_BEGIN();
+  values = extract_values(rendering, &own_values, update_func, update_data);
+  AMITK_TRACE_END("rendering_extract_values", trace_start);
+  if (values == NULL)
     return FALSE;
+
+  num_voxels = rendering->dim.x * (gsize) rendering->dim.y * (gsize) rendering->dim.z;
+
+  if (rendering->renderer == RENDERER_RAY_CAST) {
+    /* the ray caster keeps the densities as floats */
+    if (rendering->raycast != NULL) {
+      raycast_volume_free(rendering->raycast);
+      rendering->raycast = NULL;
+    }
+
+    if ((float_density = g_try_malloc(num_voxels*sizeof(gfloat))) == NULL) {
+      g_warning(_("Could not allocate memory space for density data for %s"), 
+		rendering->name);
+      if (own_values) g_free(values);
+      return FALSE;
+    }
+
+  } else {
+
+    /* tell the volpack context the dimensions of our rendering context */
+    if (vpSetVolumeSize(rendering->vpc, rendering->dim.x, 
+			rendering->dim.y, rendering->dim.z) != VP_OK) {
+      g_warning(_("Error Setting the Context Size (%s): %s"), 
+		rendering->name, 
+		vpGetErrorString(vpGetError(rendering->vpc)));
+      if (own_values) g_free(values);
+      return FALSE;
+    }
+
+    /* allocate space for the raw data and the context */
+    density_size =  num_voxels * RENDERING_DENSITY_SIZE;
+    context_size =  num_voxels * RENDERING_BYTES_PER_VOXEL;
+
+    if ((density = (rendering_density_t * ) g_try_malloc(density_size)) == NULL) {
+      g_warning(_("Could not allocate memory space for density data for %s"), 
+		rendering->name);
+      if (own_values) g_free(values);
+      return FALSE;
+    }
+
+
+    if (rendering->rendering_data != NULL) {
+      g_free(rendering->rendering_data);
+      rendering->rendering_data = NULL;
+    }
+
+    if ((rendering->rendering_data = (rendering_voxel_t * ) g_try_malloc(context_size)) == NULL) {
+      g_warning(_("Could not allocate memory space for rendering context volume for %s"), 
+		rendering->name);
+      g_free(density);
+      if (own_values) g_free(values);
+      return FALSE;
+    }
+
+    vpSetRawVoxels(rendering->vpc, rendering->rendering_data, context_size, 
+		   RENDERING_BYTES_PER_VOXEL,  rendering->dim.x * RENDERING_BYTES_PER_VOXEL,
+		   rendering->dim.x* rendering->dim.y * RENDERING_BYTES_PER_VOXEL);
   }
 
-  /* compute surface normals (for shading) and gradient magnitudes (for classification) */
-  if (vpVolumeNormals(rendering->vpc, density, density_size, RENDERING_DENSITY_FIELD, 
-		      RENDERING_GRADIENT_FIELD, RENDERING_NORMAL_FIELD) != VP_OK) {
-    g_warning(_("Error Computing the Rendering Normals (%s): %s"),
-	      rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
-    g_free(density);
-    return FALSE;
-  }                   
+  /* scale the values into densities, for rois the values are already densities */
+  if (AMITK_IS_DATA_SET(rendering->object)) {
+    amitk_data_set_get_thresholding_min_max(AMITK_DATA_SET(rendering->object),
+					    AMITK_DATA_SET(rendering->object),
+					    rendering->start, 
+					    rendering->duration, &min, &max);
+  } else {
+    min = 0.0;
+    max = RENDERING_DENSITY_MAX;
+  }
+  convert.rendering = rendering;
+  convert.values = values;
+  convert.density = density;
+  convert.float_density = float_density;
+  convert.min = min;
+  convert.scale = ((amide_data_t) RENDERING_DENSITY_MAX) / (max-min);
+  convert.high_value = rendering->zero_fill ? 0.0 : RENDERING_DENSITY_MAX;
+  amitk_parallel_for(rendering->dim.z, 1, convert_planes, &convert, NULL, NULL);
+  if (own_values) g_free(values);
+
+  if (rendering->renderer == RENDERER_RAY_CAST) {
+    /* the ray caster takes over the densities, and works out gradients and normals itself */
+    rendering->raycast = raycast_volume_new(rendering->dim, float_density,
+					    RENDERING_DENSITY_MAX, RENDERING_GRADIENT_MAX);
+    if (rendering->raycast == NULL)
+      return FALSE;
+  } else {
+    /* compute surface normals (for shading) and gradient magnitudes (for classification) */
+    if (vpVolumeNormals(rendering->vpc, density, density_size, RENDERING_DENSITY_FIELD, 
+			RENDERING_GRADIENT_FIELD, RENDERING_NORMAL_FIELD) != VP_OK) {
+      g_warning(_("Error Computing the Rendering Normals (%s): %s"),
+		rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
+      g_free(density);
+      return FALSE;
+    }                   
 
-  /* we're now done with the density volume, free it */
-  g_free(density);
+    /* we're now done with the density volume, free it */
+    g_free(density);
+  }
 
 #ifdef AMIDE_DEBUG
   /* and wrapup our timing */
@@ -670,6 +936,10 @@ gboolean rendering_load_object(rendering_t * rendering,
 	  AMITK_OBJECT_NAME(rendering->object), time2-time1);
 #endif
 
+  /* the rest is only volpack setup */
+  if (rendering->renderer == RENDERER_RAY_CAST)
+    return TRUE;
+
   /* we'll be using min-max octree's as the classifying functions will probably be changed a lot */
   /* octrees supposedly allow faster classification */
   if (rendering->optimize_rendering) { 
@@ -854,6 +1124,9 @@ void rendering_set_quality(rendering_t * rendering, rendering_quality_t quality)
   }
 
 
+  rendering->max_ray_opacity = max_ray_opacity;
+  rendering->min_voxel_opacity = min_voxel_opacity;
+
   /* set the maximum ray opacity (the renderer quits follow a ray if this value is reached */
   if (vpSetd(rendering->vpc, VP_MAX_RAY_OPACITY, max_ray_opacity) != VP_OK){
     g_warning(_("Error Setting Rendering Max Ray Opacity (%s): %s"),
@@ -889,6 +1162,7 @@ void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdoub
     break;
   }
   size_dim = ceil(zoom*POINT_MAX(rendering->dim));
+  rendering->image_dim = size_dim;
   g_free(rendering->image);
   if ((rendering->image = g_try_new(guchar,size_dim*size_dim)) == NULL) {
     g_warning(_("Could not allocate memory space for Rendering Image for %s"), 
@@ -909,6 +1183,7 @@ void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdoub
 void rendering_set_depth_cueing(rendering_t * rendering, gboolean state) {
 
   rendering->need_rerender = TRUE;
+  rendering->depth_cueing = state;
 
   if (vpEnable(rendering->vpc, VP_DEPTH_CUE, state) != VP_OK) {
       g_warning(_("Error Setting the Rendering Depth Cue (%s): %s"),
@@ -925,6 +1200,8 @@ void rendering_set_depth_cueing_parameters(rendering_t * rendering,
 					   gdouble front_factor, gdouble density) {
 
   rendering->need_rerender = TRUE;
+  rendering->front_factor = front_factor;
+  rendering->depth_cueing_density = density;
 
   /* the defaults should be 1.0 and 1.0 */
   if (vpSetDepthCueing(rendering->vpc, front_factor, density) != VP_OK){
@@ -951,7 +1228,24 @@ void rendering_render(rendering_t * rendering)
 #endif
 
   if (rendering->need_rerender) {
-    if (rendering->vpc != NULL) {
+    if (rendering->renderer == RENDERER_RAY_CAST) {
+      if ((rendering->raycast != NULL) && (rendering->image != NULL)) {
+	raycast_parameters_t parameters;
+
+	if (rendering->need_reclassify)
+	  raycast_volume_classify(rendering->raycast, rendering->density_ramp,
+				  rendering->gradient_ramp, rendering->min_voxel_opacity);
+
+	parameters.max_ray_opacity = rendering->max_ray_opacity;
+	parameters.min_voxel_opacity = rendering->min_voxel_opacity;
+	parameters.shade = (rendering->pixel_type == GRAYSCALE);
+	parameters.depth_cueing = rendering->depth_cueing;
+	parameters.front_factor = rendering->front_factor;
+	parameters.density = rendering->depth_cueing_density;
+	raycast_render(rendering->raycast, AMITK_SPACE_AXES(rendering->transformed_volume),
+		       &parameters, rendering->image, rendering->image_dim);
+      }
+    } else if (rendering->vpc != NULL) {
       if (rendering->optimize_rendering) {
 	if (rendering->need_reclassify) {
 #if AMIDE_DEBUG
@@ -1034,6 +1328,7 @@ static renderings_t * renderings_init_recurse(GList * objects,
 					      const gboolean zero_fill,
 					      const gboolean optimize_rendering,
 					      const gboolean no_gradient_opacity,
+					      const renderer_t renderer,
 					      AmitkUpdateFunc update_func,
 					      gpointer update_data) {
 
@@ -1045,11 +1340,11 @@ static renderings_t * renderings_init_recurse(GList * objects,
 
   /* recurse first */
   rest_of_list = renderings_init_recurse(objects->next, render_volume, voxel_size, start, duration, 
-					 zero_fill, optimize_rendering, no_gradient_opacity,
+					 zero_fill, optimize_rendering, no_gradient_opacity, renderer,
 					 update_func, update_data);
 
   new_rendering = rendering_init(objects->data, render_volume,voxel_size, start, duration, 
-				 zero_fill, optimize_rendering, no_gradient_opacity,
+				 zero_fill, optimize_rendering, no_gradient_opacity, renderer,
 				 update_func, update_data);
 
   if (new_rendering != NULL) {
@@ -1071,6 +1366,7 @@ static renderings_t * renderings_init_recurse(GList * objects,
 renderings_t * renderings_init(GList * objects,const amide_time_t start, const amide_time_t duration,
 			       const gboolean zero_fill, const gboolean optimize_rendering, 
 			       const gboolean no_gradient_opacity,
+			       const renderer_t renderer,
 			       const amide_real_t fov,
 			       const AmitkPoint view_center,
 			       AmitkUpdateFunc update_func,
@@ -1138,7 +1434,7 @@ renderings_t * renderings_init(GList * objects,const amide_time_t start, const a
 
   /* and generate our rendering list */
   return_list = renderings_init_recurse(objects, render_volume,voxel_size, start, duration, 
-					zero_fill, optimize_rendering, no_gradient_opacity,
+					zero_fill, optimize_rendering, no_gradient_opacity, renderer,
 					update_func, update_data);
   amitk_object_unref(render_volume);
   return return_list;
@@ -1257,8 +1553,12 @@ void renderings_set_depth_cueing_parameters(renderings_t * renderings,
 /* to render a list of rendering contexts... */
 void renderings_render(renderings_t * renderings) {
 
+  gint64 trace_start;
+
  while (renderings != NULL) {
+    trace_start = AMITK_TRACE_BEGIN();
     rendering_render(renderings->rendering);
+    AMITK_TRACE_END("rendering_render", trace_start);
     renderings = renderings->next;
   }
 
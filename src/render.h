@@ -32,6 +32,7 @@
 #include <volpack.h>
 #include "amitk_object.h"
 #include "amitk_data_set.h"
+#include "render_raycast.h"
 
 /* -------------- structures and such ------------- */
 
@@ -42,6 +43,7 @@ typedef enum {DENSITY_CLASSIFICATION, GRADIENT_CLASSIFICATION, NUM_CLASSIFICATIO
 typedef enum {HIGHEST, HIGH, FAST, FASTEST, NUM_QUALITIES} rendering_quality_t;
 typedef enum {OPACITY, GRAYSCALE, NUM_PIXEL_TYPES} pixel_type_t;
 typedef enum {CURVE_LINEAR, CURVE_SPLINE, NUM_CURVE_TYPES} curve_type_t;
+typedef enum {RENDERER_VOLPACK, RENDERER_RAY_CAST, NUM_RENDERERS} renderer_t;
 
 typedef struct {        /*   contents of a voxel */
   rendering_normal_t normal;        /*   encoded surface normal vector */
@@ -109,11 +111,16 @@ extern rendering_voxel_t * dummy_voxel;
 #define RENDERING_DEFAULT_FRONT_FACTOR 1.0
 #define RENDERING_DEFAULT_DENSITY 1.0
 
+#define RENDERING_VOLUME_CACHE_SIZE 512 /* MB of extracted volumes kept per rendering context */
+
 /* ------------ some more structures ------------ */
 
 /* our rendering context structure */
 typedef struct _rendering_t {
+  renderer_t renderer;
   vpContext * vpc;      /*  VolPack rendering Context */
+  raycast_volume_t * raycast; /* used instead of vpc's volume by the ray caster */
+  GList * volume_cache; /* extracted volumes for each frame/gate, most recently used first */
   AmitkObject * object;
   gchar * name;
   AmitkColorTable color_table;
@@ -128,6 +135,12 @@ typedef struct _rendering_t {
   amide_real_t voxel_size; /* volpack needs isotropic voxels */
   AmitkVoxel dim; /* dimensions of our rendering_data and image */
   guchar * image;
+  gint image_dim; /* image is image_dim x image_dim */
+  gdouble max_ray_opacity;
+  gdouble min_voxel_opacity;
+  gboolean depth_cueing;
+  gdouble front_factor;
+  gdouble depth_cueing_density;
   gfloat shade_table[RENDERING_NORMAL_MAX+1];	/* shading lookup table */
   gfloat density_ramp[RENDERING_DENSITY_MAX+1]; /* opacity as a function */
   gfloat gradient_ramp[RENDERING_GRADIENT_MAX+1]; /* opacity as a function */
@@ -168,6 +181,7 @@ rendering_t * rendering_init(const AmitkObject * object,
 			     const gboolean zero_fill,
 			     const gboolean optimize_rendering,
 			     const gboolean no_gradient_opacity,
+			     const renderer_t renderer,
 			     AmitkUpdateFunc update_func,
 			     gpointer update_data);
 gboolean rendering_reload_object(rendering_t * rendering, 
@@ -194,6 +208,7 @@ renderings_t * renderings_init(GList * objects,
 			       const gboolean zero_fill,
 			       const gboolean optimize_rendering,
 			       const gboolean no_gradient_opacity,
+			       const renderer_t renderer,
 			       const amide_real_t fov,
 			       const AmitkPoint view_center,
 			       AmitkUpdateFunc update_func,
@@ -217,6 +232,7 @@ guint renderings_count(renderings_t * renderings);
 /* external variables */
 extern gchar * rendering_quality_names[];
 extern gchar * pixel_type_names[];
+extern gchar * renderer_names[];
 
 
 
@@ -0,0 +1,570 @@
+/* render_raycast.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+/* notes
+   - a software ray caster, used in place of volpack when picked.  Densities
+     are kept as floats on the same 0 to RENDERING_DENSITY_MAX scale that
+     volpack uses, so the density and gradient ramps work unchanged, without
+     the 8 bit quantization
+   - the geometry follows volpack: the volume is centered on the origin, the
+     largest dimension spans the image, and the model matrix rows are the
+     rendering axes.  Rays are orthographic along -z in view space, with one
+     sample per voxel of travel
+   - opacity is density_ramp(density) * gradient_ramp(gradient magnitude),
+     both linearly interpolated, as in volpack's classification
+   - shading is a simple two sided headlight on the per voxel normals
+   - empty space is skipped with a two level min/max tree, bricks of
+     RAYCAST_BRICK_SIZE^3 voxels and blocks of RAYCAST_BLOCK_SIZE^3 bricks.
+     Classifying marks the bricks that can't produce an opacity above the
+     minimum voxel opacity for any value in their range.  Rays stop early once
+     they reach the maximum ray opacity.
+   - the image is split into tiles which are rendered on multiple threads
+*/
+
+#include "amide_config.h"
+
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+
+#include <math.h>
+#include <string.h>
+#include "amide_intl.h"
+#include "amitk_parallel.h"
+#include "render_raycast.h"
+
+#define RAYCAST_AMBIENT 0.2
+#define RAYCAST_DIFFUSE 0.8
+
+#define RAYCAST_BLOCK_VOXELS (RAYCAST_BRICK_SIZE*RAYCAST_BLOCK_SIZE)
+
+typedef struct {
+  gfloat density_min;
+  gfloat density_max;
+  gfloat gradient_min;
+  gfloat gradient_max;
+} brick_range_t;
+
+struct _raycast_volume_t {
+  AmitkVoxel dim;
+  gint density_max;
+  gint gradient_max;
+  gfloat * density; /* 0 to density_max */
+  gfloat * gradient; /* gradient magnitude, 0 to gradient_max */
+  gint8 * normals; /* 3 per voxel, unit normal * 127 */
+  gfloat * density_ramp; /* density_max+1 entries */
+  gfloat * gradient_ramp; /* gradient_max+1 entries */
+
+  /* the min/max tree */
+  AmitkVoxel brick_dim;
+  AmitkVoxel block_dim;
+  brick_range_t * brick_ranges;
+  guchar * brick_empty;
+  guchar * block_empty;
+};
+
+typedef struct {
+  const raycast_volume_t * volume;
+  const raycast_parameters_t * parameters;
+  guchar * image;
+  gint image_dim;
+  gint num_tiles_x;
+  AmitkPoint origin; /* center of pixel (0,0) on the front plane, in voxels */
+  AmitkPoint du; /* one pixel step along the image x axis */
+  AmitkPoint dv; /* one pixel step along the image y axis */
+  AmitkPoint dir; /* one voxel step along the ray, front to back */
+  AmitkPoint light; /* toward the viewer */
+  gdouble ray_length; /* front plane to back plane */
+} render_t;
+
+#define VOXEL_INDEX(volume, i_x, i_y, i_z) \
+  ((i_x) + (gsize) (volume)->dim.x*((i_y) + (gsize) (volume)->dim.y*(i_z)))
+
+
+/* gradients by central differences (one sided at the edges), in density units per voxel */
+static void gradient_planes(gint start, gint end, gpointer data) {
+
+  raycast_volume_t * volume = data;
+  gint x, y, z;
+  gint xm, xp, ym, yp, zm, zp;
+  gfloat gx, gy, gz, magnitude;
+  gsize i;
+
+  for (z=start; z < end; z++) {
+    zm = MAX(z-1, 0);
+    zp = MIN(z+1, volume->dim.z-1);
+    for (y=0; y < volume->dim.y; y++) {
+      ym = MAX(y-1, 0);
+      yp = MIN(y+1, volume->dim.y-1);
+      for (x=0; x < volume->dim.x; x++) {
+	xm = MAX(x-1, 0);
+	xp = MIN(x+1, volume->dim.x-1);
+	i = VOXEL_INDEX(volume, x, y, z);
+
+	gx = (xp == xm) ? 0.0 :
+	  (volume->density[VOXEL_INDEX(volume, xp, y, z)]-volume->density[VOXEL_INDEX(volume, xm, y, z)])/(xp-xm);
+	gy = (yp == ym) ? 0.0 :
+	  (volume->density[VOXEL_INDEX(volume, x, yp, z)]-volume->density[VOXEL_INDEX(volume, x, ym, z)])/(yp-ym);
+	gz = (zp == zm) ? 0.0 :
+	  (volume->density[VOXEL_INDEX(volume, x, y, zp)]-volume->density[VOXEL_INDEX(volume, x, y, zm)])/(zp-zm);
+	magnitude = sqrt(gx*gx+gy*gy+gz*gz);
+
+	if (magnitude > 0.0) {
+	  volume->normals[3*i+0] = rint(127.0*gx/magnitude);
+	  volume->normals[3*i+1] = rint(127.0*gy/magnitude);
+	  volume->normals[3*i+2] = rint(127.0*gz/magnitude);
+	} else {
+	  volume->normals[3*i+0] = volume->normals[3*i+1] = volume->normals[3*i+2] = 0;
+	}
+	volume->gradient[i] = MIN(magnitude, volume->gradient_max);
+      }
+    }
+  }
+
+  return;
+}
+
+/* the value ranges over each brick, including the next voxel over on each axis
+   as trilinear interpolation reaches that far */
+static void brick_range_planes(gint start, gint end, gpointer data) {
+
+  raycast_volume_t * volume = data;
+  gint bx, by, bz;
+  gint x, y, z;
+  gint x_end, y_end, z_end;
+  brick_range_t * range;
+  gsize i;
+
+  for (bz=start; bz < end; bz++)
+    for (by=0; by < volume->brick_dim.y; by++)
+      for (bx=0; bx < volume->brick_dim.x; bx++) {
+	range = &(volume->brick_ranges[bx + (gsize) volume->brick_dim.x*(by + (gsize) volume->brick_dim.y*bz)]);
+	range->density_min = range->gradient_min = G_MAXFLOAT;
+	range->density_max = range->gradient_max = -G_MAXFLOAT;
+
+	x_end = MIN((bx+1)*RAYCAST_BRICK_SIZE, volume->dim.x-1);
+	y_end = MIN((by+1)*RAYCAST_BRICK_SIZE, volume->dim.y-1);
+	z_end = MIN((bz+1)*RAYCAST_BRICK_SIZE, volume->dim.z-1);
+	for (z=bz*RAYCAST_BRICK_SIZE; z <= z_end; z++)
+	  for (y=by*RAYCAST_BRICK_SIZE; y <= y_end; y++)
+	    for (x=bx*RAYCAST_BRICK_SIZE; x <= x_end; x++) {
+	      i = VOXEL_INDEX(volume, x, y, z);
+	      if (volume->density[i] < range->density_min) range->density_min = volume->density[i];
+	      if (volume->density[i] > range->density_max) range->density_max = volume->density[i];
+	      if (volume->gradient[i] < range->gradient_min) range->gradient_min = volume->gradient[i];
+	      if (volume->gradient[i] > range->gradient_max) range->gradient_max = volume->gradient[i];
+	    }
+      }
+
+  return;
+}
+
+/* takes over the density data, which should be dim.x*dim.y*dim.z floats from 0 to density_max */
+raycast_volume_t * raycast_volume_new(const AmitkVoxel dim,
+				      gfloat * density,
+				      const gint density_max,
+				      const gint gradient_max) {
+
+  raycast_volume_t * volume;
+  gsize num_voxels;
+  gsize num_bricks;
+  gsize num_blocks;
+
+  g_return_val_if_fail(density != NULL, NULL);
+
+  if ((volume = g_try_new0(raycast_volume_t, 1)) == NULL) {
+    g_warning(_("couldn't allocate memory space for the ray casting volume"));
+    g_free(density);
+    return NULL;
+  }
+  volume->dim = dim;
+  volume->density = density;
+  volume->density_max = density_max;
+  volume->gradient_max = gradient_max;
+
+  volume->brick_dim.x = (dim.x+RAYCAST_BRICK_SIZE-1)/RAYCAST_BRICK_SIZE;
+  volume->brick_dim.y = (dim.y+RAYCAST_BRICK_SIZE-1)/RAYCAST_BRICK_SIZE;
+  volume->brick_dim.z = (dim.z+RAYCAST_BRICK_SIZE-1)/RAYCAST_BRICK_SIZE;
+  volume->block_dim.x = (volume->brick_dim.x+RAYCAST_BLOCK_SIZE-1)/RAYCAST_BLOCK_SIZE;
+  volume->block_dim.y = (volume->brick_dim.y+RAYCAST_BLOCK_SIZE-1)/RAYCAST_BLOCK_SIZE;
+  volume->block_dim.z = (volume->brick_dim.z+RAYCAST_BLOCK_SIZE-1)/RAYCAST_BLOCK_SIZE;
+
+  num_voxels = dim.x * (gsize) dim.y * (gsize) dim.z;
+  num_bricks = volume->brick_dim.x * (gsize) volume->brick_dim.y * (gsize) volume->brick_dim.z;
+  num_blocks = volume->block_dim.x * (gsize) volume->block_dim.y * (gsize) volume->block_dim.z;
+
+  volume->gradient = g_try_new(gfloat, num_voxels);
+  volume->normals = g_try_new(gint8, 3*num_voxels);
+  volume->density_ramp = g_try_new0(gfloat, density_max+1);
+  volume->gradient_ramp = g_try_new0(gfloat, gradient_max+1);
+  volume->brick_ranges = g_try_new(brick_range_t, num_bricks);
+  volume->brick_empty = g_try_new0(guchar, num_bricks);
+  volume->block_empty = g_try_new0(guchar, num_blocks);
+  if ((volume->gradient == NULL) || (volume->normals == NULL) ||
+      (volume->density_ramp == NULL) || (volume->gradient_ramp == NULL) ||
+      (volume->brick_ranges == NULL) || (volume->brick_empty == NULL) ||
+      (volume->block_empty == NULL)) {
+    g_warning(_("couldn't allocate memory space for the ray casting volume"));
+    raycast_volume_free(volume);
+    return NULL;
+  }
+
+  amitk_parallel_for(dim.z, 1, gradient_planes, volume, NULL, NULL);
+  amitk_parallel_for(volume->brick_dim.z, 1, brick_range_planes, volume, NULL, NULL);
+
+  return volume;
+}
+
+void raycast_volume_free(raycast_volume_t * volume) {
+
+  if (volume == NULL) return;
+
+  g_free(volume->density);
+  g_free(volume->gradient);
+  g_free(volume->normals);
+  g_free(volume->density_ramp);
+  g_free(volume->gradient_ramp);
+  g_free(volume->brick_ranges);
+  g_free(volume->brick_empty);
+  g_free(volume->block_empty);
+  g_free(volume);
+
+  return;
+}
+
+/* largest ramp value that any value in [min, max] can interpolate to */
+static gfloat ramp_max(const gfloat * ramp, const gint ramp_max_index, const gfloat min, const gfloat max) {
+
+  gint i, start, end;
+  gfloat result=0.0;
+
+  start = CLAMP((gint) floor(min), 0, ramp_max_index);
+  end = CLAMP((gint) ceil(max), 0, ramp_max_index);
+  for (i=start; i <= end; i++)
+    if (ramp[i] > result) result = ramp[i];
+
+  return result;
+}
+
+typedef struct {
+  raycast_volume_t * volume;
+  gdouble min_voxel_opacity;
+} classify_t;
+
+static void classify_bricks(gint start, gint end, gpointer data) {
+
+  classify_t * classify = data;
+  raycast_volume_t * volume = classify->volume;
+  brick_range_t * range;
+  gfloat max_opacity;
+  gint i;
+
+  for (i=start; i < end; i++) {
+    range = &(volume->brick_ranges[i]);
+    max_opacity = ramp_max(volume->density_ramp, volume->density_max,
+			   range->density_min, range->density_max);
+    if (max_opacity > 0.0)
+      max_opacity *= ramp_max(volume->gradient_ramp, volume->gradient_max,
+			      range->gradient_min, range->gradient_max);
+    volume->brick_empty[i] = (max_opacity <= 0.0) || (max_opacity < classify->min_voxel_opacity);
+  }
+
+  return;
+}
+
+/* figure out which parts of the volume are empty for the given opacity functions */
+void raycast_volume_classify(raycast_volume_t * volume,
+			     const gfloat * density_ramp,
+			     const gfloat * gradient_ramp,
+			     const gdouble min_voxel_opacity) {
+
+  classify_t classify;
+  AmitkVoxel i_brick, i_block;
+  gsize num_bricks;
+
+  g_return_if_fail(volume != NULL);
+
+  memcpy(volume->density_ramp, density_ramp, (volume->density_max+1)*sizeof(gfloat));
+  memcpy(volume->gradient_ramp, gradient_ramp, (volume->gradient_max+1)*sizeof(gfloat));
+
+  classify.volume = volume;
+  classify.min_voxel_opacity = min_voxel_opacity;
+  num_bricks = volume->brick_dim.x * (gsize) volume->brick_dim.y * (gsize) volume->brick_dim.z;
+  amitk_parallel_for(num_bricks, 1024, classify_bricks, &classify, NULL, NULL);
+
+  /* a block is empty if all its bricks are */
+  memset(volume->block_empty, TRUE,
+	 volume->block_dim.x * (gsize) volume->block_dim.y * (gsize) volume->block_dim.z);
+  for (i_brick.z=0; i_brick.z < volume->brick_dim.z; i_brick.z++) {
+    i_block.z = i_brick.z/RAYCAST_BLOCK_SIZE;
+    for (i_brick.y=0; i_brick.y < volume->brick_dim.y; i_brick.y++) {
+      i_block.y = i_brick.y/RAYCAST_BLOCK_SIZE;
+      for (i_brick.x=0; i_brick.x < volume->brick_dim.x; i_brick.x++) {
+	i_block.x = i_brick.x/RAYCAST_BLOCK_SIZE;
+	if (!volume->brick_empty[i_brick.x + (gsize) volume->brick_dim.x*
+				 (i_brick.y + (gsize) volume->brick_dim.y*i_brick.z)])
+	  volume->block_empty[i_block.x + (gsize) volume->block_dim.x*
+			      (i_block.y + (gsize) volume->block_dim.y*i_block.z)] = FALSE;
+      }
+    }
+  }
+
+  return;
+}
+
+static inline gfloat ramp_lookup(const gfloat * ramp, const gint ramp_max_index, const gfloat value) {
+
+  gint i;
+  gfloat fraction;
+
+  if (value <= 0.0) return ramp[0];
+  i = (gint) value;
+  if (i >= ramp_max_index) return ramp[ramp_max_index];
+  fraction = value - i;
+
+  return ramp[i] + fraction*(ramp[i+1]-ramp[i]);
+}
+
+/* the distance along the ray to where it leaves the cube of the given size
+   starting at corner (in voxels), from position p */
+static inline gdouble cell_exit(const AmitkPoint p, const AmitkPoint dir,
+				const AmitkVoxel corner, const gint size) {
+
+  gdouble exit = G_MAXDOUBLE;
+  gdouble temp;
+
+  if (dir.x > 0.0) {temp = (corner.x+size-p.x)/dir.x; if (temp < exit) exit = temp;}
+  else if (dir.x < 0.0) {temp = (corner.x-p.x)/dir.x; if (temp < exit) exit = temp;}
+  if (dir.y > 0.0) {temp = (corner.y+size-p.y)/dir.y; if (temp < exit) exit = temp;}
+  else if (dir.y < 0.0) {temp = (corner.y-p.y)/dir.y; if (temp < exit) exit = temp;}
+  if (dir.z > 0.0) {temp = (corner.z+size-p.z)/dir.z; if (temp < exit) exit = temp;}
+  else if (dir.z < 0.0) {temp = (corner.z-p.z)/dir.z; if (temp < exit) exit = temp;}
+
+  return exit;
+}
+
+/* returns the intersection of the ray with the volume's extent along the ray, FALSE if it misses */
+static gboolean clip_ray(const AmitkPoint p0, const AmitkPoint dir, const AmitkVoxel dim,
+			 gdouble * pt_near, gdouble * pt_far) {
+
+  gdouble t_near = -G_MAXDOUBLE;
+  gdouble t_far = G_MAXDOUBLE;
+  gdouble t1, t2, temp;
+  gdouble p[3] = {p0.x, p0.y, p0.z};
+  gdouble d[3] = {dir.x, dir.y, dir.z};
+  gint size[3] = {dim.x, dim.y, dim.z};
+  gint i;
+
+  for (i=0; i < 3; i++) {
+    if (d[i] == 0.0) {
+      if ((p[i] < -0.5) || (p[i] > size[i]-0.5)) return FALSE;
+    } else {
+      t1 = (-0.5-p[i])/d[i];
+      t2 = (size[i]-0.5-p[i])/d[i];
+      if (t1 > t2) {temp = t1; t1 = t2; t2 = temp;}
+      if (t1 > t_near) t_near = t1;
+      if (t2 < t_far) t_far = t2;
+    }
+  }
+
+  *pt_near = t_near;
+  *pt_far = t_far;
+
+  return (t_near <= t_far);
+}
+
+static guchar cast_ray(const render_t * render, const AmitkPoint p0) {
+
+  const raycast_volume_t * volume = render->volume;
+  const raycast_parameters_t * parameters = render->parameters;
+  gdouble t, t_far, t_exit;
+  AmitkPoint p;
+  AmitkVoxel i0, i1, corner;
+  gdouble fx, fy, fz;
+  gdouble density, gradient, opacity, shade, weight;
+  gdouble c00, c01, c10, c11;
+  gdouble opacity_sum=0.0, luminance_sum=0.0;
+  const gint8 * normal;
+  gsize i000, dx, dy, dz;
+  gdouble value;
+
+  if (!clip_ray(p0, render->dir, volume->dim, &t, &t_far))
+    return 0;
+  t = ceil(t); /* keep samples on a fixed grid, so things don't shimmer when rotating */
+
+  while (t <= t_far) {
+    p.x = CLAMP(p0.x + t*render->dir.x, 0.0, volume->dim.x-1);
+    p.y = CLAMP(p0.y + t*render->dir.y, 0.0, volume->dim.y-1);
+    p.z = CLAMP(p0.z + t*render->dir.z, 0.0, volume->dim.z-1);
+    i0.x = p.x; i0.y = p.y; i0.z = p.z;
+
+    /* skip over empty blocks and bricks */
+    corner.x = (i0.x/RAYCAST_BLOCK_VOXELS);
+    corner.y = (i0.y/RAYCAST_BLOCK_VOXELS);
+    corner.z = (i0.z/RAYCAST_BLOCK_VOXELS);
+    if (volume->block_empty[corner.x + (gsize) volume->block_dim.x*(corner.y + (gsize) volume->block_dim.y*corner.z)]) {
+      corner.x *= RAYCAST_BLOCK_VOXELS; corner.y *= RAYCAST_BLOCK_VOXELS; corner.z *= RAYCAST_BLOCK_VOXELS;
+      t_exit = t + cell_exit(p, render->dir, corner, RAYCAST_BLOCK_VOXELS);
+      t = MAX(t+1.0, ceil(t_exit));
+      continue;
+    }
+    corner.x = (i0.x/RAYCAST_BRICK_SIZE);
+    corner.y = (i0.y/RAYCAST_BRICK_SIZE);
+    corner.z = (i0.z/RAYCAST_BRICK_SIZE);
+    if (volume->brick_empty[corner.x + (gsize) volume->brick_dim.x*(corner.y + (gsize) volume->brick_dim.y*corner.z)]) {
+      corner.x *= RAYCAST_BRICK_SIZE; corner.y *= RAYCAST_BRICK_SIZE; corner.z *= RAYCAST_BRICK_SIZE;
+      t_exit = t + cell_exit(p, render->dir, corner, RAYCAST_BRICK_SIZE);
+      t = MAX(t+1.0, ceil(t_exit));
+      continue;
+    }
+
+    /* trilinear interpolation of the density and gradient */
+    i1.x = MIN(i0.x+1, volume->dim.x-1);
+    i1.y = MIN(i0.y+1, volume->dim.y-1);
+    i1.z = MIN(i0.z+1, volume->dim.z-1);
+    fx = p.x-i0.x; fy = p.y-i0.y; fz = p.z-i0.z;
+    i000 = VOXEL_INDEX(volume, i0.x, i0.y, i0.z);
+    dx = i1.x-i0.x;
+    dy = (i1.y-i0.y)*(gsize) volume->dim.x;
+    dz = (i1.z-i0.z)*(gsize) volume->dim.x*(gsize) volume->dim.y;
+
+#define TRILINEAR(data) \
+    (c00 = data[i000]      + fx*(data[i000+dx]      - data[i000]), \
+     c10 = data[i000+dy]    + fx*(data[i000+dy+dx]    - data[i000+dy]), \
+     c01 = data[i000+dz]    + fx*(data[i000+dz+dx]    - data[i000+dz]), \
+     c11 = data[i000+dy+dz] + fx*(data[i000+dy+dz+dx] - data[i000+dy+dz]), \
+     c00 += fy*(c10-c00), \
+     c01 += fy*(c11-c01), \
+     c00 + fz*(c01-c00))
+
+    density = TRILINEAR(volume->density);
+    opacity = ramp_lookup(volume->density_ramp, volume->density_max, density);
+    if (opacity > 0.0) {
+      gradient = TRILINEAR(volume->gradient);
+      opacity *= ramp_lookup(volume->gradient_ramp, volume->gradient_max, gradient);
+    }
+#undef TRILINEAR
+
+    if ((opacity > 0.0) && (opacity >= parameters->min_voxel_opacity)) {
+      weight = (1.0-opacity_sum)*opacity;
+
+      if (parameters->shade) {
+	normal = &(volume->normals[3*VOXEL_INDEX(volume, (gint) rint(p.x), (gint) rint(p.y), (gint) rint(p.z))]);
+	shade = fabs(normal[0]*render->light.x + normal[1]*render->light.y + normal[2]*render->light.z)/127.0;
+	shade = RAYCAST_AMBIENT + RAYCAST_DIFFUSE*shade;
+	if (parameters->depth_cueing)
+	  shade *= parameters->front_factor*exp(-parameters->density*t/render->ray_length);
+	luminance_sum += weight*shade;
+      }
+
+      opacity_sum += weight;
+      if (opacity_sum >= parameters->max_ray_opacity) break;
+    }
+
+    t += 1.0;
+  }
+
+  value = parameters->shade ? luminance_sum : opacity_sum;
+  value = rint(255.0*value);
+
+  return (value > 255.0) ? 255 : ((value < 0.0) ? 0 : value);
+}
+
+static void render_tiles(gint start, gint end, gpointer data) {
+
+  render_t * render = data;
+  gint i_tile;
+  gint u, v, u_start, v_start, u_end, v_end;
+  AmitkPoint row, p0;
+
+  for (i_tile=start; i_tile < end; i_tile++) {
+    u_start = (i_tile % render->num_tiles_x)*RAYCAST_TILE_SIZE;
+    v_start = (i_tile / render->num_tiles_x)*RAYCAST_TILE_SIZE;
+    u_end = MIN(u_start+RAYCAST_TILE_SIZE, render->image_dim);
+    v_end = MIN(v_start+RAYCAST_TILE_SIZE, render->image_dim);
+
+    for (v=v_start; v < v_end; v++) {
+      row = point_add(render->origin, point_cmult(v, render->dv));
+      for (u=u_start; u < u_end; u++) {
+	p0 = point_add(row, point_cmult(u, render->du));
+	render->image[u + v*render->image_dim] = cast_ray(render, p0);
+      }
+    }
+  }
+
+  return;
+}
+
+/* renders the volume into image, which is image_dim x image_dim.  The rows of axes
+   are the view's x, y, and z axes in the volume's frame, same as volpack's model matrix */
+void raycast_render(const raycast_volume_t * volume,
+		    const AmitkAxes axes,
+		    const raycast_parameters_t * parameters,
+		    guchar * image,
+		    const gint image_dim) {
+
+  render_t render;
+  AmitkPoint center;
+  gdouble pixel_size;
+  gdouble half_depth;
+  gdouble half_width;
+  gint num_tiles_y;
+
+  g_return_if_fail(volume != NULL);
+  g_return_if_fail(image != NULL);
+  if (image_dim <= 0) return;
+
+  render.volume = volume;
+  render.parameters = parameters;
+  render.image = image;
+  render.image_dim = image_dim;
+
+  /* voxel coordinates of the volume's center */
+  center.x = (volume->dim.x-1)/2.0;
+  center.y = (volume->dim.y-1)/2.0;
+  center.z = (volume->dim.z-1)/2.0;
+
+  /* the largest dimension spans the image, rays start and end on the bounding sphere */
+  pixel_size = ((gdouble) MAX(MAX(volume->dim.x, volume->dim.y), volume->dim.z))/image_dim;
+  half_width = pixel_size*(image_dim/2.0 - 0.5);
+  half_depth = 0.5*sqrt(volume->dim.x*volume->dim.x + volume->dim.y*volume->dim.y +
+			volume->dim.z*volume->dim.z);
+
+  render.du = point_cmult(pixel_size, axes[AMITK_AXIS_X]);
+  render.dv = point_cmult(pixel_size, axes[AMITK_AXIS_Y]);
+  render.dir = point_cmult(-1.0, axes[AMITK_AXIS_Z]);
+  render.light = axes[AMITK_AXIS_Z];
+  render.ray_length = 2.0*half_depth;
+  render.origin = point_add(center, point_cmult(half_depth, axes[AMITK_AXIS_Z]));
+  render.origin = point_sub(render.origin, point_cmult(half_width, axes[AMITK_AXIS_X]));
+  render.origin = point_sub(render.origin, point_cmult(half_width, axes[AMITK_AXIS_Y]));
+
+  render.num_tiles_x = (image_dim+RAYCAST_TILE_SIZE-1)/RAYCAST_TILE_SIZE;
+  num_tiles_y = (image_dim+RAYCAST_TILE_SIZE-1)/RAYCAST_TILE_SIZE;
+
+  amitk_parallel_for(render.num_tiles_x*num_tiles_y, 1, render_tiles, &render, NULL, NULL);
+
+  return;
+}
+
+#endif /* AMIDE_LIBVOLPACK_SUPPORT */
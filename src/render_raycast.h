@@ -0,0 +1,71 @@
+/* render_raycast.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+
+#ifndef __RENDER_RAYCAST_H__
+#define __RENDER_RAYCAST_H__
+
+/* header files that are always needed with this file */
+#include "amitk_point.h"
+
+/* -------------- defines ------------- */
+
+#define RAYCAST_BRICK_SIZE 8 /* voxels along each edge of a brick */
+#define RAYCAST_BLOCK_SIZE 8 /* bricks along each edge of a block */
+#define RAYCAST_TILE_SIZE 16 /* pixels along each edge of an image tile */
+
+/* -------------- structures and such ------------- */
+
+typedef struct {
+  gdouble max_ray_opacity; /* rays stop once this opaque */
+  gdouble min_voxel_opacity; /* samples less opaque than this are ignored */
+  gboolean shade; /* FALSE to just return the accumulated opacity */
+  gboolean depth_cueing;
+  gdouble front_factor;
+  gdouble density;
+} raycast_parameters_t;
+
+typedef struct _raycast_volume_t raycast_volume_t;
+
+
+/* external functions */
+raycast_volume_t * raycast_volume_new(const AmitkVoxel dim,
+				      gfloat * density,
+				      const gint density_max,
+				      const gint gradient_max);
+void               raycast_volume_free(raycast_volume_t * volume);
+void               raycast_volume_classify(raycast_volume_t * volume,
+					   const gfloat * density_ramp,
+					   const gfloat * gradient_ramp,
+					   const gdouble min_voxel_opacity);
+void               raycast_render(const raycast_volume_t * volume,
+				  const AmitkAxes axes,
+				  const raycast_parameters_t * parameters,
+				  guchar * image,
+				  const gint image_dim);
+
+#endif /* __RENDER_RAYCAST_H__ */
+#endif /* AMIDE_LIBVOLPACK_SUPPORT */
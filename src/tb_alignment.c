@@ -60,9 +60,14 @@ N_("Welcome to the data set alignment wizard, used for "
    "registration utilizing fiducial marks is not supported."
 #endif
    "\n\n"
-   "The mutual information algorithm is run on the "
-   "currently displayed slices, not the whole data "
-   "sets.");
+   "The mutual information algorithms are run on the "
+   "whole data sets, over the currently displayed "
+#ifdef AMIDE_LIBGSL_SUPPORT
+   "frames.  The multi-resolution version works coarse "
+   "to fine and is usually both faster and more robust.");
+#else
+   "frames.");
+#endif
 
 
 typedef enum {
@@ -93,6 +98,9 @@ typedef enum {
   PROCRUSTES,
 #endif
   MUTUAL_INFORMATION,
+#ifdef AMIDE_LIBGSL_SUPPORT
+  MUTUAL_INFORMATION_MULTIRES,
+#endif
   NUM_ALIGNMENT_TYPES
 } which_alignment_t;
 
@@ -100,7 +108,10 @@ static gchar * alignment_names[] = {
 #ifdef AMIDE_LIBGSL_SUPPORT
   N_("Fiducial Markers"),
 #endif
-  N_("Mutual Information")
+  N_("Mutual Information"),
+#ifdef AMIDE_LIBGSL_SUPPORT
+  N_("Mutual Information, Multi-Resolution")
+#endif
 };
 
 /* data structures */
@@ -120,8 +131,6 @@ typedef struct tb_alignment_t {
   AmitkSpace * transform_space; /* the new coordinate space for the moving volume */
   amide_time_t view_start_time;
   amide_time_t view_duration;
-  AmitkPoint view_center;
-  amide_real_t view_thickness;
   
 
   guint reference_count;
@@ -580,6 +589,9 @@ static gint forward_page_function (gint current_page, gpointer data) {
     break;
   case DATA_SETS_PAGE:
     if (tb_alignment->alignment_type == MUTUAL_INFORMATION) return CONCLUSION_PAGE;
+#ifdef AMIDE_LIBGSL_SUPPORT
+    if (tb_alignment->alignment_type == MUTUAL_INFORMATION_MULTIRES) return CONCLUSION_PAGE;
+#endif
     if ((tb_alignment->fixed_ds != NULL) && (tb_alignment->moving_ds != NULL)) 
       num_pairs = amitk_objects_count_pairs_by_name(AMITK_OBJECT_CHILDREN(tb_alignment->fixed_ds),
 						    AMITK_OBJECT_CHILDREN(tb_alignment->moving_ds));
@@ -606,6 +618,10 @@ static void prepare_page_cb(GtkAssistant * wizard, GtkWidget * page, gpointer da
   which_alignment_t which_alignment;
   gdouble performance_metric;
   gchar * temp_string;
+#ifdef AMIDE_LIBGSL_SUPPORT
+  gint iterations;
+  GTimer * timer;
+#endif
 
   which_page = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(page), "which_page"));
   which_alignment = tb_alignment->alignment_type;
@@ -638,8 +654,6 @@ static void prepare_page_cb(GtkAssistant * wizard, GtkWidget * page, gpointer da
     case MUTUAL_INFORMATION:
       tb_alignment->transform_space = alignment_mutual_information(tb_alignment->moving_ds, 
 								   tb_alignment->fixed_ds,
-								   tb_alignment->view_center,
-								   tb_alignment->view_thickness,
 								   tb_alignment->view_start_time,
 								   tb_alignment->view_duration,
 								   &performance_metric,
@@ -648,6 +662,24 @@ static void prepare_page_cb(GtkAssistant * wizard, GtkWidget * page, gpointer da
       temp_string = g_strdup_printf(_("The alignment has been calculated, press Apply, or Cancel to quit.\n\nThe calculated mutual information metric is:\n\t %5.2f"),
 				    performance_metric);
       break;
+#ifdef AMIDE_LIBGSL_SUPPORT
+    case MUTUAL_INFORMATION_MULTIRES:
+      timer = g_timer_new();
+      tb_alignment->transform_space = alignment_mutual_information_multires(tb_alignment->moving_ds, 
+									    tb_alignment->fixed_ds,
+									    tb_alignment->view_start_time,
+									    tb_alignment->view_duration,
+									    ALIGNMENT_MI_NORMALIZED,
+									    &performance_metric,
+									    &iterations,
+									    amitk_progress_dialog_update,
+									    tb_alignment->progress_dialog);
+      g_timer_stop(timer);
+      temp_string = g_strdup_printf(_("The alignment has been calculated, press Apply, or Cancel to quit.\n\nThe calculated normalized mutual information metric is:\n\t %5.3f\n\nIterations: %d\nTime: %5.1f s"),
+				    performance_metric, iterations, g_timer_elapsed(timer, NULL));
+      g_timer_destroy(timer);
+      break;
+#endif
     default:
       g_return_if_reached();
       break;
@@ -682,8 +714,6 @@ void tb_alignment(AmitkStudy * study, GtkWindow * parent) {
 
   tb_alignment->view_start_time = AMITK_STUDY_VIEW_START_TIME(study);
   tb_alignment->view_duration = AMITK_STUDY_VIEW_DURATION(study);
-  tb_alignment->view_center = AMITK_STUDY_VIEW_CENTER(study);
-  tb_alignment->view_thickness = AMITK_STUDY_VIEW_THICKNESS(study);
 
   tb_alignment->dialog = gtk_assistant_new();
   gtk_window_set_transient_for(GTK_WINDOW(tb_alignment->dialog), parent);
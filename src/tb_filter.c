@@ -34,7 +34,7 @@
 #define LABEL_WIDTH 375
 
 #define MIN_FIR_FILTER_SIZE 7
-#define MAX_FIR_FILTER_SIZE 31
+#define MAX_FIR_FILTER_SIZE 101
 #define MIN_NONLINEAR_FILTER_SIZE 3
 #define MAX_NONLINEAR_FILTER_SIZE 11
 #define DEFAULT_GAUSSIAN_FILTER_SIZE 15
@@ -50,10 +50,11 @@ N_("When the apply button is hit, a new data set will be created "
    "and placed into the study's tree, consisting of the appropriately "
    "filtered data\n");
 
-#ifdef AMIDE_LIBGSL_SUPPORT
 static const char * gaussian_filter_text = 
-N_("The Gaussian filter is an effective smoothing filter");
-#endif
+N_("The Gaussian filter is an effective smoothing filter.\n"
+   "\n"
+   "The recursive version is an approximation whose speed doesn't\n"
+   "depend on the FWHM, and is not limited by the kernel size.");
 
 
 static const char * median_3d_filter_text = 
@@ -71,12 +72,6 @@ N_("Median filters work relatively well at preserving edges while\n"
    "determining the median will be of the given kernel size, and the\n"
    "data set will be filtered 3x (once for each direction).");
 
-#ifndef AMIDE_LIBGSL_SUPPORT
-static const char *no_libgsl_text =
-N_("This filter requires support from the GNU Scientific Library (GSL).\n"
-   "This version of AMIDE has not been compiled with GSL support enabled.");
-#endif
-
 
 typedef enum {
   PICK_FILTER_PAGE,
@@ -94,6 +89,8 @@ typedef struct tb_filter_t {
   AmitkFilter filter;
   gint kernel_size;
   amide_real_t fwhm;
+  gboolean recursive;
+  GtkWidget * gaussian_kernel_size_spin;
 
   AmitkDataSet * data_set;
   AmitkStudy * study;
@@ -108,6 +105,7 @@ typedef struct tb_filter_t {
 static void filter_cb(GtkWidget * widget, gpointer data);
 static void kernel_size_spinner_cb(GtkSpinButton * spin_button, gpointer data);
 static void fwhm_spinner_cb(GtkSpinButton * spin_button, gpointer data);
+static void recursive_toggle_cb(GtkToggleButton * button, gpointer data);
 
 static void apply_cb(GtkAssistant * assistant, gpointer data);
 static void close_cb(GtkAssistant * assistant, gpointer data);
@@ -174,19 +172,37 @@ static void fwhm_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
 
 
 
+static void recursive_toggle_cb(GtkToggleButton * button, gpointer data) {
+
+  tb_filter_t * tb_filter = data;
+
+  tb_filter->recursive = gtk_toggle_button_get_active(button);
+  gtk_widget_set_sensitive(tb_filter->gaussian_kernel_size_spin, !tb_filter->recursive);
+
+  return;
+}
+
+
 /* function called when the finish button is hit */
 static void apply_cb(GtkAssistant * assistant, gpointer data) {
 
   tb_filter_t * tb_filter = data;
   AmitkDataSet * filtered;
+  gint kernel_size;
 
   /* disable the buttons */
   gtk_widget_set_sensitive(GTK_WIDGET(assistant), FALSE);
 
+  /* a kernel size of 0 gets the recursive gaussian */
+  if ((tb_filter->filter == AMITK_FILTER_GAUSSIAN) && tb_filter->recursive)
+    kernel_size = 0;
+  else
+    kernel_size = tb_filter->kernel_size;
+
   /* generate the new data set */
   filtered = amitk_data_set_get_filtered(tb_filter->data_set, 
   					 tb_filter->filter,
-  					 tb_filter->kernel_size,
+  					 kernel_size,
   					 tb_filter->fwhm,
 					 amitk_progress_dialog_update,
 					 tb_filter->progress_dialog);
@@ -289,6 +305,8 @@ static tb_filter_t * tb_filter_init(void) {
   tb_filter->study = NULL;
   tb_filter->kernel_size=3;
   tb_filter->fwhm = 1.0;
+  tb_filter->recursive = FALSE;
+  tb_filter->gaussian_kernel_size_spin = NULL;
 
   return tb_filter;
 }
@@ -299,6 +317,7 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
 
   GtkWidget * label;
   GtkWidget * spin_button;
+  GtkWidget * check_button;
   gint table_row;
   gint table_column;
   AmitkFilter i_filter;
@@ -330,7 +349,6 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     
     break;
   case GAUSSIAN_FILTER_PAGE:
-#ifdef AMIDE_LIBGSL_SUPPORT
     tb_filter->kernel_size = DEFAULT_GAUSSIAN_FILTER_SIZE;
     
     label = gtk_label_new(_(gaussian_filter_text));
@@ -355,6 +373,22 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     gtk_table_attach(GTK_TABLE(table), spin_button, 
 		     table_column+1,table_column+2, table_row,table_row+1,
 		     FALSE,FALSE, X_PADDING, Y_PADDING);
+    tb_filter->gaussian_kernel_size_spin = spin_button;
+    table_row++;
+
+    /* recursive or not */
+    label = gtk_label_new(_("Recursive"));
+    gtk_table_attach(GTK_TABLE(table), label, 
+		     table_column,table_column+1, table_row,table_row+1,
+		     FALSE,FALSE, X_PADDING, Y_PADDING);
+
+    check_button = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_button), tb_filter->recursive);
+    g_signal_connect(G_OBJECT(check_button), "toggled",  
+		     G_CALLBACK(recursive_toggle_cb), tb_filter);
+    gtk_table_attach(GTK_TABLE(table), check_button, 
+		     table_column+1,table_column+2, table_row,table_row+1,
+		     FALSE,FALSE, X_PADDING, Y_PADDING);
     table_row++;
     
     label = gtk_label_new(_("FWHM (mm)"));
@@ -372,13 +406,6 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     gtk_table_attach(GTK_TABLE(table), spin_button, 
 		     table_column+1,table_column+2, table_row,table_row+1,
 		     FALSE,FALSE, X_PADDING, Y_PADDING);
-#else /* no libgsl support */
-    label = gtk_label_new(_(no_libgsl_text));
-    gtk_table_attach(GTK_TABLE(table), label, 
-		     table_column,table_column+2, table_row,table_row+1,
-		     FALSE,FALSE, X_PADDING, Y_PADDING);
-    table_row++;
-#endif
     break;
   case MEDIAN_3D_FILTER_PAGE:
   case MEDIAN_LINEAR_FILTER_PAGE:
@@ -476,10 +503,6 @@ void tb_filter(AmitkStudy * study, AmitkDataSet * active_ds, GtkWindow * parent)
   }
   g_object_unref(logo);
 
-#ifndef AMIDE_LIBGSL_SUPPORT
-  gtk_assistant_set_page_complete(GTK_ASSISTANT(tb_filter->dialog), tb_filter->page[GAUSSIAN_FILTER_PAGE], FALSE);
-#endif
-
   gtk_widget_show_all(tb_filter->dialog);
 
   return;
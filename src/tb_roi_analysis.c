@@ -30,6 +30,7 @@
 #include "amide.h"
 #include "amide_gconf.h"
 #include "amitk_common.h"
+#include "amitk_progress_dialog.h"
 #include "analysis.h"
 #include "tb_roi_analysis.h"
 #include "ui_common.h"
@@ -191,7 +192,9 @@ static void export_analyses(const gchar * save_filename, analysis_roi_t * roi_an
   amide_real_t voxel_volume;
   gboolean title_printed;
   AmitkPoint location;
-  analysis_element_t * element;
+  const analysis_data_t * data;
+  guint * order;
+  guint j;
 
   /* sanity checks */
   g_return_if_fail(save_filename != NULL);
@@ -318,12 +321,15 @@ static void export_analyses(const gchar * save_filename, analysis_roi_t * roi_an
 	  } else { /* raw data */
 	    fprintf(file_pointer, "#   Frame %d, Gate %d, Gate Time %5.3f\n", frame, gate,gate_analyses->gate_time);
 	    fprintf(file_pointer, "#      Value\t      Weight\t      X (mm)\t      Y (mm)\t      Z (mm)\n");
-	    for (i=0; i < gate_analyses->data_array->len; i++) {
-	      element = g_ptr_array_index(gate_analyses->data_array, i);
-	      VOXEL_TO_POINT(element->ds_voxel, AMITK_DATA_SET_VOXEL_SIZE(volume_analyses->data_set),location);
+	    data = &(gate_analyses->data);
+	    order = analysis_gate_sorted_order(gate_analyses); /* highest to lowest */
+	    for (i=0; i < data->len; i++) {
+	      j = (order != NULL) ? order[i] : i;
+	      VOXEL_TO_POINT(data->voxels[j], AMITK_DATA_SET_VOXEL_SIZE(volume_analyses->data_set),location);
 	      location = amitk_space_s2b(AMITK_SPACE(volume_analyses->data_set), location);
-	      fprintf(file_pointer, "%12g\t%12g\t%12g\t%12g\t%12g\n", element->value, element->weight, location.x, location.y, location.z);
+	      fprintf(file_pointer, "%12g\t%12g\t%12g\t%12g\t%12g\n", data->values[j], data->weights[j], location.x, location.y, location.z);
 	    }
+	    g_free(order);
 	  }
 
 	  gate_analyses = gate_analyses->next_gate_analysis;
@@ -774,6 +780,8 @@ void tb_roi_analysis(AmitkStudy * study, AmitkPreferences * preferences, GtkWind
   gchar * title;
   GList * rois;
   GList * data_sets;
+  GtkWidget * progress_dialog;
+  gboolean return_val;
 
   gboolean all_data_sets;
   gboolean all_rois;
@@ -816,12 +824,18 @@ void tb_roi_analysis(AmitkStudy * study, AmitkPreferences * preferences, GtkWind
   }
 
   /* calculate all our data */
+  progress_dialog = amitk_progress_dialog_new(parent);
   tb_roi_analysis->roi_analyses = analysis_roi_init(study, rois, data_sets, calculation_type, accurate, 
-						    subfraction, threshold_percentage, threshold_value);
+						    subfraction, threshold_percentage, threshold_value,
+						    amitk_progress_dialog_update, progress_dialog);
+  g_signal_emit_by_name(G_OBJECT(progress_dialog), "delete_event", NULL, &return_val);
 
   rois = amitk_objects_unref(rois);
   data_sets = amitk_objects_unref(data_sets);
-  g_return_if_fail(tb_roi_analysis->roi_analyses != NULL);
+  if (tb_roi_analysis->roi_analyses == NULL) { /* cancelled */
+    tb_roi_analysis_free(tb_roi_analysis);
+    return;
+  }
   
   /* start setting up the widget we'll display the info from */
   title = g_strdup_printf(_("%s Roi Analysis: Study %s"), PACKAGE, 
@@ -32,6 +32,9 @@
 #include "amitk_color_table_menu.h"
 #include "amitk_threshold.h"
 #include "amitk_window_edit.h"
+#include "amitk_parallel.h"
+#include "amitk_slice_cache.h"
+#include "amitk_trace.h"
 #include "ui_common.h"
 
 
@@ -61,9 +64,13 @@ static void target_empty_area_cb(GtkWidget * widget, gpointer data);
 static void threshold_style_cb(GtkWidget * widget, gpointer data);
 
 static void warnings_to_console_cb(GtkWidget * widget, gpointer data);
+static void trace_cb(GtkWidget * widget, gpointer data);
 static void save_on_exit_cb(GtkWidget * widget, gpointer data);
 static void which_default_directory_cb(GtkWidget * widget, gpointer data);
 static void default_directory_cb(GtkWidget * fc, gpointer data);
+static void compress_xif_cb(GtkWidget * widget, gpointer data);
+static void num_threads_cb(GtkWidget * widget, gpointer data);
+static void slice_cache_size_cb(GtkWidget * widget, gpointer data);
 static void response_cb (GtkDialog * dialog, gint response_id, gpointer data);
 static gboolean delete_event_cb(GtkWidget* widget, GdkEvent * event, gpointer preferences);
 
@@ -200,6 +207,14 @@ static void warnings_to_console_cb(GtkWidget * widget, gpointer data) {
   return;
 }
 
+static void trace_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_trace(ui_study->preferences, 
+			      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+  return;
+}
+
 
 static void save_on_exit_cb(GtkWidget * widget, gpointer data) {
 
@@ -231,6 +246,30 @@ static void default_directory_cb(GtkWidget * fc, gpointer data) {
   return;
 }
 
+static void compress_xif_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_compress_xif(ui_study->preferences, 
+				     gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+  return;
+}
+
+static void num_threads_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_num_threads(ui_study->preferences, 
+				    gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(widget)));
+  return;
+}
+
+static void slice_cache_size_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_slice_cache_size(ui_study->preferences, 
+					 gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(widget)));
+  return;
+}
+
 
 /* changing the color table of a rendering context */
 static void color_table_cb(GtkWidget * widget, gpointer data) {
@@ -286,6 +325,7 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
   
   GtkWidget * dialog;
   gchar * temp_string = NULL;
+  gchar * trace_filename;
   GtkWidget * packing_table;
   GtkWidget * label;
   GtkWidget * check_button;
@@ -295,6 +335,8 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
   GtkWidget * maintain_size_button;
   GtkWidget * roi_width_spin;
   GtkWidget * target_size_spin;
+  GtkWidget * threads_spin;
+  GtkWidget * cache_spin;
 #ifdef AMIDE_LIBGNOMECANVAS_AA
   GtkWidget * roi_transparency_spin;
 #else
@@ -564,6 +606,25 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
 		   GTK_FILL, 0, X_PADDING, Y_PADDING);
   table_row++;
 
+  trace_filename = amitk_trace_get_filename();
+  temp_string = g_strdup_printf(_("Record Performance Trace\n(written to %s when turned off or on exit):"),
+				trace_filename);
+  g_free(trace_filename);
+  label = gtk_label_new(temp_string);
+  g_free(temp_string);
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  check_button = gtk_check_button_new();
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_button), 
+			       AMITK_PREFERENCES_TRACE(ui_study->preferences));
+  g_signal_connect(G_OBJECT(check_button), "toggled", G_CALLBACK(trace_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), check_button, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+
 
   label = gtk_label_new(_("Prompt for \"Save Changes\" on Exit:"));
   gtk_table_attach(GTK_TABLE(packing_table), label, 
@@ -618,6 +679,53 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
 
   table_row++;
 
+#ifdef AMIDE_ZLIB_SUPPORT
+  label = gtk_label_new(_("Compress Data in .xif Files:"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  check_button = gtk_check_button_new();
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_button), 
+			       AMITK_PREFERENCES_COMPRESS_XIF(ui_study->preferences));
+  g_signal_connect(G_OBJECT(check_button), "toggled", G_CALLBACK(compress_xif_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), check_button, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+#endif
+
+
+  label = gtk_label_new(_("Processing Threads (0 = one per processor):"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  threads_spin = gtk_spin_button_new_with_range(0, AMITK_PARALLEL_MAX_THREADS, 1);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(threads_spin), 0);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(threads_spin), 
+			    AMITK_PREFERENCES_NUM_THREADS(ui_study->preferences));
+  g_signal_connect(G_OBJECT(threads_spin), "value_changed", G_CALLBACK(num_threads_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), threads_spin, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+
+  label = gtk_label_new(_("Slice Cache Size (MB):"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  cache_spin = gtk_spin_button_new_with_range(0, AMITK_SLICE_CACHE_MAX_SIZE, 16);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(cache_spin), 0);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(cache_spin), 
+			    AMITK_PREFERENCES_SLICE_CACHE_SIZE(ui_study->preferences));
+  g_signal_connect(G_OBJECT(cache_spin), "value_changed", G_CALLBACK(slice_cache_size_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), cache_spin, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+
   gtk_widget_show_all(packing_table);
 
   /* and show all our widgets */
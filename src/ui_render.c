@@ -61,7 +61,8 @@ static void close_cb(GtkAction * action, gpointer data);
 
 
 static void read_render_preferences(gboolean * strip_highs, gboolean * optimize_renderings,
-				    gboolean * initially_no_gradient_opacity);
+				    gboolean * initially_no_gradient_opacity,
+				    renderer_t * renderer);
 static ui_render_t * ui_render_init(GtkWindow * window, GtkWidget *window_vbox, AmitkStudy * study, GList * selected_objects, AmitkPreferences * preferences);
 static ui_render_t * ui_render_free(ui_render_t * ui_render);
 
@@ -644,7 +645,8 @@ static ui_render_t * ui_render_free(ui_render_t * ui_render) {
 
 
 static void read_render_preferences(gboolean * strip_highs, gboolean * optimize_renderings,
-				    gboolean * initially_no_gradient_opacity) {
+				    gboolean * initially_no_gradient_opacity,
+				    renderer_t * renderer) {
 
   *strip_highs = 
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"StripHighs");
@@ -652,6 +654,8 @@ static void read_render_preferences(gboolean * strip_highs, gboolean * optimize_
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"OptimizeRendering");
   *initially_no_gradient_opacity = 
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"InitiallyNoGradientOpacity");
+  *renderer = 
+    CLAMP(amide_gconf_get_int(GCONF_AMIDE_RENDERING,"Renderer"), 0, NUM_RENDERERS-1);
 
   return;
 }
@@ -668,8 +672,9 @@ static ui_render_t * ui_render_init(GtkWindow * window,
   gboolean strip_highs;
   gboolean optimize_rendering;
   gboolean initially_no_gradient_opacity;
+  renderer_t renderer;
 
-  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity);
+  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity, &renderer);
 
   /* alloc space for the data structure for passing ui info */
   if ((ui_render = g_try_new(ui_render_t,1)) == NULL) {
@@ -730,6 +735,7 @@ static ui_render_t * ui_render_init(GtkWindow * window,
 					  ui_render->start, 
 					  ui_render->duration, 
 					  strip_highs, optimize_rendering, initially_no_gradient_opacity,
+					  renderer,
 					  ui_render->fov,
 					  ui_render->view_center,
 					  ui_render->disable_progress_dialog ? NULL : amitk_progress_dialog_update,
@@ -1001,6 +1007,7 @@ void ui_render_create(AmitkStudy * study, GList * selected_objects, AmitkPrefere
 static void init_strip_highs_cb(GtkWidget * widget, gpointer data);
 static void init_optimize_rendering_cb(GtkWidget * widget, gpointer data);
 static void init_no_gradient_opacity_cb(GtkWidget * widget, gpointer data);
+static void init_renderer_cb(GtkWidget * widget, gpointer data);
 
 
 
@@ -1022,6 +1029,12 @@ static void init_no_gradient_opacity_cb(GtkWidget * widget, gpointer data) {
   return;
 }
 
+static void init_renderer_cb(GtkWidget * widget, gpointer data) {
+  amide_gconf_set_int(GCONF_AMIDE_RENDERING,"Renderer", 
+		      gtk_combo_box_get_active(GTK_COMBO_BOX(widget)));
+  return;
+}
+
 
 /* function to setup a dialog to allow us to choose options for rendering */
 GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent) {
@@ -1030,14 +1043,18 @@ GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent)
   gchar * temp_string;
   GtkWidget * table;
   GtkWidget * check_button;
+  GtkWidget * label;
+  GtkWidget * menu;
   guint table_row;
   GtkWidget * tree_view;
   GtkWidget * scrolled;
   gboolean strip_highs;
   gboolean optimize_rendering;
   gboolean initially_no_gradient_opacity;
+  renderer_t renderer;
+  renderer_t i_renderer;
 
-  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity);
+  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity, &renderer);
 
   temp_string = g_strdup_printf(_("%s: Rendering Initialization Dialog"), PACKAGE);
   dialog = gtk_dialog_new_with_buttons (temp_string,  parent,
@@ -1054,7 +1071,7 @@ GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent)
   gtk_container_set_border_width(GTK_CONTAINER(dialog), 10);
 
   /* start making the widgets for this dialog box */
-  table = gtk_table_new(5,2,FALSE);
+  table = gtk_table_new(6,2,FALSE);
   table_row=0;
   gtk_container_add(GTK_CONTAINER(GTK_DIALOG(dialog)->vbox), table);
 
@@ -1098,6 +1115,19 @@ GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent)
   g_signal_connect(G_OBJECT(check_button), "toggled", G_CALLBACK(init_no_gradient_opacity_cb), dialog);
   table_row++;
 
+  /* volpack, or our own multithreaded ray caster working on float data */
+  label = gtk_label_new(_("Renderer"));
+  gtk_table_attach(GTK_TABLE(table), label, 
+		   0,1, table_row, table_row+1, 0, 0, X_PADDING, Y_PADDING);
+  menu = gtk_combo_box_new_text();
+  for (i_renderer=0; i_renderer<NUM_RENDERERS; i_renderer++) 
+    gtk_combo_box_append_text(GTK_COMBO_BOX(menu), _(renderer_names[i_renderer]));
+  gtk_combo_box_set_active(GTK_COMBO_BOX(menu), renderer);
+  gtk_table_attach(GTK_TABLE(table), menu, 
+		   1,2, table_row, table_row+1, GTK_FILL, 0, X_PADDING, Y_PADDING);
+  g_signal_connect(G_OBJECT(menu), "changed", G_CALLBACK(init_renderer_cb), dialog);
+  table_row++;
+
 
   /* and show all our widgets */
   gtk_widget_show_all(dialog);